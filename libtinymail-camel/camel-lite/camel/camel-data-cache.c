@@ -70,6 +70,17 @@ struct _CamelDataCachePrivate {
 
 	int expire_inc;
 	time_t expire_last[1<<CAMEL_DATA_CACHE_BITS];
+
+	/* bytes of the items, only maintained once size_known is set */
+	GMutex *size_lock;
+	gboolean size_known;
+	int size;
+};
+
+/* an item that is being written, its size gets known as its stream goes */
+struct _size_pending {
+	CamelDataCache *cdc;
+	char *real;
 };
 
 static CamelObject *camel_data_cache_parent;
@@ -93,6 +104,9 @@ static void data_cache_init(CamelDataCache *cdc, CamelDataCacheClass *klass)
 
 	p = cdc->priv = g_malloc0(sizeof(*cdc->priv));
 	p->busy_bag = camel_object_bag_new(g_str_hash, g_str_equal, (CamelCopyFunc)g_strdup, g_free);
+	p->size_lock = g_mutex_new();
+	p->size_known = FALSE;
+	p->size = 0;
 }
 
 static void data_cache_finalise(CamelDataCache *cdc)
@@ -101,6 +115,7 @@ static void data_cache_finalise(CamelDataCache *cdc)
 
 	p = cdc->priv;
 	camel_object_bag_destroy(p->busy_bag);
+	g_mutex_free(p->size_lock);
 	g_free(p);
 
 	g_free (cdc->path);
@@ -199,6 +214,43 @@ camel_data_cache_set_expire_access(CamelDataCache *cdc, time_t when)
 	cdc->expire_access = when;
 }
 
+static int
+data_cache_file_size(const char *real)
+{
+	struct stat st;
+
+	if (g_stat(real, &st) == 0 && S_ISREG(st.st_mode))
+		return st.st_size;
+
+	return 0;
+}
+
+/* Until someone asks for the size, the changes don't need to be followed */
+static void
+data_cache_account(CamelDataCache *cdc, int delta)
+{
+	struct _CamelDataCachePrivate *p = cdc->priv;
+
+	g_mutex_lock(p->size_lock);
+	if (p->size_known) {
+		p->size += delta;
+		if (p->size < 0)
+			p->size = 0;
+	}
+	g_mutex_unlock(p->size_lock);
+}
+
+static void
+data_cache_stream_finalize(CamelObject *stream, gpointer event_data, gpointer user_data)
+{
+	struct _size_pending *pending = user_data;
+
+	data_cache_account(pending->cdc, data_cache_file_size(pending->real));
+	camel_object_unref(pending->cdc);
+	g_free(pending->real);
+	g_free(pending);
+}
+
 static void
 data_cache_expire(CamelDataCache *cdc, const char *path, const char *keep, time_t now)
 {
@@ -224,7 +276,8 @@ data_cache_expire(CamelDataCache *cdc, const char *path, const char *keep, time_
 		    && ((cdc->expire_age != -1 && st.st_mtime + cdc->expire_age < now)
 			|| (cdc->expire_access != -1 && st.st_atime + cdc->expire_access < now))) {
 			dd(printf("Has expired!  Removing!\n"));
-			g_unlink(s->str);
+			if (g_unlink(s->str) == 0)
+				data_cache_account(cdc, -st.st_size);
 			stream = camel_object_bag_get(cdc->priv->busy_bag, s->str);
 			if (stream) {
 				camel_object_bag_remove(cdc->priv->busy_bag, stream);
@@ -458,10 +511,20 @@ camel_data_cache_add(CamelDataCache *cdc, const char *path, const char *key, Cam
 		}
 	} while (stream != NULL);
 
+	/* the old item goes, the new one counts once it's written */
+	data_cache_account(cdc, -data_cache_file_size(real));
+
 	stream = camel_stream_fs_new_with_name(real, O_RDWR|O_CREAT|O_TRUNC, 0600);
-	if (stream)
+	if (stream) {
+		struct _size_pending *pending = g_new(struct _size_pending, 1);
+
 		camel_object_bag_add(cdc->priv->busy_bag, real, stream);
-	else
+
+		camel_object_ref(cdc);
+		pending->cdc = cdc;
+		pending->real = g_strdup(real);
+		camel_object_hook_event(stream, "finalize", data_cache_stream_finalize, pending);
+	} else
 		camel_object_bag_abort(cdc->priv->busy_bag, real);
 
 	g_free(real);
@@ -613,7 +676,8 @@ camel_data_cache_delete_attachments (CamelDataCache *cdc, const char *path, cons
 	camel_object_unref (to);
 
 	camel_data_cache_remove (cdc, path, key, NULL);
-	rename (real, real1);
+	if (rename (real, real1) == 0)
+		data_cache_account (cdc, data_cache_file_size (real1));
   }
 
   g_free (real);
@@ -637,7 +701,7 @@ camel_data_cache_remove(CamelDataCache *cdc, const char *path, const char *key,
 {
 	CamelStream *stream;
 	char *real;
-	int ret;
+	int ret, size;
 
 	real = data_cache_path(cdc, FALSE, path, key);
 	stream = camel_object_bag_get(cdc->priv->busy_bag, real);
@@ -646,6 +710,8 @@ camel_data_cache_remove(CamelDataCache *cdc, const char *path, const char *key,
 		camel_object_unref(stream);
 	}
 
+	size = data_cache_file_size(real);
+
 	/* maybe we were a mem stream */
 	if (g_unlink (real) == -1 && errno != ENOENT) {
 		camel_exception_setv (ex, CAMEL_EXCEPTION_SYSTEM,
@@ -653,6 +719,7 @@ camel_data_cache_remove(CamelDataCache *cdc, const char *path, const char *key,
 				      real, g_strerror (errno));
 		ret = -1;
 	} else {
+		data_cache_account(cdc, -size);
 		ret = 0;
 	}
 
@@ -701,3 +768,45 @@ camel_data_cache_clear(CamelDataCache *cache, const char *path, CamelException *
 	/* nor for this? */
 	return -1;
 }
+
+/**
+ * camel_data_cache_get_size:
+ * @cdc: A #CamelDataCache
+ *
+ * Get how many bytes the items in the cache take. The first call walks
+ * the directories of the cache, after that the number is kept up to date
+ * as items get added, removed and expired.
+ *
+ * Return value: the size of the cache in bytes
+ **/
+int
+camel_data_cache_get_size(CamelDataCache *cdc)
+{
+	struct _CamelDataCachePrivate *p = cdc->priv;
+	int size;
+
+	g_mutex_lock(p->size_lock);
+	if (!p->size_known) {
+		GDir *dir;
+		const char *dname;
+
+		/* the items are in subdirectories, anything else in the base
+		 * path is not ours */
+		p->size = 0;
+		dir = g_dir_open(cdc->path, 0, NULL);
+		if (dir) {
+			while ((dname = g_dir_read_name(dir))) {
+				char *sub = g_build_filename(cdc->path, dname, NULL);
+				if (g_file_test(sub, G_FILE_TEST_IS_DIR))
+					camel_du(sub, &p->size);
+				g_free(sub);
+			}
+			g_dir_close(dir);
+		}
+		p->size_known = TRUE;
+	}
+	size = p->size;
+	g_mutex_unlock(p->size_lock);
+
+	return size;
+}
@@ -104,6 +104,8 @@ void         camel_data_cache_delete_attachments (CamelDataCache *cdc, const cha
 
 void camel_data_cache_set_flags (CamelDataCache *cdc, const char *path, CamelMessageInfoBase *mi);
 
+int camel_data_cache_get_size (CamelDataCache *cdc);
+
 /* Standard Camel function */
 CamelType camel_data_cache_get_type (void);
 
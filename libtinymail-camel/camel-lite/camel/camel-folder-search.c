@@ -1166,6 +1166,24 @@ match_words_message(CamelFolder *folder, const char *uid, struct _camel_search_w
 	return truth;
 }
 
+/* Caches (IMAP, POP3) only index a message once it's read through them, so
+ * the body index can lack messages. Those still have to be scanned */
+static void
+match_words_unindexed(CamelFolderSearch *search, struct _camel_search_words *words, GPtrArray *matches, CamelException *ex)
+{
+	GPtrArray *v = search->summary_set?search->summary_set:search->summary;
+	int i;
+
+	for (i=0;i<v->len;i++) {
+		CamelMessageInfo *info = g_ptr_array_index(v, i);
+		const char *uid = camel_message_info_uid(info);
+
+		if (!camel_index_has_name(search->body_index, uid)
+		    && match_words_message(search->folder, uid, words, ex))
+			g_ptr_array_add(matches, (char *)uid);
+	}
+}
+
 static GPtrArray *
 match_words_messages(CamelFolderSearch *search, struct _camel_search_words *words, CamelException *ex)
 {
@@ -1188,6 +1206,8 @@ match_words_messages(CamelFolderSearch *search, struct _camel_search_words *word
 		}
 
 		g_ptr_array_free(indexed, TRUE);
+
+		match_words_unindexed(search, words, matches, ex);
 	} else {
 		GPtrArray *v = search->summary_set?search->summary_set:search->summary;
 
@@ -1222,7 +1242,8 @@ search_body_contains(struct _ESExp *f, int argc, struct _ESExpResult **argv, Cam
 				if (argv[i]->type == ESEXP_RES_STRING) {
 					words = camel_search_words_split((const unsigned char *) argv[i]->value.string);
 					truth = TRUE;
-					if ((words->type & CAMEL_SEARCH_WORD_COMPLEX) == 0 && search->body_index) {
+					if ((words->type & CAMEL_SEARCH_WORD_COMPLEX) == 0 && search->body_index
+					    && camel_index_has_name(search->body_index, camel_message_info_uid(search->current))) {
 						for (j=0;j<words->len && truth;j++)
 							truth = match_message_index(search->body_index, camel_message_info_uid(search->current), words->words[j]->word, ex);
 					} else {
@@ -1256,6 +1277,7 @@ search_body_contains(struct _ESExp *f, int argc, struct _ESExpResult **argv, Cam
 					words = camel_search_words_split((const unsigned char *) argv[i]->value.string);
 					if ((words->type & CAMEL_SEARCH_WORD_COMPLEX) == 0 && search->body_index) {
 						matches = match_words_index(search, words, ex);
+						match_words_unindexed(search, words, matches, ex);
 					} else {
 						matches = match_words_messages(search, words, ex);
 					}
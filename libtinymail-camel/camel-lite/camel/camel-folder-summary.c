@@ -41,6 +41,7 @@
 #include <string.h>
 
 #include <unistd.h>
+#include <sys/mman.h>
 #include <sys/stat.h>
 #include <sys/types.h>
 
@@ -67,6 +68,7 @@
 #include "camel-stream-mem.h"
 #include "camel-stream-null.h"
 #include "camel-string-utils.h"
+#include "camel-uid-table.h"
 #include "camel-disco-folder.h"
 
 
@@ -79,13 +81,6 @@
 #include <glib.h>
 #include <glib/gprintf.h>
 
-static pthread_mutex_t info_lock = PTHREAD_MUTEX_INITIALIZER;
-
-/* this lock is ONLY for the standalone messageinfo stuff */
-#define GLOBAL_INFO_LOCK(i) pthread_mutex_lock(&info_lock)
-#define GLOBAL_INFO_UNLOCK(i) pthread_mutex_unlock(&info_lock)
-
-
 /* this should probably be conditional on it existing */
 #define USE_BSEARCH
 
@@ -101,8 +96,20 @@ extern int strdup_count, malloc_count, free_count;
 
 #define _PRIVATE(o) (((CamelFolderSummary *)(o))->priv)
 
+/* Only for message infos that don't belong to a summary, the others use
+ * the map_lock of their summary, see camel_message_info_lock */
 static GStaticRecMutex global_lock = G_STATIC_REC_MUTEX_INIT;
-static GStaticMutex global_lock2 = G_STATIC_MUTEX_INIT;
+
+#define SUMMARY_MAP_LOCK(s) (g_static_rec_mutex_lock (&_PRIVATE(s)->map_lock))
+#define SUMMARY_MAP_UNLOCK(s) (g_static_rec_mutex_unlock (&_PRIVATE(s)->map_lock))
+
+static GStaticRecMutex *
+info_lock (const CamelMessageInfo *mi)
+{
+	if (mi != NULL && mi->summary != NULL)
+		return &_PRIVATE(mi->summary)->map_lock;
+	return &global_lock;
+}
 
 /* trivial lists, just because ... */
 struct _node {
@@ -170,60 +177,191 @@ camel_message_info_clear_normal_flags (CamelMessageInfo *min)
 static CamelMessageInfo*
 find_message_info_with_uid (CamelFolderSummary *s, const char *uid)
 {
-	CamelMessageInfo *retval = NULL;
-	guint i = 0;
-	gboolean check_for = TRUE;
+	int idx;
 
-	if (uid == NULL || strlen (uid) <= 0)
+	if (uid == NULL || uid[0] == '\0')
 		return NULL;
 
 	g_mutex_lock (s->hash_lock);
-	if (s->uidhash != NULL) {
-		retval = g_hash_table_lookup (s->uidhash, uid);
-		check_for = FALSE;
-	}
+	idx = camel_uid_table_lookup (s->uidtable, s->messages, uid);
 	g_mutex_unlock (s->hash_lock);
 
-	if (retval == NULL && check_for) {
-		for (i=0; G_LIKELY (i < s->messages->len) ; i++)
-		{
-			CamelMessageInfo *info = s->messages->pdata[i];
-
-			/* This can cause cache trashing */
-			if (G_UNLIKELY (info->uid[0] == uid[0]) &&
-			    G_UNLIKELY (!strcmp (info->uid, uid)))
-			{
-				retval = info;
-				break;
-			}
-		}
-	}
-
-	return retval;
+	return (idx != -1) ? s->messages->pdata[idx] : NULL;
 }
 
 int
 camel_folder_summary_get_index_for (CamelFolderSummary *s, const char *uid)
 {
-	int retval = -1, i;
+	int retval;
 
-	if (uid == NULL || strlen (uid) == 0)
+	if (uid == NULL || uid[0] == '\0')
 		return -1;
 
-	for (i=0; G_LIKELY (i < s->messages->len) ; i++)
-	{
-		CamelMessageInfo *info = s->messages->pdata[i];
+	g_mutex_lock (s->hash_lock);
+	retval = camel_uid_table_lookup (s->uidtable, s->messages, uid);
+	g_mutex_unlock (s->hash_lock);
 
-		/* This can cause cache trashing */
-		if (G_UNLIKELY (info->uid[0] == uid[0]) &&
-		    G_UNLIKELY (!strcmp (info->uid, uid)))
-		{
-			retval = i;
-			break;
-		}
+	return retval;
+}
+
+/* Where a saved message info is in the summary file, and the fixed width
+ * fields of it as they were written. Lets camel_folder_summary_save update
+ * a file in place instead of rewriting it */
+struct _summary_record {
+	CamelMessageInfo *mi;
+	guint32 offset;
+	guint32 flags;
+	guint32 size;
+};
+
+struct _summary_tail_map {
+	void *start;
+	size_t length;
+};
+
+/* The mapped summary file plus the regions that got appended to it since.
+ * A full reload maps the new file as a new one of these before it takes
+ * the map_lock, points the infos into it and only then frees the old one,
+ * so readers of other summaries never wait and readers of this one only
+ * wait for the pointer swap */
+struct _CamelFolderSummaryMap {
+	GMappedFile *file;
+	GSList *tails;
+};
+
+static void
+summary_map_free (struct _CamelFolderSummaryMap *map)
+{
+	if (map == NULL)
+		return;
+
+	while (map->tails) {
+		struct _summary_tail_map *tail = map->tails->data;
+
+		munmap (tail->start, tail->length);
+		g_slice_free (struct _summary_tail_map, tail);
+		map->tails = g_slist_delete_link (map->tails, map->tails);
 	}
 
-	return retval;
+	if (map->file)
+		g_mapped_file_free (map->file);
+
+	g_slice_free (struct _CamelFolderSummaryMap, map);
+}
+
+static struct _CamelFolderSummaryMap *
+summary_map_get (CamelFolderSummary *s)
+{
+	struct _CamelFolderSummaryPrivate *p = _PRIVATE(s);
+
+	if (p->map == NULL)
+		p->map = g_slice_new0 (struct _CamelFolderSummaryMap);
+
+	return p->map;
+}
+
+/* Detaches the current mapping from @s without unmapping it */
+static struct _CamelFolderSummaryMap *
+summary_map_steal (CamelFolderSummary *s)
+{
+	struct _CamelFolderSummaryPrivate *p = _PRIVATE(s);
+	struct _CamelFolderSummaryMap *map = p->map;
+
+	p->map = NULL;
+	s->file = NULL;
+	s->eof = NULL;
+
+	return map;
+}
+
+/* Frees the mappings that reloads replaced, once the summary itself holds
+ * the only references to its infos. Strings gotten from an info stay valid
+ * for as long as the info is referenced, so whoever held one across a
+ * reload might still be looking into an old mapping until then */
+static void
+summary_maps_reclaim (CamelFolderSummary *s)
+{
+	struct _CamelFolderSummaryPrivate *p = _PRIVATE(s);
+	GSList *retired = NULL;
+
+	CAMEL_SUMMARY_LOCK(s, summary_lock);
+	CAMEL_SUMMARY_LOCK(s, ref_lock);
+	if (p->retired_maps != NULL &&
+	    g_atomic_int_get (&p->info_refs) == (gint) (s->messages->len + s->expunged->len)) {
+		retired = p->retired_maps;
+		p->retired_maps = NULL;
+	}
+	CAMEL_SUMMARY_UNLOCK(s, ref_lock);
+	CAMEL_SUMMARY_UNLOCK(s, summary_lock);
+
+	while (retired) {
+		summary_map_free (retired->data);
+		retired = g_slist_delete_link (retired, retired);
+	}
+}
+
+static inline void
+summary_info_ref (CamelMessageInfo *info)
+{
+	g_atomic_int_inc (&info->refcount);
+	if (info->summary)
+		g_atomic_int_inc (&_PRIVATE(info->summary)->info_refs);
+}
+
+/* Makes sure s->file is the mapped summary file */
+static gboolean
+summary_map_file (CamelFolderSummary *s)
+{
+	GError *err = NULL;
+
+	if (s->file)
+		return TRUE;
+
+	s->file = g_mapped_file_new (s->summary_path, FALSE, &err);
+	if (err != NULL) {
+		g_critical ("Unable to mmap file: %s\n", err->message);
+		g_error_free (err);
+		s->file = NULL;
+		return FALSE;
+	}
+
+	summary_map_get (s)->file = s->file;
+
+	return TRUE;
+}
+
+/* Called when messages got removed: the file no longer matches the start
+ * of the messages array, so the next save must rewrite it. The records
+ * array itself is only touched with the io_lock held */
+static void
+summary_forget_records (CamelFolderSummary *s)
+{
+	struct _CamelFolderSummaryPrivate *p = _PRIVATE(s);
+
+	p->records_valid = FALSE;
+}
+
+/* Removes @info from the messages array, keeping the uid table in sync */
+static void
+summary_messages_remove (CamelFolderSummary *s, CamelMessageInfo *info)
+{
+	int idx = -1;
+
+	g_mutex_lock (s->hash_lock);
+	summary_forget_records (s);
+
+	if (info->uid != NULL && info->uid[0] != '\0')
+		idx = camel_uid_table_lookup (s->uidtable, s->messages, info->uid);
+
+	if (idx != -1 && s->messages->pdata[idx] == info) {
+		camel_uid_table_remove (s->uidtable, s->messages, idx);
+		g_ptr_array_remove_index (s->messages, idx);
+	} else {
+		camel_uid_table_invalidate (s->uidtable);
+		g_ptr_array_remove (s->messages, info);
+	}
+
+	g_mutex_unlock (s->hash_lock);
 }
 
 static void do_nothing (CamelFolder *folder, CamelMessageInfoBase *mi) { }
@@ -254,46 +392,44 @@ camel_folder_summary_init (CamelFolderSummary *s)
 
 	s->messages = g_ptr_array_new();
 	s->expunged = g_ptr_array_new();
-	s->uidhash = NULL;
+	s->uidtable = camel_uid_table_new ();
 	s->hash_lock = g_mutex_new ();
 
 	p->summary_lock = g_mutex_new();
 	p->io_lock = g_mutex_new();
 	p->filter_lock = g_mutex_new();
 	p->ref_lock = g_mutex_new();
+
+	p->records = g_array_new (FALSE, FALSE, sizeof (struct _summary_record));
+	g_static_rec_mutex_init (&p->map_lock);
 }
 
+/**
+ * camel_folder_summary_prepare_hash:
+ * @summary: a #CamelFolderSummary object
+ *
+ * Make sure the uid lookup table covers all messages before doing a
+ * lot of uid lookups. The table is kept up to date by add and remove,
+ * and it's persisted next to the summary file, so this usually is a no-op.
+ **/
 void
 camel_folder_summary_prepare_hash (CamelFolderSummary *s)
 {
-	guint i = 0;
-
 	g_mutex_lock (s->hash_lock);
-
-	if (s->uidhash == NULL)
-	{
-		s->uidhash = g_hash_table_new_full (g_str_hash, g_str_equal,
-			(GDestroyNotify)g_free, NULL);
-
-		for (i=0; G_LIKELY (i < s->messages->len) ; i++)
-		{
-			CamelMessageInfo *info = s->messages->pdata[i];
-			g_hash_table_insert(s->uidhash, g_strdup (info->uid), info);
-		}
-	}
-
+	camel_uid_table_prepare (s->uidtable, s->messages);
 	g_mutex_unlock (s->hash_lock);
-
 }
 
+/**
+ * camel_folder_summary_kill_hash:
+ * @summary: a #CamelFolderSummary object
+ *
+ * Counterpart of #camel_folder_summary_prepare_hash. The uid table costs
+ * eight bytes per message and is needed for every lookup, so it is kept.
+ **/
 void
 camel_folder_summary_kill_hash (CamelFolderSummary *s)
 {
-	g_mutex_lock (s->hash_lock);
-	if (s->uidhash != NULL)
-		g_hash_table_destroy (s->uidhash);
-	s->uidhash = NULL;
-	g_mutex_unlock (s->hash_lock);
 }
 
 
@@ -324,10 +460,17 @@ camel_folder_summary_unload_mmap (CamelFolderSummary *s)
 
 	p = _PRIVATE(s);
 
-	if (s->file)
-		g_mapped_file_free (s->file);
-	s->file = NULL;
-	s->eof = NULL;
+	summary_map_free (summary_map_steal (s));
+
+	while (p->retired_maps) {
+		summary_map_free (p->retired_maps->data);
+		p->retired_maps = g_slist_delete_link (p->retired_maps, p->retired_maps);
+	}
+
+	while (p->pinned_maps) {
+		summary_map_free (p->pinned_maps->data);
+		p->pinned_maps = g_slist_delete_link (p->pinned_maps, p->pinned_maps);
+	}
 
 	return;
 }
@@ -340,9 +483,8 @@ camel_folder_summary_finalize (CamelObject *obj)
 
 	p = _PRIVATE(obj);
 
-	g_static_rec_mutex_lock (&global_lock);
-
 	g_static_rec_mutex_lock (s->dump_lock);
+	SUMMARY_MAP_LOCK(s);
 
 	g_ptr_array_foreach (s->messages, foreach_msginfo, (gpointer)s->message_info_size);
 	g_ptr_array_foreach (s->expunged, foreach_msginfo, (gpointer)s->message_info_size);
@@ -352,10 +494,9 @@ camel_folder_summary_finalize (CamelObject *obj)
 
 	camel_folder_summary_unload_mmap (s);
 
+	SUMMARY_MAP_UNLOCK(s);
 	g_static_rec_mutex_unlock (s->dump_lock);
 
-	g_static_rec_mutex_unlock (&global_lock);
-
 	/**/
 	g_free (s->dump_lock);
 
@@ -379,8 +520,7 @@ camel_folder_summary_finalize (CamelObject *obj)
 
 	g_free(s->summary_path);
 
-	if (s->uidhash != NULL)
-		g_hash_table_destroy (s->uidhash);
+	camel_uid_table_free (s->uidtable);
 	g_mutex_free(s->hash_lock);
 
 	g_mutex_free(p->summary_lock);
@@ -388,6 +528,8 @@ camel_folder_summary_finalize (CamelObject *obj)
 	g_mutex_free(p->filter_lock);
 	g_mutex_free(p->ref_lock);
 
+	g_array_free (p->records, TRUE);
+	g_static_rec_mutex_free (&p->map_lock);
 
 	g_slice_free1 (sizeof (*p), p);
 }
@@ -442,6 +584,7 @@ camel_folder_summary_set_filename(CamelFolderSummary *s, const char *name)
 
 	g_free(s->summary_path);
 	s->summary_path = g_strdup(name);
+	summary_forget_records (s);
 
 	CAMEL_SUMMARY_UNLOCK(s, summary_lock);
 }
@@ -504,7 +647,7 @@ camel_folder_summary_index(CamelFolderSummary *s, int i)
 		info = g_ptr_array_index(s->messages, i);
 
 	if (info)
-		info->refcount++;
+		summary_info_ref(info);
 
 	CAMEL_SUMMARY_UNLOCK(s, ref_lock);
 	CAMEL_SUMMARY_UNLOCK(s, summary_lock);
@@ -561,7 +704,7 @@ camel_folder_summary_array(CamelFolderSummary *s)
 	g_ptr_array_set_size(res, s->messages->len);
 	for (i=0;i<s->messages->len;i++) {
 		info = res->pdata[i] = g_ptr_array_index(s->messages, i);
-		info->refcount++;
+		summary_info_ref(info);
 	}
 
 	CAMEL_SUMMARY_UNLOCK(s, ref_lock);
@@ -614,7 +757,7 @@ camel_folder_summary_uid(CamelFolderSummary *s, const char *uid)
 	info = find_message_info_with_uid (s, uid);
 
 	if (info)
-		info->refcount++;
+		summary_info_ref(info);
 
 	CAMEL_SUMMARY_UNLOCK(s, ref_lock);
 	CAMEL_SUMMARY_UNLOCK(s, summary_lock);
@@ -737,10 +880,11 @@ perform_content_info_load(CamelFolderSummary *s)
 int
 camel_folder_summary_load(CamelFolderSummary *s)
 {
+	struct _CamelFolderSummaryPrivate *p = _PRIVATE(s);
 	int i;
 	CamelMessageInfo *mi;
-	GError *err = NULL;
 	gboolean ul = FALSE;
+	unsigned char *start;
 
 	if (s->summary_path == NULL || !g_file_test (s->summary_path, G_FILE_TEST_EXISTS | G_FILE_TEST_IS_REGULAR))
 		return -1;
@@ -749,23 +893,21 @@ camel_folder_summary_load(CamelFolderSummary *s)
 
 	camel_operation_start (NULL, "Opening summary of folder");
 
-	if (!s->file)
-	{
-		s->file = g_mapped_file_new (s->summary_path, FALSE, &err);
-		if (err != NULL)
-		{
-			g_critical ("Unable to mmap file: %s\n", err->message);
-			g_error_free (err);
-			goto error;
-		}
-	}
+	if (!summary_map_file (s))
+		goto error;
 
 	s->filepos = (unsigned char*) g_mapped_file_get_contents (s->file);
 	s->eof = s->filepos + g_mapped_file_get_length (s->file);
+	start = s->filepos;
+
+	p->records_valid = FALSE;
+	g_array_set_size (p->records, 0);
 
 	if ( ((CamelFolderSummaryClass *)(CAMEL_OBJECT_GET_CLASS(s)))->summary_header_load(s) == -1)
 		goto error;
 
+	p->header_len = s->filepos - start;
+
 
 	if (s->messages && s->messages->len > s->saved_count)
 	{
@@ -781,15 +923,17 @@ printf ("Removes %s\n", ri->uid);
 		}
 	}
 
-	g_static_rec_mutex_lock (&global_lock);
+	SUMMARY_MAP_LOCK(s);
 
 	/* now read in each message ... */
 	for (i=0; i < s->saved_count; i++)
 	{
+		struct _summary_record rec;
 		gboolean must_add = FALSE;
 		s->idx = i;
 
 		ul = TRUE;
+		rec.offset = s->filepos - start;
 
 		mi = ((CamelFolderSummaryClass *)(CAMEL_OBJECT_GET_CLASS(s)))->message_info_load(s, &must_add);
 
@@ -812,18 +956,34 @@ printf ("Removes %s\n", ri->uid);
 
 		if (must_add)
 			camel_folder_summary_mmap_add(s, mi);
+
+		rec.mi = mi;
+		rec.flags = ((CamelMessageInfoBase *)mi)->flags;
+		rec.size = ((CamelMessageInfoBase *)mi)->size;
+		g_array_append_val (p->records, rec);
 	}
 
-	g_static_rec_mutex_unlock (&global_lock);
+	SUMMARY_MAP_UNLOCK(s);
 
 	ul = FALSE;
+	p->records_end = s->filepos - start;
+	p->records_valid = TRUE;
 
 	if (s->saved_count <= 0) {
 		g_mapped_file_free (s->file);
+		p->map->file = NULL;
 		s->file = NULL;
 		s->eof = NULL;
 	}
 
+	/* On a reload the positions in s->messages didn't change, else try
+	 * to use the uid table that was written with this summary file */
+	if (!s->in_reload) {
+		g_mutex_lock (s->hash_lock);
+		camel_uid_table_load (s->uidtable, s->messages, s->summary_path);
+		g_mutex_unlock (s->hash_lock);
+	}
+
 	camel_operation_end (NULL);
 
 	CAMEL_SUMMARY_UNLOCK(s, io_lock);
@@ -835,7 +995,7 @@ printf ("Removes %s\n", ri->uid);
 
 error:
 	if (ul)
-		g_static_rec_mutex_unlock (&global_lock);
+		SUMMARY_MAP_UNLOCK(s);
 
 	camel_operation_end (NULL);
 
@@ -877,43 +1037,136 @@ perform_content_info_save(CamelFolderSummary *s, FILE *out, CamelMessageContentI
 	return 0;
 }
 
-static void 
-flush_for_reload (CamelFolderSummary *s, CamelMessageInfoBase *mi)
+/* Writes @mi to the scratch file @tmp and reads it back into @buf, so that
+ * it can be compared with the record that is on disk. Returns the length */
+static long
+summary_record_serialize (CamelFolderSummary *s, FILE *tmp, CamelMessageInfo *mi, unsigned char **buf, gsize *buflen)
 {
-	if (!(mi->flags & CAMEL_MESSAGE_INFO_NEEDS_FREE)) {
-		mi->subject = "...";
-		mi->to = "...";
-		mi->from = "...";
-		mi->cc = "...";
+	long len;
+
+	if (fseek (tmp, 0, SEEK_SET) == -1)
+		return -1;
+
+	if (((CamelFolderSummaryClass *)(CAMEL_OBJECT_GET_CLASS (s)))->message_info_save (s, tmp, mi) == -1)
+		return -1;
+
+	if (s->build_content && perform_content_info_save (s, tmp, ((CamelMessageInfoBase *)mi)->content) == -1)
+		return -1;
+
+	if (fflush (tmp) != 0 || (len = ftell (tmp)) == -1)
+		return -1;
+
+	if (*buflen < len) {
+		*buf = g_realloc (*buf, len);
+		*buflen = len;
 	}
-} 
 
-/**
- * camel_folder_summary_save:
- * @summary: a #CamelFolderSummary object
- *
- * Writes the summary to disk.  The summary is only written if changes
- * have occured.
- *
- * Returns %0 on success or %-1 on fail
- **/
+	if (fseek (tmp, 0, SEEK_SET) == -1 || fread (*buf, 1, len, tmp) != len)
+		return -1;
+
+	return len;
+}
+
+/* Maps the region of the summary file between @start and @end, which holds
+ * the records that were just appended, and points the message infos from
+ * @first on into it. Nothing else gets remapped */
+static gboolean
+summary_map_tail (CamelFolderSummary *s, guint32 first, guint32 start, guint32 end)
+{
+	struct _CamelFolderSummaryPrivate *p = _PRIVATE(s);
+	struct _CamelFolderSummaryMap *map;
+	struct _summary_tail_map *tail;
+	guint32 aligned, i;
+	gboolean retval = TRUE;
+	void *region;
+	int fd;
+
+	aligned = start - (start % sysconf (_SC_PAGESIZE));
+
+	fd = g_open (s->summary_path, O_RDONLY|O_BINARY, 0);
+	if (fd == -1)
+		return FALSE;
+
+	region = mmap (NULL, end - aligned, PROT_READ, MAP_PRIVATE, fd, aligned);
+	close (fd);
+
+	if (region == MAP_FAILED)
+		return FALSE;
+
+	tail = g_slice_new (struct _summary_tail_map);
+	tail->start = region;
+	tail->length = end - aligned;
+
+	SUMMARY_MAP_LOCK(s);
+
+	map = summary_map_get (s);
+	map->tails = g_slist_prepend (map->tails, tail);
+
+	s->in_reload = TRUE;
+	s->filepos = (unsigned char *) region + (start - aligned);
+	s->eof = (unsigned char *) region + (end - aligned);
+
+	for (i = first; i < s->messages->len && s->filepos < s->eof; i++) {
+		struct _summary_record rec;
+		CamelMessageInfo *mi;
+		gboolean must_add = FALSE;
+
+		s->idx = i;
+		rec.offset = aligned + (s->filepos - (unsigned char *) region);
+
+		mi = ((CamelFolderSummaryClass *)(CAMEL_OBJECT_GET_CLASS(s)))->message_info_load(s, &must_add);
+		if (mi == NULL) {
+			retval = FALSE;
+			break;
+		}
+
+		if (s->build_content) {
+			if (((CamelMessageInfoBase *)mi)->content != NULL)
+				camel_folder_summary_content_info_free(s, ((CamelMessageInfoBase *)mi)->content);
 
-#ifdef SAVE_APPEND
+			((CamelMessageInfoBase *)mi)->content = perform_content_info_load (s);
+			if (((CamelMessageInfoBase *)mi)->content == NULL) {
+				retval = FALSE;
+				break;
+			}
+		}
+
+		if (must_add) {
+			camel_folder_summary_mmap_add(s, mi);
+			retval = FALSE;
+		}
+
+		rec.mi = mi;
+		rec.flags = ((CamelMessageInfoBase *)mi)->flags;
+		rec.size = ((CamelMessageInfoBase *)mi)->size;
+		g_array_append_val (p->records, rec);
+	}
+
+	s->in_reload = FALSE;
+
+	SUMMARY_MAP_UNLOCK(s);
+
+	return retval;
+}
+
+/* Brings the summary file up to date without rewriting it. Records of
+ * which only the flags or the size changed get overwritten in place (the
+ * length of a record doesn't change for those), new message infos get
+ * appended and only the appended region gets mapped and reloaded. Returns
+ * 1 if the file can't be updated this way and must be rewritten. */
 static int
 camel_folder_summary_save_append (CamelFolderSummary *s, CamelException *ex)
 {
-	FILE *out;
-	int i;
-	guint32 count = 0;
-	CamelMessageInfo *mi;
-	char *path;
-	gboolean herr = FALSE;
-	gboolean hadhash, create_header = FALSE;;
+	struct _CamelFolderSummaryPrivate *p = _PRIVATE(s);
+	CamelFolderSummaryClass *klass = (CamelFolderSummaryClass *) CAMEL_OBJECT_GET_CLASS (s);
+	FILE *out = NULL, *tmp = NULL;
+	unsigned char *buf = NULL;
+	gsize buflen = 0;
+	guint32 ondisk, count, i, end;
+	int retval = 1, err;
 
 	g_static_rec_mutex_lock (s->dump_lock);
 
-	hadhash = (s->uidhash != NULL);
-
 	g_assert(s->message_info_size >= sizeof(CamelMessageInfoBase));
 
 	if (s->summary_path == NULL || (s->flags & CAMEL_SUMMARY_DIRTY) == 0) {
@@ -921,149 +1174,139 @@ camel_folder_summary_save_append (CamelFolderSummary *s, CamelException *ex)
 		return 0;
 	}
 
-	path = alloca(strlen(s->summary_path)+4);
-	sprintf(path, "%s", s->summary_path);
+	CAMEL_SUMMARY_LOCK(s, io_lock);
 
-	/* We are going to append to a RO mapped file in WRONLY APPEND.
-	 * That's a bit tricky, but fun :) (and we know that we are doing it) */
+	count = s->messages->len;
+	ondisk = p->records->len;
 
-	if (!g_file_test (path, G_FILE_TEST_EXISTS))
-		create_header = TRUE;
+	if (!p->records_valid || ondisk > count)
+		goto rewrite;
 
-	out = fopen(path, "a");
-	if (out == NULL) {
-		perror ("S");
-		i = errno;
-		g_unlink(path);
-		errno = i;
- 		camel_exception_set (ex, CAMEL_EXCEPTION_SYSTEM_IO_WRITE,
-			"Error storing the summary");
-		g_static_rec_mutex_unlock (s->dump_lock);
-		return -1;
-	}
+	/* Subclasses can reorder the messages array (MH sorts it) */
+	for (i = 0; i < ondisk; i++)
+		if (g_array_index (p->records, struct _summary_record, i).mi != s->messages->pdata[i])
+			goto rewrite;
 
-	io(printf("saving header\n"));
+	out = g_fopen (s->summary_path, "r+b");
+	tmp = tmpfile ();
+	if (out == NULL || tmp == NULL)
+		goto rewrite;
 
-	CAMEL_SUMMARY_LOCK(s, io_lock);
+	/* The header gets overwritten in place, so it must keep its length */
+	if (klass->summary_header_save (s, tmp) == -1 || fflush (tmp) != 0 || ftell (tmp) != p->header_len)
+		goto rewrite;
 
-	if (create_header) {
-		if (((CamelFolderSummaryClass *)(CAMEL_OBJECT_GET_CLASS(s)))->summary_header_save(s, out) == -1)
-			goto haerror;
-	}
+	if (fseek (out, 0, SEEK_END) == -1 || ftell (out) != p->records_end)
+		goto rewrite;
 
-	/* now write out each message ... */
-	/* we check ferorr when done for i/o errors */
+	io(printf("updating changed records\n"));
 
-	count = s->messages->len;
+	for (i = 0; i < ondisk; i++) {
+		struct _summary_record *rec = &g_array_index (p->records, struct _summary_record, i);
+		CamelMessageInfoBase *mi = s->messages->pdata[i];
+		guint32 next;
+		long len;
 
-	for (i = 0; i < count; i++) {
-		mi = s->messages->pdata[i];
+		if (mi->flags == rec->flags && mi->size == rec->size)
+			continue;
 
-		/* Only the new ones must be written (those have that funny 
-		 * internal flag set) */
+		next = (i + 1 < ondisk) ? g_array_index (p->records, struct _summary_record, i + 1).offset : p->records_end;
 
-		if (!create_header && ((CamelMessageInfoBase *)mi)->flags & CAMEL_MESSAGE_INFO_NEEDS_FREE) {
+		len = summary_record_serialize (s, tmp, (CamelMessageInfo *) mi, &buf, &buflen);
+		if (len == -1 || len != next - rec->offset)
+			goto rewrite;
 
-			if (((CamelFolderSummaryClass *)(CAMEL_OBJECT_GET_CLASS (s)))->message_info_save (s, out, mi) == -1) {
-				herr = TRUE;
-				goto haerror;
-			}
-
-			if (s->build_content) {
-				if (perform_content_info_save (s, out, ((CamelMessageInfoBase *)mi)->content) == -1) {
-					herr = TRUE;
-					goto haerror;
-				}
-			}
-		}
+		if (fseek (out, rec->offset, SEEK_SET) == -1 || fwrite (buf, len, 1, out) != 1)
+			goto error;
 
+		rec->flags = mi->flags;
+		rec->size = mi->size;
 	}
 
-	if (fflush (out) != 0 || fsync (fileno (out)) == -1)
-		herr = TRUE;
-
-haerror:
+	io(printf("appending %d new records\n", count - ondisk));
 
-	if (s->build_content)
-		for (i = 0; i < count; i++) {
-			mi = s->messages->pdata[i];
-			if (((CamelMessageInfoBase *)mi)->content != NULL)
-				camel_folder_summary_content_info_free (s, ((CamelMessageInfoBase *)mi)->content);
-			((CamelMessageInfoBase *)mi)->content = NULL;
-		}
+	if (fseek (out, p->records_end, SEEK_SET) == -1)
+		goto error;
 
-	CAMEL_SUMMARY_UNLOCK(s, io_lock);
+	for (i = ondisk; i < count; i++) {
+		CamelMessageInfo *mi = s->messages->pdata[i];
 
-	if (herr)
-		goto exception;
+		if (klass->message_info_save (s, out, mi) == -1)
+			goto error;
 
-	fclose (out);
-	s->in_reload = TRUE;
+		if (s->build_content && perform_content_info_save (s, out, ((CamelMessageInfoBase *)mi)->content) == -1)
+			goto error;
+	}
 
-	if (!hadhash)
-		camel_folder_summary_prepare_hash (s);
+	end = ftell (out);
 
-	g_static_rec_mutex_lock (&global_lock);
-	g_static_mutex_lock (&global_lock2);
+	/* The header goes last: until it's there, a reader of the file only
+	 * sees the records that were there before */
+	if (klass->summary_header_save (s, out) == -1)
+		goto error;
 
-	for (i = 0; i < count; i++) {
-		mi = s->messages->pdata[i];
-		flush_for_reload (s, (CamelMessageInfoBase *) mi);
-	}
+	if (fflush (out) != 0 || fsync (fileno (out)) == -1)
+		goto error;
 
-	/* Remap the appended file :). Moeha! */
-	camel_folder_summary_unload_mmap (s);
+	fclose (out);
+	fclose (tmp);
+	g_free (buf);
 
-	out = fopen(path, "r+");
-	if (out) {
-		((CamelFolderSummaryClass *)(CAMEL_OBJECT_GET_CLASS(s)))->summary_header_save(s, out);
-		fclose (out);
+	if (count > ondisk) {
+		if (!summary_map_tail (s, ondisk, p->records_end, end))
+			p->records_valid = FALSE;
+		p->records_end = end;
 	}
 
-	camel_folder_summary_load (s);
+	s->saved_count = count;
 
-	g_static_mutex_unlock (&global_lock2);
-	g_static_rec_mutex_unlock (&global_lock);
-
-	if (!hadhash)
-		camel_folder_summary_kill_hash (s);
+	CAMEL_SUMMARY_UNLOCK(s, io_lock);
 
-	s->in_reload = FALSE;
+	g_mutex_lock (s->hash_lock);
+	camel_uid_table_save (s->uidtable, s->messages, s->summary_path);
+	g_mutex_unlock (s->hash_lock);
 
 	s->flags &= ~CAMEL_SUMMARY_DIRTY;
 	g_static_rec_mutex_unlock (s->dump_lock);
 
 	return 0;
 
-exception:
-
+error:
+	retval = -1;
+	err = errno;
 	camel_exception_set (ex, CAMEL_EXCEPTION_SYSTEM_IO_WRITE,
 		"Error storing the summary");
-	i = errno;
-	fclose (out);
-	g_unlink (path);
-	errno = i;
+
+	/* What's on disk past the old header count is garbage now */
+	p->records_valid = FALSE;
+	errno = err;
+
+rewrite:
+	if (out)
+		fclose (out);
+	if (tmp)
+		fclose (tmp);
+	g_free (buf);
+
+	CAMEL_SUMMARY_UNLOCK(s, io_lock);
 	g_static_rec_mutex_unlock (s->dump_lock);
 
-	return -1;
+	return retval;
 }
-#endif
 
 static int
 camel_folder_summary_save_rewrite (CamelFolderSummary *s, CamelException *ex)
 {
+	struct _CamelFolderSummaryMap *old;
 	FILE *out;
 	int fd, i;
 	guint32 count = 0;
 	CamelMessageInfo *mi;
 	char *path;
 	gboolean herr = FALSE;
-	gboolean hadhash;
 
 	g_static_rec_mutex_lock (s->dump_lock);
 
-	hadhash = (s->uidhash != NULL);
-
 	g_assert(s->message_info_size >= sizeof(CamelMessageInfoBase));
 
 	if (s->summary_path == NULL || (s->flags & CAMEL_SUMMARY_DIRTY) == 0) {
@@ -1141,42 +1384,51 @@ haerror:
 		goto exception;
 
 	fclose (out);
-	s->in_reload = TRUE;
-
-	if (!hadhash)
-		camel_folder_summary_prepare_hash (s);
-
-	g_static_rec_mutex_lock (&global_lock);
-	g_static_mutex_lock (&global_lock2);
-
-	camel_folder_summary_unload_mmap (s);
-
 
 #ifdef G_OS_WIN32
+	/* A mapped file can't be replaced here, so readers have to wait */
+	SUMMARY_MAP_LOCK(s);
+	camel_folder_summary_unload_mmap (s);
 	g_unlink(s->summary_path); 
 #endif
 
+	/* The old mapping stays valid after the rename, the infos keep
+	 * pointing into it until the load below swaps them over */
 	if (g_rename(path, s->summary_path) == -1) {
 		i = errno;
 		g_unlink(path);
 		errno = i;
 		camel_exception_set (ex, CAMEL_EXCEPTION_SYSTEM_IO_WRITE,
 			"Error storing the summary");
-		g_static_mutex_unlock (&global_lock2);
-		g_static_rec_mutex_unlock (&global_lock);
+#ifdef G_OS_WIN32
+		SUMMARY_MAP_UNLOCK(s);
+#endif
 		g_static_rec_mutex_unlock (s->dump_lock);
 		return -1;
 	}
 
-	camel_folder_summary_load (s);
+	old = summary_map_steal (s);
 
-	g_static_mutex_unlock (&global_lock2);
-	g_static_rec_mutex_unlock (&global_lock);
+	/* The infos point into the new mapping after the load, but strings
+	 * that were gotten from them before might still point into the old
+	 * one. So might the infos themselves if the load failed */
+	s->in_reload = TRUE;
+	if (camel_folder_summary_load (s) == -1) {
+		if (old != NULL)
+			_PRIVATE(s)->pinned_maps = g_slist_prepend (_PRIVATE(s)->pinned_maps, old);
+	} else if (old != NULL)
+		_PRIVATE(s)->retired_maps = g_slist_prepend (_PRIVATE(s)->retired_maps, old);
+	s->in_reload = FALSE;
 
-	if (!hadhash)
-		camel_folder_summary_kill_hash (s);
+#ifdef G_OS_WIN32
+	SUMMARY_MAP_UNLOCK(s);
+#endif
 
-	s->in_reload = FALSE;
+	summary_maps_reclaim (s);
+
+	g_mutex_lock (s->hash_lock);
+	camel_uid_table_save (s->uidtable, s->messages, s->summary_path);
+	g_mutex_unlock (s->hash_lock);
 
 	s->flags &= ~CAMEL_SUMMARY_DIRTY;
 	g_static_rec_mutex_unlock (s->dump_lock);
@@ -1196,21 +1448,30 @@ exception:
 	return -1;
 }
 
+/**
+ * camel_folder_summary_save:
+ * @summary: a #CamelFolderSummary object
+ *
+ * Writes the summary to disk.  The summary is only written if changes
+ * have occured.
+ *
+ * Returns %0 on success or %-1 on fail
+ **/
 int
 camel_folder_summary_save (CamelFolderSummary *s, CamelException *ex)
 {
-	int retval;
-#ifdef SAVE_APPEND
-	if (s->had_expunges)
-#endif
-		retval = camel_folder_summary_save_rewrite (s, ex);
-#ifdef SAVE_APPEND
-	else
+	int retval = 1;
+
+	if (!s->had_expunges)
 		retval = camel_folder_summary_save_append (s, ex);
-#endif
+	if (retval == 1)
+		retval = camel_folder_summary_save_rewrite (s, ex);
 
 	s->had_expunges = FALSE;
 
+	/* Mappings that were still in use at the last rewrite */
+	summary_maps_reclaim (s);
+
 	return retval;
 }
 
@@ -1228,22 +1489,15 @@ int
 camel_folder_summary_header_load(CamelFolderSummary *s)
 {
 	int ret;
-	GError *err = NULL;
 
 	if (s->summary_path == NULL || !g_file_test (s->summary_path, G_FILE_TEST_EXISTS | G_FILE_TEST_IS_REGULAR))
 		return -1;
 
 	CAMEL_SUMMARY_LOCK(s, io_lock);
 
-	if (!s->file)
-	{
-		s->file = g_mapped_file_new (s->summary_path, FALSE, &err);
-		if (err != NULL)
-		{
-			g_critical ("Unable to mmap file: %s\n", err->message);
-			g_error_free (err);
-			return -1;
-		}
+	if (!summary_map_file (s)) {
+		CAMEL_SUMMARY_UNLOCK(s, io_lock);
+		return -1;
 	}
 
 	s->filepos = (unsigned char*) g_mapped_file_get_contents (s->file);
@@ -1328,8 +1582,7 @@ camel_folder_summary_add(CamelFolderSummary *s, CamelMessageInfo *info)
 	g_ptr_array_add(s->messages, info);
 
 	g_mutex_lock (s->hash_lock);
-	if (s->uidhash != NULL)
-		g_hash_table_insert (s->uidhash, g_strdup (info->uid), info);
+	camel_uid_table_append (s->uidtable, s->messages, s->messages->len - 1);
 	g_mutex_unlock (s->hash_lock);
 
 	s->flags |= CAMEL_SUMMARY_DIRTY;
@@ -1354,8 +1607,7 @@ camel_folder_summary_mmap_add(CamelFolderSummary *s, CamelMessageInfo *info)
 	g_ptr_array_add(s->messages, info);
 
 	g_mutex_lock (s->hash_lock);
-	if (s->uidhash != NULL)
-		g_hash_table_insert (s->uidhash, g_strdup (info->uid), info);
+	camel_uid_table_append (s->uidtable, s->messages, s->messages->len - 1);
 	g_mutex_unlock (s->hash_lock);
 
 	s->flags |= CAMEL_SUMMARY_DIRTY;
@@ -1477,11 +1729,11 @@ camel_folder_summary_info_new_from_header_with_uid (CamelFolderSummary *s, struc
 
 	bi = (CamelMessageInfoBase *)mi;
 
-	g_static_rec_mutex_lock (&global_lock);
+	g_static_rec_mutex_lock (info_lock (mi));
 	if (bi->uid)
 		g_free (bi->uid);
 	((CamelMessageInfoBase *)mi)->uid = g_strdup (uid);
-	g_static_rec_mutex_unlock (&global_lock);
+	g_static_rec_mutex_unlock (info_lock (mi));
 
 	return mi;
 }
@@ -1626,6 +1878,12 @@ camel_folder_summary_clear(CamelFolderSummary *s)
 		camel_message_info_free(s->messages->pdata[i]);
 
 	g_ptr_array_set_size(s->messages, 0);
+
+	g_mutex_lock (s->hash_lock);
+	camel_uid_table_invalidate (s->uidtable);
+	summary_forget_records (s);
+	g_mutex_unlock (s->hash_lock);
+
 	s->flags |= CAMEL_SUMMARY_DIRTY;
 	CAMEL_SUMMARY_UNLOCK(s, summary_lock);
 }
@@ -1640,7 +1898,7 @@ camel_folder_summary_dispose_all (CamelFolderSummary *s)
 		GPtrArray *items = g_ptr_array_sized_new (s->messages->len);
 
 		CAMEL_SUMMARY_LOCK(s, summary_lock);
-		g_static_rec_mutex_lock (&global_lock);
+		SUMMARY_MAP_LOCK(s);
 
 		for (i=0; i<s->messages->len; i++) {
 			CamelMessageInfo *info = (CamelMessageInfo *) s->messages->pdata[i];
@@ -1663,10 +1921,15 @@ camel_folder_summary_dispose_all (CamelFolderSummary *s)
 			g_ptr_array_add (s->expunged, info);
 		}
 
+		g_mutex_lock (s->hash_lock);
+		camel_uid_table_invalidate (s->uidtable);
+		summary_forget_records (s);
+		g_mutex_unlock (s->hash_lock);
+
 		s->had_expunges = TRUE;
 		s->flags |= CAMEL_SUMMARY_DIRTY;
 
-		g_static_rec_mutex_unlock (&global_lock);
+		SUMMARY_MAP_UNLOCK(s);
 		CAMEL_SUMMARY_UNLOCK(s, summary_lock);
 
 		g_ptr_array_free (items, TRUE);
@@ -1691,8 +1954,8 @@ camel_folder_summary_remove(CamelFolderSummary *s, CamelMessageInfo *info)
 		CamelMessageInfoBase *mi = (CamelMessageInfoBase *) info;
 
 		CAMEL_SUMMARY_LOCK(s, summary_lock);
-		g_static_rec_mutex_lock (&global_lock);
-		g_ptr_array_remove(s->messages, info);
+		SUMMARY_MAP_LOCK(s);
+		summary_messages_remove (s, info);
 		g_ptr_array_add (s->expunged, info);
 		/* NOTE! XUI */
 		destroy_possible_pstring_stuff (s, info, FALSE);
@@ -1702,12 +1965,12 @@ camel_folder_summary_remove(CamelFolderSummary *s, CamelMessageInfo *info)
 		mi->cc = "Expunged";
 		s->had_expunges = TRUE;
 		s->flags |= CAMEL_SUMMARY_DIRTY;
-		g_static_rec_mutex_unlock (&global_lock);
+		SUMMARY_MAP_UNLOCK(s);
 
 		CAMEL_SUMMARY_UNLOCK(s, summary_lock);
 	} else {
 		CAMEL_SUMMARY_LOCK(s, summary_lock);
-		g_ptr_array_remove(s->messages, info);
+		summary_messages_remove (s, info);
 		s->had_expunges = TRUE;
 		s->flags |= CAMEL_SUMMARY_DIRTY;
 		CAMEL_SUMMARY_UNLOCK(s, summary_lock);
@@ -1737,7 +2000,7 @@ camel_folder_summary_remove_uid(CamelFolderSummary *s, const char *uid)
 
 	if (oldinfo) {
 		/* make sure it doesn't vanish while we're removing it */
-		oldinfo->refcount++;
+		summary_info_ref(oldinfo);
 		CAMEL_SUMMARY_UNLOCK(s, ref_lock);
 		CAMEL_SUMMARY_UNLOCK(s, summary_lock);
 		camel_folder_summary_remove(s, oldinfo);
@@ -1764,7 +2027,11 @@ camel_folder_summary_remove_index(CamelFolderSummary *s, int index)
 		CamelMessageInfo *info = s->messages->pdata[index];
 
 		s->had_expunges = TRUE;
+		g_mutex_lock (s->hash_lock);
+		camel_uid_table_remove (s->uidtable, s->messages, index);
+		summary_forget_records (s);
 		g_ptr_array_remove_index(s->messages, index);
+		g_mutex_unlock (s->hash_lock);
 		s->flags |= CAMEL_SUMMARY_DIRTY;
 
 		CAMEL_SUMMARY_UNLOCK(s, summary_lock);
@@ -1802,6 +2069,11 @@ camel_folder_summary_remove_range(CamelFolderSummary *s, int start, int end)
 		g_ptr_array_set_size(s->messages, s->messages->len - (end - start));
 		s->flags |= CAMEL_SUMMARY_DIRTY;
 
+		g_mutex_lock (s->hash_lock);
+		camel_uid_table_invalidate (s->uidtable);
+		summary_forget_records (s);
+		g_mutex_unlock (s->hash_lock);
+
 		CAMEL_SUMMARY_UNLOCK(s, summary_lock);
 
 		for (i=start;i<end;i++)
@@ -2269,6 +2541,7 @@ message_info_new_from_header(CamelFolderSummary *s, struct _camel_header_raw *h)
 	const char *content, *charset = NULL;
 	const char *prio = NULL;
 	const char *attach = NULL;
+	struct _camel_header_references *refs;
 
 	mi = (CamelMessageInfoBase *)camel_message_info_new(s);
 	mi->flags |= CAMEL_MESSAGE_INFO_NEEDS_FREE;
@@ -2380,6 +2653,17 @@ message_info_new_from_header(CamelFolderSummary *s, struct _camel_header_raw *h)
 		g_free(msgid);
 	}
 
+	/* Only the direct parent is kept, that's enough for threading. The
+	 * first of the decoded list is the last one of References */
+	refs = camel_header_references_decode (camel_header_raw_find(&h, "references", NULL));
+	if (!refs)
+		refs = camel_header_references_inreplyto_decode (camel_header_raw_find(&h, "in-reply-to", NULL));
+	if (refs) {
+		md5_get_digest(refs->id, strlen(refs->id), digest);
+		memcpy(mi->parent_id.id.hash, digest, sizeof(mi->parent_id.id.hash));
+		camel_header_references_list_clear(&refs);
+	}
+
 	return (CamelMessageInfo *)mi;
 }
 
@@ -2559,7 +2843,15 @@ message_info_load(CamelFolderSummary *s, gboolean *must_add)
 		s->filepos += 4;
 	}
 #else
-	s->filepos += (count * 8);
+	/* We only save the parent, but take the last one of a longer list */
+	if (count > 0) {
+		s->filepos += ((count - 1) * 8);
+		mi->parent_id.id.part.hi = g_ntohl(get_unaligned_u32(s->filepos));
+		s->filepos += 4;
+		mi->parent_id.id.part.lo = g_ntohl(get_unaligned_u32(s->filepos));
+		s->filepos += 4;
+	} else
+		mi->parent_id.id.id = 0;
 #endif
 
 	ptrchr = s->filepos;
@@ -2654,6 +2946,12 @@ message_info_save(CamelFolderSummary *s, FILE *out, CamelMessageInfo *info)
 			if (camel_file_util_encode_fixed_int32(out, mi->references->references[i].id.part.lo)== -1) return -1;
 		}
 	} else {
+#else
+	if (mi->parent_id.id.id) {
+		if (camel_file_util_encode_uint32(out, 1)== -1) return -1;
+		if (camel_file_util_encode_fixed_int32(out, mi->parent_id.id.part.hi)== -1) return -1;
+		if (camel_file_util_encode_fixed_int32(out, mi->parent_id.id.part.lo)== -1) return -1;
+	} else
 #endif
 		if (camel_file_util_encode_uint32(out, 0)== -1) return -1;
 
@@ -3485,6 +3783,8 @@ camel_message_info_new (CamelFolderSummary *s)
 
 	info->refcount = 1;
 	info->summary = s;
+	if (s)
+		g_atomic_int_inc (&_PRIVATE(s)->info_refs);
 
 	return info;
 }
@@ -3501,17 +3801,8 @@ camel_message_info_ref(void *o)
 {
 	CamelMessageInfo *mi = o;
 
-	if (mi->summary) {
-		CAMEL_SUMMARY_LOCK(mi->summary, ref_lock);
-		g_assert(mi->refcount >= 1);
-		mi->refcount++;
-		CAMEL_SUMMARY_UNLOCK(mi->summary, ref_lock);
-	} else {
-		GLOBAL_INFO_LOCK(info);
-		g_assert(mi->refcount >= 1);
-		mi->refcount++;
-		GLOBAL_INFO_UNLOCK(info);
-	}
+	g_assert(mi->refcount >= 1);
+	summary_info_ref(mi);
 }
 
 void *
@@ -3554,22 +3845,35 @@ void
 camel_message_info_free(void *o)
 {
 	CamelMessageInfo *mi = o;
+	CamelFolderSummary *s;
 
 	/* camel_message_info_set_flags(mi, CAMEL_MESSAGE_FREED, CAMEL_MESSAGE_FREED); */
 
 	g_return_if_fail(mi != NULL);
 
+	/* mi is gone once the reference is dropped */
+	s = mi->summary;
+
+	if (camel_ref_count_dec_unless_last(&mi->refcount)) {
+		if (s)
+			g_atomic_int_add (&_PRIVATE(s)->info_refs, -1);
+		return;
+	}
+
 	if (mi->summary) {
 	 // if (((CamelObject *)mi->summary)->ref_count > 0) {
+		/* The summary hands out references under its ref_lock, the
+		 * last one is only dropped with that held too */
 		CAMEL_SUMMARY_LOCK(mi->summary, ref_lock);
 
-		if (mi->refcount >= 1)
-			mi->refcount--;
-		if (mi->refcount > 0) {
+		if (mi->refcount >= 1
+		    && !g_atomic_int_dec_and_test(&mi->refcount)) {
+			g_atomic_int_add (&_PRIVATE(s)->info_refs, -1);
 			CAMEL_SUMMARY_UNLOCK(mi->summary, ref_lock);
 			return;
 		}
 
+		g_atomic_int_add (&_PRIVATE(s)->info_refs, -1);
 		CAMEL_SUMMARY_UNLOCK(mi->summary, ref_lock);
 
 		/* FIXME: this is kinda busted, should really be handled by message info free */
@@ -3581,13 +3885,9 @@ camel_message_info_free(void *o)
 		((CamelFolderSummaryClass *)(CAMEL_OBJECT_GET_CLASS(mi->summary)))->message_info_free(mi->summary, mi);
 	 // }
 	} else {
-		GLOBAL_INFO_LOCK(info);
-		mi->refcount--;
-		if (mi->refcount > 0) {
-			GLOBAL_INFO_UNLOCK(info);
+		/* nobody can look these up, so no lock is needed */
+		if (!g_atomic_int_dec_and_test(&mi->refcount))
 			return;
-		}
-		GLOBAL_INFO_UNLOCK(info);
 
 		if (((CamelMessageInfoBase *)mi)->content)
 			camel_folder_summary_content_info_free(NULL, ((CamelMessageInfoBase *)mi)->content);
@@ -3619,10 +3919,11 @@ message_info_clone(CamelFolderSummary *s, const CamelMessageInfo *mi)
 	to->from = camel_pstring_strdup(from->from);
 	to->to = camel_pstring_strdup(from->to);
 	to->cc = camel_pstring_strdup(from->cc);
+	memcpy(&to->message_id, &from->message_id, sizeof(to->message_id));
+	memcpy(&to->parent_id, &from->parent_id, sizeof(to->parent_id));
 
 #ifdef NON_TINYMAIL_FEATURES
 	to->mlist = camel_pstring_strdup(from->mlist);
-	memcpy(&to->message_id, &from->message_id, sizeof(to->message_id));
 
 	if (from->references) {
 		int len = sizeof(*from->references) + ((from->references->size-1) * sizeof(from->references->references[0]));
@@ -3678,8 +3979,7 @@ info_ptr(const CamelMessageInfo *mi, int id)
 {
 	const void *retval = NULL;
 
-	g_static_rec_mutex_lock (&global_lock);
-	g_static_mutex_lock (&global_lock2);
+	g_static_rec_mutex_lock (info_lock (mi));
 
 	if (G_UNLIKELY (mi == NULL || mi->refcount <=0))
 		retval = "Invalid refcount";
@@ -3702,14 +4002,18 @@ info_ptr(const CamelMessageInfo *mi, int id)
 		case CAMEL_MESSAGE_INFO_MESSAGE_ID:
 			retval = &((const CamelMessageInfoBase *)mi)->message_id;
 		break;
+#ifndef NON_TINYMAIL_FEATURES
+		case CAMEL_MESSAGE_INFO_REFERENCES:
+			retval = &((const CamelMessageInfoBase *)mi)->parent_id;
+		break;
+#endif
 
 		default:
 			g_warning ("%s: invalid id %d", __FUNCTION__, id);
 
 	}
 
-	g_static_mutex_unlock (&global_lock2);
-	g_static_rec_mutex_unlock (&global_lock);
+	g_static_rec_mutex_unlock (info_lock (mi));
 
 	return retval;
 }
@@ -3719,7 +4023,7 @@ info_uint32(const CamelMessageInfo *mi, int id)
 {
 	guint32 retval = 0;
 
-	g_static_rec_mutex_lock (&global_lock);
+	g_static_rec_mutex_lock (info_lock (mi));
 
 	if (mi == NULL || mi->refcount <=0)
 		retval = 0;
@@ -3736,7 +4040,7 @@ info_uint32(const CamelMessageInfo *mi, int id)
 			g_warning ("%s: invalid id %d", __FUNCTION__, id);
 	}
 
-	g_static_rec_mutex_unlock (&global_lock);
+	g_static_rec_mutex_unlock (info_lock (mi));
 
 	return retval;
 }
@@ -3746,7 +4050,7 @@ info_time(const CamelMessageInfo *mi, int id)
 {
 	time_t retval = 0;
 
-	g_static_rec_mutex_lock (&global_lock);
+	g_static_rec_mutex_lock (info_lock (mi));
 
 	if (mi == NULL || mi->refcount <=0)
 		retval = 0;
@@ -3763,7 +4067,7 @@ info_time(const CamelMessageInfo *mi, int id)
 
 	}
 
-	g_static_rec_mutex_unlock (&global_lock);
+	g_static_rec_mutex_unlock (info_lock (mi));
 
 	return retval;
 }
@@ -3795,7 +4099,7 @@ camel_message_info_ptr(const CamelMessageInfo *mi, int id)
 {
 	const void * retval;
 
-	g_static_rec_mutex_lock (&global_lock);
+	g_static_rec_mutex_lock (info_lock (mi));
 
 	if (mi==NULL || mi->refcount <= 0)
 		retval = NULL;
@@ -3810,7 +4114,7 @@ camel_message_info_ptr(const CamelMessageInfo *mi, int id)
 			retval = info_ptr(mi, id);
 	}
 
-	g_static_rec_mutex_unlock (&global_lock);
+	g_static_rec_mutex_unlock (info_lock (mi));
 
 	return retval;
 }
@@ -3830,7 +4134,7 @@ camel_message_info_uint32(const CamelMessageInfo *mi, int id)
 {
 	guint32 retval;
 
-	g_static_rec_mutex_lock (&global_lock);
+	g_static_rec_mutex_lock (info_lock (mi));
 
 	if (mi == NULL || mi->refcount <=0)
 		retval = 0;
@@ -3845,7 +4149,7 @@ camel_message_info_uint32(const CamelMessageInfo *mi, int id)
 			retval = info_uint32(mi, id);
 	}
 
-	g_static_rec_mutex_unlock (&global_lock);
+	g_static_rec_mutex_unlock (info_lock (mi));
 
 	return retval;
 }
@@ -3865,7 +4169,7 @@ camel_message_info_time (const CamelMessageInfo *mi, int id)
 {
 	time_t retval;
 
-	g_static_rec_mutex_lock (&global_lock);
+	g_static_rec_mutex_lock (info_lock (mi));
 
 	if (mi == NULL || mi->refcount <=0)
 		retval = 0;
@@ -3880,7 +4184,7 @@ camel_message_info_time (const CamelMessageInfo *mi, int id)
 			retval = info_time(mi, id);
 	}
 
-	g_static_rec_mutex_unlock (&global_lock);
+	g_static_rec_mutex_unlock (info_lock (mi));
 
 	return retval;
 }
@@ -3900,7 +4204,7 @@ camel_message_info_user_flag(const CamelMessageInfo *mi, const char *id)
 {
 	gboolean retval;
 
-	g_static_rec_mutex_lock (&global_lock);
+	g_static_rec_mutex_lock (info_lock (mi));
 
 	if (mi->summary)
 		if (CAMEL_IS_FOLDER_SUMMARY (mi->summary))
@@ -3910,7 +4214,7 @@ camel_message_info_user_flag(const CamelMessageInfo *mi, const char *id)
 	else
 		retval = info_user_flag(mi, id);
 
-	g_static_rec_mutex_unlock (&global_lock);
+	g_static_rec_mutex_unlock (info_lock (mi));
 
 	return retval;
 }
@@ -3930,7 +4234,7 @@ camel_message_info_user_tag(const CamelMessageInfo *mi, const char *id)
 {
 	const char * retval;
 
-	g_static_rec_mutex_lock (&global_lock);
+	g_static_rec_mutex_lock (info_lock (mi));
 
 	if (mi->summary)
 		if (CAMEL_IS_FOLDER_SUMMARY (mi->summary))
@@ -3940,7 +4244,7 @@ camel_message_info_user_tag(const CamelMessageInfo *mi, const char *id)
 	else
 		retval = info_user_tag(mi, id);
 
-	g_static_rec_mutex_unlock (&global_lock);
+	g_static_rec_mutex_unlock (info_lock (mi));
 
 	return retval;
 }
@@ -4011,7 +4315,7 @@ info_set_user_flag(CamelMessageInfo *info, const char *name, gboolean value)
 	CamelMessageInfoBase *mi = (CamelMessageInfoBase *)info;
 	gboolean res = FALSE;
 
-	g_static_rec_mutex_lock (&global_lock);
+	g_static_rec_mutex_lock (info_lock (info));
 
 #ifdef NON_TINYMAIL_FEATURES
 	res = camel_flag_set(&mi->user_flags, name, value);
@@ -4028,7 +4332,7 @@ info_set_user_flag(CamelMessageInfo *info, const char *name, gboolean value)
 		camel_folder_change_info_free(changes);
 	}
 
-	g_static_rec_mutex_unlock (&global_lock);
+	g_static_rec_mutex_unlock (info_lock (info));
 
 	return res;
 }
@@ -4049,14 +4353,14 @@ camel_message_info_set_user_flag(CamelMessageInfo *mi, const char *id, gboolean
 {
 	gboolean retval;
 
-	g_static_rec_mutex_lock (&global_lock);
+	g_static_rec_mutex_lock (info_lock (mi));
 
 	if (mi->summary)
 		retval = ((CamelFolderSummaryClass *)((CamelObject *)mi->summary)->klass)->info_set_user_flag(mi, id, state);
 	else
 		retval = info_set_user_flag(mi, id, state);
 
-	g_static_rec_mutex_unlock (&global_lock);
+	g_static_rec_mutex_unlock (info_lock (mi));
 
 	return retval;
 }
@@ -4067,7 +4371,7 @@ info_set_user_tag(CamelMessageInfo *info, const char *name, const char *value)
 	CamelMessageInfoBase *mi = (CamelMessageInfoBase *)info;
 	gboolean res = FALSE;
 
-	g_static_rec_mutex_lock (&global_lock);
+	g_static_rec_mutex_lock (info_lock (info));
 
 #ifdef NON_TINYMAIL_FEATURES
 	res = camel_tag_set(&mi->user_tags, name, value);
@@ -4083,7 +4387,7 @@ info_set_user_tag(CamelMessageInfo *info, const char *name, const char *value)
 		camel_folder_change_info_free(changes);
 	}
 
-	g_static_rec_mutex_unlock (&global_lock);
+	g_static_rec_mutex_unlock (info_lock (info));
 
 	return res;
 }
@@ -4104,14 +4408,14 @@ camel_message_info_set_user_tag(CamelMessageInfo *mi, const char *id, const char
 {
 	gboolean retval;
 
-	g_static_rec_mutex_lock (&global_lock);
+	g_static_rec_mutex_lock (info_lock (mi));
 
 	if (mi->summary)
 		retval = ((CamelFolderSummaryClass *)((CamelObject *)mi->summary)->klass)->info_set_user_tag(mi, id, val);
 	else
 		retval = info_set_user_tag(mi, id, val);
 
-	g_static_rec_mutex_unlock (&global_lock);
+	g_static_rec_mutex_unlock (info_lock (mi));
 
 	return retval;
 }
@@ -4165,6 +4469,35 @@ camel_message_info_dump (CamelMessageInfo *mi)
 	/*camel_content_info_dump(mi->content, 0);*/
 }
 
+/**
+ * camel_message_info_lock:
+ * @mi: a #CamelMessageInfo
+ *
+ * Keeps the summary that @mi belongs to from pointing the strings of its
+ * message infos into a new mapping of the summary file. The strings that
+ * the accessors of @mi return stay valid until camel_message_info_unlock,
+ * copy them before unlocking. Only the one summary is locked.
+ **/
+void
+camel_message_info_lock (const CamelMessageInfo *mi)
+{
+	g_static_rec_mutex_lock (info_lock (mi));
+}
+
+/**
+ * camel_message_info_unlock:
+ * @mi: a #CamelMessageInfo
+ *
+ * Undoes camel_message_info_lock.
+ **/
+void
+camel_message_info_unlock (const CamelMessageInfo *mi)
+{
+	g_static_rec_mutex_unlock (info_lock (mi));
+}
+
+/* Only covers message infos that don't belong to a summary, use
+ * camel_message_info_lock for the others */
 void
 camel_folder_summary_lock ()
 {
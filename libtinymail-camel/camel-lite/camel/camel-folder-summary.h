@@ -154,7 +154,7 @@ enum {
 /* information about a given message, use accessors */
 struct _CamelMessageInfo {
 	CamelFolderSummary *summary;
-	guint32 refcount;	/* ??? */
+	volatile gint refcount;	/* atomic */
 	char *uid;
 };
 
@@ -165,7 +165,7 @@ struct _CamelMessageInfo {
 /*                                          on x86_32 */
 struct _CamelMessageInfoBase {
 	CamelFolderSummary *summary;       /* 4 bytes */
-	guint32 refcount;                  /* 4 bytes */
+	volatile gint refcount;            /* 4 bytes */
 	char *uid;                         /* 4 bytes */
 	const char *subject;               /* 4 bytes */
 	const char *from;                  /* 4 bytes */
@@ -178,6 +178,8 @@ struct _CamelMessageInfoBase {
 	struct _camel_header_param *headers;
 #endif
 	CamelSummaryMessageID message_id;  /* 8 bytes */
+	CamelSummaryMessageID parent_id;   /* 8 bytes, In-Reply-To or the
+	                                      last of References */
 
 	guint32 flags;                     /* 4 bytes */
 	guint32 size;                      /* 4 bytes */
@@ -185,7 +187,7 @@ struct _CamelMessageInfoBase {
 	time_t date_sent;                  /* 4 bytes */
 	time_t date_received;              /* 4 bytes */
 
-                                          /* 56 bytes */
+                                          /* 64 bytes */
 };
 
 
@@ -216,7 +218,7 @@ struct _CamelFolderSummary {
 	gboolean build_content;	/* do we try and parse/index the content, or not? */
 
 	GPtrArray *messages, *expunged; /* CamelMessageInfo's */
-	GHashTable *uidhash;
+	struct _CamelUIDTable *uidtable; /* uid -> index in messages */
 
 	struct _CamelFolder *folder; /* parent folder, for events */
 	struct _CamelFolderMetaSummary *meta_summary; /* Meta summary */
@@ -390,6 +392,9 @@ time_t camel_message_info_time(const CamelMessageInfo *mi, int id);
 #define camel_message_info_date_received(mi) camel_message_info_time((const CamelMessageInfo *)mi, CAMEL_MESSAGE_INFO_DATE_RECEIVED)
 
 #define camel_message_info_message_id(mi) ((const CamelSummaryMessageID *)camel_message_info_ptr((const CamelMessageInfo *)mi, CAMEL_MESSAGE_INFO_MESSAGE_ID))
+#ifndef NON_TINYMAIL_FEATURES
+#define camel_message_info_parent_id(mi) ((const CamelSummaryMessageID *)camel_message_info_ptr((const CamelMessageInfo *)mi, CAMEL_MESSAGE_INFO_REFERENCES))
+#endif
 #define camel_message_info_user_flags(mi) ((const CamelFlag *)camel_message_info_ptr((const CamelMessageInfo *)mi, CAMEL_MESSAGE_INFO_USER_FLAGS))
 #define camel_message_info_user_tags(mi) ((const CamelTag *)camel_message_info_ptr((const CamelMessageInfo *)mi, CAMEL_MESSAGE_INFO_USER_TAGS))
 
@@ -418,6 +423,9 @@ void camel_folder_summary_move_up (CamelFolderSummary *s);
 void camel_folder_summary_lock ();
 void camel_folder_summary_unlock ();
 
+void camel_message_info_lock (const CamelMessageInfo *mi);
+void camel_message_info_unlock (const CamelMessageInfo *mi);
+
 void camel_folder_summary_dispose_all (CamelFolderSummary *s);
 
 G_END_DECLS
@@ -58,7 +58,6 @@ container_add_child(CamelFolderThreadNode *node, CamelFolderThreadNode *child)
 	child->parent = node;
 }
 
-#if 0
 static void
 container_parent_child(CamelFolderThreadNode *parent, CamelFolderThreadNode *child)
 {
@@ -98,9 +97,10 @@ container_parent_child(CamelFolderThreadNode *parent, CamelFolderThreadNode *chi
 		c = c->next;
 	}
 
-	printf("DAMN, we shouldn't  be here!\n");
+	/* The child claims a parent that doesn't list it, the tree is broken */
+	g_warning ("container_parent_child: node %p is not a child of its parent %p",
+		   (void *) child, (void *) node);
 }
-#endif
 
 static void
 prune_empty(CamelFolderThread *thread, CamelFolderThreadNode **cp)
@@ -450,6 +450,8 @@ thread_summary(CamelFolderThread *thread, GPtrArray *summary)
 		const CamelSummaryMessageID *mid = camel_message_info_message_id(mi);
 #ifdef NON_TINYMAIL_FEATURES
 		const CamelSummaryReferences *references = camel_message_info_references(mi);
+#else
+		const CamelSummaryMessageID *pid = camel_message_info_parent_id(mi);
 #endif
 
 		if (mid->id.id) {
@@ -497,6 +499,15 @@ thread_summary(CamelFolderThread *thread, GPtrArray *summary)
 				child = c;
 			}
 		}
+#else
+		if (pid->id.id && pid->id.id != mid->id.id) {
+			c = g_hash_table_lookup(id_table, pid);
+			if (c == NULL) {
+				c = camel_folder_thread_node_new(thread);
+				g_hash_table_insert(id_table, (void *)pid, c);
+			}
+			container_parent_child(c, child);
+		}
 #endif
 	}
 
@@ -610,6 +621,8 @@ camel_folder_thread_messages_new (CamelFolder *folder, GPtrArray *uids, gboolean
 	thread->tree = NULL;
 	thread->mem_chain = NULL;
 	thread->folder = folder;
+	thread->id_table = NULL;
+	thread->uid_table = NULL;
 	camel_object_ref((CamelObject *)folder);
 
 	/* get all of the summary items of interest in summary order */
@@ -693,6 +706,8 @@ camel_folder_thread_messages_apply(CamelFolderThread *thread, GPtrArray *uids)
 	thread->summary = all;
 }
 
+static void free_tree_incr(CamelFolderThreadNode *node);
+
 void
 camel_folder_thread_messages_ref(CamelFolderThread *thread)
 {
@@ -721,18 +736,131 @@ camel_folder_thread_messages_unref(CamelFolderThread *thread)
 		g_ptr_array_free(thread->summary, TRUE);
 		camel_object_unref((CamelObject *)thread->folder);
 	}
+	if (thread->uid_table) {
+		free_tree_incr(thread->tree);
+		g_hash_table_destroy(thread->uid_table);
+		g_hash_table_destroy(thread->id_table);
+	}
 	g_slice_free_chain(CamelFolderThreadNode, thread->mem_chain, mem_chain);
 	g_free(thread);
 }
 
-#if 0
+/* The incremental interface doesn't rebuild anything. The nodes are in a
+ * hash table by message id and by uid, and have a prev pointer, so adding or
+ * removing a message only costs a few lookups and relinks. The nodes aren't
+ * in the mem_chain, a removed node gets freed right away */
+
+static CamelFolderThreadNode *
+node_new_incr(void)
+{
+	return g_slice_new0(CamelFolderThreadNode);
+}
+
+static void
+unlink_incr(CamelFolderThread *thread, CamelFolderThreadNode *node)
+{
+	if (node->prev)
+		node->prev->next = node->next;
+	else if (node->parent)
+		node->parent->child = node->next;
+	else
+		thread->tree = node->next;
+
+	if (node->next)
+		node->next->prev = node->prev;
+
+	node->parent = node->prev = node->next = NULL;
+}
+
+static void
+link_incr(CamelFolderThread *thread, CamelFolderThreadNode *parent, CamelFolderThreadNode *node)
+{
+	CamelFolderThreadNode **list = parent ? &parent->child : &thread->tree;
+
+	node->parent = parent;
+	node->prev = NULL;
+	node->next = *list;
+	if (*list)
+		(*list)->prev = node;
+	*list = node;
+}
+
+/* Frees a node that has neither a message nor children anymore, and then
+ * the same for the parents that became like that */
+static void
+prune_incr(CamelFolderThread *thread, CamelFolderThreadNode *node)
+{
+	while (node && node->message == NULL && node->child == NULL) {
+		CamelFolderThreadNode *parent = node->parent;
+
+		unlink_incr(thread, node);
+		if (node->id.id.id)
+			g_hash_table_remove(thread->id_table, &node->id);
+		g_slice_free(CamelFolderThreadNode, node);
+		node = parent;
+	}
+}
+
+static void
+add_incr(CamelFolderThread *thread, CamelMessageInfo *mi)
+{
+	const CamelSummaryMessageID *mid = camel_message_info_message_id(mi);
+	const CamelSummaryMessageID *pid = camel_message_info_parent_id(mi);
+	CamelFolderThreadNode *c = NULL, *p, *scan;
+
+	if (g_hash_table_lookup(thread->uid_table, camel_message_info_uid(mi)))
+		return;
+
+	if (mid->id.id) {
+		c = g_hash_table_lookup(thread->id_table, mid);
+		/* a duplicate becomes a message without id */
+		if (c && c->message)
+			c = NULL;
+		else if (!c) {
+			c = node_new_incr();
+			c->id = *mid;
+			g_hash_table_insert(thread->id_table, &c->id, c);
+			link_incr(thread, NULL, c);
+		}
+	}
+
+	if (!c) {
+		c = node_new_incr();
+		link_incr(thread, NULL, c);
+	}
+
+	camel_message_info_ref(mi);
+	c->message = mi;
+	c->order = ++thread->order;
+	g_hash_table_insert(thread->uid_table, (char *)camel_message_info_uid(mi), c);
+
+	if (!pid->id.id || pid->id.id == c->id.id.id || c->parent)
+		return;
+
+	p = g_hash_table_lookup(thread->id_table, pid);
+	if (!p) {
+		p = node_new_incr();
+		p->id = *pid;
+		g_hash_table_insert(thread->id_table, &p->id, p);
+		link_incr(thread, NULL, p);
+	}
+
+	/* would this create a loop? */
+	for (scan = p; scan; scan = scan->parent)
+		if (scan == c)
+			return;
+
+	unlink_incr(thread, c);
+	link_incr(thread, p, c);
+}
+
 /**
  * camel_folder_thread_messages_new_summary:
  * @summary: Array of CamelMessageInfo's to thread.
  *
- * Thread a list of MessageInfo's.  The summary must remain valid for the
- * life of the CamelFolderThread created by this function, and it is upto the
- * caller to ensure this.
+ * Thread a list of MessageInfo's. The thread takes its own reference on
+ * them, and can be kept up to date with camel_folder_thread_messages_add and
+ * camel_folder_thread_messages_remove.
  *
  * Return value: A CamelFolderThread contianing a tree of CamelFolderThreadNode's
  * which represent the threaded structure of the messages.
@@ -742,143 +870,109 @@ camel_folder_thread_messages_new_summary(GPtrArray *summary)
 {
 	CamelFolderThread *thread;
 
-#ifdef TIMEIT
-	struct timeval start, end;
-	unsigned long diff;
-
-	gettimeofday(&start, NULL);
-#endif
-
 	thread = g_malloc(sizeof(*thread));
 	thread->refcount = 1;
+	thread->subject = FALSE;
 	thread->tree = NULL;
 	thread->mem_chain = NULL;
 	thread->folder = NULL;
 	thread->summary = NULL;
+	thread->order = 0;
+	thread->id_table = g_hash_table_new((GHashFunc)id_hash, (GCompareFunc)id_equal);
+	thread->uid_table = g_hash_table_new(g_str_hash, g_str_equal);
 
-	thread_summary(thread, summary);
+	camel_folder_thread_messages_add(thread, summary);
 
 	return thread;
 }
 
-/* scan the list in depth-first fashion */
-static void
-build_summary_rec(GHashTable *have, GPtrArray *summary, CamelFolderThreadNode *node)
+/**
+ * camel_folder_thread_messages_add:
+ * @thread: a thread created with camel_folder_thread_messages_new_summary
+ * @summary: Array of CamelMessageInfo's to add
+ *
+ * Add messages to @thread, in the order of @summary. Messages that are
+ * in @thread already are skipped.
+ **/
+void
+camel_folder_thread_messages_add(CamelFolderThread *thread, GPtrArray *summary)
 {
-	while (node) {
-		if (node->message)
-			g_hash_table_insert(have, (char *)camel_message_info_uid(node->message), node->message);
-		g_ptr_array_add(summary, node);
-		if (node->child)
-			build_summary_rec(have, summary, node->child);
-		node = node->next;
-	}
+	int i;
+
+	g_return_if_fail (thread->uid_table != NULL);
+
+	for (i=0;i<summary->len;i++)
+		add_incr(thread, summary->pdata[i]);
 }
 
+/**
+ * camel_folder_thread_messages_remove:
+ * @thread: a thread created with camel_folder_thread_messages_new_summary
+ * @uids: the uids of the messages to remove
+ *
+ * Remove messages from @thread. A removed message that has replies stays in
+ * the tree as a node without message, so that the replies stay together.
+ **/
 void
-camel_folder_thread_messages_add(CamelFolderThread *thread, GPtrArray *summary)
+camel_folder_thread_messages_remove(CamelFolderThread *thread, GPtrArray *uids)
 {
-	GPtrArray *all;
 	int i;
-	GHashTable *table;
 
-	/* Instead of working out all the complex in's and out's of
-	   trying to do an incremental summary generation, just redo the whole
-	   thing with the summary in the current order - so it comes out
-	   in the same order */
+	g_return_if_fail (thread->uid_table != NULL);
 
-	all = g_ptr_array_new();
-	table = g_hash_table_new(g_str_hash, g_str_equal);
-	build_summary_rec(table, all, thread->tree);
-	for (i=0;i<summary->len;i++) {
-		CamelMessageInfo *info = summary->pdata[i];
+	for (i=0;i<uids->len;i++) {
+		CamelFolderThreadNode *c = g_hash_table_lookup(thread->uid_table, uids->pdata[i]);
+		CamelFolderThreadNode *child, *next;
 
-		/* check its not already there, we dont want duplicates */
-		if (g_hash_table_lookup(table, camel_message_info_uid(info)) == NULL)
-			g_ptr_array_add(all, info);
-	}
-	g_hash_table_destroy(table);
+		if (!c)
+			continue;
 
-	/* reset the tree, and rebuild fully */
-	g_slice_free_chain(CamelFolderThreadNode, thread->mem_chain, mem_chain);
-	thread->tree = NULL;
-	thread->mem_chain = NULL;
-	thread_summary(thread, all);
-}
+		g_hash_table_remove(thread->uid_table, uids->pdata[i]);
+		camel_message_info_free((CamelMessageInfo *)c->message);
+		c->message = NULL;
 
-static void
-remove_uid_node_rec(CamelFolderThread *thread, GHashTable *table, CamelFolderThreadNode **list, CamelFolderThreadNode *parent)
-{
-	CamelFolderThreadNode *prev = NULL;
-	CamelFolderThreadNode *node, *next, *child, *rest;
-
-	node = (CamelFolderThreadNode *)list;
-	next = node->next;
-	while (next) {
-
-		if (next->child)
-			remove_uid_node_rec(thread, table, &next->child, next);
-
-		/* do we have a node to remove? */
-		if (next->message && g_hash_table_lookup(table, (char *)camel_message_info_uid(node->message))) {
-			child = next->child;
-			if (child) {
-				/*
-				  node
-				  next
-				   child
-				   lchild
-				  rest
-
-				  becomes:
-				  node
-				  child
-				  lchild
-				  rest
-				*/
-
-				rest = next->next;
-				node->next = child;
-				next = child;
-				do {
-					lchild = child;
-					child->parent = parent;
-					child = child->next;
-				} while (child);
-				lchild->next = rest;
-			} else {
-				/*
-				  node
-				  next
-				  rest
-				  becomes:
-				  node
-				  rest */
-				node->next = next->next;
-				next = node->next;
+		/* without an id nothing can refer to it, its replies move up */
+		if (!c->id.id.id) {
+			for (child = c->child; child; child = next) {
+				next = child->next;
+				unlink_incr(thread, child);
+				link_incr(thread, c->parent, child);
 			}
-		} else {
-			node = next;
-			next = node->next;
 		}
+
+		prune_incr(thread, c);
 	}
 }
 
-void
-camel_folder_thread_messages_remove(CamelFolderThread *thread, GPtrArray *uids)
+/**
+ * camel_folder_thread_messages_lookup:
+ * @thread: a thread created with camel_folder_thread_messages_new_summary
+ * @uid: the uid of a message
+ *
+ * Return value: the node of the message with @uid in @thread, or NULL
+ **/
+CamelFolderThreadNode *
+camel_folder_thread_messages_lookup(CamelFolderThread *thread, const char *uid)
 {
-	GHashTable *table;
-	int i;
+	g_return_val_if_fail (thread->uid_table != NULL, NULL);
 
-	table = g_hash_table_new(g_str_hash, g_str_equal);
-	for (i=0;i<uids->len;i++)
-		g_hash_table_insert(table, uids->pdata[i], uids->pdata[i]);
-
-	remove_uid_node_rec(thread, table, &thread->tree, NULL);
-	g_hash_table_destroy(table);
+	return g_hash_table_lookup(thread->uid_table, uid);
 }
 
-#endif
+static void
+free_tree_incr(CamelFolderThreadNode *node)
+{
+	while (node) {
+		CamelFolderThreadNode *next = node->next;
+
+		if (node->child)
+			free_tree_incr(node->child);
+		if (node->message)
+			camel_message_info_free((CamelMessageInfo *)node->message);
+		g_slice_free(CamelFolderThreadNode, node);
+		node = next;
+	}
+}
 
 CamelFolderThreadNode *
 camel_folder_thread_node_new(CamelFolderThread *thread)
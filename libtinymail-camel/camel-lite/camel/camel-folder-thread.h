@@ -27,13 +27,20 @@
 
 G_BEGIN_DECLS
 
+/* next must stay the first member, the list code treats the address of a
+ * pointer to a node as a node */
 typedef struct _CamelFolderThreadNode {
+	struct _CamelFolderThreadNode *next;
 	struct _CamelFolderThreadNode *mem_chain;
-	struct _CamelFolderThreadNode *next, *parent, *child;
+	struct _CamelFolderThreadNode *parent, *child;
 	const CamelMessageInfo *message;
 	char *root_subject;	/* cached root equivalent subject */
 	guint32 order:31;
 	guint32 re:1;			/* re version of subject? */
+
+	/* only used by the incremental interface */
+	struct _CamelFolderThreadNode *prev;
+	CamelSummaryMessageID id;
 } CamelFolderThreadNode;
 
 typedef struct _CamelFolderThread {
@@ -44,19 +51,23 @@ typedef struct _CamelFolderThread {
 	struct _CamelFolderThreadNode *mem_chain;
 	CamelFolder *folder;
 	GPtrArray *summary;
+
+	/* only used by the incremental interface */
+	GHashTable *id_table, *uid_table;
+	guint32 order;
 } CamelFolderThread;
 
 /* interface 1: using uid's */
 CamelFolderThread *camel_folder_thread_messages_new(CamelFolder *folder, GPtrArray *uids, gboolean thread_subject);
 void camel_folder_thread_messages_apply(CamelFolderThread *thread, GPtrArray *uids);
 
-/* interface 2: using messageinfo's.  Currently disabled. */
-#if 0
-/* new improved interface */
+/* interface 2: using messageinfo's, incremental. The tree isn't sorted and
+ * isn't threaded by subject, new threads get prepended to it and new
+ * children to the children of their parent */
 CamelFolderThread *camel_folder_thread_messages_new_summary(GPtrArray *summary);
 void camel_folder_thread_messages_add(CamelFolderThread *thread, GPtrArray *summary);
 void camel_folder_thread_messages_remove(CamelFolderThread *thread, GPtrArray *uids);
-#endif
+CamelFolderThreadNode *camel_folder_thread_messages_lookup(CamelFolderThread *thread, const char *uid);
 
 void camel_folder_thread_messages_ref(CamelFolderThread *threads);
 void camel_folder_thread_messages_unref(CamelFolderThread *threads);
@@ -18,7 +18,15 @@
  * Boston, MA 02110-1301, USA.
  */
 
+#include <string.h>
+
 #include "camel-mime-filter-index.h"
+#include "camel-mime-filter-charset.h"
+#include "camel-mime-filter-html.h"
+#include "camel-mime-message.h"
+#include "camel-multipart.h"
+#include "camel-stream-filter.h"
+#include "camel-stream-null.h"
 #include "camel-text-index.h"
 
 static void camel_mime_filter_index_class_init (CamelMimeFilterIndexClass *klass);
@@ -180,3 +188,99 @@ camel_mime_filter_index_set_index (CamelMimeFilterIndex *filter, CamelIndex *ind
 	if (index)
 		camel_object_ref (index);
 }
+
+
+/* Runs the decoded text of @part through @filter. Parts that are not
+ * available locally are skipped, decoding those would fetch them */
+static void
+index_part (CamelMimeFilterIndex *filter, CamelDataWrapper *part)
+{
+	CamelDataWrapper *content;
+	CamelContentType *ct;
+
+	if (CAMEL_IS_MEDIUM (part))
+		content = camel_medium_get_content_object (CAMEL_MEDIUM (part));
+	else
+		content = part;
+
+	if (content == NULL || camel_data_wrapper_is_offline (content))
+		return;
+
+	if (CAMEL_IS_MULTIPART (content)) {
+		int i, parts = camel_multipart_get_number (CAMEL_MULTIPART (content));
+
+		for (i = 0; i < parts; i++)
+			index_part (filter, (CamelDataWrapper *)
+				camel_multipart_get_part (CAMEL_MULTIPART (content), i));
+	} else if (CAMEL_IS_MIME_MESSAGE (content)) {
+		index_part (filter, content);
+	} else {
+		CamelStream *null;
+		CamelStreamFilter *filtered;
+		const char *charset;
+
+		ct = camel_data_wrapper_get_mime_type_field (content);
+		if (ct == NULL || !camel_content_type_is (ct, "text", "*"))
+			return;
+
+		null = camel_stream_null_new ();
+		filtered = camel_stream_filter_new_with_stream (null);
+
+		charset = camel_content_type_param (ct, "charset");
+		if (charset && g_ascii_strcasecmp (charset, "utf-8") != 0
+		    && g_ascii_strcasecmp (charset, "us-ascii") != 0) {
+			CamelMimeFilterCharset *cf = camel_mime_filter_charset_new_convert (charset, "UTF-8");
+
+			if (cf) {
+				camel_stream_filter_add (filtered, (CamelMimeFilter *) cf);
+				camel_object_unref (cf);
+			}
+		}
+
+		if (camel_content_type_is (ct, "text", "html")) {
+			CamelMimeFilterHTML *hf = camel_mime_filter_html_new ();
+
+			camel_stream_filter_add (filtered, (CamelMimeFilter *) hf);
+			camel_object_unref (hf);
+		}
+
+		camel_stream_filter_add (filtered, (CamelMimeFilter *) filter);
+		camel_data_wrapper_decode_to_stream (content, (CamelStream *) filtered);
+		camel_stream_flush ((CamelStream *) filtered);
+
+		camel_object_unref (filtered);
+		camel_object_unref (null);
+	}
+}
+
+
+/**
+ * camel_mime_filter_index_add_message:
+ * @index: a #CamelIndex object
+ * @name: the name to index the message under, usually its uid
+ * @message: a #CamelMimeMessage object
+ *
+ * Adds the words of the text parts of @message to @index, replacing what
+ * was indexed under @name before. Only the parts that are available
+ * locally are indexed.
+ **/
+void
+camel_mime_filter_index_add_message (CamelIndex *index, const char *name, CamelMimeMessage *message)
+{
+	CamelMimeFilterIndex *filter;
+	CamelIndexName *idn;
+
+	idn = camel_index_add_name (index, name);
+	if (idn == NULL)
+		return;
+
+	filter = camel_mime_filter_index_new_index (index);
+	camel_mime_filter_index_set_name (filter, idn);
+
+	index_part (filter, (CamelDataWrapper *) message);
+
+	camel_index_write_name (index, idn);
+
+	camel_object_unref (filter);
+	camel_object_unref (idn);
+}
@@ -55,6 +55,9 @@ CamelMimeFilterIndex      *camel_mime_filter_index_new_index(struct _CamelIndex
 void camel_mime_filter_index_set_name (CamelMimeFilterIndex *filter, struct _CamelIndexName *name);
 void camel_mime_filter_index_set_index (CamelMimeFilterIndex *filter, struct _CamelIndex *index);
 
+/* Index the text parts of a whole message */
+void camel_mime_filter_index_add_message (struct _CamelIndex *index, const char *name, struct _CamelMimeMessage *message);
+
 G_END_DECLS
 
 #endif /* ! _CAMEL_MIME_FILTER_INDEX_H */
@@ -34,9 +34,12 @@
 
 #ifndef G_OS_WIN32
 #include <sys/poll.h>
+#include <fcntl.h>
+#include <unistd.h>
 #endif
 
 #include <string.h>
+#include <time.h>
 
 #include <libedataserver/e-msgport.h>
 
@@ -47,6 +50,14 @@
 
 #define d(x)
 
+/* getaddrinfo doesn't tell the TTL of what it found, so results are kept for
+ * a fixed time. Failed lookups are not kept */
+#define ADDRINFO_CACHE_TTL 300
+
+/* RFC 8305 says to wait 250 ms for a connection attempt before starting the
+ * next one, while leaving the first one running */
+#define CONNECTION_ATTEMPT_DELAY 250
+
 /* These are GNU extensions */
 #ifndef NI_MAXHOST
 #define NI_MAXHOST	1025
@@ -686,11 +697,141 @@ cs_getaddrinfo(void *data)
 }
 #endif /* NEED_ADDRINFO */
 
+/* The results of camel_getaddrinfo are all allocated like the ones of the
+ * emulation above, so that copies out of the cache can be freed the same way
+ * as a fresh result */
+static struct addrinfo *
+addrinfo_copy(const struct addrinfo *ai)
+{
+	struct addrinfo *res = NULL, *last = NULL;
+
+	for (;ai;ai = ai->ai_next) {
+		struct addrinfo *copy = g_malloc0(sizeof(*copy));
+
+		copy->ai_flags = ai->ai_flags;
+		copy->ai_family = ai->ai_family;
+		copy->ai_socktype = ai->ai_socktype;
+		copy->ai_protocol = ai->ai_protocol;
+		copy->ai_addrlen = ai->ai_addrlen;
+		copy->ai_addr = g_memdup(ai->ai_addr, ai->ai_addrlen);
+		copy->ai_canonname = g_strdup(ai->ai_canonname);
+
+		if (last == NULL)
+			res = copy;
+		else
+			last->ai_next = copy;
+		last = copy;
+	}
+
+	return res;
+}
+
+static void
+addrinfo_free(struct addrinfo *host)
+{
+	while (host) {
+		struct addrinfo *next = host->ai_next;
+
+		g_free(host->ai_canonname);
+		g_free(host->ai_addr);
+		g_free(host);
+		host = next;
+	}
+}
+
+/* One cache for all services, keyed by name, service and hints */
+struct _addrinfo_cached {
+	struct addrinfo *res;
+	time_t expires;
+};
+
+static GHashTable *addrinfo_cache = NULL;
+static GStaticMutex addrinfo_cache_lock = G_STATIC_MUTEX_INIT;
+
+static void
+addrinfo_cached_free(struct _addrinfo_cached *cached)
+{
+	addrinfo_free(cached->res);
+	g_free(cached);
+}
+
+static char *
+addrinfo_cache_key(const char *name, const char *service, const struct addrinfo *hints)
+{
+	if (hints)
+		return g_strdup_printf("%s %s %d %d %d %d", name, service ? service : "",
+				       hints->ai_flags, hints->ai_family, hints->ai_socktype, hints->ai_protocol);
+
+	return g_strdup_printf("%s %s", name, service ? service : "");
+}
+
+static struct addrinfo *
+addrinfo_cache_lookup(const char *key)
+{
+	struct _addrinfo_cached *cached;
+	struct addrinfo *res = NULL;
+
+	g_static_mutex_lock(&addrinfo_cache_lock);
+	if (addrinfo_cache && (cached = g_hash_table_lookup(addrinfo_cache, key))) {
+		if (cached->expires > time(NULL))
+			res = addrinfo_copy(cached->res);
+		else
+			g_hash_table_remove(addrinfo_cache, key);
+	}
+	g_static_mutex_unlock(&addrinfo_cache_lock);
+
+	return res;
+}
+
+static void
+addrinfo_cache_add(char *key, const struct addrinfo *res)
+{
+	struct _addrinfo_cached *cached = g_malloc(sizeof(*cached));
+
+	cached->res = addrinfo_copy(res);
+	cached->expires = time(NULL) + ADDRINFO_CACHE_TTL;
+
+	g_static_mutex_lock(&addrinfo_cache_lock);
+	if (addrinfo_cache == NULL)
+		addrinfo_cache = g_hash_table_new_full(g_str_hash, g_str_equal, g_free,
+						       (GDestroyNotify) addrinfo_cached_free);
+	g_hash_table_replace(addrinfo_cache, key, cached);
+	g_static_mutex_unlock(&addrinfo_cache_lock);
+}
+
+/**
+ * camel_getaddrinfo_flush:
+ *
+ * Forget all cached host lookups, for example because the network
+ * connection changed.
+ **/
+void
+camel_getaddrinfo_flush(void)
+{
+	g_static_mutex_lock(&addrinfo_cache_lock);
+	if (addrinfo_cache)
+		g_hash_table_remove_all(addrinfo_cache);
+	g_static_mutex_unlock(&addrinfo_cache_lock);
+}
+
+/**
+ * camel_getaddrinfo:
+ * @name: the host to look up
+ * @service: the service or port, or %NULL
+ * @hints: hints for getaddrinfo, or %NULL
+ * @ex: a #CamelException
+ *
+ * Look up @name like getaddrinfo does, in a thread that can be cancelled.
+ * Successful lookups are cached for a few minutes, for all services.
+ *
+ * Returns the addresses, to be freed with camel_freeaddrinfo(), or %NULL
+ **/
 struct addrinfo *
 camel_getaddrinfo(const char *name, const char *service, const struct addrinfo *hints, CamelException *ex)
 {
 	struct _addrinfo_msg *msg;
 	struct addrinfo *res = NULL;
+	char *key;
 #ifndef ENABLE_IPv6
 	struct addrinfo myhints;
 #endif
@@ -701,8 +842,6 @@ camel_getaddrinfo(const char *name, const char *service, const struct addrinfo *
 		return NULL;
 	}*/
 
-	camel_operation_start_transient(NULL, _("Resolving: %s"), name);
-
 	/* force ipv4 addresses only */
 #ifndef ENABLE_IPv6
 	if (hints == NULL)
@@ -714,6 +853,14 @@ camel_getaddrinfo(const char *name, const char *service, const struct addrinfo *
 	hints = &myhints;
 #endif
 
+	key = addrinfo_cache_key(name, service, hints);
+	if ((res = addrinfo_cache_lookup(key))) {
+		g_free(key);
+		return res;
+	}
+
+	camel_operation_start_transient(NULL, _("Resolving: %s"), name);
+
 	msg = g_malloc0(sizeof(*msg));
 	msg->name = name;
 	msg->service = service;
@@ -733,6 +880,20 @@ camel_getaddrinfo(const char *name, const char *service, const struct addrinfo *
 	} else
 		res = NULL;
 
+#ifndef NEED_ADDRINFO
+	if (res) {
+		struct addrinfo *sys = res;
+
+		res = addrinfo_copy(sys);
+		freeaddrinfo(sys);
+	}
+#endif
+
+	if (res)
+		addrinfo_cache_add(key, res);
+	else
+		g_free(key);
+
 	camel_operation_end(NULL);
 
 	return res;
@@ -741,19 +902,239 @@ camel_getaddrinfo(const char *name, const char *service, const struct addrinfo *
 void
 camel_freeaddrinfo(struct addrinfo *host)
 {
-#ifdef NEED_ADDRINFO
-	while (host) {
-		struct addrinfo *next = host->ai_next;
+	addrinfo_free(host);
+}
 
-		g_free(host->ai_canonname);
-		g_free(host->ai_addr);
-		g_free(host);
-		host = next;
+#ifndef G_OS_WIN32
+static glong
+now_ms(void)
+{
+	GTimeVal tv;
+
+	g_get_current_time(&tv);
+
+	return tv.tv_sec * 1000 + tv.tv_usec / 1000;
+}
+
+/* The order to try the addresses in: the first one, then one of the other
+ * family, and so on alternating, like RFC 8305 section 4 */
+static struct addrinfo **
+race_order(struct addrinfo *host, int *count)
+{
+	struct addrinfo **first, **other, **res;
+	int nfirst = 0, nother = 0, i, n = 0;
+	struct addrinfo *ai;
+
+	for (ai = host;ai;ai = ai->ai_next)
+		n++;
+
+	first = g_new(struct addrinfo *, n);
+	other = g_new(struct addrinfo *, n);
+	res = g_new(struct addrinfo *, n);
+
+	for (ai = host;ai;ai = ai->ai_next) {
+		if (ai->ai_socktype != SOCK_STREAM)
+			continue;
+		if (ai->ai_family == host->ai_family)
+			first[nfirst++] = ai;
+		else
+			other[nother++] = ai;
 	}
-#else
-	freeaddrinfo(host);
-#endif
+
+	for (i = 0, n = 0;i < nfirst || i < nother;i++) {
+		if (i < nfirst)
+			res[n++] = first[i];
+		if (i < nother)
+			res[n++] = other[i];
+	}
+
+	g_free(first);
+	g_free(other);
+	*count = n;
+
+	return res;
+}
+
+/* Starts a non-blocking connect, returns the socket or -1 */
+static int
+race_start(struct addrinfo *ai)
+{
+	int fd, errnosav;
+
+	if ((fd = socket(ai->ai_family, SOCK_STREAM, 0)) == -1)
+		return -1;
+
+	fcntl(fd, F_SETFL, fcntl(fd, F_GETFL) | O_NONBLOCK);
+
+	if (connect(fd, ai->ai_addr, ai->ai_addrlen) == 0 || errno == EINPROGRESS)
+		return fd;
+
+	errnosav = errno;
+	close(fd);
+	errno = errnosav;
+
+	return -1;
+}
+
+/**
+ * camel_tcp_connect:
+ * @host: the addresses to connect to, from camel_getaddrinfo()
+ *
+ * Connect to one of the addresses in @host. Rather than trying them one by
+ * one and waiting for each to time out, a connection attempt is started
+ * every 250 ms, alternating between IPv6 and IPv4, while the earlier ones
+ * keep running. The first one that connects is used, the others are closed.
+ * On Win32 the addresses are tried one by one.
+ *
+ * This is cancellable with camel_operation_cancel().
+ *
+ * Returns a connected, blocking socket, or -1 with errno set. errno is
+ * EINTR if the connect was cancelled.
+ **/
+int
+camel_tcp_connect(struct addrinfo *host)
+{
+	struct addrinfo **addrs;
+	struct pollfd *polls;
+	int count, started = 0, pending = 0, fd = -1, err = ETIMEDOUT, i;
+	glong next_start, deadline = 0;
+
+	if (camel_operation_cancel_check(NULL)) {
+		errno = EINTR;
+		return -1;
+	}
+
+	addrs = race_order(host, &count);
+	if (count == 0) {
+		g_free(addrs);
+		errno = EINVAL;
+		return -1;
+	}
+
+	/* polls[0] is for cancelling, poll skips it if there's no cancel fd */
+	polls = g_new0(struct pollfd, count + 1);
+	polls[0].fd = camel_operation_cancel_fd(NULL);
+	polls[0].events = POLLIN;
+
+	next_start = now_ms();
+
+	while (fd == -1) {
+		glong now = now_ms();
+		int timeout, status;
+
+		/* start the next attempt when its time came, or right away
+		 * when all earlier ones failed */
+		if (started < count && (pending == 0 || now >= next_start)) {
+			polls[started + 1].fd = race_start(addrs[started]);
+			polls[started + 1].events = POLLOUT;
+			if (polls[started + 1].fd == -1)
+				err = errno;
+			else {
+				pending++;
+				next_start = now + CONNECTION_ATTEMPT_DELAY;
+				deadline = now + CONNECT_TIMEOUT * 1000;
+			}
+			started++;
+			continue;
+		}
+
+		if (pending == 0)
+			break;
+
+		if (now >= deadline) {
+			err = ETIMEDOUT;
+			break;
+		}
+
+		timeout = deadline - now;
+		if (started < count && next_start - now < timeout)
+			timeout = next_start - now;
+
+		status = poll(polls, started + 1, timeout);
+		if (status == -1) {
+			if (errno == EINTR)
+				continue;
+			err = errno;
+			break;
+		}
+
+		if (polls[0].revents & POLLIN) {
+			err = EINTR;
+			break;
+		}
+
+		for (i = 1;i <= started && fd == -1;i++) {
+			socklen_t len = sizeof(int);
+			int ret;
+
+			if (polls[i].fd == -1 || polls[i].revents == 0)
+				continue;
+
+			if (getsockopt(polls[i].fd, SOL_SOCKET, SO_ERROR, &ret, &len) == -1)
+				ret = errno;
+
+			if (ret == 0) {
+				fd = polls[i].fd;
+			} else {
+				close(polls[i].fd);
+				err = ret;
+				pending--;
+			}
+			polls[i].fd = -1;
+		}
+	}
+
+	for (i = 1;i <= started;i++)
+		if (polls[i].fd != -1)
+			close(polls[i].fd);
+
+	g_free(polls);
+	g_free(addrs);
+
+	if (fd == -1) {
+		errno = err;
+		return -1;
+	}
+
+	fcntl(fd, F_SETFL, fcntl(fd, F_GETFL) & ~O_NONBLOCK);
+
+	return fd;
+}
+#else /* G_OS_WIN32 */
+
+/* Without poll() the addresses are tried one after the other with a plain
+ * blocking connect, a cancel is only noticed in between */
+int
+camel_tcp_connect(struct addrinfo *host)
+{
+	struct addrinfo *ai;
+	int fd;
+
+	for (ai = host;ai;ai = ai->ai_next) {
+		if (camel_operation_cancel_check(NULL)) {
+			errno = EINTR;
+			return -1;
+		}
+
+		if (ai->ai_socktype != SOCK_STREAM)
+			continue;
+
+		fd = socket(ai->ai_family, SOCK_STREAM, 0);
+		if (fd == -1)
+			continue;
+
+		if (connect(fd, ai->ai_addr, ai->ai_addrlen) == 0)
+			return fd;
+
+		closesocket(fd);
+	}
+
+	/* errno means nothing after a failed Winsock call */
+	errno = ETIMEDOUT;
+
+	return -1;
 }
+#endif /* G_OS_WIN32 */
 
 #ifdef NEED_ADDRINFO
 static void *
@@ -88,6 +88,8 @@ struct addrinfo {
 struct addrinfo *camel_getaddrinfo(const char *name, const char *service,
 				   const struct addrinfo *hints, struct _CamelException *ex);
 void camel_freeaddrinfo(struct addrinfo *host);
+void camel_getaddrinfo_flush(void);
+int camel_tcp_connect(struct addrinfo *host);
 int camel_getnameinfo(const struct sockaddr *sa, socklen_t salen, char **host, char **serv,
 		      int flags, struct _CamelException *ex);
 
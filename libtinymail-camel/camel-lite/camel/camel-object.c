@@ -38,6 +38,7 @@
 
 #include "camel-file-utils.h"
 #include "camel-object.h"
+#include "camel-private.h"
 
 #define d(x)
 #define b(x) 			/* object bag */
@@ -860,12 +861,8 @@ camel_object_ref(void *vo)
 	if (o->flags & CAMEL_OBJECT_REF_DEBUG)
 		printf ("An object of the type that you are debugging got referenced\n");
 
-	REF_LOCK();
-
-	o->ref_count++;
+	g_atomic_int_inc(&o->ref_count);
 	d(printf("%p: ref %s(%d)\n", o, o->klass->name, o->ref_count));
-
-	REF_UNLOCK();
 }
 
 void
@@ -882,16 +879,22 @@ camel_object_unref(void *vo)
 	if (o->flags & CAMEL_OBJECT_REF_DEBUG)
 		printf ("An object of the type that you are debugging got unreferenced\n");
 
+	if (camel_ref_count_dec_unless_last(&o->ref_count)) {
+		d(printf("%p: unref %s(%d)\n", o, o->klass->name, o->ref_count));
+		return;
+	}
+
+	/* This might be the last reference. The rest is done under the
+	 * ref_lock, so that a bag can't hand the object out again while it
+	 * gets removed from it */
 	if (o->hooks)
 		hooks = camel_object_get_hooks(o);
 
 	REF_LOCK();
 
-	o->ref_count--;
-
-	d(printf("%p: unref %s(%d)\n", o, o->klass->name, o->ref_count));
+	d(printf("%p: unref %s(%d)\n", o, o->klass->name, o->ref_count - 1));
 
-	if (o->ref_count > 0
+	if (!g_atomic_int_dec_and_test(&o->ref_count)
 	    || (o->flags & CAMEL_OBJECT_DESTROY)) {
 		REF_UNLOCK();
 		if (hooks)
@@ -2057,7 +2060,7 @@ camel_object_bag_get(CamelObjectBag *bag, const void *key)
 		b(printf("object bag get '%s' = %p\n", (char *)key, o));
 
 		/* we use the same lock as the refcount */
-		o->ref_count++;
+		g_atomic_int_inc(&o->ref_count);
 	} else {
 		struct _CamelObjectBagKey *res = bag->reserved;
 
@@ -2079,7 +2082,7 @@ camel_object_bag_get(CamelObjectBag *bag, const void *key)
 			/* re-check if it slipped in */
 			o = g_hash_table_lookup(bag->object_table, key);
 			if (o)
-				o->ref_count++;
+				g_atomic_int_inc(&o->ref_count);
 
 			b(printf("object bag get '%s', finished waiting, got %p\n", (char *)key, o));
 
@@ -2120,7 +2123,7 @@ camel_object_bag_peek(CamelObjectBag *bag, const void *key)
 	o = g_hash_table_lookup(bag->object_table, key);
 	if (o) {
 		/* we use the same lock as the refcount */
-		o->ref_count++;
+		g_atomic_int_inc(&o->ref_count);
 	}
 
 	REF_UNLOCK();
@@ -2155,7 +2158,7 @@ camel_object_bag_reserve(CamelObjectBag *bag, const void *key)
 
 	o = g_hash_table_lookup(bag->object_table, key);
 	if (o) {
-		o->ref_count++;
+		g_atomic_int_inc(&o->ref_count);
 	} else {
 		struct _CamelObjectBagKey *res = bag->reserved;
 
@@ -2175,7 +2178,7 @@ camel_object_bag_reserve(CamelObjectBag *bag, const void *key)
 			o = g_hash_table_lookup(bag->object_table, key);
 			if (o) {
 				b(printf("finished wait, someone else created '%s' = %p\n", (char *)key, o));
-				o->ref_count++;
+				g_atomic_int_inc(&o->ref_count);
 				/* in which case we dont need to reserve the bag either */
 				res->owner = pthread_self();
 				res->have_owner = TRUE;
@@ -2256,7 +2259,7 @@ static void
 save_bag(void *key, CamelObject *o, GPtrArray *list)
 {
 	/* we have the refcount lock already */
-	o->ref_count++;
+	g_atomic_int_inc(&o->ref_count);
 	g_ptr_array_add(list, o);
 }
 
@@ -120,8 +120,9 @@ struct _CamelObject {
 	/* current hooks on this object */
 	struct _CamelHookList *hooks;
 
-	guint32 ref_count:24;
-	guint32 flags:8;
+	/* only touched with the g_atomic_int functions */
+	volatile gint ref_count;
+	guint32 flags;
 };
 
 struct _CamelObjectClass
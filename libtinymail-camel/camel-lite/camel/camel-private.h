@@ -38,6 +38,23 @@
 
 G_BEGIN_DECLS
 
+/* Drops a reference from @count without any lock, unless it might be the
+ * last one. Returns FALSE in that case, and the caller has to take its lock
+ * and do the decrement itself */
+static inline gboolean
+camel_ref_count_dec_unless_last (volatile gint *count)
+{
+	gint old;
+
+	do {
+		old = g_atomic_int_get (count);
+		if (old <= 1)
+			return FALSE;
+	} while (!g_atomic_int_compare_and_exchange (count, old, old - 1));
+
+	return TRUE;
+}
+
 struct _CamelFolderPrivate {
 	GStaticRecMutex lock;
 	GStaticMutex change_lock;
@@ -132,6 +149,17 @@ struct _CamelFolderSummaryPrivate {
 	GMutex *filter_lock;	/* for accessing any of the filtering/indexing stuff, since we share them */
 	GMutex *alloc_lock;	/* for setting up and using allocators */
 	GMutex *ref_lock;	/* for reffing/unreffing messageinfo's ALWAYS obtain before summary_lock */
+
+	GArray *records;	/* where each saved record is on disk, see camel_folder_summary_save */
+	gboolean records_valid;	/* records matches the start of the messages array */
+	guint32 records_end;	/* file offset right after the last saved record */
+	guint32 header_len;	/* length of the header as it is on disk */
+
+	GStaticRecMutex map_lock;	/* held while the infos get pointed into a new mapping */
+	struct _CamelFolderSummaryMap *map;	/* current mapping of the summary file */
+	GSList *retired_maps;	/* mappings that a reload replaced, see summary_maps_reclaim */
+	GSList *pinned_maps;	/* mappings that a failed reload left infos pointing into */
+	gint info_refs;		/* references to infos of this summary, its own included */
 };
 
 #define CAMEL_SUMMARY_LOCK(f, l) \
@@ -0,0 +1,311 @@
+/* -*- Mode: C; tab-width: 8; indent-tabs-mode: t; c-basic-offset: 8 -*- */
+/*
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of version 2 of the GNU Lesser General Public
+ * License as published by the Free Software Foundation.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this program; if not, write to the
+ * Free Software Foundation, Inc., 51 Franklin Street, Fifth Floor,
+ * Boston, MA 02110-1301, USA.
+ *
+ */
+
+#ifdef HAVE_CONFIG_H
+#include <config.h>
+#endif
+
+#include <errno.h>
+#include <string.h>
+
+#include "camel-tcp-stream-deflate.h"
+
+#define DEFLATE_BUFFER_SIZE 4096
+
+static CamelTcpStreamClass *parent_class = NULL;
+
+static ssize_t stream_read (CamelStream *stream, char *buffer, size_t n);
+static ssize_t stream_write (CamelStream *stream, const char *buffer, size_t n);
+static int stream_flush  (CamelStream *stream);
+static int stream_close  (CamelStream *stream);
+static gboolean stream_eos (CamelStream *stream);
+
+static int stream_connect (CamelTcpStream *stream, struct addrinfo *host);
+static int stream_getsockopt (CamelTcpStream *stream, CamelSockOptData *data);
+static int stream_setsockopt (CamelTcpStream *stream, const CamelSockOptData *data);
+static struct sockaddr *stream_get_local_address (CamelTcpStream *stream, socklen_t *len);
+static struct sockaddr *stream_get_remote_address (CamelTcpStream *stream, socklen_t *len);
+static ssize_t stream_read_nb (CamelTcpStream *stream, char *buffer, size_t n);
+static int stream_gettimeout (CamelTcpStream *stream);
+
+static void
+camel_tcp_stream_deflate_class_init (CamelTcpStreamDeflateClass *camel_tcp_stream_deflate_class)
+{
+	CamelTcpStreamClass *camel_tcp_stream_class =
+		CAMEL_TCP_STREAM_CLASS (camel_tcp_stream_deflate_class);
+	CamelStreamClass *camel_stream_class =
+		CAMEL_STREAM_CLASS (camel_tcp_stream_deflate_class);
+
+	parent_class = CAMEL_TCP_STREAM_CLASS (camel_type_get_global_classfuncs (camel_tcp_stream_get_type ()));
+
+	/* virtual method overload */
+	camel_stream_class->read = stream_read;
+	camel_stream_class->write = stream_write;
+	camel_stream_class->flush = stream_flush;
+	camel_stream_class->close = stream_close;
+	camel_stream_class->eos = stream_eos;
+
+	camel_tcp_stream_class->gettimeout = stream_gettimeout;
+	camel_tcp_stream_class->read_nb = stream_read_nb;
+	camel_tcp_stream_class->connect = stream_connect;
+	camel_tcp_stream_class->getsockopt = stream_getsockopt;
+	camel_tcp_stream_class->setsockopt  = stream_setsockopt;
+	camel_tcp_stream_class->get_local_address  = stream_get_local_address;
+	camel_tcp_stream_class->get_remote_address = stream_get_remote_address;
+}
+
+static void
+camel_tcp_stream_deflate_init (gpointer object, gpointer klass)
+{
+	CamelTcpStreamDeflate *stream = CAMEL_TCP_STREAM_DEFLATE (object);
+
+	stream->real = NULL;
+	stream->inbuf = g_malloc (DEFLATE_BUFFER_SIZE);
+	stream->outbuf = g_malloc (DEFLATE_BUFFER_SIZE);
+	stream->inflate_pending = FALSE;
+}
+
+static void
+camel_tcp_stream_deflate_finalize (CamelObject *object)
+{
+	CamelTcpStreamDeflate *stream = CAMEL_TCP_STREAM_DEFLATE (object);
+
+	if (stream->real) {
+		inflateEnd (&stream->inflater);
+		deflateEnd (&stream->deflater);
+		camel_object_unref (stream->real);
+	}
+
+	g_free (stream->inbuf);
+	g_free (stream->outbuf);
+}
+
+
+CamelType
+camel_tcp_stream_deflate_get_type (void)
+{
+	static CamelType type = CAMEL_INVALID_TYPE;
+
+	if (type == CAMEL_INVALID_TYPE) {
+		type = camel_type_register (camel_tcp_stream_get_type (),
+					    "CamelTcpStreamDeflate",
+					    sizeof (CamelTcpStreamDeflate),
+					    sizeof (CamelTcpStreamDeflateClass),
+					    (CamelObjectClassInitFunc) camel_tcp_stream_deflate_class_init,
+					    NULL,
+					    (CamelObjectInitFunc) camel_tcp_stream_deflate_init,
+					    (CamelObjectFinalizeFunc) camel_tcp_stream_deflate_finalize);
+	}
+
+	return type;
+}
+
+/**
+ * camel_tcp_stream_deflate_new:
+ * @real: a connected #CamelTcpStream
+ * @level: the zlib compression level for what is written
+ *
+ * Create a new #CamelTcpStreamDeflate object that compresses what is
+ * written to it and decompresses what is read from it, and reads and
+ * writes @real for that. Both directions are raw deflate without zlib
+ * or gzip framing, as with camel_stream_gzip_new().
+ *
+ * Returns a new #CamelTcpStream object, or %NULL if zlib could not be
+ * set up
+ **/
+CamelStream *
+camel_tcp_stream_deflate_new (CamelTcpStream *real, int level)
+{
+	CamelTcpStreamDeflate *stream;
+
+	g_return_val_if_fail (CAMEL_IS_TCP_STREAM (real), NULL);
+
+	stream = CAMEL_TCP_STREAM_DEFLATE (camel_object_new (camel_tcp_stream_deflate_get_type ()));
+
+	memset (&stream->inflater, 0, sizeof (z_stream));
+	memset (&stream->deflater, 0, sizeof (z_stream));
+
+	if (inflateInit2 (&stream->inflater, -MAX_WBITS) != Z_OK) {
+		camel_object_unref (stream);
+		return NULL;
+	}
+
+	if (deflateInit2 (&stream->deflater, level, Z_DEFLATED, -MAX_WBITS,
+			  8, Z_DEFAULT_STRATEGY) != Z_OK) {
+		inflateEnd (&stream->inflater);
+		camel_object_unref (stream);
+		return NULL;
+	}
+
+	camel_object_ref (real);
+	stream->real = real;
+
+	return CAMEL_STREAM (stream);
+}
+
+/* Inflates into buffer until there's at least one byte for the caller. In
+ * non-blocking mode only one read of the real stream is tried, a partial
+ * deflate block is kept in inbuf for the next call */
+static ssize_t
+inflate_read (CamelTcpStreamDeflate *stream, char *buffer, size_t n, gboolean nb)
+{
+	z_stream *z = &stream->inflater;
+	gboolean did_read = FALSE;
+	ssize_t nread;
+	int retval;
+
+	if (n == 0)
+		return 0;
+
+	z->next_out = (Bytef *) buffer;
+	z->avail_out = n;
+
+	for (;;) {
+		if (z->avail_in == 0 && !stream->inflate_pending) {
+			if (nb && did_read) {
+				errno = EAGAIN;
+				return -1;
+			}
+
+			if (nb)
+				nread = camel_tcp_stream_read_nb (stream->real, stream->inbuf, DEFLATE_BUFFER_SIZE);
+			else
+				nread = camel_stream_read (CAMEL_STREAM (stream->real), stream->inbuf, DEFLATE_BUFFER_SIZE);
+
+			if (nread <= 0)
+				return nread;
+
+			did_read = TRUE;
+			z->next_in = (Bytef *) stream->inbuf;
+			z->avail_in = nread;
+		}
+
+		retval = inflate (z, Z_SYNC_FLUSH);
+		if (retval != Z_OK && retval != Z_BUF_ERROR) {
+			errno = EIO;
+			return -1;
+		}
+
+		/* With the output full, inflate may still have more without
+		 * needing any input */
+		stream->inflate_pending = (z->avail_out == 0);
+
+		if (z->avail_out < n)
+			return n - z->avail_out;
+	}
+}
+
+static ssize_t
+stream_read (CamelStream *stream, char *buffer, size_t n)
+{
+	return inflate_read (CAMEL_TCP_STREAM_DEFLATE (stream), buffer, n, FALSE);
+}
+
+static ssize_t
+stream_read_nb (CamelTcpStream *stream, char *buffer, size_t n)
+{
+	return inflate_read (CAMEL_TCP_STREAM_DEFLATE (stream), buffer, n, TRUE);
+}
+
+static ssize_t
+stream_write (CamelStream *stream, const char *buffer, size_t n)
+{
+	CamelTcpStreamDeflate *deflater = CAMEL_TCP_STREAM_DEFLATE (stream);
+	z_stream *z = &deflater->deflater;
+	size_t len;
+
+	z->next_in = (Bytef *) buffer;
+	z->avail_in = n;
+
+	/* Nobody calls flush after writing a command, so every write has
+	 * to be flushed out to the peer by itself */
+	do {
+		z->next_out = (Bytef *) deflater->outbuf;
+		z->avail_out = DEFLATE_BUFFER_SIZE;
+
+		if (deflate (z, Z_SYNC_FLUSH) == Z_STREAM_ERROR) {
+			errno = EIO;
+			return -1;
+		}
+
+		len = DEFLATE_BUFFER_SIZE - z->avail_out;
+		if (len > 0 && camel_stream_write (CAMEL_STREAM (deflater->real), deflater->outbuf, len) == -1)
+			return -1;
+	} while (z->avail_out == 0);
+
+	return n;
+}
+
+static int
+stream_flush (CamelStream *stream)
+{
+	return camel_stream_flush (CAMEL_STREAM (CAMEL_TCP_STREAM_DEFLATE (stream)->real));
+}
+
+static int
+stream_close (CamelStream *stream)
+{
+	return camel_stream_close (CAMEL_STREAM (CAMEL_TCP_STREAM_DEFLATE (stream)->real));
+}
+
+static gboolean
+stream_eos (CamelStream *stream)
+{
+	CamelTcpStreamDeflate *deflater = CAMEL_TCP_STREAM_DEFLATE (stream);
+
+	if (deflater->inflater.avail_in > 0 || deflater->inflate_pending)
+		return FALSE;
+
+	return camel_stream_eos (CAMEL_STREAM (deflater->real));
+}
+
+static int
+stream_connect (CamelTcpStream *stream, struct addrinfo *host)
+{
+	return camel_tcp_stream_connect (CAMEL_TCP_STREAM_DEFLATE (stream)->real, host);
+}
+
+static int
+stream_getsockopt (CamelTcpStream *stream, CamelSockOptData *data)
+{
+	return camel_tcp_stream_getsockopt (CAMEL_TCP_STREAM_DEFLATE (stream)->real, data);
+}
+
+static int
+stream_setsockopt (CamelTcpStream *stream, const CamelSockOptData *data)
+{
+	return camel_tcp_stream_setsockopt (CAMEL_TCP_STREAM_DEFLATE (stream)->real, data);
+}
+
+static struct sockaddr *
+stream_get_local_address (CamelTcpStream *stream, socklen_t *len)
+{
+	return camel_tcp_stream_get_local_address (CAMEL_TCP_STREAM_DEFLATE (stream)->real, len);
+}
+
+static struct sockaddr *
+stream_get_remote_address (CamelTcpStream *stream, socklen_t *len)
+{
+	return camel_tcp_stream_get_remote_address (CAMEL_TCP_STREAM_DEFLATE (stream)->real, len);
+}
+
+static int
+stream_gettimeout (CamelTcpStream *stream)
+{
+	return camel_tcp_stream_gettimeout (CAMEL_TCP_STREAM_DEFLATE (stream)->real);
+}
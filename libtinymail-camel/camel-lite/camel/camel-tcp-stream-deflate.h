@@ -0,0 +1,65 @@
+/* -*- Mode: C; tab-width: 8; indent-tabs-mode: t; c-basic-offset: 8 -*- */
+/*
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of version 2 of the GNU Lesser General Public
+ * License as published by the Free Software Foundation.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this program; if not, write to the
+ * Free Software Foundation, Inc., 51 Franklin Street, Fifth Floor,
+ * Boston, MA 02110-1301, USA.
+ *
+ */
+
+
+#ifndef CAMEL_TCP_STREAM_DEFLATE_H
+#define CAMEL_TCP_STREAM_DEFLATE_H
+
+#include <zlib.h>
+
+#include <camel/camel-tcp-stream.h>
+
+#define CAMEL_TCP_STREAM_DEFLATE_TYPE     (camel_tcp_stream_deflate_get_type ())
+#define CAMEL_TCP_STREAM_DEFLATE(obj)     (CAMEL_CHECK_CAST((obj), CAMEL_TCP_STREAM_DEFLATE_TYPE, CamelTcpStreamDeflate))
+#define CAMEL_TCP_STREAM_DEFLATE_CLASS(k) (CAMEL_CHECK_CLASS_CAST ((k), CAMEL_TCP_STREAM_DEFLATE_TYPE, CamelTcpStreamDeflateClass))
+#define CAMEL_IS_TCP_STREAM_DEFLATE(o)    (CAMEL_CHECK_TYPE((o), CAMEL_TCP_STREAM_DEFLATE_TYPE))
+
+G_BEGIN_DECLS
+
+/* A raw deflate (RFC 1951) layer on top of a connected CamelTcpStream,
+ * like the IMAP COMPRESS=DEFLATE extension (RFC 4978) wants it. It's a
+ * CamelTcpStream itself so that read_nb and the socket options still
+ * work on what's on top of it */
+
+struct _CamelTcpStreamDeflate
+{
+	CamelTcpStream parent_object;
+
+	CamelTcpStream *real;
+
+	z_stream inflater, deflater;
+	char *inbuf, *outbuf;
+	gboolean inflate_pending;
+};
+
+typedef struct {
+	CamelTcpStreamClass parent_class;
+
+	/* virtual functions */
+
+} CamelTcpStreamDeflateClass;
+
+/* Standard Camel function */
+CamelType camel_tcp_stream_deflate_get_type (void);
+
+/* public methods */
+CamelStream *camel_tcp_stream_deflate_new (CamelTcpStream *real, int level);
+
+G_END_DECLS
+
+#endif /* CAMEL_TCP_STREAM_DEFLATE_H */
@@ -47,6 +47,7 @@
 
 #include "camel-certdb.h"
 #include "camel-file-utils.h"
+#include "camel-net-utils.h"
 #include "camel-operation.h"
 #include "camel-service.h"
 #include "camel-session.h"
@@ -92,6 +93,12 @@ struct CRYPTO_dynlock_value {
 
 static pthread_mutex_t *mutex_buf = NULL;
 
+/* The last session with each host:port, so that reconnects and extra
+ * connections to the same server can resume it */
+static GHashTable *session_cache = NULL;
+static GStaticMutex session_cache_lock = G_STATIC_MUTEX_INIT;
+static volatile gint handshakes_full = 0, handshakes_resumed = 0;
+
 
 static void 
 openssl_enable_compress (CamelTcpStream *stream)
@@ -706,90 +713,6 @@ stream_close (CamelStream *stream)
 	return 0;
 }
 
-/* this is a 'cancellable' connect, cancellable from camel_operation_cancel etc */
-/* returns -1 & errno == EINTR if the connection was cancelled */
-static int
-socket_connect (struct addrinfo *host)
-{
-	struct sockaddr *saddr = host->ai_addr;
-	struct timeval tv;
-	int cancel_fd;
-	int ret, fd;
-
-	/* see if we're cancelled yet */
-	if (camel_operation_cancel_check (NULL)) {
-		errno = EINTR;
-		return -1;
-	}
-
-	fd = socket (host->ai_family, SOCK_STREAM, 0);
-
-	cancel_fd = camel_operation_cancel_fd (NULL);
-	if (cancel_fd == -1) {
-		ret = connect (fd, saddr, sizeof (struct sockaddr));
-		if (ret == -1) {
-			close (fd);
-			return -1;
-		}
-
-		return fd;
-	} else {
-		fd_set rdset, wrset;
-		int flags, fdmax;
-
-		flags = fcntl (fd, F_GETFL);
-		fcntl (fd, F_SETFL, flags | O_NONBLOCK);
-
-		ret = connect (fd, saddr, sizeof (struct sockaddr));
-		if (ret == 0) {
-			fcntl (fd, F_SETFL, flags);
-			return fd;
-		}
-
-		if (errno != EINPROGRESS) {
-			close (fd);
-			return -1;
-		}
-
-		FD_ZERO (&rdset);
-		FD_ZERO (&wrset);
-		FD_SET (fd, &wrset);
-		FD_SET (cancel_fd, &rdset);
-		fdmax = MAX (fd, cancel_fd) + 1;
-		tv.tv_usec = 0;
-		tv.tv_sec = CONNECT_TIMEOUT;
-
-		if (select (fdmax, &rdset, &wrset, 0, &tv) == 0) {
-			close (fd);
-			errno = ETIMEDOUT;
-			return -1;
-		}
-
-		if (cancel_fd != -1 && FD_ISSET (cancel_fd, &rdset)) {
-			close (fd);
-			errno = EINTR;
-			return -1;
-		} else {
-			socklen_t len = sizeof (int);
-
-			if (getsockopt (fd, SOL_SOCKET, SO_ERROR, &ret, &len) == -1) {
-				close (fd);
-				return -1;
-			}
-
-			if (ret != 0) {
-				close (fd);
-				errno = ret;
-				return -1;
-			}
-		}
-
-		fcntl (fd, F_SETFL, flags);
-	}
-
-	return fd;
-}
-
 static const char *
 x509_strerror (int err)
 {
@@ -952,11 +875,51 @@ ssl_verify (int ok, X509_STORE_CTX *ctx)
 	return ok;
 }
 
+/**
+ * camel_tcp_stream_ssl_get_handshake_counts:
+ * @full: return location for the number of full handshakes, or %NULL
+ * @resumed: return location for the number of resumed handshakes, or %NULL
+ *
+ * Get how many SSL handshakes were done since startup, and how many of them
+ * resumed an earlier session with the same host and port.
+ **/
+void
+camel_tcp_stream_ssl_get_handshake_counts (guint *full, guint *resumed)
+{
+	if (full)
+		*full = g_atomic_int_get (&handshakes_full);
+	if (resumed)
+		*resumed = g_atomic_int_get (&handshakes_resumed);
+}
+
+static char *
+session_key (CamelTcpStreamSSL *openssl, int sockfd)
+{
+	struct sockaddr_storage peer;
+	socklen_t len = sizeof (peer);
+	int port;
+
+	if (getpeername (sockfd, (struct sockaddr *) &peer, &len) == -1)
+		return NULL;
+
+	if (peer.ss_family == AF_INET)
+		port = ntohs (((struct sockaddr_in *) &peer)->sin_port);
+#ifdef ENABLE_IPv6
+	else if (peer.ss_family == AF_INET6)
+		port = ntohs (((struct sockaddr_in6 *) &peer)->sin6_port);
+#endif
+	else
+		return NULL;
+
+	return g_strdup_printf ("%s:%d", openssl->priv->expected_host, port);
+}
+
 static SSL *
 open_ssl_connection (CamelSession *session, int sockfd, CamelTcpStreamSSL *openssl)
 {
 	SSL_CTX *ssl_ctx = NULL;
 	SSL *ssl = NULL;
+	char *key;
 	int n;
 
 	/* SSLv23_client_method will negotiate with SSL v2, v3, or TLS v1 */
@@ -970,7 +933,42 @@ open_ssl_connection (CamelSession *session, int sockfd, CamelTcpStreamSSL *opens
 
 	SSL_CTX_set_app_data (ssl_ctx, openssl);
 
+	key = session_key (openssl, sockfd);
+	if (key) {
+		g_static_mutex_lock (&session_cache_lock);
+		if (session_cache) {
+			SSL_SESSION *cached = g_hash_table_lookup (session_cache, key);
+			if (cached)
+				SSL_set_session (ssl, cached);
+		}
+		g_static_mutex_unlock (&session_cache_lock);
+	}
+
 	n = SSL_connect (ssl);
+
+	if (n == 1) {
+		if (SSL_session_reused (ssl))
+			g_atomic_int_inc (&handshakes_resumed);
+		else
+			g_atomic_int_inc (&handshakes_full);
+	}
+
+	/* Keep the new session, or forget one that didn't work out */
+	if (key) {
+		g_static_mutex_lock (&session_cache_lock);
+		if (session_cache == NULL)
+			session_cache = g_hash_table_new_full (g_str_hash, g_str_equal,
+				g_free, (GDestroyNotify) SSL_SESSION_free);
+		if (n == 1 && !SSL_session_reused (ssl))
+			g_hash_table_replace (session_cache, key, SSL_get1_session (ssl));
+		else {
+			if (n != 1)
+				g_hash_table_remove (session_cache, key);
+			g_free (key);
+		}
+		g_static_mutex_unlock (&session_cache_lock);
+	}
+
 	if (n != 1) {
 		int errnosave = ssl_errno (ssl, n);
 
@@ -990,7 +988,8 @@ open_ssl_connection (CamelSession *session, int sockfd, CamelTcpStreamSSL *opens
 	return ssl;
 }
 
-static int stream_connect_do (CamelTcpStream *stream, struct addrinfo *host)
+static int
+stream_connect (CamelTcpStream *stream, struct addrinfo *host)
 {
 	CamelTcpStreamSSL *openssl = CAMEL_TCP_STREAM_SSL (stream);
 	SSL *ssl = NULL;
@@ -998,14 +997,16 @@ static int stream_connect_do (CamelTcpStream *stream, struct addrinfo *host)
 
 	g_return_val_if_fail (host != NULL, -1);
 
-	fd = socket_connect (host);
+	fd = camel_tcp_connect (host);
 	if (fd == -1)
 		return -1;
 
 	if (openssl->priv->ssl_mode) {
 		ssl = open_ssl_connection (openssl->priv->session, fd, openssl);
-		if (!ssl)
+		if (!ssl) {
+			close (fd);
 			return -1;
+		}
 	}
 
 	openssl->priv->sockfd = fd;
@@ -1014,18 +1015,6 @@ static int stream_connect_do (CamelTcpStream *stream, struct addrinfo *host)
 	return 0;
 }
 
-static int
-stream_connect (CamelTcpStream *stream, struct addrinfo *host)
-{
-	while (host) {
-		if (stream_connect_do (stream, host) == 0)
-			return 0;
-		host = host->ai_next;
-	}
-
-	return -1;
-}
-
 
 static int
 get_sockopt_level (const CamelSockOptData *data)
@@ -35,6 +35,7 @@
 #include <sys/socket.h>
 
 #include "camel-file-utils.h"
+#include "camel-net-utils.h"
 #include "camel-operation.h"
 #include "camel-tcp-stream-raw.h"
 
@@ -305,189 +306,6 @@ stream_close (CamelStream *stream)
 	return 0;
 }
 
-static int 
-connect_timeout (int soc, const struct sockaddr *addr, socklen_t addrlen)
-{
-  int res = 1; 
-  long arg; 
-  fd_set myset; 
-  struct timeval tv; 
-  int valopt; 
-  socklen_t lon; 
-
-  arg = fcntl(soc, F_GETFL, NULL);
-  arg |= O_NONBLOCK;
-  fcntl(soc, F_SETFL, arg);
-
-  res = connect(soc, addr, addrlen); 
-  if (res < 0) { 
-     if (errno == EINPROGRESS) { 
-        do { 
-           tv.tv_sec = CONNECT_TIMEOUT; 
-           tv.tv_usec = 0; 
-           FD_ZERO(&myset); 
-           FD_SET(soc, &myset); 
-           res = select(soc+1, NULL, &myset, NULL, &tv); 
-           if (res < 0 && errno != EINTR) {
-              res = -1;
-              goto err;
-           }
-           else if (res > 0) { 
-              lon = sizeof(int); 
-              if (getsockopt(soc, SOL_SOCKET, SO_ERROR, (void*)(&valopt), &lon) < 0) {
-                 res = -1;
-                 goto err;
-              }
-              if (valopt) {
-                 res = -1;
-                 goto err;
-              }
-              break; 
-           } 
-           else {
-              res = -1;
-              goto err;
-           }
-        } while (1); 
-     } 
-     else
-       res = -1;
-  } 
-
-err:
-
-  arg = fcntl(soc, F_GETFL, NULL);
-  arg &= (~O_NONBLOCK); 
-  fcntl(soc, F_SETFL, arg);
-
-  return res;
-}
-
-/* this is a 'cancellable' connect, cancellable from camel_operation_cancel etc */
-/* returns -1 & errno == EINTR if the connection was cancelled */
-static int
-socket_connect(struct addrinfo *h)
-{
-	struct timeval tv;
-	socklen_t len;
-	int cancel_fd;
-	int errnosav;
-	int ret, fd;
-
-	/* see if we're cancelled yet */
-	if (camel_operation_cancel_check (NULL)) {
-		errno = EINTR;
-		return -1;
-	}
-
-	if (h->ai_socktype != SOCK_STREAM) {
-		errno = EINVAL;
-		return -1;
-	}
-
-	if ((fd = socket (h->ai_family, SOCK_STREAM, 0)) == -1)
-		return -1;
-
-	cancel_fd = camel_operation_cancel_fd (NULL);
-	if (cancel_fd == -1) {
-		if (connect_timeout (fd, h->ai_addr, h->ai_addrlen) == -1) {
-			/* Yeah, errno is meaningless on Win32 after a
-			 * Winsock call fails, but I doubt the callers
-			 * check errno anyway.
-			 */
-			errnosav = errno;
-			SOCKET_CLOSE (fd);
-			errno = errnosav;
-			return -1;
-		}
-
-		return fd;
-	} else {
-#ifndef G_OS_WIN32
-		int flags;
-#endif
-		int fdmax, status;
-		fd_set rdset, wrset;
-
-#ifndef G_OS_WIN32
-		flags = fcntl (fd, F_GETFL);
-		fcntl (fd, F_SETFL, flags | O_NONBLOCK);
-#else
-		{
-			u_long yes = 1;
-			ioctlsocket (fd, FIONBIO, &yes);
-		}
-#endif
-		if (connect (fd, h->ai_addr, h->ai_addrlen) == 0) {
-#ifndef G_OS_WIN32
-			fcntl (fd, F_SETFL, flags);
-#else
-			{
-				u_long no = 0;
-				ioctlsocket (fd, FIONBIO, &no);
-			}
-#endif
-			return fd;
-		}
-
-		if (!SOCKET_ERROR_IS_EINPROGRESS ()) {
-			errnosav = errno;
-			SOCKET_CLOSE (fd);
-			errno = errnosav;
-			return -1;
-		}
-
-		do {
-			FD_ZERO (&rdset);
-			FD_ZERO (&wrset);
-			FD_SET (fd, &wrset);
-			FD_SET (cancel_fd, &rdset);
-			fdmax = MAX (fd, cancel_fd) + 1;
-			tv.tv_sec = CONNECT_TIMEOUT;
-			tv.tv_usec = 0;
-
-			status = select (fdmax, &rdset, &wrset, NULL, &tv);
-		} while (status == -1 && SOCKET_ERROR_IS_EINTR ());
-
-		if (status <= 0) {
-			SOCKET_CLOSE (fd);
-			errno = ETIMEDOUT;
-			return -1;
-		}
-
-		if (cancel_fd != -1 && FD_ISSET (cancel_fd, &rdset)) {
-			SOCKET_CLOSE (fd);
-			errno = EINTR;
-			return -1;
-		} else {
-			len = sizeof (int);
-
-			if (getsockopt (fd, SOL_SOCKET, SO_ERROR, (char *) &ret, &len) == -1) {
-				errnosav = errno;
-				SOCKET_CLOSE (fd);
-				errno = errnosav;
-				return -1;
-			}
-
-			if (ret != 0) {
-				SOCKET_CLOSE (fd);
-				errno = ret;
-				return -1;
-			}
-		}
-#ifndef G_OS_WIN32
-		fcntl (fd, F_SETFL, flags);
-#else
-		{
-			u_long no = 0;
-			ioctlsocket (fd, FIONBIO, &no);
-		}
-#endif
-	}
-
-	return fd;
-}
-
 static int
 stream_connect (CamelTcpStream *stream, struct addrinfo *host)
 {
@@ -495,15 +313,11 @@ stream_connect (CamelTcpStream *stream, struct addrinfo *host)
 
 	g_return_val_if_fail (host != NULL, -1);
 
-	while (host) {
-		raw->sockfd = socket_connect(host);
-		if (raw->sockfd != -1)
-			return 0;
-
-		host = host->ai_next;
-	}
+	raw->sockfd = camel_tcp_connect (host);
+	if (raw->sockfd == -1)
+		return -1;
 
-	return -1;
+	return 0;
 }
 
 static int
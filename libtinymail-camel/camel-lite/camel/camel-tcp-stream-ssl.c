@@ -44,6 +44,8 @@
 #include <prio.h>
 #include <prerror.h>
 #include <prerr.h>
+#include <private/pprio.h>
+#include <secitem.h>
 #include <secerr.h>
 #include <sslerr.h>
 #include "nss.h"    /* Don't use <> here or it will include the system nss.h instead */
@@ -60,6 +62,7 @@
 
 #include "camel-certdb.h"
 #include "camel-file-utils.h"
+#include "camel-net-utils.h"
 #include "camel-operation.h"
 #include "camel-private.h"
 #include "camel-session.h"
@@ -103,8 +106,16 @@ struct _CamelTcpStreamSSLPrivate {
 	guint reads;
 	GMutex *reads_lock;
 	gboolean scheduled_close;
+	char *session_key;
 };
 
+/* NSS keeps a client session cache of its own, keyed by peer id. What is kept
+ * here is the session id of the last handshake with each host:port, only to
+ * tell resumed handshakes apart from full ones */
+static GHashTable *session_ids = NULL;
+static GStaticMutex session_ids_lock = G_STATIC_MUTEX_INIT;
+static volatile gint handshakes_full = 0, handshakes_resumed = 0;
+
 /*
  * This method is used for making sure we don't close the ssl socket
  * before all the scheduled reads are finished. It also rejects read
@@ -240,6 +251,7 @@ camel_tcp_stream_ssl_finalize (CamelObject *object)
 	g_mutex_free (stream->priv->reads_lock);
 
 	g_free (stream->priv->expected_host);
+	g_free (stream->priv->session_key);
 
 	g_free (stream->priv);
 }
@@ -1350,15 +1362,82 @@ ssl_bad_cert (void *data, PRFileDesc *sockfd)
 #endif
 }
 
+/**
+ * camel_tcp_stream_ssl_get_handshake_counts:
+ * @full: return location for the number of full handshakes, or %NULL
+ * @resumed: return location for the number of resumed handshakes, or %NULL
+ *
+ * Get how many SSL handshakes were done since startup, and how many of them
+ * resumed an earlier session with the same host and port.
+ **/
+void
+camel_tcp_stream_ssl_get_handshake_counts (guint *full, guint *resumed)
+{
+	if (full)
+		*full = g_atomic_int_get (&handshakes_full);
+	if (resumed)
+		*resumed = g_atomic_int_get (&handshakes_resumed);
+}
+
+static void
+session_id_free (gpointer data)
+{
+	g_byte_array_free (data, TRUE);
+}
+
+static void
+ssl_handshake_done (PRFileDesc *fd, void *data)
+{
+	CamelTcpStreamSSL *ssl = data;
+	SECItem *id = SSL_GetSessionID (fd);
+	GByteArray *last;
+
+	if (!ssl->priv->session_key || !id) {
+		g_atomic_int_inc (&handshakes_full);
+		if (id)
+			SECITEM_FreeItem (id, PR_TRUE);
+		return;
+	}
+
+	g_static_mutex_lock (&session_ids_lock);
+	if (session_ids == NULL)
+		session_ids = g_hash_table_new_full (g_str_hash, g_str_equal, g_free,
+			session_id_free);
+
+	last = g_hash_table_lookup (session_ids, ssl->priv->session_key);
+	if (last && last->len == id->len && !memcmp (last->data, id->data, id->len))
+		g_atomic_int_inc (&handshakes_resumed);
+	else {
+		g_atomic_int_inc (&handshakes_full);
+		last = g_byte_array_sized_new (id->len);
+		g_byte_array_append (last, id->data, id->len);
+		g_hash_table_replace (session_ids, g_strdup (ssl->priv->session_key), last);
+	}
+	g_static_mutex_unlock (&session_ids_lock);
+
+	SECITEM_FreeItem (id, PR_TRUE);
+}
+
 static PRFileDesc *
 enable_ssl (CamelTcpStreamSSL *ssl, PRFileDesc *fd)
 {
 	PRFileDesc *ssl_fd;
+	PRNetAddr peer;
 
 	ssl_fd = SSL_ImportFD (NULL, fd ? fd : ssl->priv->sockfd);
 	if (!ssl_fd)
 		return NULL;
 
+	/* NSS resumes sessions with the same peer id, so that's host:port */
+	g_free (ssl->priv->session_key);
+	ssl->priv->session_key = NULL;
+	if (PR_GetPeerName (ssl_fd, &peer) == PR_SUCCESS) {
+		ssl->priv->session_key = g_strdup_printf ("%s:%d", ssl->priv->expected_host,
+			PR_ntohs (PR_NetAddrInetPort (&peer)));
+		SSL_SetSockPeerID (ssl_fd, ssl->priv->session_key);
+	}
+	SSL_HandshakeCallback (ssl_fd, ssl_handshake_done, ssl);
+
 	SSL_OptionSet (ssl_fd, SSL_SECURITY, PR_TRUE);
 
 	if (ssl->priv->flags & CAMEL_TCP_STREAM_SSL_ENABLE_SSL2) {
@@ -1390,61 +1469,24 @@ enable_ssl (CamelTcpStreamSSL *ssl, PRFileDesc *fd)
 	return ssl_fd;
 }
 
+/* The connect itself is done on a plain socket, racing all addresses at
+ * once, and NSPR only gets the connected socket. In ssl mode the handshake
+ * then happens on the first read or write */
 static int
-sockaddr_to_praddr(struct sockaddr *s, int len, PRNetAddr *addr)
-{
-	/* We assume the ip addresses are the same size - they have to be anyway.
-	   We could probably just use memcpy *shrug* */
-
-	memset(addr, 0, sizeof(*addr));
-
-	if (s->sa_family == AF_INET) {
-		struct sockaddr_in *sin = (struct sockaddr_in *)s;
-
-		if (len < sizeof(*sin))
-			return -1;
-
-		addr->inet.family = PR_AF_INET;
-		addr->inet.port = sin->sin_port;
-		memcpy(&addr->inet.ip, &sin->sin_addr, sizeof(addr->inet.ip));
-
-		return 0;
-	}
-#ifdef ENABLE_IPv6
-	else if (s->sa_family == PR_AF_INET6) {
-		struct sockaddr_in6 *sin = (struct sockaddr_in6 *)s;
-
-		if (len < sizeof(*sin))
-			return -1;
-
-		addr->ipv6.family = PR_AF_INET6;
-		addr->ipv6.port = sin->sin6_port;
-		addr->ipv6.flowinfo = sin->sin6_flowinfo;
-		memcpy(&addr->ipv6.ip, &sin->sin6_addr, sizeof(addr->ipv6.ip));
-		addr->ipv6.scope_id = sin->sin6_scope_id;
-
-		return 0;
-	}
-#endif
-
-	return -1;
-}
-
-static int
-socket_connect(CamelTcpStream *stream, struct addrinfo *host)
+stream_connect(CamelTcpStream *stream, struct addrinfo *host)
 {
 	CamelTcpStreamSSL *ssl = CAMEL_TCP_STREAM_SSL (stream);
-	PRNetAddr netaddr;
-	PRFileDesc *fd, *cancel_fd;
+	PRFileDesc *fd;
+	int sockfd;
 
-	if (sockaddr_to_praddr(host->ai_addr, host->ai_addrlen, &netaddr) != 0) {
-		errno = EINVAL;
+	sockfd = camel_tcp_connect (host);
+	if (sockfd == -1)
 		return -1;
-	}
 
-	fd = PR_OpenTCPSocket(netaddr.raw.family);
+	fd = PR_ImportTCPSocket (sockfd);
 	if (fd == NULL) {
 		set_errno (PR_GetError ());
+		close (sockfd);
 		return -1;
 	}
 
@@ -1452,13 +1494,13 @@ socket_connect(CamelTcpStream *stream, struct addrinfo *host)
 		PRFileDesc *ssl_fd;
 
 		ssl_fd = enable_ssl (ssl, fd);
-		if (ssl_fd == NULL) {
+		if (ssl_fd == NULL || SSL_ResetHandshake (ssl_fd, PR_FALSE) == SECFailure) {
 			int errnosave;
 
 			set_errno (PR_GetError ());
 			errnosave = errno;
-			PR_Shutdown (fd, PR_SHUTDOWN_BOTH);
-			PR_Close (fd);
+			PR_Shutdown (ssl_fd ? ssl_fd : fd, PR_SHUTDOWN_BOTH);
+			PR_Close (ssl_fd ? ssl_fd : fd);
 			errno = errnosave;
 
 			return -1;
@@ -1467,58 +1509,6 @@ socket_connect(CamelTcpStream *stream, struct addrinfo *host)
 		fd = ssl_fd;
 	}
 
-	cancel_fd = camel_operation_cancel_prfd(NULL);
-
-	if (PR_Connect (fd, &netaddr, cancel_fd?PR_INTERVAL_NO_WAIT:(CONNECT_TIMEOUT*1000)) == PR_FAILURE) {
-		int errnosave;
-
-		set_errno (PR_GetError ());
-		if (PR_GetError () == PR_IN_PROGRESS_ERROR ||
-		    (cancel_fd && (PR_GetError () == PR_CONNECT_TIMEOUT_ERROR ||
-				   PR_GetError () == PR_IO_TIMEOUT_ERROR))) {
-			gboolean connected = FALSE;
-			PRPollDesc poll[2];
-
-			poll[0].fd = fd;
-			poll[0].in_flags = PR_POLL_WRITE | PR_POLL_EXCEPT;
-			poll[1].fd = cancel_fd;
-			poll[1].in_flags = PR_POLL_READ;
-
-			do {
-				poll[0].out_flags = 0;
-				poll[1].out_flags = 0;
-
-				if (PR_Poll (poll, cancel_fd?2:1, (CONNECT_TIMEOUT*1000)) == PR_FAILURE) {
-					set_errno (PR_GetError ());
-					goto exception;
-				}
-
-				if (poll[1].out_flags == PR_POLL_READ) {
-					set_errno (PR_GetError ());
-					goto exception;
-				}
-
-				if (PR_ConnectContinue(fd, poll[0].out_flags) == PR_FAILURE) {
-					set_errno (PR_GetError ());
-					if (PR_GetError () != PR_IN_PROGRESS_ERROR)
-						goto exception;
-				} else {
-					connected = TRUE;
-				}
-			} while (!connected);
-		} else {
-		exception:
-			errnosave = errno;
-			PR_Shutdown (fd, PR_SHUTDOWN_BOTH);
-			PR_Close (fd);
-			errno = errnosave;
-
-			return -1;
-		}
-
-		errno = 0;
-	}
-
 	g_mutex_lock (ssl->priv->reads_lock);
 	ssl->priv->reads = 0;
 	ssl->priv->scheduled_close = FALSE;
@@ -1528,18 +1518,6 @@ socket_connect(CamelTcpStream *stream, struct addrinfo *host)
 	return 0;
 }
 
-static int
-stream_connect(CamelTcpStream *stream, struct addrinfo *host)
-{
-	while (host) {
-		if (socket_connect(stream, host) == 0)
-			return 0;
-		host = host->ai_next;
-	}
-
-	return -1;
-}
-
 static int
 stream_getsockopt (CamelTcpStream *stream, CamelSockOptData *data)
 {
@@ -62,6 +62,8 @@ CamelStream *camel_tcp_stream_ssl_new_raw (CamelService *service, const char *ex
 
 int camel_tcp_stream_ssl_enable_ssl (CamelTcpStreamSSL *ssl);
 
+void camel_tcp_stream_ssl_get_handshake_counts (guint *full, guint *resumed);
+
 G_END_DECLS
 
 #endif /* CAMEL_TCP_STREAM_SSL_H */
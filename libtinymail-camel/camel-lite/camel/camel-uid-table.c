@@ -0,0 +1,667 @@
+/* -*- Mode: C; tab-width: 8; indent-tabs-mode: t; c-basic-offset: 8 -*- */
+/* camel-uid-table.c: compact UID to summary index lookup table.
+ *
+ * The table maps a message UID to its position in a summary's messages
+ * array without allocating anything per UID. IMAP UIDs are integers, so
+ * for those we keep a sorted array of (uid, index) pairs and binary
+ * search it. Anything else (POP3 UIDLs, local UIDs with flags) goes into
+ * an open addressing table of (hash, index+1) pairs where the key itself
+ * is compared against the CamelMessageInfo the index points to.
+ *
+ * The pairs are written to "<summary>.uidx" next to the summary and are
+ * mmap()ed on load, so a freshly opened folder doesn't have to walk all
+ * of its UIDs before the first lookup.
+ */
+
+/*
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of version 2 of the GNU Lesser General Public
+ * License as published by the Free Software Foundation.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301
+ * USA
+ */
+
+#ifdef HAVE_CONFIG_H
+#include <config.h>
+#endif
+
+#include <errno.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/stat.h>
+#include <sys/types.h>
+
+#include <glib.h>
+#include <glib/gstdio.h>
+
+#include "camel-folder-summary.h"
+#include "camel-uid-table.h"
+
+#define d(x)
+
+#define CAMEL_UID_TABLE_MAGIC "CUIX"
+#define CAMEL_UID_TABLE_VERSION (1)
+#define CAMEL_UID_TABLE_MIN_SLOTS (64)
+
+/* On-disk header, host byte order: the file is a private cache that is
+ * thrown away whenever it doesn't match the summary it belongs to */
+struct _CamelUIDTableHeader {
+	char magic[4];
+	guint32 version;
+	guint32 kind;
+	guint32 count;		/* length of the messages array it indexes */
+	guint32 slots;		/* number of pairs that follow the header */
+	guint32 used;		/* number of occupied pairs */
+	guint32 summary_size;	/* st_size of the summary when written */
+	guint32 summary_mtime;	/* st_mtime of the summary when written */
+};
+
+struct _CamelUIDTable {
+	CamelUIDTableKind kind;
+	gboolean valid;
+	guint32 count;		/* length of the messages array covered */
+	guint32 slots;		/* numeric: capacity, hashed: power of two */
+	guint32 used;
+	guint32 *pairs;		/* slots * 2 guint32's */
+	GMappedFile *file;	/* non-NULL while pairs points into it */
+};
+
+#define uid_at(messages, i) (((CamelMessageInfo *) (messages)->pdata[(i)])->uid)
+
+static gboolean
+uid_to_number (const char *uid, guint32 *num)
+{
+	guint64 val = 0;
+	const char *p = uid;
+
+	if (uid == NULL || *uid == '\0')
+		return FALSE;
+
+	/* Only canonical numbers, so that "007" and "7" can't collide */
+	if (uid[0] == '0' && uid[1] != '\0')
+		return FALSE;
+
+	while (*p) {
+		if (*p < '0' || *p > '9')
+			return FALSE;
+		val = val * 10 + (*p - '0');
+		if (val > G_MAXUINT32)
+			return FALSE;
+		p++;
+	}
+
+	*num = (guint32) val;
+
+	return TRUE;
+}
+
+/* FNV-1a, it must stay stable as the hashes are persisted */
+static guint32
+uid_hash (const char *uid)
+{
+	guint32 h = 2166136261U;
+
+	while (*uid) {
+		h ^= (guchar) *uid++;
+		h *= 16777619U;
+	}
+
+	return h;
+}
+
+static void
+table_reset (CamelUIDTable *table)
+{
+	if (table->file)
+		g_mapped_file_free (table->file);
+	else
+		g_free (table->pairs);
+
+	table->file = NULL;
+	table->pairs = NULL;
+	table->kind = CAMEL_UID_TABLE_NONE;
+	table->valid = FALSE;
+	table->count = 0;
+	table->slots = 0;
+	table->used = 0;
+}
+
+/* Copy-on-write: the mapped pairs are read-only */
+static void
+table_own (CamelUIDTable *table)
+{
+	guint32 *pairs;
+
+	if (!table->file)
+		return;
+
+	pairs = g_new (guint32, MAX (table->slots, 1) * 2);
+	memcpy (pairs, table->pairs, table->slots * 2 * sizeof (guint32));
+	g_mapped_file_free (table->file);
+	table->file = NULL;
+	table->pairs = pairs;
+}
+
+static void
+hashed_insert (guint32 *pairs, guint32 slots, guint32 hash, guint32 index)
+{
+	guint32 mask = slots - 1, i = hash & mask;
+
+	while (pairs[i * 2 + 1] != 0)
+		i = (i + 1) & mask;
+
+	pairs[i * 2] = hash;
+	pairs[i * 2 + 1] = index + 1;
+}
+
+static void
+hashed_grow (CamelUIDTable *table)
+{
+	guint32 *pairs, slots = table->slots * 2, i;
+
+	pairs = g_new0 (guint32, slots * 2);
+	for (i = 0; i < table->slots; i++)
+		if (table->pairs[i * 2 + 1] != 0)
+			hashed_insert (pairs, slots, table->pairs[i * 2], table->pairs[i * 2 + 1] - 1);
+
+	g_free (table->pairs);
+	table->pairs = pairs;
+	table->slots = slots;
+}
+
+static int
+pair_cmp (const void *a, const void *b)
+{
+	guint32 ua = *(const guint32 *) a, ub = *(const guint32 *) b;
+
+	return ua < ub ? -1 : (ua > ub ? 1 : 0);
+}
+
+/* Returns the index in messages, -1 if not found or -2 if the table turned
+ * out to be out of sync with the messages array. @pos receives the pair. */
+static int
+table_find (CamelUIDTable *table, GPtrArray *messages, const char *uid, guint32 *pos)
+{
+	guint32 idx;
+
+	if (table->kind == CAMEL_UID_TABLE_NUMERIC) {
+		guint32 num, lo = 0, hi = table->used;
+
+		if (!uid_to_number (uid, &num))
+			return -1;
+
+		while (lo < hi) {
+			guint32 mid = lo + (hi - lo) / 2;
+
+			if (table->pairs[mid * 2] < num)
+				lo = mid + 1;
+			else
+				hi = mid;
+		}
+
+		if (lo >= table->used || table->pairs[lo * 2] != num)
+			return -1;
+
+		idx = table->pairs[lo * 2 + 1];
+		if (idx >= messages->len || strcmp (uid_at (messages, idx), uid) != 0)
+			return -2;
+
+		if (pos)
+			*pos = lo;
+
+		return idx;
+	} else if (table->kind == CAMEL_UID_TABLE_HASHED) {
+		guint32 hash = uid_hash (uid), mask = table->slots - 1;
+		guint32 i = hash & mask;
+
+		while (table->pairs[i * 2 + 1] != 0) {
+			if (table->pairs[i * 2] == hash) {
+				const char *found;
+
+				idx = table->pairs[i * 2 + 1] - 1;
+				if (idx >= messages->len)
+					return -2;
+				found = uid_at (messages, idx);
+				if (strcmp (found, uid) == 0) {
+					if (pos)
+						*pos = i;
+					return idx;
+				}
+				/* A real collision has the same hash, anything
+				 * else means the slot is stale */
+				if (uid_hash (found) != hash)
+					return -2;
+			}
+			i = (i + 1) & mask;
+		}
+	}
+
+	return -1;
+}
+
+/**
+ * camel_uid_table_new:
+ *
+ * Creates an empty, invalid UID table. It gets built on first use or
+ * loaded with #camel_uid_table_load.
+ *
+ * Returns a new #CamelUIDTable
+ **/
+CamelUIDTable *
+camel_uid_table_new (void)
+{
+	return g_slice_new0 (CamelUIDTable);
+}
+
+void
+camel_uid_table_free (CamelUIDTable *table)
+{
+	table_reset (table);
+	g_slice_free (CamelUIDTable, table);
+}
+
+/**
+ * camel_uid_table_invalidate:
+ * @table: a #CamelUIDTable
+ *
+ * Drop the contents of @table, the next lookup will rebuild it.
+ **/
+void
+camel_uid_table_invalidate (CamelUIDTable *table)
+{
+	table_reset (table);
+}
+
+/**
+ * camel_uid_table_build:
+ * @table: a #CamelUIDTable
+ * @messages: array of #CamelMessageInfo
+ *
+ * Rebuild @table from scratch. If all UIDs in @messages are integers the
+ * numeric layout is used, else the hashed one.
+ *
+ * Returns %TRUE on success
+ **/
+gboolean
+camel_uid_table_build (CamelUIDTable *table, GPtrArray *messages)
+{
+	guint32 i, num, last = 0, n = messages->len;
+	gboolean numeric = TRUE, sorted = TRUE;
+
+	table_reset (table);
+
+	for (i = 0; i < n && numeric; i++)
+		numeric = uid_to_number (uid_at (messages, i), &num);
+
+	if (numeric) {
+		table->kind = CAMEL_UID_TABLE_NUMERIC;
+		table->slots = MAX (n, CAMEL_UID_TABLE_MIN_SLOTS);
+		table->pairs = g_new (guint32, table->slots * 2);
+
+		for (i = 0; i < n; i++) {
+			uid_to_number (uid_at (messages, i), &num);
+			if (i > 0 && num <= last)
+				sorted = FALSE;
+			table->pairs[i * 2] = num;
+			table->pairs[i * 2 + 1] = i;
+			last = num;
+		}
+
+		if (!sorted)
+			qsort (table->pairs, n, sizeof (guint32) * 2, pair_cmp);
+	} else {
+		table->kind = CAMEL_UID_TABLE_HASHED;
+		table->slots = CAMEL_UID_TABLE_MIN_SLOTS;
+		while (table->slots < n * 2)
+			table->slots <<= 1;
+		table->pairs = g_new0 (guint32, table->slots * 2);
+
+		for (i = 0; i < n; i++)
+			hashed_insert (table->pairs, table->slots, uid_hash (uid_at (messages, i)), i);
+	}
+
+	table->used = n;
+	table->count = n;
+	table->valid = TRUE;
+
+	d(printf ("Built %s uid table for %d messages\n", numeric ? "numeric" : "hashed", n));
+
+	return TRUE;
+}
+
+/**
+ * camel_uid_table_prepare:
+ * @table: a #CamelUIDTable
+ * @messages: array of #CamelMessageInfo
+ *
+ * Make sure @table covers @messages, building it if needed.
+ **/
+void
+camel_uid_table_prepare (CamelUIDTable *table, GPtrArray *messages)
+{
+	if (!table->valid || table->count != messages->len)
+		camel_uid_table_build (table, messages);
+}
+
+/**
+ * camel_uid_table_lookup:
+ * @table: a #CamelUIDTable
+ * @messages: the array of #CamelMessageInfo that @table indexes
+ * @uid: the uid to look for
+ *
+ * Find the position of @uid in @messages. The table is (re)built first if
+ * it is invalid or doesn't cover @messages.
+ *
+ * Returns the index or -1 if @uid isn't in @messages
+ **/
+int
+camel_uid_table_lookup (CamelUIDTable *table, GPtrArray *messages, const char *uid)
+{
+	int idx;
+
+	if (uid == NULL || *uid == '\0')
+		return -1;
+
+	camel_uid_table_prepare (table, messages);
+
+	idx = table_find (table, messages, uid, NULL);
+
+	if (G_UNLIKELY (idx == -2)) {
+		camel_uid_table_build (table, messages);
+		idx = table_find (table, messages, uid, NULL);
+	}
+
+	return idx < 0 ? -1 : idx;
+}
+
+/**
+ * camel_uid_table_append:
+ * @table: a #CamelUIDTable
+ * @messages: the array of #CamelMessageInfo that @table indexes
+ * @index: index of the item that was just appended to @messages
+ *
+ * Keep @table in sync after an append. Appending a UID larger than all
+ * previous ones to a numeric table, or anything to a hashed table, is
+ * O(1). Other cases just invalidate the table.
+ **/
+void
+camel_uid_table_append (CamelUIDTable *table, GPtrArray *messages, guint index)
+{
+	const char *uid;
+
+	if (!table->valid)
+		return;
+
+	if (index != table->count || index >= messages->len) {
+		table_reset (table);
+		return;
+	}
+
+	uid = uid_at (messages, index);
+
+	if (table->kind == CAMEL_UID_TABLE_NUMERIC) {
+		guint32 num;
+
+		if (!uid_to_number (uid, &num) ||
+		    (table->used > 0 && num <= table->pairs[(table->used - 1) * 2])) {
+			table_reset (table);
+			return;
+		}
+
+		table_own (table);
+
+		if (table->used == table->slots) {
+			table->slots = MAX (table->slots * 2, CAMEL_UID_TABLE_MIN_SLOTS);
+			table->pairs = g_renew (guint32, table->pairs, table->slots * 2);
+		}
+
+		table->pairs[table->used * 2] = num;
+		table->pairs[table->used * 2 + 1] = index;
+	} else {
+		table_own (table);
+
+		if ((table->used + 1) * 2 > table->slots)
+			hashed_grow (table);
+
+		hashed_insert (table->pairs, table->slots, uid_hash (uid), index);
+	}
+
+	table->used++;
+	table->count++;
+}
+
+/**
+ * camel_uid_table_remove:
+ * @table: a #CamelUIDTable
+ * @messages: the array of #CamelMessageInfo that @table indexes
+ * @index: index of the item that is about to be removed from @messages
+ *
+ * Keep @table in sync with a removal. Must be called before the item is
+ * actually removed from @messages. This only shuffles integers around,
+ * nothing gets allocated.
+ **/
+void
+camel_uid_table_remove (CamelUIDTable *table, GPtrArray *messages, guint index)
+{
+	guint32 pos = 0, i;
+
+	if (!table->valid)
+		return;
+
+	if (table->count != messages->len || index >= messages->len ||
+	    table_find (table, messages, uid_at (messages, index), &pos) != (int) index) {
+		table_reset (table);
+		return;
+	}
+
+	table_own (table);
+
+	if (table->kind == CAMEL_UID_TABLE_NUMERIC) {
+		memmove (table->pairs + pos * 2, table->pairs + (pos + 1) * 2,
+			 (table->used - pos - 1) * 2 * sizeof (guint32));
+		table->used--;
+
+		for (i = 0; i < table->used; i++)
+			if (table->pairs[i * 2 + 1] > index)
+				table->pairs[i * 2 + 1]--;
+	} else {
+		guint32 mask = table->slots - 1, j = pos, k;
+
+		/* Backward shift deletion, keeps probe sequences intact
+		 * without tombstones */
+		for (;;) {
+			j = (j + 1) & mask;
+			if (table->pairs[j * 2 + 1] == 0)
+				break;
+			k = table->pairs[j * 2] & mask;
+			if ((j > pos && (k <= pos || k > j)) ||
+			    (j < pos && (k <= pos && k > j))) {
+				table->pairs[pos * 2] = table->pairs[j * 2];
+				table->pairs[pos * 2 + 1] = table->pairs[j * 2 + 1];
+				pos = j;
+			}
+		}
+		table->pairs[pos * 2] = 0;
+		table->pairs[pos * 2 + 1] = 0;
+		table->used--;
+
+		for (i = 0; i < table->slots; i++)
+			if (table->pairs[i * 2 + 1] > index + 1)
+				table->pairs[i * 2 + 1]--;
+	}
+
+	table->count--;
+}
+
+/**
+ * camel_uid_table_load:
+ * @table: a #CamelUIDTable
+ * @messages: the freshly loaded array of #CamelMessageInfo
+ * @summary_path: path of the summary file @messages was loaded from
+ *
+ * Map the persisted table that belongs to @summary_path. The file is only
+ * used if it was written for exactly this version of the summary file.
+ *
+ * Returns %TRUE if the persisted table got mapped
+ **/
+gboolean
+camel_uid_table_load (CamelUIDTable *table, GPtrArray *messages, const char *summary_path)
+{
+	struct _CamelUIDTableHeader header;
+	GMappedFile *file;
+	struct stat st;
+	gsize length;
+	char *path, *contents;
+
+	if (summary_path == NULL || g_stat (summary_path, &st) == -1)
+		return FALSE;
+
+	path = g_strdup_printf ("%s.uidx", summary_path);
+	file = g_mapped_file_new (path, FALSE, NULL);
+	g_free (path);
+
+	if (file == NULL)
+		return FALSE;
+
+	contents = g_mapped_file_get_contents (file);
+	length = g_mapped_file_get_length (file);
+
+	if (length < sizeof (header))
+		goto fail;
+
+	memcpy (&header, contents, sizeof (header));
+
+	if (memcmp (header.magic, CAMEL_UID_TABLE_MAGIC, 4) != 0 ||
+	    header.version != CAMEL_UID_TABLE_VERSION ||
+	    header.count != messages->len ||
+	    header.summary_size != (guint32) st.st_size ||
+	    header.summary_mtime != (guint32) st.st_mtime ||
+	    header.used > header.slots ||
+	    length < sizeof (header) + (gsize) header.slots * 2 * sizeof (guint32))
+		goto fail;
+
+	if (header.kind == CAMEL_UID_TABLE_NUMERIC) {
+		if (header.used != header.count)
+			goto fail;
+	} else if (header.kind == CAMEL_UID_TABLE_HASHED) {
+		if (header.slots == 0 || (header.slots & (header.slots - 1)) != 0)
+			goto fail;
+	} else
+		goto fail;
+
+	table_reset (table);
+
+	table->kind = header.kind;
+	table->count = header.count;
+	table->slots = header.slots;
+	table->used = header.used;
+	table->pairs = (guint32 *) (contents + sizeof (header));
+	table->file = file;
+	table->valid = TRUE;
+
+	return TRUE;
+
+fail:
+	g_mapped_file_free (file);
+
+	return FALSE;
+}
+
+/**
+ * camel_uid_table_save:
+ * @table: a #CamelUIDTable
+ * @messages: the array of #CamelMessageInfo that @table indexes
+ * @summary_path: path of the summary file that was just written
+ *
+ * Write @table next to @summary_path. Must be called after the summary
+ * itself was written, as the file is stamped with its size and mtime.
+ *
+ * Returns %0 on success or %-1 on fail
+ **/
+int
+camel_uid_table_save (CamelUIDTable *table, GPtrArray *messages, const char *summary_path)
+{
+	struct _CamelUIDTableHeader header;
+	struct stat st;
+	guint32 npairs;
+	char *path, *tmp;
+	FILE *out;
+	int retval = -1;
+
+	if (summary_path == NULL || g_stat (summary_path, &st) == -1)
+		return -1;
+
+	camel_uid_table_prepare (table, messages);
+
+	memcpy (header.magic, CAMEL_UID_TABLE_MAGIC, 4);
+	header.version = CAMEL_UID_TABLE_VERSION;
+	header.kind = table->kind;
+	header.count = table->count;
+	header.used = table->used;
+	header.summary_size = (guint32) st.st_size;
+	header.summary_mtime = (guint32) st.st_mtime;
+
+	/* Numeric tables are saved without their spare capacity */
+	npairs = (table->kind == CAMEL_UID_TABLE_NUMERIC) ? table->used : table->slots;
+	header.slots = npairs;
+
+	path = g_strdup_printf ("%s.uidx", summary_path);
+	tmp = g_strdup_printf ("%s~", path);
+
+	out = g_fopen (tmp, "wb");
+	if (out == NULL)
+		goto out;
+
+	if (fwrite (&header, sizeof (header), 1, out) != 1 ||
+	    (npairs > 0 && fwrite (table->pairs, sizeof (guint32) * 2, npairs, out) != npairs) ||
+	    fflush (out) != 0) {
+		fclose (out);
+		g_unlink (tmp);
+		goto out;
+	}
+
+	fclose (out);
+
+	/* The mapping must go before we rename on top of it */
+	table_own (table);
+
+#ifdef G_OS_WIN32
+	g_unlink (path);
+#endif
+
+	if (g_rename (tmp, path) == -1)
+		g_unlink (tmp);
+	else
+		retval = 0;
+
+out:
+	g_free (tmp);
+	g_free (path);
+
+	return retval;
+}
+
+/**
+ * camel_uid_table_unlink:
+ * @summary_path: path of a summary file
+ *
+ * Remove the persisted UID table that belongs to @summary_path.
+ **/
+void
+camel_uid_table_unlink (const char *summary_path)
+{
+	char *path = g_strdup_printf ("%s.uidx", summary_path);
+
+	g_unlink (path);
+	g_free (path);
+}
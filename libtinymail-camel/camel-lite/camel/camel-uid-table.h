@@ -0,0 +1,52 @@
+/* -*- Mode: C; tab-width: 8; indent-tabs-mode: t; c-basic-offset: 8 -*- */
+/* camel-uid-table.h: compact UID to summary index lookup table. */
+
+/*
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of version 2 of the GNU Lesser General Public
+ * License as published by the Free Software Foundation.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301
+ * USA
+ */
+
+#ifndef CAMEL_UID_TABLE_H
+#define CAMEL_UID_TABLE_H 1
+
+#include <glib.h>
+
+G_BEGIN_DECLS
+
+typedef enum {
+	CAMEL_UID_TABLE_NONE,
+	CAMEL_UID_TABLE_NUMERIC,	/* sorted (uid, index) pairs, IMAP */
+	CAMEL_UID_TABLE_HASHED		/* open addressing (hash, index+1), POP3 */
+} CamelUIDTableKind;
+
+typedef struct _CamelUIDTable CamelUIDTable;
+
+CamelUIDTable *camel_uid_table_new (void);
+void camel_uid_table_free (CamelUIDTable *table);
+
+void camel_uid_table_invalidate (CamelUIDTable *table);
+gboolean camel_uid_table_build (CamelUIDTable *table, GPtrArray *messages);
+void camel_uid_table_prepare (CamelUIDTable *table, GPtrArray *messages);
+
+int camel_uid_table_lookup (CamelUIDTable *table, GPtrArray *messages, const char *uid);
+void camel_uid_table_append (CamelUIDTable *table, GPtrArray *messages, guint index);
+void camel_uid_table_remove (CamelUIDTable *table, GPtrArray *messages, guint index);
+
+gboolean camel_uid_table_load (CamelUIDTable *table, GPtrArray *messages, const char *summary_path);
+int camel_uid_table_save (CamelUIDTable *table, GPtrArray *messages, const char *summary_path);
+void camel_uid_table_unlink (const char *summary_path);
+
+G_END_DECLS
+
+#endif /* CAMEL_UID_TABLE_H */
@@ -123,12 +123,14 @@
 #include <camel/camel-stream-process.h>
 #include <camel/camel-string-utils.h>
 #include <camel/camel-tcp-stream.h>
+#include <camel/camel-tcp-stream-deflate.h>
 #include <camel/camel-tcp-stream-raw.h>
 #include <camel/camel-tcp-stream-ssl.h>
 #include <camel/camel-text-index.h>
 #include <camel/camel-transport.h>
 #include <camel/camel-types.h>
 #include <camel/camel-uid-cache.h>
+#include <camel/camel-uid-table.h>
 #include <camel/camel-url.h>
 #include <camel/camel-url-scanner.h>
 #include <camel/camel-utf8.h>
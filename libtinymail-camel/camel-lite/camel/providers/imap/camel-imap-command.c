@@ -159,12 +159,12 @@ camel_imap_command (CamelImapStore *store, CamelFolder *folder,
 		
 		if (modseq && (store->capabilities & IMAP_CAPABILITY_QRESYNC))
 		{
-			CamelImapSummary *imap_summary = CAMEL_IMAP_SUMMARY (folder->summary);
+			char *params = camel_imap_folder_get_qresync_params (CAMEL_IMAP_FOLDER (folder), modseq);
 
 			cmd = imap_command_strdup_printf (store,
-				"SELECT %F (QRESYNC (%d %s))",
-				folder->full_name,
-				imap_summary->validity, modseq);
+				"SELECT %F (QRESYNC (%s))",
+				folder->full_name, params);
+			g_free (params);
 
 		} else if (folder) {
 			if (store->capabilities & IMAP_CAPABILITY_CONDSTORE)
@@ -1036,6 +1036,7 @@ camel_imap_response_free (CamelImapStore *store, CamelImapResponse *response)
 {
 	int i, number, exists = 0;
 	GArray *expunged = NULL;
+	GPtrArray *vanished = NULL;
 	char *resp, *p;
 	gboolean fetching_message = FALSE;
 
@@ -1053,9 +1054,12 @@ camel_imap_response_free (CamelImapStore *store, CamelImapResponse *response)
 			number = strtoul (resp + 2, &p, 10);
 			if (!g_ascii_strcasecmp (p, " EXISTS")) {
 				exists = number;
-
-			/* TNY TODO, QRESYNC TODO: add VANISHED HERE */
-
+			} else if (number == 0 && !g_ascii_strncasecmp (resp + 2, "VANISHED ", 9)) {
+				/* With QRESYNC enabled these replace EXPUNGE */
+				if (!vanished)
+					vanished = g_ptr_array_new ();
+				g_ptr_array_add (vanished, resp);
+				continue;
 			} else if (!g_ascii_strcasecmp (p, " EXPUNGE")
 				   || !g_ascii_strcasecmp(p, " XGWMOVE")) {
 				/* XGWMOVE response is the same as an EXPUNGE response */
@@ -1072,6 +1076,17 @@ camel_imap_response_free (CamelImapStore *store, CamelImapResponse *response)
 	g_ptr_array_free (response->untagged, TRUE);
 	g_free (response->status);
 
+	if (vanished) {
+		for (i = 0; i < vanished->len; i++) {
+			resp = vanished->pdata[i];
+			if (response->folder && !fetching_message &&
+			    !(store->parameters & IMAP_PARAM_DONT_TOUCH_SUMMARY))
+				camel_imap_folder_vanished (response->folder, resp + 2);
+			g_free (resp);
+		}
+		g_ptr_array_free (vanished, TRUE);
+	}
+
 	if (response->folder && !fetching_message) {
 		if (exists > 0 || expunged) {
 			/* Update the summary */
@@ -55,6 +55,7 @@
 #include <sys/types.h>
 
 #include <glib/gi18n-lib.h>
+#include <glib/gstdio.h>
 
 #include <libedataserver/e-data-server-util.h>
 #include <libedataserver/e-time-utils.h>
@@ -94,6 +95,8 @@
 #include "camel-imap-utils.h"
 #include "camel-imap-wrapper.h"
 
+#include "bs/bodystruct.h"
+
 
 #include <camel/camel-tcp-stream.h>
 
@@ -124,11 +127,13 @@ static void imap_rename (CamelFolder *folder, const char *new);
 static void imap_set_push_email (CamelFolder *folder, gboolean setting);
 
 static int process_condstore_line (CamelImapFolder *imap_folder, char *resp, CamelFolderChangeInfo *changes);
+static int process_qresync_line (CamelImapFolder *imap_folder, char *resp, CamelFolderChangeInfo *changes);
 
 
 static char* imap_fetch (CamelFolder *folder, const char *uid, const char *spec, gboolean *binary, CamelException *ex);
 static char* imap_get_cache_filename (CamelFolder *folder, const char *uid, const char *spec, CamelFolderPartState *state);
 static char* imap_fetch_structure (CamelFolder *folder, const char *uid, CamelException *ex);
+static void prefetch_structures (CamelFolder *folder, CamelFolderChangeInfo *changes);
 static char* imap_convert (CamelFolder *folder, const char *uid, const char *spec, const char *convert_to, CamelException *ex);
 
 /* message manipulation */
@@ -169,6 +174,7 @@ static void camel_imap_folder_changed_for_uids (CamelFolder *folder, GPtrArray *
 static CamelObjectClass *parent_class;
 
 static GData *parse_fetch_response (CamelImapFolder *imap_folder, char *msg_att);
+static CamelStream *fetch_record_part_stream (CamelImapFolder *imap_folder, CamelImapFetchRecord *record);
 static void camel_imap_folder_changed_for_idle (CamelFolder *folder, int exists,
 			   GArray *expunged, CamelException *ex, CamelFolderChangeInfo *changes, gboolean exists_happened);
 
@@ -362,6 +368,9 @@ camel_imap_folder_new (CamelStore *parent, const char *folder_name,
 		folder->folder_flags |= CAMEL_FOLDER_HAS_PUSHEMAIL_CAPABILITY;
 
 	imap_folder->search = camel_imap_search_new(folder_dir);
+	if (imap_folder->cache->index)
+		camel_folder_search_set_body_index (imap_folder->search,
+			imap_folder->cache->index);
 
 	return folder;
 }
@@ -403,12 +412,50 @@ imap_set_allow_external_images (CamelFolder *folder, const char *uid, gboolean a
 	return;
 }
 
+/* The files in the directory of a folder that aren't cached parts */
+static const char *folder_files[] = {
+	"summary.mmap",
+	"summary.mmap.uidx",
+	"cmeta",
+	"journal",
+	"highestmodseq",
+	CAMEL_IMAP_MESSAGE_CACHE_INDEX ".index",
+	CAMEL_IMAP_MESSAGE_CACHE_INDEX ".index.data",
+	NULL
+};
+
+/* The cache keeps its size up to date, so only the few other files of the
+ * folder need a stat. The store summary gets the result, for listing the
+ * folder while it's not open */
 static int
 imap_get_local_size (CamelFolder *folder)
 {
 	CamelImapFolder *imap_folder = (CamelImapFolder *) folder;
-	int msize = 0;
-	camel_du (imap_folder->folder_dir, &msize);
+	CamelStoreSummary *ssummary = (CamelStoreSummary *) ((CamelImapStore *) folder->parent_store)->summary;
+	CamelImapStoreInfo *si;
+	struct stat st;
+	int msize, i;
+
+	CAMEL_IMAP_FOLDER_REC_LOCK (imap_folder, cache_lock);
+	msize = camel_imap_message_cache_get_size (imap_folder->cache);
+	CAMEL_IMAP_FOLDER_REC_UNLOCK (imap_folder, cache_lock);
+
+	for (i = 0; folder_files[i]; i++) {
+		gchar *path = g_strdup_printf ("%s/%s", imap_folder->folder_dir, folder_files[i]);
+		if (g_stat (path, &st) == 0 && S_ISREG (st.st_mode))
+			msize += st.st_size;
+		g_free (path);
+	}
+
+	si = (CamelImapStoreInfo *) camel_store_summary_path (ssummary, folder->full_name);
+	if (si) {
+		if (si->local_size != msize) {
+			si->local_size = msize;
+			camel_store_summary_touch (ssummary);
+		}
+		camel_store_summary_info_free (ssummary, (CamelStoreInfo *) si);
+	}
+
 	return msize;
 }
 
@@ -455,6 +502,97 @@ camel_imap_folder_get_highestmodseq (CamelImapFolder *imap_folder)
 	return get_highestmodseq (imap_folder);
 }
 
+static unsigned long
+summary_uid_numeric (CamelFolderSummary *summary, int index)
+{
+	CamelMessageInfo *info;
+	unsigned long uid = 0;
+
+	info = camel_folder_summary_index (summary, index);
+	if (info) {
+		uid = strtoul (camel_message_info_uid (info), NULL, 10);
+		camel_message_info_free (info);
+	}
+
+	return uid;
+}
+
+/* What goes between the parentheses of SELECT's QRESYNC parameter:
+ * uidvalidity, modseq, known-uids and seq-match-data (rfc5162). The
+ * seq-match-data samples our sequence to uid mapping at exponentially
+ * growing distances from the end, so that a server which forgot about
+ * old expunges can still tell which of our uids are gone */
+char*
+camel_imap_folder_get_qresync_params (CamelImapFolder *imap_folder, const char *highestmodseq)
+{
+	CamelFolderSummary *summary = ((CamelFolder *) imap_folder)->summary;
+	unsigned long seqs[32], uids[32], first;
+	int count, seq, step, n = 0, i;
+	GString *params;
+
+	params = g_string_new ("");
+	g_string_append_printf (params, "%u %s",
+		CAMEL_IMAP_SUMMARY (summary)->validity, highestmodseq);
+
+	count = camel_folder_summary_count (summary);
+
+	for (seq = count, step = 1; seq > 0 && n < G_N_ELEMENTS (seqs); seq -= step, step *= 2) {
+		uids[n] = summary_uid_numeric (summary, seq - 1);
+		if (uids[n] == 0)
+			break;
+		seqs[n++] = seq;
+	}
+
+	first = count > 0 ? summary_uid_numeric (summary, 0) : 0;
+
+	if (n > 0 && first > 0) {
+		g_string_append_printf (params, " %lu:%lu (", first, uids[0]);
+		for (i = n - 1; i >= 0; i--)
+			g_string_append_printf (params, i ? "%lu," : "%lu ", seqs[i]);
+		for (i = n - 1; i >= 0; i--)
+			g_string_append_printf (params, i ? "%lu," : "%lu)", uids[i]);
+	}
+
+	return g_string_free (params, FALSE);
+}
+
+/* Removes the messages of one range of a VANISHED uid set. Unlike
+ * imap_uid_set_to_array this never makes up uids we don't have, so a
+ * range like 1:4000000 costs at most what's in the summary */
+static void
+vanished_range (CamelFolder *folder, unsigned long first, unsigned long last, CamelFolderChangeInfo *changes)
+{
+	GPtrArray *uids = g_ptr_array_new ();
+	int i, count = camel_folder_summary_count (folder->summary);
+
+	if (last - first < (unsigned long) count) {
+		unsigned long uid;
+
+		for (uid = first; uid <= last; uid++) {
+			char *str = g_strdup_printf ("%lu", uid);
+			CamelMessageInfo *info = camel_folder_summary_uid (folder->summary, str);
+
+			if (info) {
+				g_ptr_array_add (uids, str);
+				camel_message_info_free (info);
+			} else
+				g_free (str);
+		}
+	} else {
+		for (i = 0; i < count; i++) {
+			unsigned long uid = summary_uid_numeric (folder->summary, i);
+
+			if (uid > last)
+				break;
+			if (uid >= first)
+				g_ptr_array_add (uids, g_strdup_printf ("%lu", uid));
+		}
+	}
+
+	camel_imap_folder_changed_for_uids (folder, uids, changes);
+	imap_uid_array_free (uids);
+}
+
 static void
 handle_vanished (CamelFolder *folder, char *resp, CamelFolderChangeInfo *changes)
 {
@@ -469,12 +607,42 @@ handle_vanished (CamelFolder *folder, char *resp, CamelFolderChangeInfo *changes
 		str = resp+9;
 
 	for (uidset = strtok_r (str, ",", &lasts); uidset; uidset = strtok_r (NULL, ",", &lasts)) {
-		GPtrArray *parray = imap_uid_set_to_array (folder->summary, uidset);
-		camel_imap_folder_changed_for_uids (folder, parray, changes);
-		imap_uid_array_free (parray);
+		unsigned long first, last;
+		char *end;
+
+		first = strtoul (uidset, &end, 10);
+		last = (*end == ':') ? strtoul (end + 1, NULL, 10) : first;
+		if (last < first) {
+			unsigned long tmp = first;
+			first = last;
+			last = tmp;
+		}
+
+		if (first > 0)
+			vanished_range (folder, first, last, changes);
 	}
 }
 
+/**
+ * camel_imap_folder_vanished:
+ * @folder: the selected folder
+ * @resp: an untagged VANISHED response
+ *
+ * With QRESYNC enabled the server sends VANISHED instead of EXPUNGE,
+ * this removes those uids from the summary and emits folder_changed.
+ **/
+void
+camel_imap_folder_vanished (CamelFolder *folder, char *resp)
+{
+	CamelFolderChangeInfo *changes = camel_folder_change_info_new ();
+
+	handle_vanished (folder, resp, changes);
+
+	if (camel_folder_change_info_changed (changes))
+		camel_object_trigger_event (CAMEL_OBJECT (folder), "folder_changed", changes);
+	camel_folder_change_info_free (changes);
+}
+
 /* Called with the store's connect_lock locked */
 
 
@@ -513,10 +681,18 @@ camel_imap_folder_selected (CamelFolder *folder, CamelImapResponse *response,
 	char *resp, *phighestmodseq = NULL, *highestmodseq = NULL;
 	CamelImapStore *store = CAMEL_IMAP_STORE (folder->parent_store);
 	gboolean removals = FALSE, condstore = FALSE, needtoput=FALSE, suc=FALSE;
+	gboolean qresync = FALSE;
 	CamelFolderChangeInfo *changes = NULL;
 
 	count = camel_folder_summary_count (folder->summary);
 
+	/* camel_imap_command sent QRESYNC if it had a modseq for us */
+	if (store->capabilities & IMAP_CAPABILITY_QRESYNC) {
+		char *modseq = get_highestmodseq (imap_folder);
+		qresync = (modseq != NULL);
+		g_free (modseq);
+	}
+
 	/* With CONDSTORE this is the typical output.
 	 * C: A142 SELECT INBOX (CONDSTORE)
 	 * S: * 172 EXISTS
@@ -527,7 +703,14 @@ camel_imap_folder_selected (CamelFolder *folder, CamelImapResponse *response,
 	 * S: * FLAGS (\Answered \Flagged \Deleted \Seen \Draft)
 	 * S: * OK [PERMANENTFLAGS (\Deleted \Seen \*)] Limited
 	 * S: * OK [HIGHESTMODSEQ 715194045007]
-	 * S: A142 OK [READ-WRITE] SELECT completed, CONDSTORE is now enabled */
+	 * S: A142 OK [READ-WRITE] SELECT completed, CONDSTORE is now enabled
+	 *
+	 * And with QRESYNC, only what changed since the modseq we passed:
+	 * C: A02 SELECT INBOX (QRESYNC (67890007 90060115194045000 41:211 (1,9 41,58)))
+	 * S: * OK [HIGHESTMODSEQ 90060115205545359]
+	 * S: * VANISHED (EARLIER) 41,43:116,118,120:211
+	 * S: * 49 FETCH (UID 117 FLAGS (\Seen \Answered) MODSEQ (90060115194045001))
+	 * S: A02 OK [READ-WRITE] mailbox selected */
 
 	for (i = 0; i < response->untagged->len; i++)
 	{
@@ -600,7 +783,8 @@ camel_imap_folder_selected (CamelFolder *folder, CamelImapResponse *response,
 				char *nresp = g_strdup_printf ("* %d%s", (int)num, resp);
 				if (changes == NULL)
 					changes = camel_folder_change_info_new();
-				if (process_condstore_line (imap_folder, nresp, changes) == -1)
+				if ((qresync ? process_qresync_line (imap_folder, nresp, changes) :
+					       process_condstore_line (imap_folder, nresp, changes)) == -1)
 					g_warning ("Invalid QRESYNC response: (%s)", nresp);
 				g_free (nresp);
 			}
@@ -611,9 +795,16 @@ camel_imap_folder_selected (CamelFolder *folder, CamelImapResponse *response,
 			if (changes == NULL)
 				changes = camel_folder_change_info_new();
 			handle_vanished (folder, resp, changes);
+			/* camel_imap_response_free would do it again */
+			g_free (response->untagged->pdata[i]);
+			g_ptr_array_remove_index (response->untagged, i--);
 		}
 	}
 
+	/* A NOMODSEQ mailbox ignores the QRESYNC parameters */
+	if (!condstore)
+		qresync = FALSE;
+
 	if (camel_strstrcase (response->status, "OK [READ-ONLY]"))
 	{
 		folder->folder_flags |= CAMEL_FOLDER_IS_READONLY;
@@ -683,7 +874,7 @@ camel_imap_folder_selected (CamelFolder *folder, CamelImapResponse *response,
 	 * happened. This CONDSTORE code does not yet support expunges.
 	 * Therefore we will simply use the old code. */
 
-	if (count > exists || (!(store->capabilities & IMAP_CAPABILITY_QRESYNC)))
+	if (!qresync || count > exists)
 	{
 		/* If we still have more local than remote, something in the
 		 * VANISHED line didn't work :-\, if count is < exist then
@@ -785,9 +976,15 @@ camel_imap_folder_selected (CamelFolder *folder, CamelImapResponse *response,
 
 		imap_folder->cancel_occurred = FALSE;
 	} else {
-		/* Wow, this IMAP server rocks! it has QRESYNC! Hi there Isode!*/
+		/* Wow, this IMAP server rocks! it has QRESYNC! Hi there Isode!
+		 * The VANISHED and FETCH lines above were all that changed,
+		 * what's left are the new messages at the end */
 		suc = TRUE;
 		needtoput = TRUE;
+		imap_folder->need_rescan = FALSE;
+
+		if (phighestmodseq != NULL)
+			g_free (phighestmodseq);
 
 		if (exists > count)
 			camel_imap_folder_changed (folder, exists, NULL, ex);
@@ -1027,26 +1224,72 @@ flags_to_label(CamelFolder *folder, CamelImapMessageInfo *mi)
 #endif
 
 
+static void
+apply_server_flags (CamelFolder *folder, CamelImapMessageInfo *iinfo, guint32 flags, CamelFolderChangeInfo *changes)
+{
+	guint32 server_set, server_cleared;
+
+	if (flags == iinfo->server_flags)
+		return;
+
+	camel_folder_summary_touch (folder->summary);
+	server_set = flags & ~iinfo->server_flags;
+	server_cleared = iinfo->server_flags & ~flags;
+	iinfo->info.flags = (iinfo->info.flags | server_set) & ~server_cleared;
+	iinfo->server_flags = flags;
+	if (changes)
+		camel_folder_change_info_change_uid (changes, camel_message_info_uid (iinfo));
+	/* flags_to_label(folder, (CamelImapMessageInfo *)info); */
+}
+
+/* A FETCH in the response to a QRESYNC SELECT. The VANISHED (EARLIER)
+ * might come after it, so the sequence number can't be trusted yet, but
+ * the uid can. Uids we don't know are new messages, those are left for
+ * camel_imap_folder_changed */
+static int
+process_qresync_line (CamelImapFolder *imap_folder, char *resp, CamelFolderChangeInfo *changes)
+{
+	CamelFolder *folder = (CamelFolder *) imap_folder;
+	CamelImapFetchRecord record;
+	CamelMessageInfo *info;
+	char *uid;
+
+	if (!imap_parse_fetch_record (resp, &record) || !record.uid)
+		return -1;
+
+	if (!(record.fields & IMAP_FETCH_FLAGS))
+		return 0;
+
+	uid = g_alloca (record.uid_len + 1);
+	memcpy (uid, record.uid, record.uid_len);
+	uid[record.uid_len] = '\0';
+
+	info = camel_folder_summary_uid (folder->summary, uid);
+	if (info) {
+		apply_server_flags (folder, (CamelImapMessageInfo *) info, record.flags, changes);
+		camel_message_info_free (info);
+	}
+
+	return 0;
+}
+
 static int
 process_condstore_line (CamelImapFolder *imap_folder, char *resp, CamelFolderChangeInfo *changes)
 {
 	gint retval = 0, summary_len;
-	GData *data;
-	char *uid;
+	CamelImapFetchRecord record;
 	guint32 flags, seq;
 	CamelMessageInfo *info;
 	CamelImapMessageInfo *iinfo;
 	CamelFolder *folder = (CamelFolder *) imap_folder;
 
 	summary_len = camel_folder_summary_count (folder->summary);
-	data = parse_fetch_response (imap_folder, resp);
 
-	if (!data)
+	if (!imap_parse_fetch_record (resp, &record))
 		return -1;
 
-	uid = g_datalist_get_data (&data, "UID");
-	flags = GPOINTER_TO_UINT (g_datalist_get_data (&data, "FLAGS"));
-	seq = GPOINTER_TO_UINT (g_datalist_get_data (&data, "SEQUENCE"));
+	flags = record.flags;
+	seq = record.seq;
 
 	/* So basically: if the UID is not found locally, we have flags
 	 * for a new message. That's cool, but not an error as the
@@ -1061,10 +1304,8 @@ process_condstore_line (CamelImapFolder *imap_folder, char *resp, CamelFolderCha
 	 * int, but it's just for security-clarity here. Let it be, it
 	 * doesn't hurt either) */
 
-	if (!uid /*|| seq < 0 */|| seq-1 > summary_len) {
-		g_datalist_clear (&data);
+	if (!record.uid /*|| seq < 0 */|| seq-1 > summary_len)
 		return -1;
-	}
 
 	info = camel_folder_summary_index (folder->summary, seq-1);
 	iinfo = (CamelImapMessageInfo *) info;
@@ -1080,22 +1321,9 @@ process_condstore_line (CamelImapFolder *imap_folder, char *resp, CamelFolderCha
 
 	if (info)
 	{
-		/* printf ("%s vs %s on %d\n", info->uid, uid, seq-1); */
-		if (!strcmp (info->uid, uid))
+		if (imap_fetch_record_uid_equal (&record, info->uid))
 		{
-		  if (flags != iinfo->server_flags)
-		  {
-			guint32 server_set, server_cleared;
-
-			camel_folder_summary_touch (folder->summary);
-			server_set = flags & ~iinfo->server_flags;
-			server_cleared = iinfo->server_flags & ~flags;
-			iinfo->info.flags = (iinfo->info.flags | server_set) & ~server_cleared;
-			iinfo->server_flags = flags;
-			if (changes)
-				camel_folder_change_info_change_uid(changes, uid);
-			/* flags_to_label(folder, (CamelImapMessageInfo *)info); */
-		  }
+		  apply_server_flags (folder, iinfo, flags, changes);
 		  camel_message_info_free (info);
 		} else {
 			imap_folder->need_rescan = TRUE;
@@ -1104,8 +1332,6 @@ process_condstore_line (CamelImapFolder *imap_folder, char *resp, CamelFolderCha
 	} else
 		retval = -1;
 
-	g_datalist_clear (&data);
-
 	return retval;
 }
 
@@ -1277,24 +1503,19 @@ imap_rescan (CamelFolder *folder, int exists, CamelException *ex)
 	while ((type = camel_imap_command_response (store, &resp, ex))
 	       	== CAMEL_IMAP_RESPONSE_UNTAGGED)
 	{
-		GData *data;
-		char *uid;
-		guint32 flags;
+		CamelImapFetchRecord record;
+		gboolean parsed;
 
-		data = parse_fetch_response (imap_folder, resp);
-		g_free (resp);
-		resp = NULL;
-		if (!data)
-			continue;
-
-		seq = GPOINTER_TO_INT (g_datalist_get_data (&data, "SEQUENCE"));
-		uid = g_datalist_get_data (&data, "UID");
-		flags = GPOINTER_TO_UINT (g_datalist_get_data (&data, "FLAGS"));
+		/* The record points into resp, so it's only freed after */
+		parsed = imap_parse_fetch_record (resp, &record);
+		seq = record.seq;
 
-		if (!uid || !seq || seq > summary_len || seq < 0)
+		if (!parsed || !record.uid || !seq || seq > summary_len || seq < 0)
 		{
-			retval = FALSE;
-			g_datalist_clear (&data);
+			if (parsed)
+				retval = FALSE;
+			g_free (resp);
+			resp = NULL;
 			continue;
 		}
 
@@ -1302,9 +1523,12 @@ imap_rescan (CamelFolder *folder, int exists, CamelException *ex)
 		 * difficult here. */
 
 		camel_operation_progress (NULL, ++summary_got , summary_len);
-		new[seq - 1].uid = g_strdup (uid);
-		new[seq - 1].flags = flags;
-		g_datalist_clear (&data);
+		g_free (new[seq - 1].uid);
+		new[seq - 1].uid = g_strndup (record.uid, record.uid_len);
+		new[seq - 1].flags = record.flags;
+
+		g_free (resp);
+		resp = NULL;
 	}
 
 	camel_operation_end (NULL);
@@ -1504,6 +1728,10 @@ imap_sync_offline (CamelFolder *folder, CamelException *ex)
 	if (folder->summary)
 		camel_folder_summary_save (folder->summary, ex);
 	camel_store_summary_save((CamelStoreSummary *)((CamelImapStore *)folder->parent_store)->summary, ex);
+
+	CAMEL_IMAP_FOLDER_REC_LOCK (folder, cache_lock);
+	camel_imap_message_cache_sync_index (((CamelImapFolder *) folder)->cache);
+	CAMEL_IMAP_FOLDER_REC_UNLOCK (folder, cache_lock);
 }
 
 static void
@@ -2889,6 +3117,14 @@ imap_get_message (CamelFolder *folder, const char *uid, CamelFolderReceiveType t
 		camel_exception_get_id(ex) == CAMEL_EXCEPTION_SERVICE_UNAVAILABLE);
 
 done:
+	/* Whatever text of it is available locally now goes in the body index,
+	 * this is a no-op if it's in there already */
+	if (msg) {
+		CAMEL_IMAP_FOLDER_REC_LOCK (imap_folder, cache_lock);
+		camel_imap_message_cache_index (imap_folder->cache, uid, msg);
+		CAMEL_IMAP_FOLDER_REC_UNLOCK (imap_folder, cache_lock);
+	}
+
 	camel_message_info_free(&mi->info);
 	return msg;
 
@@ -3021,28 +3257,29 @@ decode_internaldate (const unsigned char *in)
 
 
 static CamelImapMessageInfo*
-message_from_data (CamelFolder *folder, GData *data)
+message_from_record (CamelFolder *folder, CamelImapFetchRecord *record)
 {
 	CamelMimeMessage *msg;
 	CamelStream *stream;
 	CamelImapMessageInfo *mi;
-	const char *idate;
 	gint size = 0;
 	struct _camel_header_raw *h;
 
-	stream = g_datalist_get_data (&data, "BODY_PART_STREAM");
+	stream = fetch_record_part_stream ((CamelImapFolder *) folder, record);
 	if (!stream)
 		return NULL;
 
 	msg = camel_mime_message_new ();
 	if (camel_data_wrapper_construct_from_stream (CAMEL_DATA_WRAPPER (msg), stream) == -1) {
+		camel_object_unref (CAMEL_OBJECT (stream));
 		camel_object_unref (CAMEL_OBJECT (msg));
 		return NULL;
 	}
+	camel_object_unref (CAMEL_OBJECT (stream));
 
 	mi = (CamelImapMessageInfo *)camel_folder_summary_info_new_from_message (folder->summary, msg);
 
-	size = GPOINTER_TO_INT (g_datalist_get_data (&data, "RFC822.SIZE"));
+	size = record->size;
 	if (size)
 		mi->info.size = size;
 
@@ -3071,8 +3308,9 @@ message_from_data (CamelFolder *folder, GData *data)
 	 * message got written to the store. It's often not the same as the date
 	 * in the "Received" headers. */
 
-	if ((idate = g_datalist_get_data (&data, "INTERNALDATE")))
-		mi->info.date_received = decode_internaldate ((const unsigned char *) idate);
+	/* decode_internaldate stops at the closing quote by itself */
+	if (record->idate)
+		mi->info.date_received = decode_internaldate ((const unsigned char *) record->idate);
 
 	return mi;
 }
@@ -3173,7 +3411,7 @@ construct_junk_headers (char *header, char *value, struct _junk_data *jdata)
 #ifdef NON_TINYMAIL_FEATURES
 #define CAMEL_MESSAGE_INFO_HEADERS "DATE FROM TO CC SUBJECT REFERENCES IN-REPLY-TO MESSAGE-ID MIME-VERSION CONTENT-TYPE X-PRIORITY X-MSMAIL-PRIORITY"
 #else
-#define CAMEL_MESSAGE_INFO_HEADERS "DATE FROM TO CC SUBJECT MESSAGE-ID X-PRIORITY X-MSMAIL-PRIORITY IMPORTANCE X-MS-HAS-ATTACH CONTENT-TYPE"
+#define CAMEL_MESSAGE_INFO_HEADERS "DATE FROM TO CC SUBJECT MESSAGE-ID REFERENCES IN-REPLY-TO X-PRIORITY X-MSMAIL-PRIORITY IMPORTANCE X-MS-HAS-ATTACH CONTENT-TYPE"
 #endif
 
 
@@ -3209,14 +3447,13 @@ imap_get_uids (CamelFolder *folder, CamelImapStore *store, CamelException *ex, G
 				cnt++;
 			}
 		} else {
-			GData *data = parse_fetch_response ((CamelImapFolder *)folder, resp);
-			int sequence = GPOINTER_TO_INT (g_datalist_get_data (&data, "SEQUENCE"));
-			char *uid = g_datalist_get_data (&data, "UID");
-			if (sequence > greater_than && uid) {
-				g_ptr_array_add (needheaders, g_strdup (uid));
+			CamelImapFetchRecord record;
+
+			if (imap_parse_fetch_record (resp, &record) &&
+			    record.seq > greater_than && record.uid) {
+				g_ptr_array_add (needheaders, g_strndup (record.uid, record.uid_len));
 				cnt++;
 			}
-			g_datalist_clear (&data);
 		}
 
 		g_free (resp);
@@ -3251,21 +3488,344 @@ imap_search_request_string (CamelImapFolder *imap_folder)
 }
 
 
+/* The flags and uid of a header FETCH on top of what message_from_record
+ * gets out of it */
+static CamelImapMessageInfo *
+fetched_info_from_record (CamelFolder *folder, CamelImapFetchRecord *record)
+{
+	CamelImapMessageInfo *mi = message_from_record (folder, record);
+
+	if (!mi)
+		return NULL;
+
+	if (record->flags)
+	{
+		mi->server_flags = record->flags;
+		mi->info.flags |= record->flags;
+		/* flags_to_label(folder, mi); */
+	}
+
+	if (record->uid)
+	{
+		if (mi->info.uid)
+			g_free (mi->info.uid);
+		mi->info.uid = g_strndup (record->uid, record->uid_len);
+	}
+
+	return mi;
+}
+
+/* Appends a fetched info to the summary, correcting the summary if the
+ * server's sequence number for it says that we are out of sync */
 static void
-imap_update_summary (CamelFolder *folder, int exists,
-		     CamelFolderChangeInfo *changes,
-		     CamelException *ex)
+add_fetched_info (CamelFolder *folder, CamelImapMessageInfo *mi, guint32 sequence,
+		  int exists, CamelFolderChangeInfo *mchanges, gboolean *oosync)
+{
+	guint32 curlen = camel_folder_summary_count (folder->summary);
+
+	if (sequence > 0 && sequence <= exists && sequence != curlen)
+	{
+		int r;
+		if (curlen > sequence)
+		{
+			for (r = curlen-1; r > sequence; r--)
+			{
+				CamelMessageInfo *ri;
+				g_warning ("Problem with your local summary store (too much), correcting: curlen=%d, r=%d, seq=%d\n", curlen, r, sequence);
+				ri = g_ptr_array_index (folder->summary->messages, r);
+				if (ri) {
+					/* camel_folder_change_info_remove_uid (mchange, camel_message_info_uid (mi)); */
+					((CamelMessageInfoBase*)ri)->flags |= CAMEL_MESSAGE_EXPUNGED;
+					((CamelMessageInfoBase*)ri)->flags |= CAMEL_MESSAGE_FREED;
+					camel_folder_summary_remove (folder->summary, ri);
+				}
+			}
+		} else {
+			for (r=0; r < sequence - curlen - 1; r++)
+			{
+				CamelMessageInfo *ni = camel_message_info_clone (mi);
+				if (ni) {
+					g_warning ("Problem with your local summary store (too few), correcting: curlen=%d, r=%d, seq=%d\n", curlen, r, sequence);
+					camel_folder_summary_add (folder->summary, (CamelMessageInfo *)ni);
+					/* camel_folder_change_info_add_uid (mchanges, camel_message_info_uid (ni)); */
+				}
+			}
+		}
+		*oosync = TRUE;
+	}
+
+	camel_folder_summary_add (folder->summary, (CamelMessageInfo *)mi);
+
+	/* printf ("Change: %s!\n", camel_message_info_uid (mi)); */
+	camel_folder_change_info_add_uid (mchanges, camel_message_info_uid (mi));
+	if ((mi->info.flags & CAMEL_IMAP_MESSAGE_RECENT))
+		camel_folder_change_info_recent_uid(mchanges, camel_message_info_uid (mi));
+}
+
+/* Parallel header download, opt-in with the header_connections url
+ * parameter. A batch of new uids is split in consecutive ranges: the
+ * first range is fetched on the folder's own connection, the others on
+ * extra connections in their own threads. The infos are only added to
+ * the summary after all of them are done, in uid order */
+
+#define PARALLEL_HEADERS_MIN 200	/* don't split ranges smaller than this */
+
+typedef struct {
+	CamelFolder *folder;
+	CamelImapStore *store;
+	GPtrArray *uids;		/* sorted, a slice of needheaders */
+	const char *header_spec;
+	CamelOperation *cc;
+
+	GPtrArray *infos;		/* what came back, in the order it came */
+	GArray *seqs;
+	gboolean complete;
+	CamelException ex;
+} HeaderRange;
+
+static CamelImapStore *
+create_header_store (CamelImapFolder *imap_folder)
+{
+	CamelFolder *folder = (CamelFolder *) imap_folder;
+	CamelService *parent = CAMEL_SERVICE (folder->parent_store);
+	CamelException ex = CAMEL_EXCEPTION_INITIALISER;
+	CamelImapStore *store;
+
+	store = CAMEL_IMAP_STORE (camel_object_new (CAMEL_IMAP_STORE_TYPE));
+
+	/* Like the get-message store, this one must leave the summary to
+	 * the folder's own connection */
+	camel_url_set_param (parent->url, "dont_touch_summary", "yes");
+	camel_service_construct (CAMEL_SERVICE (store),
+		camel_service_get_session (parent),
+		camel_service_get_provider (parent),
+		parent->url, &ex);
+	CAMEL_SERVICE (store)->data = parent->data;
+
+	if (!camel_exception_is_set (&ex))
+		camel_service_connect (CAMEL_SERVICE (store), &ex);
+
+	if (camel_exception_is_set (&ex) || !camel_disco_store_check_online (CAMEL_DISCO_STORE (store), &ex)) {
+		imap_debug ("Header connection failed: %s\n", camel_exception_get_description (&ex));
+		camel_exception_clear (&ex);
+		camel_object_unref (store);
+		return NULL;
+	}
+
+	return store;
+}
+
+/* Takes up to wanted of the account's header connections */
+static int
+reserve_header_connections (CamelImapStore *store, int wanted)
+{
+	int got = 0;
+
+	while (got < wanted) {
+		int busy = g_atomic_int_get (&store->header_connections_busy);
+
+		if (busy >= (int) store->header_connections)
+			break;
+		if (g_atomic_int_compare_and_exchange (&store->header_connections_busy, busy, busy + 1))
+			got++;
+	}
+
+	return got;
+}
+
+static void
+header_stores_free (CamelImapStore *parent, GPtrArray *pool)
+{
+	int i;
+
+	for (i = 0; i < pool->len; i++) {
+		CamelImapStore *store = pool->pdata[i];
+
+		camel_service_disconnect (CAMEL_SERVICE (store), TRUE, NULL);
+		camel_object_unref (store);
+	}
+
+	g_atomic_int_add (&parent->header_connections_busy, -((int) pool->len));
+	g_ptr_array_free (pool, TRUE);
+}
+
+/* Grows the pool to what the account allows, the first time it's needed */
+static void
+header_stores_fill (CamelImapFolder *imap_folder, GPtrArray *pool)
+{
+	CamelImapStore *parent = CAMEL_IMAP_STORE (((CamelFolder *) imap_folder)->parent_store);
+	int wanted = reserve_header_connections (parent, parent->header_connections - pool->len);
+
+	while (wanted-- > 0) {
+		CamelImapStore *store = create_header_store (imap_folder);
+
+		if (!store) {
+			g_atomic_int_add (&parent->header_connections_busy, -(wanted + 1));
+			break;
+		}
+		g_ptr_array_add (pool, store);
+	}
+}
+
+static gpointer
+fetch_header_range (gpointer data)
+{
+	HeaderRange *range = data;
+	CamelFolder *folder = range->folder;
+	CamelImapResponseType type = CAMEL_IMAP_RESPONSE_TAGGED;
+	int uid = 0;
+
+	if (range->cc)
+		camel_operation_register (range->cc);
+
+	while (uid < range->uids->len)
+	{
+		char *uidset, *resp = NULL;
+
+		uidset = imap_uid_array_to_set (folder->summary, range->uids, uid, UID_SET_LIMIT, &uid);
+		if (!camel_imap_command_start (range->store, folder, &range->ex,
+					       "UID FETCH %s (FLAGS RFC822.SIZE INTERNALDATE BODY.PEEK[%s])",
+					       uidset, range->header_spec)) {
+			g_free (uidset);
+			type = CAMEL_IMAP_RESPONSE_ERROR;
+			break;
+		}
+		g_free (uidset);
+
+		while ((type = camel_imap_command_response (range->store, &resp, &range->ex))
+			== CAMEL_IMAP_RESPONSE_UNTAGGED)
+		{
+			CamelImapFetchRecord record;
+			CamelImapMessageInfo *mi = NULL;
+
+			if (imap_parse_fetch_record (resp, &record))
+				mi = fetched_info_from_record (folder, &record);
+
+			if (mi) {
+				g_ptr_array_add (range->infos, mi);
+				g_array_append_val (range->seqs, record.seq);
+			}
+
+			g_free (resp); resp = NULL;
+		}
+		g_free (resp);
+
+		if (type == CAMEL_IMAP_RESPONSE_ERROR)
+			break;
+	}
+
+	range->complete = (type != CAMEL_IMAP_RESPONSE_ERROR);
+
+	if (range->cc)
+		camel_operation_unregister (range->cc);
+
+	return NULL;
+}
+
+/* Fetches the headers of needheaders (sorted) over the folder's connection
+ * and the pool, and adds them to the summary. Returns how many of the
+ * uids in needheaders it took care of, the caller fetches the rest the
+ * normal way. That's what's left after the first range that failed, so
+ * that the summary never gets a hole */
+static guint
+fetch_headers_parallel (CamelFolder *folder, GPtrArray *pool, GPtrArray *needheaders,
+			const char *header_spec, int exists, CamelFolderChangeInfo *mchanges,
+			guint *ucnt, guint *allhdrs, guint ineed, gboolean *oosync)
+{
+	CamelImapStore *store = CAMEL_IMAP_STORE (folder->parent_store);
+	HeaderRange *ranges;
+	GThread **threads;
+	guint nranges, per, done = 0;
+	int i, j;
+
+	if (pool->len < store->header_connections)
+		header_stores_fill ((CamelImapFolder *) folder, pool);
+
+	nranges = MIN (pool->len + 1, needheaders->len / PARALLEL_HEADERS_MIN);
+	if (nranges < 2)
+		return 0;
+
+	per = (needheaders->len + nranges - 1) / nranges;
+	ranges = g_new0 (HeaderRange, nranges);
+	threads = g_new0 (GThread *, nranges);
+
+	for (i = 0; i < nranges; i++) {
+		guint first = i * per, last = MIN (first + per, needheaders->len);
+
+		ranges[i].folder = folder;
+		ranges[i].store = i == 0 ? store : pool->pdata[i - 1];
+		ranges[i].uids = g_ptr_array_sized_new (last - first);
+		for (j = first; j < last; j++)
+			g_ptr_array_add (ranges[i].uids, needheaders->pdata[j]);
+		ranges[i].header_spec = header_spec;
+		ranges[i].cc = i == 0 ? NULL : camel_operation_registered ();
+		ranges[i].infos = g_ptr_array_new ();
+		ranges[i].seqs = g_array_new (FALSE, FALSE, sizeof (guint32));
+		camel_exception_init (&ranges[i].ex);
+
+		if (i > 0)
+			threads[i] = g_thread_create (fetch_header_range, &ranges[i], TRUE, NULL);
+	}
+
+	/* The folder's own connection is locked by this thread, so its
+	 * range is fetched here */
+	fetch_header_range (&ranges[0]);
+
+	for (i = 1; i < nranges; i++)
+		if (threads[i])
+			g_thread_join (threads[i]);
+		else
+			ranges[i].complete = FALSE;
+
+	for (i = 0; i < nranges; i++) {
+		gboolean merge = done == i * per && ranges[i].complete;
+
+		for (j = 0; j < ranges[i].infos->len; j++) {
+			CamelImapMessageInfo *mi = ranges[i].infos->pdata[j];
+
+			if (merge) {
+				(*ucnt)++;
+				(*allhdrs)++;
+				add_fetched_info (folder, mi, g_array_index (ranges[i].seqs, guint32, j),
+						  exists, mchanges, oosync);
+			} else
+				camel_message_info_free (mi);
+		}
+
+		if (merge)
+			done = i * per + ranges[i].uids->len;
+		else if (ranges[i].store != store)
+			camel_service_disconnect (CAMEL_SERVICE (ranges[i].store), FALSE, NULL);
+
+		if (ranges[i].cc)
+			camel_operation_unref (ranges[i].cc);
+		g_ptr_array_free (ranges[i].infos, TRUE);
+		g_array_free (ranges[i].seqs, TRUE);
+		g_ptr_array_free (ranges[i].uids, TRUE);
+		camel_exception_clear (&ranges[i].ex);
+	}
+
+	camel_operation_progress (NULL, *allhdrs, ineed);
+
+	g_free (threads);
+	g_free (ranges);
+
+	return done;
+}
+
+static void
+update_summary_batches (CamelFolder *folder, int exists,
+			CamelFolderChangeInfo *changes, GPtrArray *pool,
+			CamelException *ex)
 {
    CamelImapStore *store = CAMEL_IMAP_STORE (folder->parent_store);
    CamelImapFolder *imap_folder = CAMEL_IMAP_FOLDER (folder);
    GPtrArray *needheaders;
-   guint32 flags;
    int seq=0;
    CamelImapResponseType type;
    const char *header_spec;
    CamelImapMessageInfo *mi;
    char *resp;
-   GData *data;
    gboolean more = TRUE, oosync = FALSE, oldrescval = imap_folder->need_rescan;
    unsigned int nextn, cnt=0, tcnt=0, ucnt=0, ineed = 0, allhdrs = 0;
    gboolean do_the_save = TRUE;
@@ -3488,6 +4048,10 @@ imap_update_summary (CamelFolder *folder, int exists,
 		mchanges = camel_folder_change_info_new ();
 		mchanges->push_email_event = changes->push_email_event;
 
+		if (store->header_connections > 0)
+			uid = fetch_headers_parallel (folder, pool, needheaders,
+				header_spec, exists, mchanges, &ucnt, &allhdrs, ineed, &oosync);
+
 		while (uid < needheaders->len)
 		{
 			uidset = imap_uid_array_to_set (folder->summary, needheaders, uid, UID_SET_LIMIT, &uid);
@@ -3524,82 +4088,27 @@ imap_update_summary (CamelFolder *folder, int exists,
 			while ((type = camel_imap_command_response (store, &resp, ex))
 				== CAMEL_IMAP_RESPONSE_UNTAGGED)
 			{
-				gchar *muid;
-				guint32 sequence, curlen;
-
-				data = parse_fetch_response (imap_folder, resp);
-				g_free (resp); resp = NULL;
+				CamelImapFetchRecord record;
 
-				if (!data)
+				if (!imap_parse_fetch_record (resp, &record)) {
+					g_free (resp); resp = NULL;
 					continue;
+				}
 
-				mi = message_from_data (folder, data);
+				mi = fetched_info_from_record (folder, &record);
 
 				if (mi)
 				{
-				  flags = GPOINTER_TO_INT (g_datalist_get_data (&data, "FLAGS"));
-				  if (flags)
-				  {
-					mi->server_flags = flags;
-					mi->info.flags |= flags;
-					/* flags_to_label(folder, mi); */
-				  }
-
-				  muid = g_datalist_get_data (&data, "UID");
-
-				  if (muid)
-				  {
-					if (mi->info.uid)
-						g_free (mi->info.uid);
-					mi->info.uid = g_strdup (muid);
-				  }
-
 				  ucnt++;
 
 				  allhdrs++;
 				  camel_operation_progress (NULL, allhdrs , ineed);
-				  sequence = GPOINTER_TO_INT (g_datalist_get_data (&data, "SEQUENCE"));
-				  curlen = camel_folder_summary_count (folder->summary);
-
-				  if (sequence > 0 && sequence <= exists && sequence != curlen)
-				  {
-				  	int r;
-				  	if (curlen > sequence)
-				  	{
-				  		for (r = curlen-1; r > sequence; r--)
-				  		{
-				  			CamelMessageInfo *ri;
-				  			g_warning ("Problem with your local summary store (too much), correcting: curlen=%d, r=%d, seq=%d\n", curlen, r, sequence);
-				  			ri = g_ptr_array_index (folder->summary->messages, r);
-				  			if (ri) {
-				  				/* camel_folder_change_info_remove_uid (mchange, camel_message_info_uid (mi)); */
-				  				((CamelMessageInfoBase*)ri)->flags |= CAMEL_MESSAGE_EXPUNGED;
-				  				((CamelMessageInfoBase*)ri)->flags |= CAMEL_MESSAGE_FREED;
-				  				camel_folder_summary_remove (folder->summary, ri);
-				  			}
-				  		}
-				  	} else {
-				  		for (r=0; r < sequence - curlen - 1; r++)
-				  		{
-				  			CamelMessageInfo *ni = camel_message_info_clone (mi);
-				  			if (ni) {
-				  				g_warning ("Problem with your local summary store (too few), correcting: curlen=%d, r=%d, seq=%d\n", curlen, r, sequence);
-				  				camel_folder_summary_add (folder->summary, (CamelMessageInfo *)ni);
-				  				/* camel_folder_change_info_add_uid (mchanges, camel_message_info_uid (ni)); */
-				  			}
-				  		}
-				  	}
-				  	oosync = TRUE;
-				  }
-
-				  camel_folder_summary_add (folder->summary, (CamelMessageInfo *)mi);
-
-				  /* printf ("Change: %s!\n", camel_message_info_uid (mi)); */
-				  camel_folder_change_info_add_uid (mchanges, camel_message_info_uid (mi));
-				   if ((mi->info.flags & CAMEL_IMAP_MESSAGE_RECENT))
-					camel_folder_change_info_recent_uid(mchanges, camel_message_info_uid (mi));
+				  add_fetched_info (folder, mi, record.seq, exists, mchanges, &oosync);
 				}
 
+				/* record pointed into it */
+				g_free (resp); resp = NULL;
+
 				if (did_hack) {
 					hcnt++;
 					if (hcnt > 1000) {
@@ -3628,8 +4137,6 @@ imap_update_summary (CamelFolder *folder, int exists,
 						hcnt = 0;
 					}
 				}
-
-				g_datalist_clear (&data);
 			}
 
 			if (resp != NULL)
@@ -3693,6 +4200,22 @@ imap_update_summary (CamelFolder *folder, int exists,
 
 }
 
+static void
+imap_update_summary (CamelFolder *folder, int exists,
+		     CamelFolderChangeInfo *changes,
+		     CamelException *ex)
+{
+	CamelImapStore *store = CAMEL_IMAP_STORE (folder->parent_store);
+	GPtrArray *pool = g_ptr_array_new ();
+
+	update_summary_batches (folder, exists, changes, pool, ex);
+
+	header_stores_free (store, pool);
+
+	if (!camel_exception_is_set (ex))
+		prefetch_structures (folder, changes);
+}
+
 typedef struct {
 	guint32 id;
 	guint32 flags;
@@ -4846,6 +5369,16 @@ imap_get_cache_filename (CamelFolder *folder, const char *uid, const char *spec,
 
 
 
+/* For the files that get written in the directory of the cache directly,
+ * so that the cache knows about their size */
+static void
+cache_add_file (CamelImapFolder *imap_folder, const char *uid, const char *path)
+{
+	CAMEL_IMAP_FOLDER_REC_LOCK (imap_folder, cache_lock);
+	camel_imap_message_cache_add_file (imap_folder->cache, uid, strrchr (path, '/') + 1);
+	CAMEL_IMAP_FOLDER_REC_UNLOCK (imap_folder, cache_lock);
+}
+
 static char * 
 imap_convert (CamelFolder *folder, const char *uid, const char *spec, const char *convert_to, CamelException *ex)
 {
@@ -5058,6 +5591,7 @@ convert_berrorhander:
 
 		if (fil)
 			fclose (fil);
+		cache_add_file (imap_folder, uid, path);
 		stop_gmsgstore (imap_folder, ctchecker, FALSE);
 	}
 	
@@ -5520,6 +6054,7 @@ fetch_retry:
 
 		if (fil)
 			fclose (fil);
+		cache_add_file (imap_folder, uid, path);
 		stop_gmsgstore (imap_folder, ctchecker, FALSE);
 	}
 	
@@ -5584,6 +6119,137 @@ walk_the_string (char *in, GString *str)
 	return;
 }
 
+/* The BODYSTRUCTURE of a FETCH response in the form in which it's cached,
+ * which is what bodystruct_parse wants */
+static char *
+structure_from_record (CamelImapFetchRecord *record)
+{
+	GString *str = g_string_new ("BODYSTRUCTURE ");
+	char *body = g_strndup (record->body, record->body_len);
+
+	walk_the_string (body, str);
+	g_free (body);
+
+	return g_string_free (str, FALSE);
+}
+
+static void
+cache_structure (CamelImapFolder *imap_folder, const char *uid, const char *structure, CamelException *ex)
+{
+	gchar *path = g_strdup_printf ("%s/%s_bodystructure", imap_folder->cache->path, uid);
+	FILE *file = fopen (path, "w");
+
+	if (file) {
+		fputs (structure, file);
+		fclose (file);
+		cache_add_file (imap_folder, uid, path);
+	} else {
+		gchar *mss = g_strdup_printf (_("Write to cache failed: %s"), g_strerror (errno));
+		camel_exception_set (ex, CAMEL_EXCEPTION_SYSTEM_IO_WRITE, mss);
+		g_free (mss);
+	}
+
+	g_free (path);
+}
+
+typedef struct {
+	CamelImapFolder *imap_folder;
+	const char *uid;
+} CacheHeaderInfo;
+
+/* Puts the BODY[HEADER] or BODY[n.HEADER] of a FETCH response where
+ * imap_fetch looks for the part, so that fetching it later is a cache hit */
+static void
+cache_fetched_header (CamelImapFetchRecord *record, gpointer user_data)
+{
+	CacheHeaderInfo *info = user_data;
+	const char *part;
+	char *to_free, *path;
+	gboolean failed;
+	size_t len, i;
+	FILE *file;
+
+	/* The spec ends up in a file name */
+	if (record->part_spec_len < 6 ||
+	    strncmp (record->part_spec + record->part_spec_len - 6, "HEADER", 6) != 0)
+		return;
+	for (i = 0; i < record->part_spec_len - 6; i++)
+		if (!isdigit ((int) record->part_spec[i]) && record->part_spec[i] != '.')
+			return;
+
+	path = g_strdup_printf ("%s/%s_%.*s_ENCODED", info->imap_folder->cache->path,
+		info->uid, (int) record->part_spec_len, record->part_spec);
+
+	file = fopen (path, "w");
+	if (file) {
+		part = imap_fetch_record_part (record, &len, &to_free);
+		failed = fwrite (part, 1, len, file) != len;
+		if (fclose (file) != 0 || failed)
+			g_unlink (path);
+		else
+			cache_add_file (info->imap_folder, info->uid, path);
+		g_free (to_free);
+	}
+
+	g_free (path);
+}
+
+static void
+append_nested_headers (bodystruct_t *part, GString *items)
+{
+	for (; part != NULL; part = part->next) {
+		if (part->parent != NULL && part->part_spec && *part->part_spec &&
+		    part->content.type && !g_ascii_strcasecmp (part->content.type, "message") &&
+		    part->content.subtype && !g_ascii_strcasecmp (part->content.subtype, "rfc822"))
+			g_string_append_printf (items, "%sBODY.PEEK[%s.HEADER]",
+				items->len > 0 ? " " : "", part->part_spec);
+
+		append_nested_headers (part->subparts, items);
+	}
+}
+
+/* The headers of the attached messages are wanted right after the structure
+ * too, so they are fetched together. Failing is fine, they are fetched one
+ * by one then */
+static void
+prefetch_nested_headers (CamelImapStore *store, CamelImapFolder *imap_folder, const char *uid, char *structure)
+{
+	CamelException ex = CAMEL_EXCEPTION_INITIALISER;
+	CamelImapResponse *response;
+	CamelImapFetchRecord record;
+	CacheHeaderInfo info;
+	bodystruct_t *bodystructure;
+	GError *err = NULL;
+	GString *items;
+	int i;
+
+	bodystructure = bodystruct_parse ((guchar *) structure, strlen (structure), &err);
+	if (err) {
+		g_error_free (err);
+		return;
+	}
+
+	items = g_string_new ("");
+	append_nested_headers (bodystructure, items);
+	bodystruct_free (bodystructure);
+
+	if (items->len > 0) {
+		response = camel_imap_command (store, (CamelFolder *) imap_folder, &ex,
+			"UID FETCH %s (%s)", uid, items->str);
+		if (response) {
+			info.imap_folder = imap_folder;
+			info.uid = uid;
+			for (i = 0; i < response->untagged->len; i++)
+				imap_parse_fetch_record_parts (response->untagged->pdata[i], &record,
+					cache_fetched_header, &info);
+			camel_imap_response_free (store, response);
+		}
+		camel_exception_clear (&ex);
+	}
+
+	g_string_free (items, TRUE);
+}
+
 static char*
 imap_fetch_structure (CamelFolder *folder, const char *uid, CamelException *ex)
 {
@@ -5594,9 +6260,12 @@ imap_fetch_structure (CamelFolder *folder, const char *uid, CamelException *ex)
 
 	if (file) {
 		struct stat buf;
+		size_t len;
+
 		fstat (fileno (file), &buf);
-		retval = (char *) malloc (buf.st_size + 10);
-		fgets (retval, buf.st_size, file);
+		retval = (char *) g_malloc (buf.st_size + 1);
+		len = fread (retval, 1, buf.st_size, file);
+		retval[len] = '\0';
 		fclose (file);
 	} else {
 
@@ -5606,49 +6275,56 @@ imap_fetch_structure (CamelFolder *folder, const char *uid, CamelException *ex)
 		} else {
 			gboolean ctchecker = FALSE;
 			CamelImapStore *store;
-			GString *bodyst = g_string_new ("");
 			CamelImapResponse *response, *noop_response;
-			gint i = 0; gchar *resp;
-			gboolean hdr_bin=FALSE;
-
-			gchar *mpstr = camel_folder_fetch (folder, uid, "HEADER", &hdr_bin, ex);
-			g_free (mpstr);
+			CamelImapFetchRecord record;
+			CacheHeaderInfo info;
+			gint i;
 
 			store = create_gmsgstore (imap_folder, &ctchecker, ex);
 
 			if (!store)
 				goto frees;
 
-
-			noop_response = camel_imap_command (store, (CamelFolder *) imap_folder, ex, "NOOP");
-			if (noop_response)
-				camel_imap_response_free (store, noop_response);
-			else {
-				stop_gmsgstore (imap_folder, ctchecker, FALSE);
-				goto frees;
+			/* Only a connection that was idle for a while has to be
+			 * checked, a new one just logged in */
+			if (!ctchecker) {
+				noop_response = camel_imap_command (store, (CamelFolder *) imap_folder, ex, "NOOP");
+				if (noop_response)
+					camel_imap_response_free (store, noop_response);
+				else {
+					stop_gmsgstore (imap_folder, ctchecker, FALSE);
+					goto frees;
+				}
 			}
 
 			camel_operation_start (NULL, _("Retrieving message bodystructure"));
 
-			response= camel_imap_command (store, folder, ex,
-				"UID FETCH %s BODYSTRUCTURE", uid);
+			/* The header is wanted right after the structure, asking
+			 * for both at once saves a round trip */
+			response = camel_imap_command (store, folder, ex,
+				"UID FETCH %s (BODYSTRUCTURE BODY.PEEK[HEADER])", uid);
 
 			if (response) {
+				info.imap_folder = imap_folder;
+				info.uid = uid;
+
 				for (i = 0; i < response->untagged->len; i++) {
-					resp = ((char*)response->untagged->pdata[i]) + 2;
-					walk_the_string (resp, bodyst);
+					if (!imap_parse_fetch_record_parts (response->untagged->pdata[i],
+							&record, cache_fetched_header, &info))
+						continue;
+					if ((record.fields & IMAP_FETCH_BODY) && !retval)
+						retval = structure_from_record (&record);
 				}
 
 				camel_imap_response_free (store, response);
 
-				retval = bodyst->str;
-				g_string_free (bodyst, FALSE);
-			} else {
+				if (retval)
+					prefetch_nested_headers (store, imap_folder, uid, retval);
+			}
+
+			if (!retval && !camel_exception_is_set (ex))
 				camel_exception_set (ex, CAMEL_EXCEPTION_SERVICE_PROTOCOL,
 					     _("Failure fetchting BODYSTRUCTURE from IMAP server"));
-				g_string_free (bodyst, TRUE);
-				retval = NULL;
-			}
 
 			stop_gmsgstore (imap_folder, ctchecker, FALSE);
 
@@ -5657,17 +6333,8 @@ imap_fetch_structure (CamelFolder *folder, const char *uid, CamelException *ex)
 			camel_operation_end (NULL);
 		}
 
-		if (retval) {
-			file = fopen (path, "w");
-			if (file) {
-				fputs (retval, file);
-				fclose (file);
-			} else {
-				gchar *mss = g_strdup_printf (_("Write to cache failed: %s"), g_strerror (errno));
-				camel_exception_set (ex, CAMEL_EXCEPTION_SYSTEM_IO_WRITE, mss);
-				g_free (mss);
-			}
-		}
+		if (retval)
+			cache_structure (imap_folder, uid, retval, ex);
 	}
  frees:
 	g_free (path);
@@ -5675,6 +6342,73 @@ imap_fetch_structure (CamelFolder *folder, const char *uid, CamelException *ex)
 	return retval;
 }
 
+/* Caches the BODYSTRUCTURE of the newest of the messages that were added,
+ * as many as the prefetch_bodystructures url parameter says. Opening them
+ * with a bodystructure based receive strategy then starts with fetching
+ * their parts */
+static void
+prefetch_structures (CamelFolder *folder, CamelFolderChangeInfo *changes)
+{
+	CamelImapFolder *imap_folder = CAMEL_IMAP_FOLDER (folder);
+	CamelImapStore *store = CAMEL_IMAP_STORE (folder->parent_store);
+	CamelException ex = CAMEL_EXCEPTION_INITIALISER;
+	CamelImapResponse *response;
+	CamelImapFetchRecord record;
+	GString *set;
+	gchar *path, *uid, *structure;
+	guint i, first;
+
+	if (store->prefetch_bodystructures == 0 || !changes ||
+	    !changes->uid_added || changes->uid_added->len == 0)
+		return;
+
+	/* They are added in the order of the server, the newest last */
+	first = 0;
+	if (changes->uid_added->len > store->prefetch_bodystructures)
+		first = changes->uid_added->len - store->prefetch_bodystructures;
+
+	set = g_string_new ("");
+	for (i = first; i < changes->uid_added->len; i++) {
+		uid = changes->uid_added->pdata[i];
+		path = g_strdup_printf ("%s/%s_bodystructure", imap_folder->cache->path, uid);
+		if (!g_file_test (path, G_FILE_TEST_EXISTS))
+			g_string_append_printf (set, "%s%s", set->len > 0 ? "," : "", uid);
+		g_free (path);
+	}
+
+	if (set->len == 0) {
+		g_string_free (set, TRUE);
+		return;
+	}
+
+	camel_operation_start (NULL, _("Retrieving message bodystructures"));
+
+	response = camel_imap_command (store, folder, &ex, "UID FETCH %s BODYSTRUCTURE", set->str);
+	if (response) {
+		for (i = 0; i < response->untagged->len; i++) {
+			if (!imap_parse_fetch_record (response->untagged->pdata[i], &record) ||
+			    !(record.fields & IMAP_FETCH_UID) || !(record.fields & IMAP_FETCH_BODY) ||
+			    strspn (record.uid, "0123456789") != record.uid_len)
+				continue;
+
+			uid = g_strndup (record.uid, record.uid_len);
+			structure = structure_from_record (&record);
+			cache_structure (imap_folder, uid, structure, &ex);
+			CAMEL_IMAP_FOLDER_REC_LOCK (imap_folder, cache_lock);
+			camel_imap_message_cache_set_partial (imap_folder->cache, uid, TRUE);
+			CAMEL_IMAP_FOLDER_REC_UNLOCK (imap_folder, cache_lock);
+			g_free (structure);
+			g_free (uid);
+		}
+		camel_imap_response_free (store, response);
+	}
+
+	camel_operation_end (NULL);
+
+	camel_exception_clear (&ex);
+	g_string_free (set, TRUE);
+}
+
 CamelStream *
 camel_imap_folder_fetch_data (CamelImapFolder *imap_folder, const char *uid,
 			      const char *section_text, gboolean cache_only,
@@ -6296,148 +7030,88 @@ errorhander:
 
 
 
-static GData *
-parse_fetch_response (CamelImapFolder *imap_folder, char *response)
+/* Gets the BODY[...] data of @record as a stream. Unless it's only some
+ * of the header fields, it gets stored in the message cache on the way */
+static CamelStream *
+fetch_record_part_stream (CamelImapFolder *imap_folder, CamelImapFetchRecord *record)
 {
-	GData *data = NULL;
-	char *start, *part_spec = NULL, *body = NULL, *uid = NULL, *idate = NULL;
-	gboolean cache_header = TRUE, header = FALSE;
-	size_t body_len = 0;
-
-	if (*response != '(') {
-		long seq;
-
-		if (*response != '*' || *(response + 1) != ' ')
-			return NULL;
-		seq = strtoul (response + 2, &response, 10);
-		if (seq == 0)
-			return NULL;
-		if (g_ascii_strncasecmp (response, " FETCH (", 8) != 0)
-			return NULL;
-		response += 7;
+	CamelStream *stream = NULL;
+	const char *part;
+	char *to_free, *uid, *part_spec;
+	size_t len;
 
-		g_datalist_set_data (&data, "SEQUENCE", GINT_TO_POINTER (seq));
-	}
+	if (!(record->fields & IMAP_FETCH_UID) || !(record->fields & IMAP_FETCH_BODY_PART))
+		return NULL;
 
-	do {
-		/* Skip the initial '(' or the ' ' between elements */
-		response++;
-
-		if (!g_ascii_strncasecmp (response, "FLAGS ", 6)) {
-			guint32 flags;
-
-			response += 6;
-			/* FIXME user flags */
-			flags = imap_parse_flag_list (&response);
-
-			g_datalist_set_data (&data, "FLAGS", GUINT_TO_POINTER (flags));
-		} else if (!g_ascii_strncasecmp (response, "RFC822.SIZE ", 12)) {
-			unsigned long size;
-
-			response += 12;
-			size = strtoul (response, &response, 10);
-			g_datalist_set_data (&data, "RFC822.SIZE", GUINT_TO_POINTER (size));
-		} else if (!g_ascii_strncasecmp (response, "BODY[", 5) ||
-			   !g_ascii_strncasecmp (response, "RFC822 ", 7)) {
-			char *p;
-
-			if (*response == 'B') {
-				response += 5;
-
-				/* HEADER], HEADER.FIELDS (...)], or 0] */
-				if (!g_ascii_strncasecmp (response, "HEADER", 6)) {
-					header = TRUE;
-					if (!g_ascii_strncasecmp (response + 6, ".FIELDS", 7))
-						cache_header = FALSE;
-				} else if (!g_ascii_strncasecmp (response, "0]", 2))
-					header = TRUE;
-
-				p = strchr (response, ']');
-				if (!p || *(p + 1) != ' ')
-					break;
+	part = imap_fetch_record_part (record, &len, &to_free);
 
-				if (cache_header)
-					part_spec = g_strndup (response, p - response);
-				else
-					part_spec = g_strdup ("HEADER.FIELDS");
+	if (record->header && !record->cache_header) {
+		stream = camel_stream_mem_new_with_buffer (part, len);
+	} else {
+		uid = g_alloca (record->uid_len + 1);
+		memcpy (uid, record->uid, record->uid_len);
+		uid[record->uid_len] = '\0';
 
-				response = p + 2;
-			} else {
-				part_spec = g_strdup ("");
-				response += 7;
+		part_spec = g_alloca (record->part_spec_len + 1);
+		memcpy (part_spec, record->part_spec, record->part_spec_len);
+		part_spec[record->part_spec_len] = '\0';
 
-				if (!g_ascii_strncasecmp (response, "HEADER", 6))
-					header = TRUE;
-			}
+		CAMEL_IMAP_FOLDER_REC_LOCK (imap_folder, cache_lock);
+		stream = camel_imap_message_cache_insert (imap_folder->cache,
+							  uid, part_spec,
+							  part, len, NULL);
+		CAMEL_IMAP_FOLDER_REC_UNLOCK (imap_folder, cache_lock);
+		if (stream == NULL)
+			stream = camel_stream_mem_new_with_buffer (part, len);
+	}
 
-			body = imap_parse_nstring ((const char **) &response, &body_len);
-			if (!response) {
-				g_free (part_spec);
-				break;
-			}
+	g_free (to_free);
 
-			if (!body)
-				body = g_strdup ("");
-			g_datalist_set_data_full (&data, "BODY_PART_SPEC", part_spec, g_free);
-			g_datalist_set_data_full (&data, "BODY_PART_DATA", body, g_free);
-			g_datalist_set_data (&data, "BODY_PART_LEN", GINT_TO_POINTER (body_len));
-		} else if (!g_ascii_strncasecmp (response, "BODY ", 5) ||
-			   !g_ascii_strncasecmp (response, "BODYSTRUCTURE ", 14)) {
-			response = strchr (response, ' ') + 1;
-			start = response;
-			imap_skip_list ((const char **) &response);
-			g_datalist_set_data_full (&data, "BODY", g_strndup (start, response - start), g_free);
-		} else if (!g_ascii_strncasecmp (response, "UID ", 4)) {
-			int len;
-
-			len = strcspn (response + 4, " )");
-			uid = g_strndup (response + 4, len);
-			g_datalist_set_data_full (&data, "UID", uid, g_free);
-			response += 4 + len;
-		} else if (!g_ascii_strncasecmp (response, "INTERNALDATE ", 13)) {
-			int len;
-
-			response += 13;
-			if (*response == '"') {
-				response++;
-				len = strcspn (response, "\"");
-				idate = g_strndup (response, len);
-				g_datalist_set_data_full (&data, "INTERNALDATE", idate, g_free);
-				response += len + 1;
-			}
-		} else if (!g_ascii_strncasecmp (response, "MODSEQ ", 7)) {
-			char *marker = strchr (response + 7, ')');
-			if (marker)
-				response = marker + 1;
+	return stream;
+}
 
-			if (!marker)
-				g_warning ("Unexpected MODSEQ format: %s", response);
-		} else {
-			g_warning ("Unexpected FETCH response from server: (%s", response);
-			break;
-		}
-	} while (response && *response != ')');
+/* The GData flavour of imap_parse_fetch_record, for the places that aren't
+ * called once per message of the folder */
+static GData *
+parse_fetch_response (CamelImapFolder *imap_folder, char *response)
+{
+	CamelImapFetchRecord record;
+	GData *data = NULL;
+	CamelStream *stream;
 
-	if (!response || *response != ')') {
-		g_datalist_clear (&data);
+	if (!imap_parse_fetch_record (response, &record))
 		return NULL;
-	}
 
-	if (uid && body) {
-		CamelStream *stream;
+	if (record.fields & IMAP_FETCH_SEQUENCE)
+		g_datalist_set_data (&data, "SEQUENCE", GINT_TO_POINTER (record.seq));
+	if (record.fields & IMAP_FETCH_FLAGS)
+		g_datalist_set_data (&data, "FLAGS", GUINT_TO_POINTER (record.flags));
+	if (record.fields & IMAP_FETCH_RFC822_SIZE)
+		g_datalist_set_data (&data, "RFC822.SIZE", GUINT_TO_POINTER (record.size));
+	if (record.fields & IMAP_FETCH_UID)
+		g_datalist_set_data_full (&data, "UID", g_strndup (record.uid, record.uid_len), g_free);
+	if (record.fields & IMAP_FETCH_INTERNALDATE)
+		g_datalist_set_data_full (&data, "INTERNALDATE", g_strndup (record.idate, record.idate_len), g_free);
+	if (record.fields & IMAP_FETCH_BODY)
+		g_datalist_set_data_full (&data, "BODY", g_strndup (record.body, record.body_len), g_free);
+
+	if (record.fields & IMAP_FETCH_BODY_PART) {
+		const char *part;
+		char *to_free;
+		size_t len;
+
+		part = imap_fetch_record_part (&record, &len, &to_free);
+
+		if (record.cache_header)
+			g_datalist_set_data_full (&data, "BODY_PART_SPEC", g_strndup (record.part_spec, record.part_spec_len), g_free);
+		else
+			g_datalist_set_data_full (&data, "BODY_PART_SPEC", g_strdup ("HEADER.FIELDS"), g_free);
+		g_datalist_set_data_full (&data, "BODY_PART_DATA", g_strndup (part, len), g_free);
+		g_datalist_set_data (&data, "BODY_PART_LEN", GINT_TO_POINTER (len));
 
-		if (header && !cache_header) {
-			stream = camel_stream_mem_new_with_buffer (body, body_len);
-		} else {
-			CAMEL_IMAP_FOLDER_REC_LOCK (imap_folder, cache_lock);
-			stream = camel_imap_message_cache_insert (imap_folder->cache,
-								  uid, part_spec,
-								  body, body_len, NULL);
-			CAMEL_IMAP_FOLDER_REC_UNLOCK (imap_folder, cache_lock);
-			if (stream == NULL)
-				stream = camel_stream_mem_new_with_buffer (body, body_len);
-		}
+		g_free (to_free);
 
+		stream = fetch_record_part_stream (imap_folder, &record);
 		if (stream)
 			g_datalist_set_data_full (&data, "BODY_PART_STREAM", stream,
 						  (GDestroyNotify) camel_object_unref);
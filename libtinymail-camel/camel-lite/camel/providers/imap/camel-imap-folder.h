@@ -96,6 +96,8 @@ void camel_imap_folder_stop_idle_in_connect_lock (CamelFolder *folder);
 void camel_imap_folder_start_idle (CamelFolder *folder);
 
 char* camel_imap_folder_get_highestmodseq (CamelImapFolder *imap_folder);
+char* camel_imap_folder_get_qresync_params (CamelImapFolder *imap_folder, const char *highestmodseq);
+void camel_imap_folder_vanished (CamelFolder *folder, char *resp);
 
 
 G_END_DECLS
@@ -26,6 +26,7 @@
 
 #include <ctype.h>
 #include <errno.h>
+#include <fcntl.h>
 
 #ifndef _GNU_SOURCE
 #define _GNU_SOURCE
@@ -40,17 +41,21 @@
 
 #include "camel-data-wrapper.h"
 #include "camel-exception.h"
+#include "camel-mime-filter-index.h"
+#include "camel-mime-message.h"
 #include "camel-stream-fs.h"
 
 #include "camel-string-utils.h"
 #include "camel-imap-message-cache.h"
 #include "camel-stream-buffer.h"
+#include "camel-text-index.h"
 
 #ifndef O_BINARY
 #define O_BINARY 0
 #endif
 
 static void finalize (CamelImapMessageCache *cache);
+static void index_wait (CamelImapMessageCache *cache);
 static void stream_finalize (CamelObject *stream, gpointer event_data, gpointer user_data);
 
 
@@ -98,6 +103,55 @@ finalize (CamelImapMessageCache *cache)
 	}
 	if (cache->cached)
 		g_hash_table_destroy (cache->cached);
+	if (cache->sizes)
+		g_hash_table_destroy (cache->sizes);
+	index_wait (cache);
+	if (cache->index) {
+		camel_index_sync (cache->index);
+		camel_object_unref (cache->index);
+	}
+}
+
+/* Waits for a background sync of the index, before the index gets
+ * replaced, renamed or closed */
+static void
+index_wait (CamelImapMessageCache *cache)
+{
+	if (cache->index_thread) {
+		g_thread_join (cache->index_thread);
+		cache->index_thread = NULL;
+	}
+}
+
+static gpointer
+index_sync_thread (gpointer data)
+{
+	CamelImapMessageCache *cache = data;
+
+	/* The text index locks itself, searches and additions just wait
+	 * while it gets compacted */
+	camel_index_sync (cache->index);
+	g_atomic_int_compare_and_exchange (&cache->index_busy, 1, 0);
+
+	return NULL;
+}
+
+/* The body index of the messages in the cache, so that searching them
+ * offline doesn't have to parse every cached message */
+static void
+index_open (CamelImapMessageCache *cache, gboolean truncate)
+{
+	char *path = g_strdup_printf ("%s/" CAMEL_IMAP_MESSAGE_CACHE_INDEX, cache->path);
+	int flags = O_RDWR | O_CREAT;
+
+	if (truncate || camel_text_index_check (path) == -1)
+		flags |= O_TRUNC;
+
+	cache->index = (CamelIndex *) camel_text_index_new (path, flags);
+	if (cache->index == NULL)
+		g_warning ("Could not open or create the body index %s: %s",
+			   path, g_strerror (errno));
+	g_free (path);
 }
 
 static void
@@ -141,6 +195,30 @@ cache_put (CamelImapMessageCache *cache, const char *uid, const char *key,
 	}
 }
 
+/* Updates the size of the cache for the file of key, after it got written
+ * or removed. The key must be in parts */
+static void
+account_file (CamelImapMessageCache *cache, const char *key)
+{
+	gpointer okey, ostream, osize;
+	guint32 size = 0;
+	struct stat st;
+	char *path;
+
+	if (!g_hash_table_lookup_extended (cache->parts, key, &okey, &ostream))
+		return;
+
+	path = g_strdup_printf ("%s/%s", cache->path, key);
+	if (g_stat (path, &st) == 0)
+		size = st.st_size;
+	g_free (path);
+
+	if (g_hash_table_lookup_extended (cache->sizes, okey, NULL, &osize))
+		cache->size -= MIN (cache->size, GPOINTER_TO_UINT (osize));
+	cache->size += size;
+	g_hash_table_insert (cache->sizes, okey, GUINT_TO_POINTER (size));
+}
+
 /**
  * camel_imap_message_cache_new:
  * @path: directory to use for storage
@@ -149,7 +227,8 @@ cache_put (CamelImapMessageCache *cache, const char *uid, const char *key,
  *
  * Return value: a new CamelImapMessageCache object using @path for
  * storage. If cache files already exist in @path, then any that do not
- * correspond to messages in @summary will be deleted.
+ * correspond to messages in @summary will be deleted. The size of the ones
+ * that are kept is counted, after that it's kept up to date.
  **/
 CamelImapMessageCache *
 camel_imap_message_cache_new (const char *path, CamelFolderSummary *summary,
@@ -174,9 +253,14 @@ camel_imap_message_cache_new (const char *path, CamelFolderSummary *summary,
 
 	cache = (CamelImapMessageCache *)camel_object_new (CAMEL_IMAP_MESSAGE_CACHE_TYPE);
 	cache->path = g_strdup (path);
+	cache->index_thread = NULL;
+	cache->index_busy = 0;
+	index_open (cache, FALSE);
 
 	cache->parts = g_hash_table_new (g_str_hash, g_str_equal);
 	cache->cached = g_hash_table_new (NULL, NULL);
+	cache->sizes = g_hash_table_new (g_str_hash, g_str_equal);
+	cache->size = 0;
 	deletes = g_ptr_array_new ();
 
 	camel_folder_summary_prepare_hash (summary);
@@ -197,8 +281,12 @@ camel_imap_message_cache_new (const char *path, CamelFolderSummary *summary,
 		if (info) {
 			camel_message_info_free(info);
 			cache_put (cache, uid, dname, NULL);
-		} else 
+			account_file (cache, dname);
+		} else {
 			g_ptr_array_add (deletes, g_strdup_printf ("%s/%s", cache->path, dname)); 
+			if (cache->index)
+				camel_index_delete_name (cache->index, uid);
+		}
 		g_free (uid);
 	}
 	g_dir_close (dir);
@@ -238,6 +326,13 @@ camel_imap_message_cache_set_path (CamelImapMessageCache *cache, const char *pat
 {
 	g_free(cache->path);
 	cache->path = g_strdup(path);
+
+	index_wait (cache);
+	if (cache->index) {
+		char *ipath = g_strdup_printf ("%s/" CAMEL_IMAP_MESSAGE_CACHE_INDEX, path);
+		camel_index_rename (cache->index, ipath);
+		g_free (ipath);
+	}
 }
 
 static void
@@ -287,9 +382,10 @@ insert_setup (CamelImapMessageCache *cache, const char *uid, const char *part_sp
 }
 
 static CamelStream *
-insert_abort (char *path, CamelStream *stream)
+insert_abort (CamelImapMessageCache *cache, char *path, char *key, CamelStream *stream)
 {
 	g_unlink (path);
+	account_file (cache, key);
 	g_free (path);
 	camel_object_unref (CAMEL_OBJECT (stream));
 	return NULL;
@@ -302,6 +398,7 @@ insert_finish (CamelImapMessageCache *cache, const char *uid, char *path,
 	camel_stream_flush (stream);
 	camel_stream_reset (stream);
 	cache_put (cache, uid, key, stream);
+	account_file (cache, key);
 	g_free (path);
 
 	return stream;
@@ -336,7 +433,7 @@ camel_imap_message_cache_insert (CamelImapMessageCache *cache, const char *uid,
 		camel_exception_setv (ex, CAMEL_EXCEPTION_SYSTEM_IO_WRITE,
 				      _("Failed to cache message %s: %s"),
 				      uid, g_strerror (errno));
-		return insert_abort (path, stream);
+		return insert_abort (cache, path, key, stream);
 	}
 
 	return insert_finish (cache, uid, path, key, stream);
@@ -491,7 +588,7 @@ camel_imap_message_cache_insert_stream (CamelImapMessageCache *cache,
 		camel_exception_setv (ex, CAMEL_EXCEPTION_SYSTEM_IO_WRITE,
 				      _("Failed to cache message %s: %s"),
 				      uid, g_strerror (errno));
-		insert_abort (path, stream);
+		insert_abort (cache, path, key, stream);
 	} else {
 		insert_finish (cache, uid, path, key, stream);
 		camel_object_unref (CAMEL_OBJECT (stream));
@@ -523,7 +620,7 @@ camel_imap_message_cache_insert_wrapper (CamelImapMessageCache *cache,
 		camel_exception_setv (ex, CAMEL_EXCEPTION_SYSTEM_IO_WRITE,
 				      _("Failed to cache message %s: %s"),
 				      uid, g_strerror (errno));
-		insert_abort (path, stream);
+		insert_abort (cache, path, key, stream);
 	} else {
 		insert_finish (cache, uid, path, key, stream);
 		camel_object_unref (CAMEL_OBJECT (stream));
@@ -762,7 +859,10 @@ void camel_imap_message_cache_replace_cache (CamelImapMessageCache *cache, const
 	gchar *real = cachefile_get(cache->path, uid, part_spec);
 	gchar *dest_real = cachefile_get(cache->path, dest_uid, dest_part_spec);
 
-	rename (dest_real, real);
+	if (rename (dest_real, real) == 0) {
+		account_file (cache, strrchr (dest_real, '/') + 1);
+		camel_imap_message_cache_add_file (cache, uid, strrchr (real, '/') + 1);
+	}
 
 	g_free (real);
 	g_free (dest_real);
@@ -809,7 +909,8 @@ camel_imap_message_cache_delete_attachments (CamelImapMessageCache *cache, const
 	camel_object_unref (to);
 
 	camel_imap_message_cache_remove (cache, uid);
-	rename (real, real1);
+	if (rename (real, real1) == 0)
+		camel_imap_message_cache_add_file (cache, uid, strrchr (real1, '/') + 1);
   }
 
   g_free (real);
@@ -832,6 +933,9 @@ camel_imap_message_cache_remove (CamelImapMessageCache *cache, const char *uid)
 	CamelObject *stream;
 	int i;
 
+	if (cache->index)
+		camel_index_delete_name (cache->index, uid);
+
 	subparts = g_hash_table_lookup (cache->parts, uid);
 	if (!subparts)
 		return;
@@ -840,6 +944,8 @@ camel_imap_message_cache_remove (CamelImapMessageCache *cache, const char *uid)
 		path = g_strdup_printf ("%s/%s", cache->path, key);
 		g_unlink (path);
 		g_free (path);
+		account_file (cache, key);
+		g_hash_table_remove (cache->sizes, key);
 		stream = g_hash_table_lookup (cache->parts, key);
 		if (stream) {
 			camel_object_unhook_event (stream, "finalize",
@@ -854,6 +960,38 @@ camel_imap_message_cache_remove (CamelImapMessageCache *cache, const char *uid)
 	g_ptr_array_free (subparts, TRUE);
 }
 
+/**
+ * camel_imap_message_cache_add_file:
+ * @cache: the cache
+ * @uid: UID of the message the file belongs to
+ * @name: name of the file, in the directory of @cache
+ *
+ * Tells @cache about a file for @uid that got written without the insert
+ * functions, so that it counts for the size of @cache and gets removed
+ * with the other data of @uid.
+ **/
+void
+camel_imap_message_cache_add_file (CamelImapMessageCache *cache, const char *uid,
+				   const char *name)
+{
+	if (!g_hash_table_lookup_extended (cache->parts, name, NULL, NULL))
+		cache_put (cache, uid, name, NULL);
+	account_file (cache, name);
+}
+
+/**
+ * camel_imap_message_cache_get_size:
+ * @cache: the cache
+ *
+ * Return value: how many bytes the cached data takes, without walking
+ * the directory of @cache.
+ **/
+guint32
+camel_imap_message_cache_get_size (CamelImapMessageCache *cache)
+{
+	return cache->size;
+}
+
 static void
 add_uids (gpointer key, gpointer value, gpointer data)
 {
@@ -879,6 +1017,54 @@ camel_imap_message_cache_clear (CamelImapMessageCache *cache)
 	for (i = 0; i < uids->len; i++)
 		camel_imap_message_cache_remove (cache, uids->pdata[i]);
 	g_ptr_array_free (uids, TRUE);
+
+	/* Starting over is cheaper than deleting every name */
+	index_wait (cache);
+	if (cache->index) {
+		camel_object_unref (cache->index);
+		index_open (cache, TRUE);
+	}
+}
+
+/**
+ * camel_imap_message_cache_index:
+ * @cache: the cache
+ * @uid: UID of the message
+ * @message: the message with @uid
+ *
+ * Adds the text parts of @message that are available locally to the body
+ * index of @cache, unless it already has @uid.
+ **/
+void
+camel_imap_message_cache_index (CamelImapMessageCache *cache, const char *uid,
+				CamelMimeMessage *message)
+{
+	if (!cache->index || camel_index_has_name (cache->index, uid))
+		return;
+
+	camel_mime_filter_index_add_message (cache->index, uid, message);
+}
+
+/**
+ * camel_imap_message_cache_sync_index:
+ * @cache: the cache
+ *
+ * Writes the body index of @cache to disk in a thread of its own, which
+ * also compacts it if it got fragmented by removals. Does nothing while an
+ * earlier sync is still running.
+ **/
+void
+camel_imap_message_cache_sync_index (CamelImapMessageCache *cache)
+{
+	if (!cache->index || !g_atomic_int_compare_and_exchange (&cache->index_busy, 0, 1))
+		return;
+
+	/* The previous one is done, it cleared index_busy */
+	index_wait (cache);
+
+	cache->index_thread = g_thread_create (index_sync_thread, cache, TRUE, NULL);
+	if (!cache->index_thread)
+		index_sync_thread (cache);
 }
 
 
@@ -43,8 +43,19 @@ struct _CamelImapMessageCache {
 	char *path;
 	GHashTable *parts, *cached;
 	guint32 max_uid;
+	CamelIndex *index;
+	/* syncs and compacts the index in the background, index_busy is
+	 * set while it runs */
+	GThread *index_thread;
+	gint index_busy;
+	/* bytes of the files in parts, and of each of them */
+	guint32 size;
+	GHashTable *sizes;
 };
 
+/* File name of the body index, in the directory of the cache */
+#define CAMEL_IMAP_MESSAGE_CACHE_INDEX "body.ibex"
+
 
 typedef struct {
 	CamelFolderClass parent_class;
@@ -97,6 +108,16 @@ void         camel_imap_message_cache_remove (CamelImapMessageCache *cache,
 
 void         camel_imap_message_cache_clear  (CamelImapMessageCache *cache);
 
+void         camel_imap_message_cache_add_file (CamelImapMessageCache *cache,
+					      const char *uid,
+					      const char *name);
+guint32      camel_imap_message_cache_get_size (CamelImapMessageCache *cache);
+
+void         camel_imap_message_cache_index  (CamelImapMessageCache *cache,
+					      const char *uid,
+					      CamelMimeMessage *message);
+void         camel_imap_message_cache_sync_index (CamelImapMessageCache *cache);
+
 void         camel_imap_message_cache_copy   (CamelImapMessageCache *source,
 					      const char *source_uid,
 					      CamelImapMessageCache *dest,
@@ -43,8 +43,9 @@
 #define io(x)			/* io debug */
 
 #define CAMEL_IMAP_STORE_SUMMARY_VERSION_0 (1)
+#define CAMEL_IMAP_STORE_SUMMARY_VERSION_1 (2)	/* adds local_size */
 
-#define CAMEL_IMAP_STORE_SUMMARY_VERSION (1)
+#define CAMEL_IMAP_STORE_SUMMARY_VERSION (2)
 
 #define _PRIVATE(o) (((CamelImapStoreSummary *)(o))->priv)
 
@@ -683,7 +684,9 @@ store_info_load(CamelStoreSummary *s, FILE *in)
 
 	mi = (CamelImapStoreInfo *)camel_imap_store_summary_parent->store_info_load(s, in);
 	if (mi) {
-		if (camel_file_util_decode_string(in, &mi->full_name) == -1) {
+		if (camel_file_util_decode_string(in, &mi->full_name) == -1
+		    || (((CamelImapStoreSummary *)s)->version >= CAMEL_IMAP_STORE_SUMMARY_VERSION_1
+			&& camel_file_util_decode_uint32(in, &mi->local_size) == -1)) {
 			camel_store_summary_info_free(s, (CamelStoreInfo *)mi);
 			mi = NULL;
 		} else {
@@ -702,7 +705,8 @@ store_info_save(CamelStoreSummary *s, FILE *out, CamelStoreInfo *mi)
 	CamelImapStoreInfo *isi = (CamelImapStoreInfo *)mi;
 
 	if (camel_imap_store_summary_parent->store_info_save(s, out, mi) == -1
-	    || camel_file_util_encode_string(out, isi->full_name) == -1)
+	    || camel_file_util_encode_string(out, isi->full_name) == -1
+	    || camel_file_util_encode_uint32(out, isi->local_size) == -1)
 		return -1;
 
 	return 0;
@@ -52,6 +52,7 @@ typedef enum _CamelImapStoreNamespaceType {
 struct _CamelImapStoreInfo {
 	CamelStoreInfo info;
 	char *full_name;
+	guint32 local_size;	/* bytes in the folder's cache, 0 when unknown */
 };
 
 typedef struct _CamelImapStoreNamespace CamelImapStoreNamespace;
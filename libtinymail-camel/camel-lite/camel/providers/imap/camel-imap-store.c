@@ -60,8 +60,11 @@
 #include "camel/camel-stream-mem.h"
 #include "camel/camel-mime-message.h"
 #include "camel/camel-string-utils.h"
+#include "camel/camel-tcp-stream-deflate.h"
 #include "camel/camel-tcp-stream-raw.h"
 #include "camel/camel-tcp-stream-ssl.h"
+#include "camel/camel-text-index.h"
+#include "camel/camel-uid-table.h"
 #include "camel/camel-url.h"
 #include "camel/camel-utf8.h"
 
@@ -147,17 +150,55 @@ static void imap_set_server_level (CamelImapStore *store);
 
 static void imap_get_folder_status (CamelStore *store, const char *folder_name, int *unseen, int *messages, int *uidnext);
 
+/* The size that the folder reported when it was last open, see
+ * imap_get_local_size. Only a folder that never did gets its directory
+ * walked, after which the result is remembered too */
 static int
-imapstore_get_local_size (CamelStore *store, const gchar *folder_name)
+get_folder_local_size (CamelImapStore *imap_store, const gchar *folder_name)
 {
-	CamelImapStore *imap_store = (CamelImapStore *) store;
-	gchar *storage_path = g_strdup_printf ("%s/folders", imap_store->storage_path);
-	gchar *folder_dir = imap_path_to_physical (storage_path, folder_name);
+	CamelStoreSummary *ssummary = (CamelStoreSummary *) imap_store->summary;
+	CamelImapStoreInfo *si;
+	gchar *storage_path, *folder_dir;
 	int msize = 0;
 
+	si = (CamelImapStoreInfo *) camel_store_summary_path (ssummary, folder_name);
+	if (si && si->local_size != 0) {
+		msize = si->local_size;
+		camel_store_summary_info_free (ssummary, (CamelStoreInfo *) si);
+		return msize;
+	}
+
+	storage_path = g_strdup_printf ("%s/folders", imap_store->storage_path);
+	folder_dir = imap_path_to_physical (storage_path, folder_name);
 	g_free (storage_path);
 	camel_du (folder_dir, &msize);
 	g_free (folder_dir);
+
+	if (si) {
+		if (msize != 0) {
+			si->local_size = msize;
+			camel_store_summary_touch (ssummary);
+		}
+		camel_store_summary_info_free (ssummary, (CamelStoreInfo *) si);
+	}
+
+	return msize;
+}
+
+static int
+imapstore_get_local_size (CamelStore *store, const gchar *folder_name)
+{
+	CamelImapStore *imap_store = (CamelImapStore *) store;
+	CamelFolder *folder;
+	int msize;
+
+	folder = camel_object_bag_peek (store->folders, folder_name);
+	if (folder) {
+		msize = camel_folder_get_local_size (folder);
+		camel_object_unref (folder);
+	} else
+		msize = get_folder_local_size (imap_store, folder_name);
+
 	return msize;
 }
 
@@ -672,6 +713,10 @@ camel_imap_store_init (gpointer object, gpointer klass)
 
 	imap_store->dontdistridlehack = FALSE;
 
+	imap_store->header_connections = 0;
+	imap_store->header_connections_busy = 0;
+	imap_store->prefetch_bodystructures = 0;
+
 	imap_store->idle_sleep_set = FALSE;
 	imap_store->idle_sleep = IDLE_DEFAULT_SLEEP_TIME * (1000000/IDLE_TICK_TIME);
 	imap_store->getsrv_sleep = 100; /* default of 100s */
@@ -777,6 +822,12 @@ construct (CamelService *service, CamelSession *session,
 		imap_store->parameters |= IMAP_PARAM_FILTER_JUNK_INBOX;
 	if (camel_url_get_param (url, "dont_touch_summary"))
 		imap_store->parameters |= IMAP_PARAM_DONT_TOUCH_SUMMARY;
+	if (camel_url_get_param (url, "header_connections"))
+		imap_store->header_connections = CLAMP (atoi (camel_url_get_param (url, "header_connections")),
+							0, IMAP_MAX_HEADER_CONNECTIONS);
+	if (camel_url_get_param (url, "prefetch_bodystructures"))
+		imap_store->prefetch_bodystructures = CLAMP (atoi (camel_url_get_param (url, "prefetch_bodystructures")),
+							     0, IMAP_MAX_PREFETCH_BODYSTRUCTURES);
 
 	/* setup journal*/
 	path = g_strdup_printf ("%s/journal", imap_store->storage_path);
@@ -1332,14 +1383,6 @@ connect_to_server (CamelService *service, struct addrinfo *ai, int ssl_mode, int
 			goto exception;
 		}
 
-		if (store->capabilities & IMAP_CAPABILITY_COMPRESS) {
-			// response = camel_imap_command (store, NULL, ex, "COMPRESS DEFLATE");
-			if (TRUE /* && response */) {
-				camel_tcp_stream_enable_compress (CAMEL_TCP_STREAM (tcp_stream));
-				// camel_imap_response_free_without_processing (store, response);
-			}
-		}
-
 		/* we're done */
 		return TRUE;
 	}
@@ -1823,6 +1866,10 @@ imap_forget_folder (CamelImapStore *imap_store, const char *folder_name, CamelEx
 	}
 	camel_object_unref (summary);
 
+	state_file = g_strdup_printf ("%s/" CAMEL_IMAP_MESSAGE_CACHE_INDEX, folder_dir);
+	camel_text_index_remove (state_file);
+	g_free (state_file);
+
 	g_unlink (summary_file);
 	g_free (summary_file);
 
@@ -2191,6 +2238,42 @@ save_namespace_in_summary (CamelImapStore *store, struct _namespace *namespace,
 	}
 }
 
+/* COMPRESS=DEFLATE, rfc4978. Both sides start compressing right after
+ * the tagged OK, and the server won't send anything unasked in between,
+ * so nothing compressed can be in the old istream's buffer yet */
+static void
+imap_enable_compress (CamelImapStore *store)
+{
+	CamelImapResponse *response;
+	CamelException ex = CAMEL_EXCEPTION_INITIALISER;
+	CamelStream *stream;
+
+	if (!(store->capabilities & IMAP_CAPABILITY_COMPRESS) ||
+	    !CAMEL_IS_TCP_STREAM (store->ostream) ||
+	    CAMEL_IS_TCP_STREAM_DEFLATE (store->ostream))
+		return;
+
+	response = camel_imap_command (store, NULL, &ex, "COMPRESS DEFLATE");
+	if (!response) {
+		imap_debug ("COMPRESS DEFLATE failed: %s\n", camel_exception_get_description (&ex));
+		camel_exception_clear (&ex);
+		return;
+	}
+	camel_imap_response_free_without_processing (store, response);
+
+	stream = camel_tcp_stream_deflate_new (CAMEL_TCP_STREAM (store->ostream), Z_DEFAULT_COMPRESSION);
+	if (!stream) {
+		/* The server compresses from now on, we can't go on */
+		camel_service_disconnect (CAMEL_SERVICE (store), FALSE, NULL);
+		return;
+	}
+
+	camel_object_unref (store->istream);
+	camel_object_unref (store->ostream);
+	store->ostream = stream;
+	store->istream = camel_stream_buffer_new (stream, CAMEL_STREAM_BUFFER_READ);
+}
+
 static gboolean
 imap_connect_online (CamelService *service, CamelException *ex)
 {
@@ -2232,6 +2315,8 @@ imap_connect_online (CamelService *service, CamelException *ex)
 		return FALSE;
 	}
 
+	imap_enable_compress (store);
+
 	/* Get namespace and hierarchy separator */
 	if ((store->capabilities & IMAP_CAPABILITY_NAMESPACE) &&
 		!(store->parameters & IMAP_PARAM_OVERRIDE_NAMESPACE))
@@ -3416,6 +3501,7 @@ move_cache (const gchar *oldpath, const gchar *newpath)
 		if (g_file_test (new_summary, G_FILE_TEST_EXISTS)) {
 			g_unlink (new_summary);
 		}
+		camel_uid_table_unlink (new_summary);
 	}
 }
 
@@ -4192,26 +4278,30 @@ fill_fi(CamelStore *store, CamelFolderInfo *fi, guint32 flags)
 	CamelFolder *folder;
 	CamelImapStore *imap_store = (CamelImapStore *) store;
 	gint msize = 0;
-	char *storage_path = g_strdup_printf("%s/folders", imap_store->storage_path);
-	char *folder_dir = imap_path_to_physical (storage_path, fi->full_name);
-
-	g_free(storage_path);
-	camel_du (folder_dir, &msize);
 
 	folder = camel_object_bag_peek(store->folders, fi->full_name);
 	if (folder) {
 		fi->unread = camel_folder_get_unread_message_count(folder);
 		fi->total = camel_folder_get_message_count(folder);
+		msize = camel_folder_get_local_size (folder);
 		camel_object_unref(folder);
 
-	} else if ((fi->unread == -1) || (fi->total == -1)) {
-		gchar *spath = g_strdup_printf ("%s/summary.mmap", folder_dir);
-		camel_file_util_read_counts (spath, fi);
-		g_free (spath);
+	} else {
+		if ((fi->unread == -1) || (fi->total == -1)) {
+			char *storage_path = g_strdup_printf("%s/folders", imap_store->storage_path);
+			char *folder_dir = imap_path_to_physical (storage_path, fi->full_name);
+			gchar *spath = g_strdup_printf ("%s/summary.mmap", folder_dir);
+
+			camel_file_util_read_counts (spath, fi);
+			g_free (spath);
+			g_free (folder_dir);
+			g_free (storage_path);
+		}
+
+		msize = get_folder_local_size (imap_store, fi->full_name);
 	}
 
 	fi->local_size = msize;
-	g_free (folder_dir);
 }
 
 
@@ -137,6 +137,12 @@ typedef enum {
 #define IMAP_PARAM_SUBSCRIPTIONS		(1 << 5)
 #define IMAP_PARAM_DONT_TOUCH_SUMMARY		(1 << 6)
 
+/* Upper limit for the header_connections url parameter */
+#define IMAP_MAX_HEADER_CONNECTIONS		4
+
+/* Upper limit for the prefetch_bodystructures url parameter */
+#define IMAP_MAX_PREFETCH_BODYSTRUCTURES	100
+
 struct _CamelImapStore {
 	CamelDiscoStore parent_object;
 
@@ -186,6 +192,15 @@ struct _CamelImapStore {
 	gboolean idle_blocked;
 
 	struct addrinfo *addrinfo;
+
+	/* Extra connections for downloading headers, and how many of
+	 * them are in use by the folders of this account */
+	guint header_connections;
+	volatile gint header_connections_busy;
+
+	/* How many of the newest messages get their BODYSTRUCTURE cached
+	 * when they are added to the summary */
+	guint prefetch_bodystructures;
 };
 
 typedef struct {
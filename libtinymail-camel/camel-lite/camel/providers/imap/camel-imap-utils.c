@@ -793,7 +793,7 @@ void
 imap_skip_list (const char **str_p)
 {
 	skip_char (str_p, '(');
-	while (*str_p && **str_p != ')') {
+	while (*str_p && **str_p && **str_p != ')') {
 		if (**str_p == '(')
 			imap_skip_list (str_p);
 		else
@@ -804,6 +804,226 @@ imap_skip_list (const char **str_p)
 	skip_char (str_p, ')');
 }
 
+/**
+ * imap_parse_fetch_record:
+ * @response: an untagged FETCH response ("* 1 FETCH (...)") or just
+ * the msg_att list of one
+ * @record: the record to fill in
+ *
+ * Parses @response into @record without copying anything: the strings
+ * in @record point into @response, which must outlive it. Literals are
+ * expected in the form camel_imap_command_response() leaves them in.
+ *
+ * Return value: %FALSE if @response isn't a FETCH response that could
+ * be parsed.
+ **/
+gboolean
+imap_parse_fetch_record (const char *response, CamelImapFetchRecord *record)
+{
+	return imap_parse_fetch_record_parts (response, record, NULL, NULL);
+}
+
+/**
+ * imap_parse_fetch_record_parts:
+ * @response: like for imap_parse_fetch_record()
+ * @record: the record to fill in
+ * @func: called for each BODY[...] part, or %NULL
+ * @user_data: passed to @func
+ *
+ * Like imap_parse_fetch_record(), for responses with more than one
+ * BODY[...] part: @record only keeps the last one, but each part is in
+ * @record while @func is called for it.
+ *
+ * Return value: %FALSE if @response isn't a FETCH response that could
+ * be parsed.
+ **/
+gboolean
+imap_parse_fetch_record_parts (const char *response, CamelImapFetchRecord *record,
+			       CamelImapFetchPartFunc func, gpointer user_data)
+{
+	memset (record, 0, sizeof (CamelImapFetchRecord));
+	record->cache_header = TRUE;
+
+	if (*response != '(') {
+		unsigned long seq;
+
+		if (*response != '*' || *(response + 1) != ' ')
+			return FALSE;
+		seq = strtoul (response + 2, (char **) &response, 10);
+		if (seq == 0)
+			return FALSE;
+		if (g_ascii_strncasecmp (response, " FETCH (", 8) != 0)
+			return FALSE;
+		response += 7;
+
+		record->seq = seq;
+		record->fields |= IMAP_FETCH_SEQUENCE;
+	}
+
+	do {
+		/* Skip the initial '(' or the ' ' between elements */
+		response++;
+
+		if (!g_ascii_strncasecmp (response, "FLAGS ", 6)) {
+			response += 6;
+			/* FIXME user flags */
+			record->flags = imap_parse_flag_list ((char **) &response);
+			record->fields |= IMAP_FETCH_FLAGS;
+		} else if (!g_ascii_strncasecmp (response, "RFC822.SIZE ", 12)) {
+			response += 12;
+			record->size = strtoul (response, (char **) &response, 10);
+			record->fields |= IMAP_FETCH_RFC822_SIZE;
+		} else if (!g_ascii_strncasecmp (response, "BODY[", 5) ||
+			   !g_ascii_strncasecmp (response, "RFC822 ", 7)) {
+			const char *p;
+
+			if (*response == 'B') {
+				response += 5;
+
+				/* HEADER], HEADER.FIELDS (...)], or 0] */
+				if (!g_ascii_strncasecmp (response, "HEADER", 6)) {
+					record->header = TRUE;
+					if (!g_ascii_strncasecmp (response + 6, ".FIELDS", 7))
+						record->cache_header = FALSE;
+				} else if (!g_ascii_strncasecmp (response, "0]", 2))
+					record->header = TRUE;
+
+				p = strchr (response, ']');
+				if (!p || *(p + 1) != ' ')
+					return FALSE;
+
+				record->part_spec = response;
+				record->part_spec_len = p - response;
+				response = p + 2;
+			} else {
+				record->part_spec = "";
+				record->part_spec_len = 0;
+				response += 7;
+
+				if (!g_ascii_strncasecmp (response, "HEADER", 6))
+					record->header = TRUE;
+			}
+
+			/* Like imap_parse_nstring, but pointing into the
+			 * response instead of copying */
+			if (*response == '{') {
+				record->part_len = strtoul (response + 1, (char **) &p, 10);
+				if (*p++ != '}' || *p++ != '\n' || memchr (p, 0, record->part_len) != NULL)
+					return FALSE;
+				record->part_data = p;
+				response = p + record->part_len;
+			} else if (*response == '"') {
+				p = response + 1;
+				while (*p && *p != '"' && *p != '\n') {
+					if (*p == '\\' && p[1])
+						p++;
+					p++;
+				}
+				if (*p != '"')
+					return FALSE;
+				record->part_data = response;
+				record->part_len = p + 1 - response;
+				record->part_quoted = TRUE;
+				response = p + 1;
+			} else if (!g_ascii_strncasecmp (response, "nil", 3)) {
+				response += 3;
+			} else
+				return FALSE;
+
+			record->fields |= IMAP_FETCH_BODY_PART;
+			if (func)
+				func (record, user_data);
+		} else if (!g_ascii_strncasecmp (response, "BODY ", 5) ||
+			   !g_ascii_strncasecmp (response, "BODYSTRUCTURE ", 14)) {
+			response = strchr (response, ' ') + 1;
+			record->body = response;
+			imap_skip_list (&response);
+			if (!response)
+				return FALSE;
+			record->body_len = response - record->body;
+			record->fields |= IMAP_FETCH_BODY;
+		} else if (!g_ascii_strncasecmp (response, "UID ", 4)) {
+			record->uid = response + 4;
+			record->uid_len = strcspn (record->uid, " )");
+			response += 4 + record->uid_len;
+			record->fields |= IMAP_FETCH_UID;
+		} else if (!g_ascii_strncasecmp (response, "INTERNALDATE ", 13)) {
+			response += 13;
+			if (*response == '"') {
+				response++;
+				record->idate = response;
+				record->idate_len = strcspn (response, "\"");
+				if (response[record->idate_len] != '"')
+					return FALSE;
+				response += record->idate_len + 1;
+				record->fields |= IMAP_FETCH_INTERNALDATE;
+			}
+		} else if (!g_ascii_strncasecmp (response, "MODSEQ ", 7)) {
+			const char *marker = strchr (response + 7, ')');
+
+			if (!marker) {
+				g_warning ("Unexpected MODSEQ format: %s", response);
+				return FALSE;
+			}
+
+			if (response[7] == '(') {
+				record->modseq = g_ascii_strtoull (response + 8, NULL, 10);
+				record->fields |= IMAP_FETCH_MODSEQ;
+			}
+			response = marker + 1;
+		} else {
+			g_warning ("Unexpected FETCH response from server: (%s", response);
+			return FALSE;
+		}
+
+		/* Elements are separated by a space, anything else ends the
+		 * list: a truncated response must not be read past its end */
+	} while (response && *response == ' ');
+
+	return response && *response == ')';
+}
+
+/**
+ * imap_fetch_record_part:
+ * @record: a record filled in by imap_parse_fetch_record()
+ * @len: returns the length of the part
+ * @to_free: returns what the caller has to g_free() when done with the
+ * part, or %NULL
+ *
+ * Gets the BODY[...] data of @record. Literals, which is what servers
+ * send, are returned in place; only quoted strings have to be copied to
+ * be unescaped. A NIL part is returned as an empty string.
+ *
+ * Return value: the part data, not nul terminated.
+ **/
+const char *
+imap_fetch_record_part (CamelImapFetchRecord *record, size_t *len, char **to_free)
+{
+	*to_free = NULL;
+
+	if (record->part_data == NULL) {
+		*len = 0;
+		return "";
+	}
+
+	if (record->part_quoted) {
+		const char *str = record->part_data;
+
+		*to_free = imap_parse_nstring (&str, len);
+		return *to_free ? *to_free : "";
+	}
+
+	*len = record->part_len;
+	return record->part_data;
+}
+
+gboolean
+imap_fetch_record_uid_equal (CamelImapFetchRecord *record, const char *uid)
+{
+	return record->uid && uid && strlen (uid) == record->uid_len &&
+		!strncmp (record->uid, uid, record->uid_len);
+}
+
 static int
 parse_params (const char **parms_p, CamelContentType *type)
 {
@@ -76,6 +76,52 @@ char    *imap_quote_string         (const char *str);
 
 void     imap_skip_list            (const char **str_p);
 
+enum {
+	IMAP_FETCH_SEQUENCE     = 1 << 0,
+	IMAP_FETCH_UID          = 1 << 1,
+	IMAP_FETCH_FLAGS        = 1 << 2,
+	IMAP_FETCH_RFC822_SIZE  = 1 << 3,
+	IMAP_FETCH_INTERNALDATE = 1 << 4,
+	IMAP_FETCH_BODY         = 1 << 5,	/* BODY or BODYSTRUCTURE */
+	IMAP_FETCH_BODY_PART    = 1 << 6,	/* BODY[...] or RFC822 */
+	IMAP_FETCH_MODSEQ       = 1 << 7
+};
+
+/* One FETCH response as imap_parse_fetch_record finds it. The strings
+ * point into the response line and are not nul terminated, use the
+ * lengths. Nothing in here is allocated, so it can live on the stack */
+typedef struct {
+	guint32 fields;			/* IMAP_FETCH_* that were present */
+
+	guint32 seq;
+	guint32 flags;
+	guint32 size;
+	guint64 modseq;
+
+	const char *uid;
+	size_t uid_len;
+	const char *idate;
+	size_t idate_len;
+	const char *body;		/* the BODY or BODYSTRUCTURE list */
+	size_t body_len;
+
+	const char *part_spec;		/* what's between BODY[ and ] */
+	size_t part_spec_len;
+	const char *part_data;		/* a quoted string if part_quoted, */
+	size_t part_len;		/* see imap_fetch_record_part */
+	gboolean part_quoted;
+	gboolean header;		/* the part is (some of) the header */
+	gboolean cache_header;		/* it's the complete header */
+} CamelImapFetchRecord;
+
+typedef void (*CamelImapFetchPartFunc) (CamelImapFetchRecord *record, gpointer user_data);
+
+gboolean imap_parse_fetch_record   (const char *response, CamelImapFetchRecord *record);
+gboolean imap_parse_fetch_record_parts (const char *response, CamelImapFetchRecord *record,
+					CamelImapFetchPartFunc func, gpointer user_data);
+const char *imap_fetch_record_part (CamelImapFetchRecord *record, size_t *len, char **to_free);
+gboolean imap_fetch_record_uid_equal (CamelImapFetchRecord *record, const char *uid);
+
 char    *imap_uid_array_to_set     (CamelFolderSummary *summary, GPtrArray *uids, int uid, ssize_t maxlen, int *lastuid);
 GPtrArray *imap_uid_set_to_array   (CamelFolderSummary *summary, const char *uids);
 void     imap_uid_array_free       (GPtrArray *arr);
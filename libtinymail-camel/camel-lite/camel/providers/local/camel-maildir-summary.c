@@ -33,6 +33,11 @@
 #include <sys/types.h>
 #include <sys/types.h>
 #include <sys/uio.h>
+#include <time.h>
+#ifdef HAVE_SYS_INOTIFY_H
+#include <pthread.h>
+#include <sys/inotify.h>
+#endif
 
 #include <glib/gi18n-lib.h>
 
@@ -62,6 +67,10 @@ static char *maildir_summary_next_uid_string(CamelFolderSummary *s);
 static int maildir_summary_decode_x_evolution(CamelLocalSummary *cls, const char *xev, CamelLocalMessageInfo *mi);
 static char *maildir_summary_encode_x_evolution(CamelLocalSummary *cls, const CamelLocalMessageInfo *mi);
 
+#ifdef HAVE_SYS_INOTIFY_H
+static void maildir_watch_stop(CamelMaildirSummary *mds);
+#endif
+
 static void camel_maildir_summary_class_init	(CamelMaildirSummaryClass *class);
 static void camel_maildir_summary_init	(CamelMaildirSummary *gspaper);
 static void camel_maildir_summary_finalise	(CamelObject *obj);
@@ -74,6 +83,15 @@ struct _CamelMaildirSummaryPrivate {
 	char *hostname;
 
 	GHashTable *load_map;
+
+	/* mtimes of cur and new at their last full scan, 0 if not to be
+	 * trusted. A directory whose mtime didn't change needs no scan */
+	time_t cur_mtime, new_mtime;
+
+	/* With inotify, what changes in cur between checks is applied from
+	 * the events, and cur isn't scanned at all. This is the watch of cur
+	 * on the shared inotify instance, -1 if there's none */
+	int watch_wd;
 };
 
 static CamelLocalSummaryClass *parent_class;
@@ -140,6 +158,8 @@ camel_maildir_summary_init (CamelMaildirSummary *o)
 	} else {
 		o->priv->hostname = g_strdup("localhost");
 	}
+
+	o->priv->watch_wd = -1;
 }
 
 static void
@@ -148,6 +168,9 @@ camel_maildir_summary_finalise(CamelObject *obj)
 	CamelMaildirSummary *o = (CamelMaildirSummary *)obj;
 
 	g_free(o->priv->hostname);
+#ifdef HAVE_SYS_INOTIFY_H
+	maildir_watch_stop(o);
+#endif
 	g_free(o->priv);
 }
 
@@ -601,160 +624,408 @@ camel_maildir_summary_add (CamelLocalSummary *cls, const char *name, char *uid)
 }
 
 
-static int
-maildir_summary_check(CamelLocalSummary *cls, CamelFolderChangeInfo *changes, CamelException *ex)
+/* the uid of a file in cur, the part before the info */
+static char *
+maildir_name_to_uid(const char *name)
 {
-	DIR *dir;
+	const char *p = strchr(name, '!');
+
+	if (!p)
+		p = strchr(name, ':');
+
+	return p ? g_strndup(name, p - name) : g_strdup(name);
+}
+
+static time_t
+maildir_dir_mtime(const char *path)
+{
+	struct stat st;
+
+	if (stat(path, &st) == -1)
+		return 0;
+
+	return st.st_mtime;
+}
+
+/* Reads all of a directory in one pass */
+static GPtrArray *
+maildir_read_names(DIR *dir)
+{
+	GPtrArray *names = g_ptr_array_new();
 	struct dirent *d;
-	char *p;
+
+	while ((d = readdir(dir))) {
+		if (d->d_name[0] == '.' || !strcmp(d->d_name, "core"))
+			continue;
+		g_ptr_array_add(names, g_strdup(d->d_name));
+	}
+
+	return names;
+}
+
+static void
+maildir_free_names(GPtrArray *names)
+{
+	int i;
+
+	for (i = 0; i < names->len; i++)
+		g_free(names->pdata[i]);
+	g_ptr_array_free(names, TRUE);
+}
+
+static void
+maildir_summary_check_add(CamelLocalSummary *cls, const char *name, CamelFolderChangeInfo *changes)
+{
+	char *uid = maildir_name_to_uid(name);
 	CamelMessageInfo *info;
-	CamelFolderSummary *s = (CamelFolderSummary *)cls;
-	char *new, *cur;
-	char *uid;
-	int count, total;
 
-	new = g_strdup_printf("%s/new", cls->folder_path);
-	cur = g_strdup_printf("%s/cur", cls->folder_path);
+	info = camel_folder_summary_uid((CamelFolderSummary *)cls, uid);
+	if (info == NULL) {
+		/* must be a message incorporated by another client, this is not a 'recent' uid */
+		if (camel_maildir_summary_add (cls, name, uid) == 0)
+			if (changes)
+				camel_folder_change_info_add_uid(changes, uid);
+	} else
+		camel_message_info_free(info);
 
-	camel_operation_start(NULL, _("Checking folder consistency"));
+	g_free(uid);
+}
 
-	/* scan the directory, check for mail files not in the index, or index entries that
-	   no longer exist */
-	dir = opendir(cur);
-	if (dir == NULL) {
-		camel_exception_setv (ex, CAMEL_EXCEPTION_SYSTEM_IO_READ,
-			_("Cannot open maildir directory path: %s: %s"),
-			cls->folder_path, g_strerror (errno));
-		g_free(cur);
-		g_free(new);
-		camel_operation_end(NULL);
+#ifdef HAVE_SYS_INOTIFY_H
+/* One inotify instance serves all maildir summaries of the process, there
+ * are only a few of those per user. Whichever summary checks first reads
+ * the events of all of them, they're queued per watch until their own
+ * summary gets to them */
+struct _maildir_watch {
+	GByteArray *events;	/* struct inotify_event's as read */
+	gboolean lost;
+};
+
+static pthread_mutex_t watch_lock = PTHREAD_MUTEX_INITIALIZER;
+static int watch_fd = -1;
+static GHashTable *watches = NULL;	/* wd -> struct _maildir_watch */
+
+static void
+maildir_watch_free(struct _maildir_watch *w)
+{
+	g_byte_array_free(w->events, TRUE);
+	g_free(w);
+}
+
+static void
+maildir_watch_set_lost(gpointer key, gpointer value, gpointer user_data)
+{
+	((struct _maildir_watch *)value)->lost = TRUE;
+}
+
+/* Reads what's available on the shared instance into the queues, with
+ * watch_lock held */
+static void
+maildir_watch_read(void)
+{
+	char buf[4096] __attribute__ ((aligned (__alignof__ (struct inotify_event))));
+	ssize_t len;
+
+	while ((len = read(watch_fd, buf, sizeof(buf))) > 0) {
+		char *p = buf;
+
+		while (p < buf + len) {
+			struct inotify_event *ev = (struct inotify_event *)p;
+			size_t size = sizeof(struct inotify_event) + ev->len;
+			struct _maildir_watch *w;
+
+			p += size;
+
+			if (ev->mask & IN_Q_OVERFLOW) {
+				g_hash_table_foreach(watches, maildir_watch_set_lost, NULL);
+				continue;
+			}
+
+			/* Watches that were stopped still get an IN_IGNORED */
+			w = g_hash_table_lookup(watches, GINT_TO_POINTER(ev->wd));
+			if (w != NULL)
+				g_byte_array_append(w->events, (guint8 *)ev, size);
+		}
+	}
+
+	if (len == -1 && errno != EAGAIN && errno != EINTR)
+		g_hash_table_foreach(watches, maildir_watch_set_lost, NULL);
+}
+
+static void
+maildir_watch_stop(CamelMaildirSummary *mds)
+{
+	if (mds->priv->watch_wd == -1)
+		return;
+
+	pthread_mutex_lock(&watch_lock);
+	inotify_rm_watch(watch_fd, mds->priv->watch_wd);
+	g_hash_table_remove(watches, GINT_TO_POINTER(mds->priv->watch_wd));
+	pthread_mutex_unlock(&watch_lock);
+
+	mds->priv->watch_wd = -1;
+}
+
+/* (Re)starts watching cur, before a full scan so that nothing that happens
+ * during the scan is missed. Changing flags renames a file, so that shows up
+ * as a remove followed by an add of the same uid */
+static void
+maildir_watch_start(CamelMaildirSummary *mds, const char *cur)
+{
+	struct _maildir_watch *w;
+	int wd;
+
+	maildir_watch_stop(mds);
+
+	pthread_mutex_lock(&watch_lock);
+
+	if (watch_fd == -1) {
+		watch_fd = inotify_init();
+		if (watch_fd == -1) {
+			pthread_mutex_unlock(&watch_lock);
+			return;
+		}
+		fcntl(watch_fd, F_SETFL, fcntl(watch_fd, F_GETFL) | O_NONBLOCK);
+		watches = g_hash_table_new_full(g_direct_hash, g_direct_equal, NULL,
+						(GDestroyNotify)maildir_watch_free);
+	}
+
+	wd = inotify_add_watch(watch_fd, cur,
+			       IN_CREATE | IN_MOVED_TO | IN_DELETE | IN_MOVED_FROM | IN_DELETE_SELF | IN_MOVE_SELF);
+	if (wd != -1) {
+		w = g_new0(struct _maildir_watch, 1);
+		w->events = g_byte_array_new();
+		g_hash_table_replace(watches, GINT_TO_POINTER(wd), w);
+		mds->priv->watch_wd = wd;
+	}
+
+	pthread_mutex_unlock(&watch_lock);
+}
+
+struct _watch_apply_data {
+	CamelLocalSummary *cls;
+	CamelFolderChangeInfo *changes;
+};
+
+static void
+maildir_watch_apply_uid(gpointer key, gpointer value, gpointer user_data)
+{
+	struct _watch_apply_data *data = user_data;
+	const char *name = value;
+	CamelMessageInfo *info;
+
+	if (name[0]) {
+		maildir_summary_check_add(data->cls, name, data->changes);
+		return;
+	}
+
+	info = camel_folder_summary_uid((CamelFolderSummary *)data->cls, key);
+	if (info) {
+		if (data->cls->index)
+			camel_index_delete_name(data->cls->index, camel_message_info_uid(info));
+		if (data->changes)
+			camel_folder_change_info_remove_uid(data->changes, camel_message_info_uid(info));
+		camel_folder_summary_remove((CamelFolderSummary *)data->cls, info);
+		camel_message_info_free(info);
+	}
+}
+
+/* Applies what happened in cur since the last check. Returns -1 if that
+ * isn't known, because events got lost or cur itself went away, and cur
+ * has to be scanned */
+static int
+maildir_watch_apply(CamelLocalSummary *cls, CamelFolderChangeInfo *changes)
+{
+	CamelMaildirSummary *mds = (CamelMaildirSummary *)cls;
+	struct _watch_apply_data data;
+	struct _maildir_watch *w;
+	GByteArray *events;
+	GHashTable *last;
+	gboolean lost;
+	guint8 *p;
+
+	/* Takes this summary's queue, leaving an empty one */
+	pthread_mutex_lock(&watch_lock);
+	maildir_watch_read();
+	w = g_hash_table_lookup(watches, GINT_TO_POINTER(mds->priv->watch_wd));
+	if (w == NULL) {
+		pthread_mutex_unlock(&watch_lock);
 		return -1;
 	}
+	events = w->events;
+	lost = w->lost;
+	w->events = g_byte_array_new();
+	pthread_mutex_unlock(&watch_lock);
 
-	total = 0;
-	count = 0;
-	while (readdir(dir))
-		total++;
-	rewinddir(dir);
+	/* uid -> the name it got last, or "" if it got removed last */
+	last = g_hash_table_new_full(g_str_hash, g_str_equal, g_free, g_free);
 
-	camel_folder_summary_prepare_hash ((CamelFolderSummary *)cls);
+	p = events->data;
+	while (!lost && p < events->data + events->len) {
+		struct inotify_event *ev = (struct inotify_event *)p;
 
-	while (d = readdir(dir)) {
-		gboolean mfree = FALSE;
+		p += sizeof(struct inotify_event) + ev->len;
 
-		camel_operation_progress(NULL, count, total);
-		count++;
+		if (ev->mask & (IN_IGNORED | IN_DELETE_SELF | IN_MOVE_SELF)) {
+			lost = TRUE;
+			break;
+		}
 
-		/* FIXME: also run stat to check for regular file */
-		p = d->d_name;
-		if (p[0] == '.')
+		if (ev->len == 0 || ev->name[0] == '.' || (ev->mask & IN_ISDIR))
 			continue;
 
-		if (!strcmp (d->d_name, "core"))
-			continue;
+		g_hash_table_replace(last, maildir_name_to_uid(ev->name),
+				     g_strdup((ev->mask & (IN_CREATE | IN_MOVED_TO)) ? ev->name : ""));
+	}
 
-		/* map the filename -> uid */
-		uid = strchr(d->d_name, '!');
+	g_byte_array_free(events, TRUE);
 
-		if (!uid)
-			uid = strchr(d->d_name, ':');
+	if (lost) {
+		g_hash_table_destroy(last);
+		return -1;
+	}
 
-		if (uid) {
-			uid =  g_strndup(d->d_name, uid - d->d_name);
-			mfree = TRUE;
-		} else
-			uid = d->d_name;
+	data.cls = cls;
+	data.changes = changes;
+	g_hash_table_foreach(last, maildir_watch_apply_uid, &data);
+
+	g_hash_table_destroy(last);
+
+	return 0;
+}
+#endif
+
+static int
+maildir_summary_check(CamelLocalSummary *cls, CamelFolderChangeInfo *changes, CamelException *ex)
+{
+	CamelMaildirSummary *mds = (CamelMaildirSummary *)cls;
+	DIR *dir;
+	CamelMessageInfo *info;
+	CamelFolderSummary *s = (CamelFolderSummary *)cls;
+	char *new, *cur;
+	time_t now, cur_mtime, new_mtime;
+	gboolean cur_done = FALSE, cur_scan = FALSE;
+	GPtrArray *names;
+	int i;
 
+	new = g_strdup_printf("%s/new", cls->folder_path);
+	cur = g_strdup_printf("%s/cur", cls->folder_path);
 
-		info = camel_folder_summary_uid ((CamelFolderSummary *)cls, uid);
-		if (info == NULL) {
-			/* must be a message incorporated by another client, this is not a 'recent' uid */
-			if (camel_maildir_summary_add (cls, d->d_name, uid) == 0)
-				if (changes)
-					camel_folder_change_info_add_uid(changes, uid);
+	/* An mtime in the current second can still change without changing,
+	 * so only older ones are remembered */
+	now = time(NULL);
+	new_mtime = maildir_dir_mtime(new);
 
+#ifdef HAVE_SYS_INOTIFY_H
+	/* A watch that was just started doesn't know what changed before it,
+	 * the mtime of cur is sampled after that and cur is scanned anyway */
+	if (mds->priv->watch_wd != -1 && maildir_watch_apply(cls, changes) == 0) {
+		cur_done = TRUE;
+	} else {
+		maildir_watch_start(mds, cur);
+		cur_scan = TRUE;
+	}
+#endif
 
-		} else {
-			// CamelMaildirMessageInfo *mdi = (CamelMaildirMessageInfo *) info;
-			// mdi->filename = g_strdup (d->d_name);
-			camel_message_info_free(info);
+	cur_mtime = maildir_dir_mtime(cur);
+
+	if (!cur_done && !cur_scan && cur_mtime != 0 && cur_mtime == mds->priv->cur_mtime)
+		cur_done = TRUE;
+
+	if (!cur_done) {
+		camel_operation_start(NULL, _("Checking folder consistency"));
+
+		/* scan the directory, check for mail files not in the index */
+		dir = opendir(cur);
+		if (dir == NULL) {
+			camel_exception_setv (ex, CAMEL_EXCEPTION_SYSTEM_IO_READ,
+				_("Cannot open maildir directory path: %s: %s"),
+				cls->folder_path, g_strerror (errno));
+			g_free(cur);
+			g_free(new);
+			camel_operation_end(NULL);
+			return -1;
 		}
 
-		if (mfree)
-			g_free(uid);
-	}
-	closedir(dir);
+		names = maildir_read_names(dir);
+		closedir(dir);
 
-	camel_operation_end(NULL);
+		camel_folder_summary_prepare_hash ((CamelFolderSummary *)cls);
 
-	camel_operation_start(NULL, _("Checking for new messages"));
+		for (i = 0; i < names->len; i++) {
+			camel_operation_progress(NULL, i, names->len);
+			maildir_summary_check_add(cls, names->pdata[i], changes);
+		}
+
+		camel_folder_summary_kill_hash ((CamelFolderSummary *)cls);
+
+		maildir_free_names(names);
+		mds->priv->cur_mtime = cur_mtime < now ? cur_mtime : 0;
+
+		camel_operation_end(NULL);
+	}
 
 	/* now, scan new for new messages, and copy them to cur, and so forth */
-	dir = opendir(new);
-	if (dir != NULL) {
-		total = 0;
-		count = 0;
-		while (readdir(dir))
-			total++;
-		rewinddir(dir);
-
-		while (d = readdir(dir)) {
-			char *name, *newname, *destname, *destfilename;
-			char *src, *dest;
-
-			camel_operation_progress(NULL, count, total);
-			count++;
-
-			name = d->d_name;
-			if (name[0] == '.')
-				continue;
+	if (new_mtime == 0 || new_mtime != mds->priv->new_mtime) {
+		dir = opendir(new);
+		if (dir != NULL) {
+			camel_operation_start(NULL, _("Checking for new messages"));
 
-			if (!strcmp (d->d_name, "core"))
-				continue;
+			names = maildir_read_names(dir);
+			closedir(dir);
 
-			/* already in summary?  shouldn't happen, but just incase ... */
-			if ((info = camel_folder_summary_uid((CamelFolderSummary *)cls, name))) {
-				camel_message_info_free(info);
-				newname = destname = camel_folder_summary_next_uid_string(s);
-			} else {
-				newname = NULL;
-				destname = name;
-			}
+			for (i = 0; i < names->len; i++) {
+				char *name, *newname, *destname, *destfilename;
+				char *src, *dest;
 
-			/* copy this to the destination folder, use 'standard' semantics for maildir info field */
-			src = g_strdup_printf("%s/%s", new, name);
-			destfilename = g_strdup_printf("%s!2,", destname);
-			dest = g_strdup_printf("%s/%s", cur, destfilename);
+				camel_operation_progress(NULL, i, names->len);
 
-			/* FIXME: This should probably use link/unlink */
+				name = names->pdata[i];
 
-			if (rename(src, dest) == 0) {
-				camel_maildir_summary_add (cls, destfilename, destname);
-				if (changes) {
-					camel_folder_change_info_add_uid(changes, destname);
-					camel_folder_change_info_recent_uid(changes, destname);
+				/* already in summary?  shouldn't happen, but just incase ... */
+				if ((info = camel_folder_summary_uid((CamelFolderSummary *)cls, name))) {
+					camel_message_info_free(info);
+					newname = destname = camel_folder_summary_next_uid_string(s);
+				} else {
+					newname = NULL;
+					destname = name;
 				}
-			} else {
-				/* else?  we should probably care about failures, but wont */
-				g_warning("Failed to move new maildir message %s to cur %s", src, dest);
+
+				/* copy this to the destination folder, use 'standard' semantics for maildir info field */
+				src = g_strdup_printf("%s/%s", new, name);
+				destfilename = g_strdup_printf("%s!2,", destname);
+				dest = g_strdup_printf("%s/%s", cur, destfilename);
+
+				/* FIXME: This should probably use link/unlink */
+
+				if (rename(src, dest) == 0) {
+					camel_maildir_summary_add (cls, destfilename, destname);
+					if (changes) {
+						camel_folder_change_info_add_uid(changes, destname);
+						camel_folder_change_info_recent_uid(changes, destname);
+					}
+				} else {
+					/* else?  we should probably care about failures, but wont */
+					g_warning("Failed to move new maildir message %s to cur %s", src, dest);
+				}
+
+				/* c strings are painful to work with ... */
+				g_free(destfilename);
+				g_free(newname);
+				g_free(src);
+				g_free(dest);
 			}
 
-			/* c strings are painful to work with ... */
-			g_free(destfilename);
-			g_free(newname);
-			g_free(src);
-			g_free(dest);
-		}
+			maildir_free_names(names);
+			mds->priv->new_mtime = new_mtime < now ? new_mtime : 0;
 
-		camel_operation_end(NULL);
-		closedir(dir);
+			camel_operation_end(NULL);
+		}
 	}
 
 	g_free(new);
 	g_free(cur);
 
-	camel_folder_summary_kill_hash ((CamelFolderSummary *)cls);
-
 	camel_folder_summary_save ((CamelFolderSummary *) cls, ex);
 
 	return 0;
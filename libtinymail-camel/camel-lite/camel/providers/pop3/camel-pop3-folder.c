@@ -37,6 +37,7 @@
 #include <glib/gstdio.h>
 
 #include <errno.h>
+#include <fcntl.h>
 #include <stdlib.h>
 
 #ifndef _GNU_SOURCE
@@ -50,6 +51,8 @@
 
 #include "camel-data-cache.h"
 #include "camel-exception.h"
+#include "camel-folder-search.h"
+#include "camel-mime-filter-index.h"
 #include "camel-mime-message.h"
 #include "camel-operation.h"
 
@@ -59,6 +62,7 @@
 #include "camel-pop3-stream.h"
 #include "camel-stream-mem.h"
 #include "camel-string-utils.h"
+#include "camel-text-index.h"
 
 #include "camel-disco-diary.h"
 
@@ -96,18 +100,89 @@ check_dir (CamelPOP3Store *store, CamelFolder *folder)
 		g_mkdir_with_parents (store->storage_path, S_IRUSR | S_IWUSR | S_IXUSR);
 }
 
+static void
+pop3_init (CamelPOP3Folder *pop3_folder)
+{
+	pop3_folder->index = NULL;
+	pop3_folder->search = NULL;
+	g_static_rec_mutex_init (&pop3_folder->search_lock);
+	g_static_mutex_init (&pop3_folder->index_lock);
+}
+
 static void
 pop3_finalize (CamelObject *object)
 {
 	CamelFolder *folder = (CamelFolder *) object;
+	CamelPOP3Folder *pop3_folder = (CamelPOP3Folder *) object;
 
 	check_dir (NULL, folder);
 
 	camel_folder_summary_save (folder->summary, NULL);
 
+	if (pop3_folder->search)
+		camel_object_unref (pop3_folder->search);
+	if (pop3_folder->index) {
+		camel_index_sync (pop3_folder->index);
+		camel_object_unref (pop3_folder->index);
+	}
+	g_static_rec_mutex_free (&pop3_folder->search_lock);
+	g_static_mutex_free (&pop3_folder->index_lock);
+
 	return;
 }
 
+/* The cached messages go in a body index as they are retrieved, so that
+ * searching them doesn't have to parse every one of them */
+static void
+pop3_index_open (CamelPOP3Folder *pop3_folder, CamelPOP3Store *p3store)
+{
+	char *path = g_strdup_printf ("%s/body.ibex", p3store->storage_path);
+	int flags = O_RDWR | O_CREAT;
+
+	if (camel_text_index_check (path) == -1)
+		flags |= O_TRUNC;
+
+	pop3_folder->index = (CamelIndex *) camel_text_index_new (path, flags);
+	if (pop3_folder->index == NULL)
+		g_warning ("Could not open or create the body index %s: %s",
+			   path, g_strerror (errno));
+	g_free (path);
+}
+
+static void
+pop3_index_message (CamelFolder *folder, const char *uid, CamelMimeMessage *message)
+{
+	CamelPOP3Folder *pop3_folder = (CamelPOP3Folder *) folder;
+
+	g_static_mutex_lock (&pop3_folder->index_lock);
+	if (pop3_folder->index && !camel_index_has_name (pop3_folder->index, uid))
+		camel_mime_filter_index_add_message (pop3_folder->index, uid, message);
+	g_static_mutex_unlock (&pop3_folder->index_lock);
+}
+
+static void
+pop3_unindex_message (CamelFolder *folder, const char *uid)
+{
+	CamelPOP3Folder *pop3_folder = (CamelPOP3Folder *) folder;
+
+	g_static_mutex_lock (&pop3_folder->index_lock);
+	if (pop3_folder->index)
+		camel_index_delete_name (pop3_folder->index, uid);
+	g_static_mutex_unlock (&pop3_folder->index_lock);
+}
+
+/* Also compacts the index once enough got deleted from it */
+static void
+pop3_index_sync (CamelFolder *folder)
+{
+	CamelPOP3Folder *pop3_folder = (CamelPOP3Folder *) folder;
+
+	g_static_mutex_lock (&pop3_folder->index_lock);
+	if (pop3_folder->index)
+		camel_index_sync (pop3_folder->index);
+	g_static_mutex_unlock (&pop3_folder->index_lock);
+}
+
 static void
 camel_pop3_summary_set_extra_flags (CamelFolder *folder, CamelMessageInfoBase *mi)
 {
@@ -147,6 +222,7 @@ camel_pop3_folder_new (CamelStore *parent, CamelException *ex)
 
 	g_free (summary_file);
 
+	pop3_index_open ((CamelPOP3Folder *) folder, p3store);
 
 	/* mt-ok, since we dont have the folder-lock for new() */
 	/* camel_folder_refresh_info (folder, ex);
@@ -163,6 +239,7 @@ camel_pop3_folder_new (CamelStore *parent, CamelException *ex)
 	}
 
 	folder->folder_flags |= CAMEL_FOLDER_HAS_SUMMARY_CAPABILITY;
+	folder->folder_flags |= CAMEL_FOLDER_HAS_SEARCH_CAPABILITY;
 
 	return folder;
 }
@@ -171,10 +248,8 @@ static int
 pop3_get_local_size (CamelFolder *folder)
 {
 	CamelPOP3Store *p3store = CAMEL_POP3_STORE (folder->parent_store);
-	int msize = 0;
 	check_dir (p3store, NULL);
-	camel_du (p3store->storage_path , &msize);
-	return msize;
+	return camel_pop3_store_get_local_size (p3store);
 }
 
 /* create a uid from md5 of 'top' output */
@@ -285,6 +360,175 @@ cmd_uidl(CamelPOP3Engine *pe, CamelPOP3Stream *stream, void *data)
 	return 1;
 }
 
+/* Without a BODYSTRUCTURE, the headers are all there is to guess the
+ * attachment flag from */
+static void
+pop3_set_info_hints (CamelMessageInfoBase *mi, struct _camel_header_raw *h, guint32 size)
+{
+	mi->size = size;
+
+	if (camel_header_raw_find(&h, "X-MSMail-Priority", NULL) &&
+	    !camel_header_raw_find(&h, "X-MS-Has-Attach", NULL)) {
+		mi->flags &= ~CAMEL_MESSAGE_ATTACHMENTS;
+	} else if (!camel_header_raw_find (&h, "X-MS-Has-Attach", NULL)) {
+		/* TNY TODO: This is a hack! But else we need to parse
+		 * BODYSTRUCTURE (and I'm lazy). It needs fixing though. */
+		if (mi->size > 102400)
+			mi->flags |= CAMEL_MESSAGE_ATTACHMENTS;
+		/* ... it does */
+	}
+}
+
+/* How many TOP commands are queued on the engine at once. The engine only
+ * has CAMEL_POP3_SEND_LIMIT bytes of them on the wire, this bounds how
+ * many infos wait to be added to the summary */
+#define POP3_TOP_WINDOW 100
+
+struct _top_request {
+	CamelFolder *folder;
+	CamelPOP3FolderInfo *fi;
+	CamelMessageInfoBase *mi;
+	CamelPOP3Command *cmd;
+};
+
+/* makes a message info from the headers of a TOP while they come in */
+static int
+cmd_tosummary (CamelPOP3Engine *pe, CamelPOP3Stream *stream, void *data)
+{
+	struct _top_request *req = data;
+	struct _camel_header_raw *h;
+	CamelMimeParser *mp;
+
+	mp = camel_mime_parser_new ();
+	camel_mime_parser_init_with_stream (mp, (CamelStream *) stream);
+	switch (camel_mime_parser_step (mp, NULL, NULL)) {
+	case CAMEL_MIME_PARSER_STATE_HEADER:
+	case CAMEL_MIME_PARSER_STATE_MESSAGE:
+	case CAMEL_MIME_PARSER_STATE_MULTIPART:
+		h = camel_mime_parser_headers_raw (mp);
+		req->mi = (CamelMessageInfoBase *) camel_folder_summary_info_new_from_header_with_uid (
+			req->folder->summary, h, req->fi->uid);
+		pop3_set_info_hints (req->mi, h, req->fi->size);
+		break;
+	default:
+		break;
+	}
+	camel_object_unref (mp);
+
+	return 1;
+}
+
+/* Gets the headers of all messages that are neither in the summary nor in
+ * the logbook with TOP. The commands are queued a window at a time, so that
+ * the engine pipelines them if the server allows it, and the infos of a
+ * window go to the summary and the logbook together. What is left when TOP
+ * fails is up to the caller */
+static void
+pop3_fetch_tops (CamelFolder *folder, CamelFolderChangeInfo **changes, CamelException *ex)
+{
+	CamelPOP3Store *pop3_store = CAMEL_POP3_STORE (folder->parent_store);
+	struct _top_request *reqs;
+	GPtrArray *uids;
+	int i = 0, hcnt = 0;
+
+	reqs = g_new0 (struct _top_request, POP3_TOP_WINDOW);
+	uids = g_ptr_array_sized_new (POP3_TOP_WINDOW);
+
+	while (i < pop3_store->uids->len) {
+		gboolean top_failed = FALSE;
+		int n, queued = 0, r = 0;
+
+		g_static_rec_mutex_lock (pop3_store->eng_lock);
+
+		if (pop3_store->engine == NULL || !(pop3_store->engine->capa & CAMEL_POP3_CAP_TOP)) {
+			g_static_rec_mutex_unlock (pop3_store->eng_lock);
+			break;
+		}
+
+		for (; queued < POP3_TOP_WINDOW && i < pop3_store->uids->len; i++) {
+			CamelPOP3FolderInfo *fi = pop3_store->uids->pdata[i];
+			CamelMessageInfo *mi;
+
+			if (!fi || !fi->uid)
+				continue;
+
+			mi = camel_folder_summary_uid (folder->summary, fi->uid);
+			if (mi) {
+				camel_message_info_free (mi);
+				continue;
+			}
+
+			if (camel_pop3_logbook_is_registered (pop3_store->book, fi->uid))
+				continue;
+
+			reqs[queued].folder = folder;
+			reqs[queued].fi = fi;
+			reqs[queued].mi = NULL;
+			reqs[queued].cmd = camel_pop3_engine_command_new (pop3_store->engine, CAMEL_POP3_COMMAND_MULTI,
+				cmd_tosummary, &reqs[queued], "TOP %u 0\r\n", fi->id);
+			queued++;
+		}
+
+		/* the replies come in order, once the last one is done the
+		 * whole window is */
+		if (queued > 0)
+			while ((r = camel_pop3_engine_iterate (pop3_store->engine, reqs[queued - 1].cmd)) > 0)
+				;
+
+		for (n = 0; n < queued; n++) {
+			if (reqs[n].cmd->state == CAMEL_POP3_COMMAND_ERR && !reqs[n].mi)
+				top_failed = TRUE;
+			camel_pop3_engine_command_free (pop3_store->engine, reqs[n].cmd);
+			reqs[n].cmd = NULL;
+		}
+
+		if (top_failed && pop3_store->engine)
+			pop3_store->engine->capa &= ~CAMEL_POP3_CAP_TOP;
+
+		g_static_rec_mutex_unlock (pop3_store->eng_lock);
+
+		for (n = 0; n < queued; n++) {
+			struct _top_request *req = &reqs[n];
+
+			if (req->mi) {
+				camel_folder_summary_add (folder->summary, (CamelMessageInfo *) req->mi);
+				if (!*changes)
+					*changes = camel_folder_change_info_new ();
+				camel_folder_change_info_add_uid (*changes, req->fi->uid);
+				g_ptr_array_add (uids, req->fi->uid);
+				req->mi = NULL;
+			}
+		}
+
+		if (uids->len > 0) {
+			camel_pop3_logbook_register_many (pop3_store->book, uids);
+			hcnt += uids->len;
+			g_ptr_array_set_size (uids, 0);
+		}
+
+		if (*changes && camel_folder_change_info_changed (*changes)) {
+			camel_object_trigger_event (CAMEL_OBJECT (folder), "folder_changed", *changes);
+			camel_folder_change_info_free (*changes);
+			*changes = NULL;
+		}
+
+		if (hcnt > 1000) {
+			/* Periodically save the summary (this reduces
+			   memory usage too) */
+			camel_folder_summary_save (folder->summary, ex);
+			hcnt = 0;
+		}
+
+		camel_operation_progress (NULL, i, pop3_store->uids->len);
+
+		if (r == -1)
+			break;
+	}
+
+	g_ptr_array_free (uids, TRUE);
+	g_free (reqs);
+}
+
 static void
 pop3_refresh_info (CamelFolder *folder, CamelException *ex)
 {
@@ -357,6 +601,10 @@ pop3_refresh_info (CamelFolder *folder, CamelException *ex)
 
 	camel_pop3_logbook_open (pop3_store->book);
 
+	/* Most of the new messages are done here, the loop below takes care
+	 * of what TOP didn't get */
+	pop3_fetch_tops (folder, &changes, ex);
+
 	for (i=0;i<pop3_store->uids->len;i++) {
 		CamelPOP3FolderInfo *fi = pop3_store->uids->pdata[i];
 		CamelMessageInfoBase *mi = NULL;
@@ -390,35 +638,10 @@ pop3_refresh_info (CamelFolder *folder, CamelException *ex)
 
 				mi = (CamelMessageInfoBase*) camel_folder_summary_uid (folder->summary, fi->uid);
 				if (mi) {
-					mi->size = (fi->size);
+					pop3_set_info_hints (mi, ((CamelMimePart *)msg)->headers, fi->size);
 					camel_message_info_free (mi);
 				}
 
-				struct _camel_header_raw *h;
-				
-				h = ((CamelMimePart *)msg)->headers;
-				if (camel_header_raw_find(&h, "X-MSMail-Priority", NULL) &&
-				    !camel_header_raw_find(&h, "X-MS-Has-Attach", NULL)) {
-					mi = (CamelMessageInfoBase*) camel_folder_summary_uid (folder->summary, fi->uid);
-					if (mi) {
-						mi->size = (fi->size);
-						((CamelMessageInfoBase *)mi)->flags &= ~CAMEL_MESSAGE_ATTACHMENTS;
-						camel_message_info_free (mi);
-					}
-				} else if (!camel_header_raw_find (&h, "X-MS-Has-Attach", NULL)) {
-					
-					mi = (CamelMessageInfoBase*) camel_folder_summary_uid (folder->summary, fi->uid);
-					if (mi) {
-						mi->size = (fi->size);
-						/* TNY TODO: This is a hack! But else we need to parse
-						 * BODYSTRUCTURE (and I'm lazy). It needs fixing though. */
-						if (mi->size > 102400)
-							mi->flags |= CAMEL_MESSAGE_ATTACHMENTS;
-						/* ... it does */
-						camel_message_info_free (mi);
-					}
-				}
-
 
 				camel_object_unref (CAMEL_OBJECT (msg));
 
@@ -621,6 +844,8 @@ pop3_sync (CamelFolder *folder, gboolean expunge, CamelException *ex)
 
 			if (pop3_store->cache && info->uid)
 				camel_data_cache_remove(pop3_store->cache, "cache", info->uid, NULL);
+			if (info->uid)
+				pop3_unindex_message (folder, info->uid);
 
 			if (expunge) {
 				CamelPOP3FolderInfo *fi = NULL;
@@ -694,6 +919,7 @@ pop3_sync (CamelFolder *folder, gboolean expunge, CamelException *ex)
 	g_static_rec_mutex_unlock (pop3_store->eng_lock);
 
 	camel_folder_summary_save (folder->summary, ex);
+	pop3_index_sync (folder);
 
 	return;
 
@@ -811,6 +1037,7 @@ camel_pop3_delete_old(CamelFolder *folder, int days_to_delete,	CamelException *e
 				/* also remove from cache */
 				if (pop3_store->cache && fi->uid) {
 					camel_data_cache_remove(pop3_store->cache, "cache", fi->uid, NULL);
+					pop3_unindex_message (folder, fi->uid);
 				}
 			}
 		}
@@ -1314,12 +1541,14 @@ rfail:
 		{
 
 			camel_data_cache_remove (pop3_store->cache, "cache", fi->uid, &tex);
+			pop3_unindex_message (folder, fi->uid);
 			im_certain = TRUE;
 
 		} else if ((type & CAMEL_FOLDER_RECEIVE_PARTIAL)
 			&& !camel_data_cache_is_partial (pop3_store->cache, "cache", fi->uid))
 		{
 			camel_data_cache_remove (pop3_store->cache, "cache", fi->uid, &tex);
+			pop3_unindex_message (folder, fi->uid);
 			im_certain = TRUE;
 		}
 	}
@@ -1457,6 +1686,9 @@ rfail:
 		camel_message_info_free (mi);
 	}
 
+	if (message)
+		pop3_index_message (folder, uid, message);
+
 done:
 	if (stream)
 		camel_object_unref((CamelObject *)stream);
@@ -1732,6 +1964,63 @@ static void
 pop3_sync_offline (CamelFolder *folder, CamelException *ex)
 {
 	camel_folder_summary_save (folder->summary, ex);
+	pop3_index_sync (folder);
+}
+
+static GPtrArray *
+pop3_search_by_expression (CamelFolder *folder, const char *expression, CamelException *ex)
+{
+	CamelPOP3Folder *pop3_folder = (CamelPOP3Folder *) folder;
+	GPtrArray *matches;
+
+	g_static_rec_mutex_lock (&pop3_folder->search_lock);
+
+	if (pop3_folder->search == NULL)
+		pop3_folder->search = camel_folder_search_new ();
+
+	/* The search reads the index without index_lock, the text index has a
+	 * lock of its own for that. Matching may get messages, and with that
+	 * take eng_lock and index_lock */
+	camel_folder_search_set_folder (pop3_folder->search, folder);
+	camel_folder_search_set_body_index (pop3_folder->search, pop3_folder->index);
+	matches = camel_folder_search_search (pop3_folder->search, expression, NULL, ex);
+
+	g_static_rec_mutex_unlock (&pop3_folder->search_lock);
+
+	return matches;
+}
+
+static GPtrArray *
+pop3_search_by_uids (CamelFolder *folder, const char *expression, GPtrArray *uids, CamelException *ex)
+{
+	CamelPOP3Folder *pop3_folder = (CamelPOP3Folder *) folder;
+	GPtrArray *matches;
+
+	if (uids->len == 0)
+		return g_ptr_array_new ();
+
+	g_static_rec_mutex_lock (&pop3_folder->search_lock);
+
+	if (pop3_folder->search == NULL)
+		pop3_folder->search = camel_folder_search_new ();
+
+	camel_folder_search_set_folder (pop3_folder->search, folder);
+	camel_folder_search_set_body_index (pop3_folder->search, pop3_folder->index);
+	matches = camel_folder_search_search (pop3_folder->search, expression, uids, ex);
+
+	g_static_rec_mutex_unlock (&pop3_folder->search_lock);
+
+	return matches;
+}
+
+static void
+pop3_search_free (CamelFolder *folder, GPtrArray *result)
+{
+	CamelPOP3Folder *pop3_folder = (CamelPOP3Folder *) folder;
+
+	g_static_rec_mutex_lock (&pop3_folder->search_lock);
+	camel_folder_search_free_result (pop3_folder->search, result);
+	g_static_rec_mutex_unlock (&pop3_folder->search_lock);
 }
 
 static void
@@ -1858,6 +2147,9 @@ camel_pop3_folder_class_init (CamelPOP3FolderClass *camel_pop3_folder_class)
 	camel_folder_class->delete_attachments = pop3_delete_attachments;
 	camel_folder_class->get_allow_external_images = pop3_get_allow_external_images;
 	camel_folder_class->set_allow_external_images = pop3_set_allow_external_images;
+	camel_folder_class->search_by_expression = pop3_search_by_expression;
+	camel_folder_class->search_by_uids = pop3_search_by_uids;
+	camel_folder_class->search_free = pop3_search_free;
 
 	camel_disco_folder_class->refresh_info_online = pop3_refresh_info;
 	camel_disco_folder_class->sync_online = pop3_sync_online;
@@ -1891,7 +2183,7 @@ camel_pop3_folder_get_type (void)
 							      sizeof (CamelPOP3FolderClass),
 							      (CamelObjectClassInitFunc) camel_pop3_folder_class_init,
 							      NULL,
-							      NULL,
+							      (CamelObjectInitFunc) pop3_init,
 							      (CamelObjectFinalizeFunc) pop3_finalize);
 	}
 
@@ -50,6 +50,15 @@ typedef struct {
 
 typedef struct {
 	CamelDiscoFolder parent_object;
+
+	/* The body index of the cached messages, for searching them */
+	struct _CamelIndex *index;
+	struct _CamelFolderSearch *search;
+	GStaticRecMutex search_lock;
+	/* Only held while the index gets changed, never across a
+	 * get_message. A search can take eng_lock while it holds search_lock,
+	 * so the index must not need search_lock under eng_lock */
+	GStaticMutex index_lock;
 } CamelPOP3Folder;
 
 typedef struct {
@@ -106,6 +106,35 @@ camel_pop3_logbook_register (CamelPOP3Logbook *book, const gchar *uid)
 	return;
 }
 
+/* Like camel_pop3_logbook_register for all of uids, with one write */
+void
+camel_pop3_logbook_register_many (CamelPOP3Logbook *book, GPtrArray *uids)
+{
+	FILE *f = NULL;
+	int i;
+
+	g_static_rec_mutex_lock (book->lock);
+
+	if (book->registered) {
+		for (i = 0; i < uids->len; i++)
+			book->registered = g_list_prepend (book->registered,
+				g_strdup (uids->pdata[i]));
+	}
+
+	f = fopen (book->path, "a");
+	if (f) {
+		for (i = 0; i < uids->len; i++) {
+			fputs (uids->pdata[i], f);
+			fputc ('\n', f);
+		}
+		fclose (f);
+	}
+
+	g_static_rec_mutex_unlock (book->lock);
+
+	return;
+}
+
 gboolean
 camel_pop3_logbook_is_registered (CamelPOP3Logbook *book, const gchar *uid)
 {
@@ -53,6 +53,7 @@ CamelType camel_pop3_logbook_get_type (void);
 CamelPOP3Logbook* camel_pop3_logbook_new (gpointer store_in);
 
 void camel_pop3_logbook_register (CamelPOP3Logbook *book, const gchar *uid);
+void camel_pop3_logbook_register_many (CamelPOP3Logbook *book, GPtrArray *uids);
 gboolean camel_pop3_logbook_is_registered (CamelPOP3Logbook *book, const gchar *uid);
 
 void camel_pop3_logbook_open (CamelPOP3Logbook *book);
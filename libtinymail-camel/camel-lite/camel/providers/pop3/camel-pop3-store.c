@@ -33,6 +33,7 @@
 #endif
 
 #include <sys/types.h>
+#include <sys/stat.h>
 #include <ctype.h>
 #include <errno.h>
 #include <stdio.h>
@@ -98,15 +99,48 @@ static CamelFolder *get_trash  (CamelStore *store, CamelException *ex);
 static void pop3_get_folder_status (CamelStore *store, const char *folder_name, int *unseen, int *messages, int *uidnext);
 
 
-static int
-pop3store_get_local_size (CamelStore *store, const gchar *folder_name)
+/**
+ * camel_pop3_store_get_local_size:
+ * @store: the store
+ *
+ * The bytes that the cached messages and the other files of the store
+ * take. The data cache keeps the size of its items up to date, those are in
+ * subdirectories. Only the few files next to them, like the summary, the
+ * body index, the journal and the logbook, get a stat.
+ **/
+int
+camel_pop3_store_get_local_size (CamelPOP3Store *store)
 {
-	CamelPOP3Store *p3store = (CamelPOP3Store *) store;
 	int msize = 0;
-	camel_du (p3store->storage_path , &msize);
+
+	if (store->cache)
+		msize = camel_data_cache_get_size (store->cache);
+
+	if (store->storage_path) {
+		GDir *dir = g_dir_open (store->storage_path, 0, NULL);
+		const gchar *dname;
+
+		while (dir && (dname = g_dir_read_name (dir))) {
+			gchar *spath = g_build_filename (store->storage_path, dname, NULL);
+			struct stat st;
+
+			if (g_stat (spath, &st) == 0 && S_ISREG (st.st_mode))
+				msize += st.st_size;
+			g_free (spath);
+		}
+		if (dir)
+			g_dir_close (dir);
+	}
+
 	return msize;
 }
 
+static int
+pop3store_get_local_size (CamelStore *store, const gchar *folder_name)
+{
+	return camel_pop3_store_get_local_size ((CamelPOP3Store *) store);
+}
+
 static char*
 pop3_delete_cache  (CamelStore *store)
 {
@@ -196,7 +230,7 @@ pop3_build_folder_info (CamelPOP3Store *store, const char *folder_name)
 {
 	const char *name;
 	CamelFolderInfo *fi;
-	gint msize = 0;
+	gint msize;
 	gchar *folder_dir = store->storage_path;
 	gchar *spath;
 	FILE *f;
@@ -209,7 +243,7 @@ pop3_build_folder_info (CamelPOP3Store *store, const char *folder_name)
 	fi->unread = 0;
 	fi->total = 0;
 
-	camel_du (folder_dir, &msize);
+	msize = camel_pop3_store_get_local_size (store);
 
 	spath = g_strdup_printf ("%s/summary.mmap", folder_dir);
 	f = fopen (spath, "r");
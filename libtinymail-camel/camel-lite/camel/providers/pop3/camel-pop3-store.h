@@ -70,6 +70,7 @@ typedef struct {
 
 /* public methods */
 void camel_pop3_store_expunge (CamelPOP3Store *store, CamelException *ex);
+int camel_pop3_store_get_local_size (CamelPOP3Store *store);
 
 /* support functions */
 enum { CAMEL_POP3_OK, CAMEL_POP3_ERR, CAMEL_POP3_FAIL };
@@ -52,6 +52,7 @@
 #include "camel-smtp-transport.h"
 #include "camel-stream-buffer.h"
 #include "camel-stream-filter.h"
+#include "camel-stream-mem.h"
 #include "camel-tcp-stream-raw.h"
 #include "camel-tcp-stream.h"
 
@@ -83,9 +84,13 @@ static char *get_name (CamelService *service, gboolean brief);
 static gboolean smtp_helo (CamelSmtpTransport *transport, CamelException *ex);
 static gboolean smtp_auth (CamelSmtpTransport *transport, const char *mech, CamelException *ex);
 static gboolean smtp_mail (CamelSmtpTransport *transport, const char *sender,
-			   gboolean has_8bit_parts, CamelException *ex);
+			   const char *body, CamelException *ex);
 static gboolean smtp_rcpt (CamelSmtpTransport *transport, const char *recipient, CamelException *ex);
+static gboolean smtp_pipeline_envelope (CamelSmtpTransport *transport, const char *sender, const char *body,
+					GPtrArray *recipients, gboolean data, CamelException *ex);
+static gboolean smtp_data_command (CamelSmtpTransport *transport, CamelException *ex);
 static gboolean smtp_data (CamelSmtpTransport *transport, CamelMimeMessage *message, CamelException *ex);
+static gboolean smtp_bdat (CamelSmtpTransport *transport, CamelMimeMessage *message, CamelException *ex);
 static gboolean smtp_rset (CamelSmtpTransport *transport, CamelException *ex);
 static gboolean smtp_quit (CamelSmtpTransport *transport, CamelException *ex);
 
@@ -741,9 +746,11 @@ smtp_send_to (CamelTransport *transport, CamelMimeMessage *message,
 	      CamelException *ex)
 {
 	CamelSmtpTransport *smtp_transport = CAMEL_SMTP_TRANSPORT (transport);
+	CamelBestencEncoding enctype = CAMEL_BESTENC_8BIT;
 	const CamelInternetAddress *cia;
-	gboolean has_8bit_parts;
-	const char *addr;
+	const char *addr, *rcpt, *body = NULL;
+	gboolean chunking, retval;
+	GPtrArray *rcpts;
 	int i, len;
 
 	if (!smtp_transport->connected) {
@@ -758,47 +765,68 @@ smtp_send_to (CamelTransport *transport, CamelMimeMessage *message,
 		return FALSE;
 	}
 
-	camel_operation_start (NULL, _("Sending message"));
-
-	/* find out if the message has 8bit mime parts */
-	has_8bit_parts = camel_mime_message_has_8bit_parts (message);
-
-	/* rfc1652 (8BITMIME) requires that you notify the ESMTP daemon that
-	   you'll be sending an 8bit mime message at "MAIL FROM:" time. */
-	if (!smtp_mail (smtp_transport, addr, has_8bit_parts, ex)) {
-		camel_operation_end (NULL);
-		return FALSE;
-	}
-
 	len = camel_address_length (recipients);
 	if (len == 0) {
 		camel_exception_setv (ex, CAMEL_EXCEPTION_SYSTEM,
 				      _("Cannot send message: no recipients defined."));
-		camel_operation_end (NULL);
 		return FALSE;
 	}
 
 	cia = CAMEL_INTERNET_ADDRESS (recipients);
+	rcpts = g_ptr_array_sized_new (len);
 	for (i = 0; i < len; i++) {
-		char *enc;
-
-		if (!camel_internet_address_get (cia, i, NULL, &addr)) {
+		if (!camel_internet_address_get (cia, i, NULL, &rcpt)) {
 			camel_exception_set (ex, CAMEL_EXCEPTION_SYSTEM,
 					     _("Cannot send message: one or more invalid recipients"));
-			camel_operation_end (NULL);
+			g_ptr_array_foreach (rcpts, (GFunc) g_free, NULL);
+			g_ptr_array_free (rcpts, TRUE);
 			return FALSE;
 		}
 
-		enc = camel_internet_address_encode_address(NULL, NULL, addr);
-		if (!smtp_rcpt (smtp_transport, enc, ex)) {
-			g_free(enc);
-			camel_operation_end (NULL);
-			return FALSE;
-		}
-		g_free(enc);
+		g_ptr_array_add (rcpts, camel_internet_address_encode_address (NULL, NULL, rcpt));
 	}
 
-	if (!smtp_data (smtp_transport, message, ex)) {
+	camel_operation_start (NULL, _("Sending message"));
+
+	/* rfc3030: with BDAT nothing in the body needs escaping. BINARYMIME
+	 * isn't used: the whole message goes through the CRLF filter, which
+	 * would corrupt binary parts that are sent unencoded */
+	chunking = (smtp_transport->flags & CAMEL_SMTP_TRANSPORT_CHUNKING) != 0;
+	if (!(smtp_transport->flags & CAMEL_SMTP_TRANSPORT_8BITMIME))
+		enctype = CAMEL_BESTENC_7BIT;
+
+	/* FIXME: should we get the best charset too?? */
+	/* Changes the encoding of all mime parts to fit within our required
+	   encoding type and also force any text parts with long lines (longer
+	   than 998 octets) to wrap by QP or base64 encoding them. */
+	camel_mime_message_set_best_encoding (message, CAMEL_BESTENC_GET_ENCODING, enctype);
+
+	/* rfc1652 (8BITMIME) requires that you notify the ESMTP daemon that
+	   you'll be sending an 8bit mime message at "MAIL FROM:" time. */
+	if (camel_mime_message_has_8bit_parts (message) && enctype == CAMEL_BESTENC_8BIT)
+		body = "8BITMIME";
+
+	if (smtp_transport->flags & CAMEL_SMTP_TRANSPORT_PIPELINING) {
+		retval = smtp_pipeline_envelope (smtp_transport, addr, body, rcpts, !chunking, ex);
+	} else {
+		retval = smtp_mail (smtp_transport, addr, body, ex);
+		for (i = 0; retval && i < rcpts->len; i++)
+			retval = smtp_rcpt (smtp_transport, rcpts->pdata[i], ex);
+		if (retval && !chunking)
+			retval = smtp_data_command (smtp_transport, ex);
+	}
+
+	g_ptr_array_foreach (rcpts, (GFunc) g_free, NULL);
+	g_ptr_array_free (rcpts, TRUE);
+
+	if (retval) {
+		if (chunking)
+			retval = smtp_bdat (smtp_transport, message, ex);
+		else
+			retval = smtp_data (smtp_transport, message, ex);
+	}
+
+	if (!retval) {
 		camel_operation_end (NULL);
 		return FALSE;
 	}
@@ -1007,7 +1035,9 @@ smtp_helo (CamelSmtpTransport *transport, CamelException *ex)
 	   are being called a second time (ie, after a STARTTLS) */
 	transport->flags &= ~(CAMEL_SMTP_TRANSPORT_8BITMIME |
 			      CAMEL_SMTP_TRANSPORT_ENHANCEDSTATUSCODES |
-			      CAMEL_SMTP_TRANSPORT_STARTTLS);
+			      CAMEL_SMTP_TRANSPORT_STARTTLS |
+			      CAMEL_SMTP_TRANSPORT_PIPELINING |
+			      CAMEL_SMTP_TRANSPORT_CHUNKING);
 
 	if (transport->authtypes) {
 		g_hash_table_foreach (transport->authtypes, authtypes_free, NULL);
@@ -1073,6 +1103,10 @@ smtp_helo (CamelSmtpTransport *transport, CamelException *ex)
 				transport->flags |= CAMEL_SMTP_TRANSPORT_ENHANCEDSTATUSCODES;
 			} else if (!strncmp (token, "STARTTLS", 8)) {
 				transport->flags |= CAMEL_SMTP_TRANSPORT_STARTTLS;
+			} else if (!strncmp (token, "PIPELINING", 10)) {
+				transport->flags |= CAMEL_SMTP_TRANSPORT_PIPELINING;
+			} else if (!strncmp (token, "CHUNKING", 8)) {
+				transport->flags |= CAMEL_SMTP_TRANSPORT_CHUNKING;
 			} else if (!strncmp (token, "AUTH", 4)) {
 				if (!transport->authtypes || transport->flags & CAMEL_SMTP_TRANSPORT_AUTH_EQUAL) {
 					/* Don't bother parsing any authtypes if we already have a list.
@@ -1250,13 +1284,13 @@ smtp_auth (CamelSmtpTransport *transport, const char *mech, CamelException *ex)
 }
 
 static gboolean
-smtp_mail (CamelSmtpTransport *transport, const char *sender, gboolean has_8bit_parts, CamelException *ex)
+smtp_mail (CamelSmtpTransport *transport, const char *sender, const char *body, CamelException *ex)
 {
 	/* we gotta tell the smtp server who we are. (our email addy) */
 	char *cmdbuf, *respbuf = NULL;
 
-	if (transport->flags & CAMEL_SMTP_TRANSPORT_8BITMIME && has_8bit_parts)
-		cmdbuf = g_strdup_printf ("MAIL FROM:<%s> BODY=8BITMIME\r\n", sender);
+	if (body)
+		cmdbuf = g_strdup_printf ("MAIL FROM:<%s> BODY=%s\r\n", sender, body);
 	else
 		cmdbuf = g_strdup_printf ("MAIL FROM:<%s>\r\n", sender);
 
@@ -1337,25 +1371,112 @@ smtp_rcpt (CamelSmtpTransport *transport, const char *recipient, CamelException
 	return TRUE;
 }
 
+/* Reads one reply, continuation lines and all, and checks its code. Only
+ * the first failure goes to ex, so that when replies to pipelined commands
+ * are read the error is about the command that failed first */
 static gboolean
-smtp_data (CamelSmtpTransport *transport, CamelMimeMessage *message, CamelException *ex)
+smtp_read_reply (CamelSmtpTransport *transport, const char *code, const char *message, CamelException *ex)
 {
-	CamelBestencEncoding enctype = CAMEL_BESTENC_8BIT;
-	struct _camel_header_raw *header, *savedbcc, *n, *tail;
-	char *cmdbuf, *respbuf = NULL;
-	CamelStreamFilter *filtered_stream;
-	CamelMimeFilter *crlffilter;
-	int ret, mtry;
+	CamelException lex = CAMEL_EXCEPTION_INITIALISER;
+	char *respbuf = NULL;
 
-	/* If the server doesn't support 8BITMIME, set our required encoding to be 7bit */
-	if (!(transport->flags & CAMEL_SMTP_TRANSPORT_8BITMIME))
-		enctype = CAMEL_BESTENC_7BIT;
+	/* disconnected by an earlier failure */
+	if (!transport->istream)
+		return FALSE;
 
-	/* FIXME: should we get the best charset too?? */
-	/* Changes the encoding of all mime parts to fit within our required
-	   encoding type and also force any text parts with long lines (longer
-	   than 998 octets) to wrap by QP or base64 encoding them. */
-	camel_mime_message_set_best_encoding (message, CAMEL_BESTENC_GET_ENCODING, enctype);
+	if (camel_exception_is_set (ex))
+		ex = &lex;
+
+	do {
+		g_free (respbuf);
+		respbuf = camel_stream_buffer_read_line (CAMEL_STREAM_BUFFER (transport->istream));
+
+		smtp_debug ("<- %s\n", respbuf ? respbuf : "(null)");
+
+		if (!respbuf || strncmp (respbuf, code, 3)) {
+			smtp_set_exception (transport, TRUE, respbuf, message, ex);
+			camel_exception_clear (&lex);
+			g_free (respbuf);
+			return FALSE;
+		}
+	} while (*(respbuf+3) == '-'); /* if we got "250-" then loop again */
+	g_free (respbuf);
+
+	return TRUE;
+}
+
+/* rfc2920 (PIPELINING): MAIL FROM, the RCPT TOs and, unless the message
+ * goes with BDAT, DATA are written at once and then the replies are read.
+ * They are all read even after a failure, else the next command would get
+ * a reply that isn't its own */
+static gboolean
+smtp_pipeline_envelope (CamelSmtpTransport *transport, const char *sender, const char *body,
+			GPtrArray *recipients, gboolean data, CamelException *ex)
+{
+	gboolean retval, data_ok = FALSE;
+	GString *cmdbuf;
+	int i;
+
+	cmdbuf = g_string_new ("");
+	if (body)
+		g_string_append_printf (cmdbuf, "MAIL FROM:<%s> BODY=%s\r\n", sender, body);
+	else
+		g_string_append_printf (cmdbuf, "MAIL FROM:<%s>\r\n", sender);
+	for (i = 0; i < recipients->len; i++)
+		g_string_append_printf (cmdbuf, "RCPT TO:<%s>\r\n", (char *) recipients->pdata[i]);
+	if (data)
+		g_string_append (cmdbuf, "DATA\r\n");
+
+	smtp_debug ("-> %s", cmdbuf->str);
+
+	if (camel_stream_write (transport->ostream, cmdbuf->str, cmdbuf->len) == -1) {
+		g_string_free (cmdbuf, TRUE);
+		camel_exception_setv (ex, errno == EINTR ? CAMEL_EXCEPTION_USER_CANCEL : CAMEL_EXCEPTION_SYSTEM,
+				      _("MAIL FROM command failed: %s: mail not sent"),
+				      g_strerror (errno));
+
+		camel_service_disconnect ((CamelService *) transport, FALSE, NULL);
+
+		return FALSE;
+	}
+	g_string_free (cmdbuf, TRUE);
+
+	retval = smtp_read_reply (transport, "250", _("MAIL FROM command failed"), ex);
+
+	for (i = 0; i < recipients->len; i++) {
+		char *message;
+
+		message = g_strdup_printf (_("RCPT TO <%s> failed"), (char *) recipients->pdata[i]);
+		if (!smtp_read_reply (transport, "250", message, ex))
+			retval = FALSE;
+		g_free (message);
+	}
+
+	if (data) {
+		data_ok = smtp_read_reply (transport, "354", _("DATA command failed"), ex);
+		retval = retval && data_ok;
+	}
+
+	if (!retval && transport->istream) {
+		if (data_ok) {
+			/* the server accepted DATA for the recipients that
+			 * were fine, the only way out is to never finish it */
+			camel_service_disconnect ((CamelService *) transport, FALSE, NULL);
+		} else {
+			CamelException rex = CAMEL_EXCEPTION_INITIALISER;
+
+			smtp_rset (transport, &rex);
+			camel_exception_clear (&rex);
+		}
+	}
+
+	return retval;
+}
+
+static gboolean
+smtp_data_command (CamelSmtpTransport *transport, CamelException *ex)
+{
+	char *cmdbuf, *respbuf = NULL;
 
 	cmdbuf = g_strdup ("DATA\r\n");
 
@@ -1387,13 +1508,16 @@ smtp_data (CamelSmtpTransport *transport, CamelMimeMessage *message, CamelExcept
 	}
 
 	g_free (respbuf);
-	respbuf = NULL;
 
-	/* setup stream filtering */
-	crlffilter = camel_mime_filter_crlf_new (CAMEL_MIME_FILTER_CRLF_ENCODE, CAMEL_MIME_FILTER_CRLF_MODE_CRLF_DOTS);
-	filtered_stream = camel_stream_filter_new_with_stream (transport->ostream);
-	camel_stream_filter_add (filtered_stream, CAMEL_MIME_FILTER (crlffilter));
-	camel_object_unref (crlffilter);
+	return TRUE;
+}
+
+/* Writes the message to stream without its Bcc headers */
+static int
+smtp_write_message (CamelMimeMessage *message, CamelStream *stream)
+{
+	struct _camel_header_raw *header, *savedbcc, *n, *tail;
+	int ret;
 
 	/* unlink the bcc headers */
 	savedbcc = NULL;
@@ -1415,11 +1539,32 @@ smtp_data (CamelSmtpTransport *transport, CamelMimeMessage *message, CamelExcept
 	}
 
 	/* write the message */
-	ret = camel_data_wrapper_write_to_stream (CAMEL_DATA_WRAPPER (message), CAMEL_STREAM (filtered_stream));
+	ret = camel_data_wrapper_write_to_stream (CAMEL_DATA_WRAPPER (message), stream);
 
 	/* restore the bcc headers */
 	header->next = savedbcc;
 
+	return ret;
+}
+
+/* Sends the message after DATA got its 354 */
+static gboolean
+smtp_data (CamelSmtpTransport *transport, CamelMimeMessage *message, CamelException *ex)
+{
+	char *respbuf = NULL;
+	CamelStreamFilter *filtered_stream;
+	CamelMimeFilter *crlffilter;
+	int ret, mtry;
+
+	/* setup stream filtering */
+	crlffilter = camel_mime_filter_crlf_new (CAMEL_MIME_FILTER_CRLF_ENCODE, CAMEL_MIME_FILTER_CRLF_MODE_CRLF_DOTS);
+	filtered_stream = camel_stream_filter_new_with_stream (transport->ostream);
+	camel_stream_filter_add (filtered_stream, CAMEL_MIME_FILTER (crlffilter));
+	camel_object_unref (crlffilter);
+
+	/* write the message */
+	ret = smtp_write_message (message, CAMEL_STREAM (filtered_stream));
+
 	if (ret == -1) {
 		camel_exception_setv (ex, errno == EINTR ? CAMEL_EXCEPTION_USER_CANCEL : CAMEL_EXCEPTION_SYSTEM,
 				      _("DATA command failed: %s: mail not sent"),
@@ -1475,6 +1620,103 @@ smtp_data (CamelSmtpTransport *transport, CamelMimeMessage *message, CamelExcept
 	return (mtry != 3);
 }
 
+#define SMTP_BDAT_CHUNK_SIZE (64 * 1024)
+
+/* rfc3030 (CHUNKING): sends the message in BDAT chunks. The size of a
+ * chunk has to be known before it's sent, so the message is put together
+ * in memory first. With PIPELINING the chunks go out without waiting, and
+ * the replies are read after the LAST one */
+static gboolean
+smtp_bdat (CamelSmtpTransport *transport, CamelMimeMessage *message, CamelException *ex)
+{
+	gboolean pipelined = (transport->flags & CAMEL_SMTP_TRANSPORT_PIPELINING) != 0;
+	CamelStreamFilter *filtered_stream;
+	CamelMimeFilter *crlffilter;
+	CamelStream *mem;
+	GByteArray *buffer;
+	guint offset = 0, unread = 0;
+	gboolean retval = TRUE;
+	int ret;
+
+	buffer = g_byte_array_new ();
+	mem = camel_stream_mem_new_with_byte_array (buffer);
+
+	/* no dot-stuffing, the server doesn't look at the contents */
+	crlffilter = camel_mime_filter_crlf_new (CAMEL_MIME_FILTER_CRLF_ENCODE, CAMEL_MIME_FILTER_CRLF_MODE_CRLF_ONLY);
+	filtered_stream = camel_stream_filter_new_with_stream (mem);
+	camel_stream_filter_add (filtered_stream, CAMEL_MIME_FILTER (crlffilter));
+	camel_object_unref (crlffilter);
+
+	ret = smtp_write_message (message, CAMEL_STREAM (filtered_stream));
+	camel_stream_flush (CAMEL_STREAM (filtered_stream));
+	camel_object_unref (filtered_stream);
+
+	if (ret == -1) {
+		camel_exception_setv (ex, errno == EINTR ? CAMEL_EXCEPTION_USER_CANCEL : CAMEL_EXCEPTION_SYSTEM,
+				      _("BDAT command failed: %s: mail not sent"),
+				      g_strerror (errno));
+		camel_object_unref (mem);
+
+		/* the envelope is in place, but no BDAT went out yet */
+		if (transport->istream) {
+			CamelException rex = CAMEL_EXCEPTION_INITIALISER;
+
+			smtp_rset (transport, &rex);
+			camel_exception_clear (&rex);
+		}
+
+		return FALSE;
+	}
+
+	do {
+		guint len = MIN (SMTP_BDAT_CHUNK_SIZE, buffer->len - offset);
+		gboolean last = (offset + len == buffer->len);
+		char *cmdbuf;
+
+		cmdbuf = g_strdup_printf ("BDAT %u%s\r\n", len, last ? " LAST" : "");
+
+		smtp_debug ("-> %s", cmdbuf);
+
+		if (camel_stream_write (transport->ostream, cmdbuf, strlen (cmdbuf)) == -1 ||
+		    camel_stream_write (transport->ostream, (char *) buffer->data + offset, len) == -1) {
+			g_free (cmdbuf);
+			camel_exception_setv (ex, errno == EINTR ? CAMEL_EXCEPTION_USER_CANCEL : CAMEL_EXCEPTION_SYSTEM,
+					      _("BDAT command failed: %s: mail not sent"),
+					      g_strerror (errno));
+			camel_object_unref (mem);
+
+			camel_service_disconnect ((CamelService *) transport, FALSE, NULL);
+
+			return FALSE;
+		}
+		g_free (cmdbuf);
+
+		offset += len;
+		unread++;
+
+		if (!pipelined || last) {
+			while (unread > 0) {
+				if (!smtp_read_reply (transport, "250", _("BDAT command failed"), ex))
+					retval = FALSE;
+				unread--;
+			}
+		}
+	} while (retval && offset < buffer->len);
+
+	camel_object_unref (mem);
+
+	/* a failed chunk doesn't end the transaction, the message is dropped
+	 * with it though */
+	if (!retval && transport->istream && offset < buffer->len) {
+		CamelException rex = CAMEL_EXCEPTION_INITIALISER;
+
+		smtp_rset (transport, &rex);
+		camel_exception_clear (&rex);
+	}
+
+	return retval;
+}
+
 static gboolean
 smtp_rset (CamelSmtpTransport *transport, CamelException *ex)
 {
@@ -49,6 +49,8 @@
 #define CAMEL_SMTP_TRANSPORT_STARTTLS               (1 << 3)
 
 #define CAMEL_SMTP_TRANSPORT_AUTH_EQUAL             (1 << 4)  /* set if we are using authtypes from a broken AUTH= */
+#define CAMEL_SMTP_TRANSPORT_PIPELINING             (1 << 5)
+#define CAMEL_SMTP_TRANSPORT_CHUNKING               (1 << 6)
 
 G_BEGIN_DECLS
 
@@ -30,6 +30,7 @@
 #include "tny-camel-account-priv.h"
 
 #include <tny-folder-store-query.h>
+#include <tny-search-query.h>
 
 static void remove_quotes (gchar *buffer);
 static gchar **split_recipients (gchar *buffer);
@@ -176,6 +177,100 @@ _tny_folder_store_query_passes (TnyFolderStoreQuery *query, CamelFolderInfo *fin
 	return retval;
 }
 
+static void
+append_search_string (GString *expr, const gchar *str)
+{
+	g_string_append_c (expr, '"');
+	for (; *str; str++) {
+		if (*str == '"' || *str == '\\')
+			g_string_append_c (expr, '\\');
+		g_string_append_c (expr, *str);
+	}
+	g_string_append_c (expr, '"');
+}
+
+static guint
+append_search_items (GString *expr, TnyList *items, gboolean body)
+{
+	TnyIterator *iter = tny_list_create_iterator (items);
+	guint count = 0;
+
+	while (!tny_iterator_is_done (iter))
+	{
+		TnySearchQueryItem *item = (TnySearchQueryItem *) tny_iterator_get_current (iter);
+		TnySearchQueryField field = tny_search_query_item_get_field (item);
+		const gchar *header = NULL;
+
+		switch (field) {
+		case TNY_SEARCH_QUERY_FIELD_SUBJECT:
+			header = "subject";
+			break;
+		case TNY_SEARCH_QUERY_FIELD_FROM:
+			header = "from";
+			break;
+		case TNY_SEARCH_QUERY_FIELD_TO:
+			header = "to";
+			break;
+		case TNY_SEARCH_QUERY_FIELD_CC:
+			header = "cc";
+			break;
+		case TNY_SEARCH_QUERY_FIELD_BODY:
+		default:
+			break;
+		}
+
+		if (body && !header) {
+			g_string_append (expr, " (body-contains ");
+			append_search_string (expr, tny_search_query_item_get_pattern (item));
+			g_string_append_c (expr, ')');
+			count++;
+		} else if (!body && header) {
+			g_string_append_printf (expr, " (header-contains \"%s\" ", header);
+			append_search_string (expr, tny_search_query_item_get_pattern (item));
+			g_string_append_c (expr, ')');
+			count++;
+		}
+
+		g_object_unref (item);
+		tny_iterator_next (iter);
+	}
+
+	g_object_unref (iter);
+
+	return count;
+}
+
+/* Compiles @query into a search expression for camel_folder_search_by_expression.
+ * The header items are matched per message against the summary. The body
+ * items are outside of the match-all, that way they are looked up once for
+ * the whole folder: in the body index of the folder, or with a single
+ * SEARCH command by IMAP. Inside a match-all they would be matched per
+ * message. The result must be freed */
+gchar *
+_tny_search_query_to_camel_expression (TnySearchQuery *query)
+{
+	GString *expr;
+	TnyList *items;
+
+	items = tny_search_query_get_items (query);
+
+	if (tny_list_get_length (items) == 0) {
+		g_object_unref (items);
+		return g_strdup ("(match-all #t)");
+	}
+
+	expr = g_string_new ("(and (match-all (and");
+	if (append_search_items (expr, items, FALSE) == 0)
+		g_string_append (expr, " #t");
+	g_string_append (expr, "))");
+	append_search_items (expr, items, TRUE);
+	g_string_append_c (expr, ')');
+
+	g_object_unref (items);
+
+	return g_string_free (expr, FALSE);
+}
+
 static void
 remove_quotes (gchar *buffer)
 {
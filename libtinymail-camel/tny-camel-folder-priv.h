@@ -24,6 +24,7 @@
 #include <camel/camel-store.h>
 #include <tny-account.h>
 #include <tny-folder.h>
+#include <tny-camel-prefetch-policy.h>
 
 typedef struct _TnyCamelFolderPriv TnyCamelFolderPriv;
 
@@ -49,6 +50,7 @@ struct _TnyCamelFolderPriv
 	TnyFolderType cached_folder_type;
 	TnyMsgRemoveStrategy *remove_strat;
 	TnyMsgReceiveStrategy *receive_strat;
+	TnyCamelPrefetchPolicy *prefetch_policy;
 	TnyFolder *self;
 	gboolean want_changes, handle_changes, dont_fkill;
 	TnyFolderStore *parent;
@@ -76,10 +76,12 @@
 #include "tny-camel-store-account-priv.h"
 #include "tny-camel-folder-priv.h"
 #include "tny-camel-header-priv.h"
+#include "tny-camel-header-list-priv.h"
 #include "tny-camel-msg-priv.h"
 #include "tny-camel-common-priv.h"
 #include "tny-session-camel-priv.h"
 #include "tny-camel-msg-header-priv.h"
+#include "tny-camel-prefetch-policy-priv.h"
 
 #include <tny-camel-shared.h>
 
@@ -2295,8 +2297,6 @@ add_message_with_uid (gpointer data, gpointer user_data)
 	TnyCamelFolderPriv *priv = ptr->priv;
 	TnyList *headers = ptr->headers;
 
-	/* TODO: Proxy instantiation (happens a lot, could use a pool) */
-
 	header = _tny_camel_header_new ();
 	_tny_camel_header_set_folder ((TnyCamelHeader *) header, (TnyCamelFolder *) self, priv);
 	_tny_camel_header_set_camel_message_info ((TnyCamelHeader *) header, mi, FALSE);
@@ -2583,6 +2583,268 @@ tny_camel_folder_get_headers_default (TnyFolder *self, TnyList *headers, gboolea
 }
 
 
+static void
+tny_camel_folder_search (TnyFolder *self, TnySearchQuery *query, TnyList *headers, GError **err)
+{
+	TNY_CAMEL_FOLDER_GET_CLASS (self)->search(self, query, headers, err);
+	return;
+}
+
+/* Folders that can't search themselves (POP) get searched by a plain
+ * CamelFolderSearch on their summary */
+static GPtrArray *
+search_camel_folder (CamelFolder *folder, const gchar *expr, CamelFolderSearch **search, CamelException *ex)
+{
+	if (camel_folder_has_search_capability (folder)) {
+		*search = NULL;
+		return camel_folder_search_by_expression (folder, expr, ex);
+	}
+
+	*search = camel_folder_search_new ();
+	camel_folder_search_set_folder (*search, folder);
+	return camel_folder_search_search (*search, expr, NULL, ex);
+}
+
+static void
+tny_camel_folder_search_default (TnyFolder *self, TnySearchQuery *query, TnyList *headers, GError **err)
+{
+	TnyCamelFolderPriv *priv = TNY_CAMEL_FOLDER_GET_PRIVATE (self);
+	CamelException ex = CAMEL_EXCEPTION_INITIALISER;
+	CamelFolderSearch *search = NULL;
+	GPtrArray *uids;
+	gchar *expr;
+
+	g_assert (TNY_IS_LIST (headers));
+
+	if (!_tny_session_check_operation (TNY_FOLDER_PRIV_GET_SESSION(priv), priv->account, err, 
+			TNY_ERROR_DOMAIN, TNY_SERVICE_ERROR_STATE))
+		return;
+
+	if (!priv->account) {
+		g_set_error (err, TNY_ERROR_DOMAIN,
+			TNY_SERVICE_ERROR_STATE,
+			_("Folder not ready for searching"));
+		return;
+	}
+
+	g_static_rec_mutex_lock (priv->folder_lock);
+
+	if (!load_folder_no_lock (priv))
+	{
+		_tny_camel_exception_to_tny_error (&priv->load_ex, err);
+		camel_exception_clear (&priv->load_ex);
+		g_static_rec_mutex_unlock (priv->folder_lock);
+		_tny_session_stop_operation (TNY_FOLDER_PRIV_GET_SESSION (priv));
+		return;
+	}
+
+	_tny_camel_folder_reason (priv);
+
+	/* The header items are matched against the summary by the search
+	 * itself, IMAP hands the body items to the server when online. Only
+	 * the messages that match get a TnyHeader */
+	expr = _tny_search_query_to_camel_expression (query);
+	uids = search_camel_folder (priv->folder, expr, &search, &ex);
+	g_free (expr);
+
+	if (camel_exception_is_set (&ex)) {
+		_tny_camel_exception_to_tny_error (&ex, err);
+		camel_exception_clear (&ex);
+	}
+
+	if (uids) {
+		guint i;
+
+		for (i = uids->len - 1; i < uids->len; i--) {
+			CamelMessageInfo *mi = camel_folder_summary_uid (priv->folder->summary,
+				uids->pdata[i]);
+
+			if (mi) {
+				TnyHeader *header = _tny_camel_header_new ();
+				_tny_camel_header_set_folder ((TnyCamelHeader *) header, (TnyCamelFolder *) self, priv);
+				_tny_camel_header_set_camel_message_info ((TnyCamelHeader *) header, mi, FALSE);
+				tny_list_prepend (headers, (GObject *) header);
+				g_object_unref (header);
+				camel_message_info_free (mi);
+			}
+		}
+
+		if (search)
+			camel_folder_search_free_result (search, uids);
+		else
+			camel_folder_search_free (priv->folder, uids);
+	}
+
+	if (search)
+		camel_object_unref (search);
+
+	_tny_camel_folder_unreason (priv);
+	g_static_rec_mutex_unlock (priv->folder_lock);
+
+	_tny_session_stop_operation (TNY_FOLDER_PRIV_GET_SESSION (priv));
+
+	return;
+}
+
+
+typedef struct 
+{
+	TnyCamelQueueable parent;
+
+	GError *err;
+	TnyFolder *self;
+	TnySearchQuery *query;
+	TnyList *headers;
+	TnyGetHeadersCallback callback;
+	TnyStatusCallback status_callback;
+	gpointer user_data;
+	TnySessionCamel *session;
+	gboolean cancelled;
+	TnyIdleStopper *stopper;
+
+} SearchInfo;
+
+
+static void
+tny_camel_folder_search_async_destroyer (gpointer thr_user_data)
+{
+	SearchInfo *info = thr_user_data;
+	TnyCamelFolderPriv *priv = TNY_CAMEL_FOLDER_GET_PRIVATE (info->self);
+
+	/* thread reference */
+	_tny_camel_folder_unreason (priv);
+	g_object_unref (info->self);
+	g_object_unref (info->query);
+	g_object_unref (info->headers);
+
+	if (info->err)
+		g_error_free (info->err);
+
+	tny_idle_stopper_destroy (info->stopper);
+	info->stopper = NULL;
+
+	camel_object_unref (info->session);
+
+	return;
+}
+
+static gboolean
+tny_camel_folder_search_async_callback (gpointer thr_user_data)
+{
+	SearchInfo *info = thr_user_data;
+	if (info->callback) {
+		tny_lockable_lock (info->session->priv->ui_lock);
+		info->callback (info->self, info->cancelled, info->headers, info->err, info->user_data);
+		tny_lockable_unlock (info->session->priv->ui_lock);
+	}
+	tny_idle_stopper_stop (info->stopper);
+
+	return FALSE;
+}
+
+static void
+tny_camel_folder_search_async_status (struct _CamelOperation *op, const char *what, int sofar, int oftotal, void *thr_user_data)
+{
+	SearchInfo *oinfo = thr_user_data;
+	TnyProgressInfo *info = NULL;
+
+	info = tny_progress_info_new (G_OBJECT (oinfo->self), oinfo->status_callback, 
+				      TNY_FOLDER_STATUS, TNY_FOLDER_STATUS_CODE_SEARCH, what, sofar, 
+				      oftotal, oinfo->stopper, oinfo->session->priv->ui_lock, oinfo->user_data);
+
+	g_idle_add_full (TNY_PRIORITY_LOWER_THAN_GTK_REDRAWS, 
+			 tny_progress_info_idle_func, info, 
+			 tny_progress_info_destroy);
+
+	return;
+}
+
+static gpointer 
+tny_camel_folder_search_async_thread (gpointer thr_user_data)
+{
+	SearchInfo *info = (SearchInfo*) thr_user_data;
+	TnyCamelFolderPriv *priv = TNY_CAMEL_FOLDER_GET_PRIVATE (info->self);
+
+	info->err = NULL;
+	info->cancelled = FALSE;
+
+	_tny_camel_account_start_camel_operation (TNY_CAMEL_ACCOUNT (priv->account),
+						  tny_camel_folder_search_async_status, 
+						  info, "Searching messages");
+
+	tny_folder_search (info->self, info->query, info->headers, &info->err);
+
+	_tny_camel_account_stop_camel_operation (TNY_CAMEL_ACCOUNT (priv->account));
+
+	if (info->err != NULL) {
+		if (camel_strstrcase (info->err->message, "cancel") != NULL)
+			info->cancelled = TRUE;
+	}
+
+	return NULL;
+}
+
+static gboolean
+tny_camel_folder_search_async_cancelled_callback (gpointer thr_user_data)
+{
+	SearchInfo *info = thr_user_data;
+	if (info->callback) {
+		tny_lockable_lock (info->session->priv->ui_lock);
+		info->callback (info->self, TRUE, info->headers, info->err, info->user_data);
+		tny_lockable_unlock (info->session->priv->ui_lock);
+	}
+	return FALSE;
+}
+
+static void 
+tny_camel_folder_search_async (TnyFolder *self, TnySearchQuery *query, TnyList *headers, TnyGetHeadersCallback callback, TnyStatusCallback status_callback, gpointer user_data)
+{
+	TNY_CAMEL_FOLDER_GET_CLASS (self)->search_async(self, query, headers, callback, status_callback, user_data);
+	return;
+}
+
+static void 
+tny_camel_folder_search_async_default (TnyFolder *self, TnySearchQuery *query, TnyList *headers, TnyGetHeadersCallback callback, TnyStatusCallback status_callback, gpointer user_data)
+{
+	SearchInfo *info;
+	TnyCamelFolderPriv *priv = TNY_CAMEL_FOLDER_GET_PRIVATE (self);
+
+	/* Idle info for the callbacks */
+	info = g_slice_new (SearchInfo);
+	info->session = TNY_FOLDER_PRIV_GET_SESSION (priv);
+	camel_object_ref (info->session);
+	info->self = self;
+	info->query = query;
+	info->headers = headers;
+	info->callback = callback;
+	info->status_callback = status_callback;
+	info->user_data = user_data;
+	info->err = NULL;
+	info->cancelled = FALSE;
+	info->stopper = tny_idle_stopper_new();
+
+	/* thread reference */
+	g_object_ref (info->self);
+	g_object_ref (info->query);
+	g_object_ref (info->headers);
+
+	_tny_camel_folder_reason (priv);
+
+	_tny_camel_queue_launch_wflags (TNY_FOLDER_PRIV_GET_QUEUE (priv), 
+		tny_camel_folder_search_async_thread, 
+		tny_camel_folder_search_async_callback,
+		tny_camel_folder_search_async_destroyer, 
+		tny_camel_folder_search_async_cancelled_callback,
+		tny_camel_folder_search_async_destroyer, 
+		&info->cancelled,
+		info, sizeof (SearchInfo),
+		TNY_CAMEL_QUEUE_CANCELLABLE_ITEM, 
+		__FUNCTION__);
+
+	return;
+}
+
+
 
 typedef struct 
 {
@@ -2598,9 +2860,171 @@ typedef struct
 	TnySessionCamel *session;
 	TnyIdleStopper *stopper;
 	gboolean cancelled;
+	gchar *prefetch_uid;
+	guint generation;
 
 } GetMsgInfo;
 
+typedef struct 
+{
+	TnyCamelQueueable parent;
+
+	TnyFolder *self;
+	TnyCamelPrefetchPolicy *policy;
+	gchar *uid;
+	guint generation;
+	gboolean cancelled;
+
+} PrefetchInfo;
+
+/* Getting messages doesn't have to wait for the store's queue, unless that
+ * one is (re)connecting or it's POP */
+static TnyCamelQueue*
+get_msg_queue (TnyFolder *self, TnyCamelFolderPriv *priv)
+{
+	if (!TNY_IS_CAMEL_POP_FOLDER (self) && 
+	    !_tny_camel_queue_has_items (TNY_FOLDER_PRIV_GET_QUEUE (priv), 
+					 TNY_CAMEL_QUEUE_RECONNECT_ITEM | TNY_CAMEL_QUEUE_CONNECT_ITEM))
+		return TNY_FOLDER_PRIV_GET_MSG_QUEUE (priv);
+
+	return TNY_FOLDER_PRIV_GET_QUEUE (priv);
+}
+
+static gpointer 
+tny_camel_folder_prefetch_thread (gpointer thr_user_data)
+{
+	PrefetchInfo *info = (PrefetchInfo *) thr_user_data;
+	TnyCamelFolderPriv *priv = TNY_CAMEL_FOLDER_GET_PRIVATE (info->self);
+	CamelMessageInfo *mi = NULL;
+	TnyHeader *header;
+	TnyMsg *msg;
+	GError *err = NULL;
+
+	/* Another message got opened since this one got scheduled */
+	if (!_tny_camel_prefetch_policy_is_current (info->policy, info->generation)) {
+		info->cancelled = TRUE;
+		return NULL;
+	}
+
+	g_static_rec_mutex_lock (priv->folder_lock);
+	if (load_folder_no_lock (priv) && priv->folder->summary)
+		mi = camel_folder_summary_uid (priv->folder->summary, info->uid);
+	g_static_rec_mutex_unlock (priv->folder_lock);
+
+	if (!mi)
+		return NULL;
+
+	/* Already there, for example because the user opened it meanwhile */
+	if (camel_message_info_flags (mi) & CAMEL_MESSAGE_CACHED) {
+		camel_message_info_free (mi);
+		return NULL;
+	}
+
+	header = _tny_camel_header_new ();
+	_tny_camel_header_set_folder ((TnyCamelHeader *) header, (TnyCamelFolder *) info->self, priv);
+	_tny_camel_header_set_camel_message_info ((TnyCamelHeader *) header, mi, FALSE);
+	camel_message_info_free (mi);
+
+	/* With the folder's own strategy, so that what gets cached is what a 
+	 * later tny_folder_get_msg will look for */
+	msg = tny_msg_receive_strategy_perform_get_msg (priv->receive_strat, 
+			info->self, header, &err);
+
+	reset_local_size (priv);
+
+	if (msg) {
+		if (!err)
+			_tny_camel_prefetch_policy_prefetched (info->policy, info->uid);
+		g_object_unref (msg);
+	}
+
+	if (err)
+		g_error_free (err);
+
+	g_object_unref (header);
+
+	return NULL;
+}
+
+static void
+tny_camel_folder_prefetch_destroyer (gpointer thr_user_data)
+{
+	PrefetchInfo *info = (PrefetchInfo *) thr_user_data;
+	TnyCamelFolderPriv *priv = TNY_CAMEL_FOLDER_GET_PRIVATE (info->self);
+
+	if (info->cancelled)
+		_tny_camel_prefetch_policy_cancelled (info->policy);
+
+	/* thread reference */
+	_tny_camel_folder_unreason (priv);
+	g_object_unref (info->self);
+	g_object_unref (info->policy);
+	g_free (info->uid);
+
+	return;
+}
+
+static void
+tny_camel_folder_prefetch_cancelled_destroyer (gpointer thr_user_data)
+{
+	PrefetchInfo *info = (PrefetchInfo *) thr_user_data;
+
+	info->cancelled = TRUE;
+	tny_camel_folder_prefetch_destroyer (thr_user_data);
+
+	return;
+}
+
+/* Schedules the messages that the policy expects to be opened after uid. They
+ * go in the normal lane of the queue, behind anything the user asked for */
+static void
+schedule_prefetches (TnyFolder *self, TnyCamelFolderPriv *priv, TnyCamelPrefetchPolicy *policy, const gchar *uid, guint generation)
+{
+	TnyCamelQueue *queue;
+	GPtrArray *uids, *order;
+	guint i;
+
+	if (!priv->folder || !priv->folder->summary)
+		return;
+
+	queue = get_msg_queue (self, priv);
+	if (!queue)
+		return;
+
+	order = _tny_camel_prefetch_policy_get_order (policy, uid);
+	uids = _tny_camel_prefetch_policy_select (policy, priv->folder->summary, order, uid);
+	if (order) {
+		g_ptr_array_foreach (order, (GFunc) g_free, NULL);
+		g_ptr_array_free (order, TRUE);
+	}
+
+	for (i = 0; i < uids->len; i++) {
+		PrefetchInfo *info = g_slice_new (PrefetchInfo);
+
+		info->self = TNY_FOLDER (g_object_ref (self));
+		info->policy = TNY_CAMEL_PREFETCH_POLICY (g_object_ref (policy));
+		info->uid = uids->pdata[i];
+		info->generation = generation;
+		info->cancelled = FALSE;
+
+		/* thread reference */
+		_tny_camel_folder_reason (priv);
+
+		_tny_camel_queue_launch_wflags (queue, 
+			tny_camel_folder_prefetch_thread, NULL,
+			tny_camel_folder_prefetch_destroyer, NULL,
+			tny_camel_folder_prefetch_cancelled_destroyer, 
+			&info->cancelled,
+			info, sizeof (PrefetchInfo), 
+			TNY_CAMEL_QUEUE_NORMAL_ITEM|TNY_CAMEL_QUEUE_PREFETCH_ITEM,
+			__FUNCTION__);
+	}
+
+	g_ptr_array_free (uids, TRUE);
+
+	return;
+}
+
 
 static void
 tny_camel_folder_get_msg_async_destroyer (gpointer thr_user_data)
@@ -2618,6 +3042,9 @@ tny_camel_folder_get_msg_async_destroyer (gpointer thr_user_data)
 	tny_idle_stopper_destroy (info->stopper);
 	info->stopper = NULL;
 
+	if (info->prefetch_uid)
+		g_free (info->prefetch_uid);
+
 	/**/
 
 	camel_object_unref (info->session);
@@ -2647,6 +3074,14 @@ tny_camel_folder_get_msg_async_callback (gpointer thr_user_data)
 		tny_lockable_unlock (info->session->priv->ui_lock);
 	}
 
+	if (info->msg && info->prefetch_uid) {
+		TnyCamelFolderPriv *priv = TNY_CAMEL_FOLDER_GET_PRIVATE (info->self);
+		TnyCamelPrefetchPolicy *policy = priv->prefetch_policy;
+
+		if (policy && _tny_camel_prefetch_policy_is_current (policy, info->generation))
+			schedule_prefetches (info->self, priv, policy, info->prefetch_uid, info->generation);
+	}
+
 	if (info->msg)
 		g_object_unref (info->msg);
 
@@ -2756,6 +3191,9 @@ tny_camel_folder_get_msg_async_cancelled_destroyer (gpointer thr_user_data)
 	tny_idle_stopper_destroy (info->stopper);
 	info->stopper = NULL;
 
+	if (info->prefetch_uid)
+		g_free (info->prefetch_uid);
+
 	/**/
 
 	camel_object_unref (info->session);
@@ -2801,6 +3239,8 @@ tny_camel_folder_get_msg_async_default (TnyFolder *self, TnyHeader *header, TnyG
 	info->status_callback = status_callback;
 	info->user_data = user_data;
 	info->err = NULL;
+	info->prefetch_uid = NULL;
+	info->generation = 0;
 
 	info->stopper = tny_idle_stopper_new();
 
@@ -2811,12 +3251,40 @@ tny_camel_folder_get_msg_async_default (TnyFolder *self, TnyHeader *header, TnyG
 	/* thread reference header */
 	g_object_ref (info->header);
 
-	if (!TNY_IS_CAMEL_POP_FOLDER (self) && 
-	    !_tny_camel_queue_has_items (TNY_FOLDER_PRIV_GET_QUEUE (priv), 
-					 TNY_CAMEL_QUEUE_RECONNECT_ITEM | TNY_CAMEL_QUEUE_CONNECT_ITEM))
-		queue = TNY_FOLDER_PRIV_GET_MSG_QUEUE (priv);
-	else
-		queue = TNY_FOLDER_PRIV_GET_QUEUE (priv);
+	queue = get_msg_queue (self, priv);
+
+	if (priv->prefetch_policy) {
+		TnyCamelQueue *other;
+
+		/* The user moved on, what got prefetched for the previous message
+		 * and didn't run yet is no longer wanted */
+		info->prefetch_uid = tny_header_dup_uid (header);
+		info->generation = _tny_camel_prefetch_policy_navigate (
+			priv->prefetch_policy, info->prefetch_uid);
+
+		if (queue)
+			_tny_camel_queue_remove_items (queue, TNY_CAMEL_QUEUE_PREFETCH_ITEM);
+		other = TNY_FOLDER_PRIV_GET_QUEUE (priv);
+		if (other && other != queue)
+			_tny_camel_queue_remove_items (other, TNY_CAMEL_QUEUE_PREFETCH_ITEM);
+		other = TNY_FOLDER_PRIV_GET_MSG_QUEUE (priv);
+		if (other && other != queue)
+			_tny_camel_queue_remove_items (other, TNY_CAMEL_QUEUE_PREFETCH_ITEM);
+
+		/* Ahead of the prefetches that are still pending */
+		_tny_camel_queue_launch_wflags (queue, 
+			tny_camel_folder_get_msg_async_thread, 
+			tny_camel_folder_get_msg_async_callback,
+			tny_camel_folder_get_msg_async_destroyer, 
+			tny_camel_folder_get_msg_async_cancelled_callback,
+			tny_camel_folder_get_msg_async_cancelled_destroyer, 
+			&info->cancelled,
+			info, sizeof (GetMsgInfo), 
+			TNY_CAMEL_QUEUE_NORMAL_ITEM|TNY_CAMEL_QUEUE_PRIORITY_ITEM,
+			__FUNCTION__);
+
+		return;
+	}
 
 	_tny_camel_queue_launch (queue, 
 		tny_camel_folder_get_msg_async_thread, 
@@ -6043,6 +6511,174 @@ tny_camel_folder_get_full_name (TnyCamelFolder *self)
 	return priv->folder_name;
 }
 
+/**
+ * tny_camel_folder_get_headers_view:
+ * @self: A #TnyCamelFolder object
+ * @err: (null-ok): a #GError or NULL
+ *
+ * Get a read-only #TnyList that is a live view on the headers of @self. Unlike
+ * tny_folder_get_headers(), this doesn't create a #TnyHeader for each message
+ * up front: the length of the list is the amount of messages in the summary of
+ * @self, and a #TnyHeader is only created when it gets asked for with
+ * tny_iterator_get_current(). Messages that get added to @self show up at the
+ * end of the list, expunging a message shifts the ones after it.
+ *
+ * Prepending, appending and removing items is not possible.
+ *
+ * Return value: (caller-owns): a #TnyList of #TnyHeader instances, or NULL
+ * if the folder couldn't be loaded
+ **/
+TnyList*
+tny_camel_folder_get_headers_view (TnyCamelFolder *self, GError **err)
+{
+	TnyCamelFolderPriv *priv = TNY_CAMEL_FOLDER_GET_PRIVATE (self);
+	TnyList *retval = NULL;
+
+	if (!priv->account) {
+		g_set_error (err, TNY_ERROR_DOMAIN,
+			TNY_SERVICE_ERROR_REFRESH,
+			_("Folder not ready for getting headers"));
+		return NULL;
+	}
+
+	g_static_rec_mutex_lock (priv->folder_lock);
+
+	if (!load_folder_no_lock (priv)) {
+		_tny_camel_exception_to_tny_error (&priv->load_ex, err);
+		camel_exception_clear (&priv->load_ex);
+		g_static_rec_mutex_unlock (priv->folder_lock);
+		return NULL;
+	}
+
+	retval = _tny_camel_header_list_new (self, priv->folder->summary);
+
+	g_static_rec_mutex_unlock (priv->folder_lock);
+
+	return retval;
+}
+
+/**
+ * tny_camel_folder_get_threaded_headers_view:
+ * @self: A #TnyCamelFolder object
+ * @err: (null-ok): a #GError or NULL
+ *
+ * Get a read-only #TnyList that is a live, threaded view on the headers of
+ * @self. The messages are threaded once, using their Message-ID and their
+ * In-Reply-To or References, and after that the threads get updated with
+ * every change of @self rather than rebuilt. The list has the messages of
+ * each thread depth first, the threads in the order they were started in.
+ * Use tny_camel_folder_get_thread_depth() to indent them.
+ *
+ * Like with tny_camel_folder_get_headers_view(), a #TnyHeader is only
+ * created when it gets asked for. Prepending, appending and removing items
+ * is not possible.
+ *
+ * Return value: (caller-owns): a #TnyList of #TnyHeader instances, or NULL
+ * if the folder couldn't be loaded
+ **/
+TnyList*
+tny_camel_folder_get_threaded_headers_view (TnyCamelFolder *self, GError **err)
+{
+	TnyCamelFolderPriv *priv = TNY_CAMEL_FOLDER_GET_PRIVATE (self);
+	TnyList *retval = NULL;
+
+	if (!priv->account) {
+		g_set_error (err, TNY_ERROR_DOMAIN,
+			TNY_SERVICE_ERROR_REFRESH,
+			_("Folder not ready for getting headers"));
+		return NULL;
+	}
+
+	g_static_rec_mutex_lock (priv->folder_lock);
+
+	if (!load_folder_no_lock (priv)) {
+		_tny_camel_exception_to_tny_error (&priv->load_ex, err);
+		camel_exception_clear (&priv->load_ex);
+		g_static_rec_mutex_unlock (priv->folder_lock);
+		return NULL;
+	}
+
+	retval = _tny_camel_header_list_new_threaded (self, priv->folder);
+
+	g_static_rec_mutex_unlock (priv->folder_lock);
+
+	return retval;
+}
+
+/**
+ * tny_camel_folder_get_thread_depth:
+ * @self: A #TnyCamelFolder object
+ * @view: a #TnyList from tny_camel_folder_get_threaded_headers_view()
+ * @header: a #TnyHeader in @view
+ *
+ * Get how deep @header is in its thread: 0 for the first message of a thread,
+ * 1 for a reply to it, and so on.
+ *
+ * Return value: the depth of @header, or -1 if it isn't in @view
+ **/
+gint
+tny_camel_folder_get_thread_depth (TnyCamelFolder *self, TnyList *view, TnyHeader *header)
+{
+	TnyCamelHeaderList *list = (TnyCamelHeaderList *) view;
+	gchar *uid;
+	gint retval;
+
+	g_return_val_if_fail (G_TYPE_CHECK_INSTANCE_TYPE (view, TNY_TYPE_CAMEL_HEADER_LIST), -1);
+	g_return_val_if_fail (list->folder == self, -1);
+
+	uid = tny_header_dup_uid (header);
+	if (!uid)
+		return -1;
+	retval = _tny_camel_header_list_get_depth (list, uid);
+	g_free (uid);
+
+	return retval;
+}
+
+/**
+ * tny_camel_folder_set_prefetch_policy:
+ * @self: A #TnyCamelFolder object
+ * @policy: (null-ok): a #TnyCamelPrefetchPolicy or NULL
+ *
+ * Set the policy that decides which messages get fetched in the background
+ * after a message got retrieved with tny_folder_get_msg_async(). The
+ * prefetched messages are retrieved with the #TnyMsgReceiveStrategy of @self
+ * and stay in the cache. Retrieving a message cancels the prefetches that
+ * didn't start yet. Use NULL to disable prefetching, which is the default.
+ **/
+void
+tny_camel_folder_set_prefetch_policy (TnyCamelFolder *self, TnyCamelPrefetchPolicy *policy)
+{
+	TnyCamelFolderPriv *priv = TNY_CAMEL_FOLDER_GET_PRIVATE (self);
+
+	if (policy)
+		g_object_ref (policy);
+	if (priv->prefetch_policy)
+		g_object_unref (priv->prefetch_policy);
+	priv->prefetch_policy = policy;
+
+	return;
+}
+
+/**
+ * tny_camel_folder_get_prefetch_policy:
+ * @self: A #TnyCamelFolder object
+ *
+ * Get the prefetch policy of @self. If not NULL, you must unreference the
+ * return value after use.
+ *
+ * Return value: (null-ok) (caller-owns): the #TnyCamelPrefetchPolicy or NULL
+ **/
+TnyCamelPrefetchPolicy*
+tny_camel_folder_get_prefetch_policy (TnyCamelFolder *self)
+{
+	TnyCamelFolderPriv *priv = TNY_CAMEL_FOLDER_GET_PRIVATE (self);
+
+	if (!priv->prefetch_policy)
+		return NULL;
+
+	return TNY_CAMEL_PREFETCH_POLICY (g_object_ref (priv->prefetch_policy));
+}
 
 CamelFolder*
 _tny_camel_folder_get_folder (TnyCamelFolder *self)
@@ -6562,6 +7198,11 @@ tny_camel_folder_dispose (GObject *object)
 		priv->receive_strat = NULL;
 	}
 
+	if (priv->prefetch_policy) {
+		g_object_unref (G_OBJECT (priv->prefetch_policy));
+		priv->prefetch_policy = NULL;
+	}
+
 	if (priv->parent) {
 		g_object_weak_unref (G_OBJECT (priv->parent), notify_parent_del, self);
 		priv->parent = NULL;
@@ -6677,6 +7318,8 @@ tny_folder_init (gpointer g, gpointer iface_data)
 	klass->get_url_string= tny_camel_folder_get_url_string;
 	klass->get_caps= tny_camel_folder_get_caps;
 	klass->remove_msgs_async= tny_camel_folder_remove_msgs_async;
+	klass->search= tny_camel_folder_search;
+	klass->search_async= tny_camel_folder_search_async;
 
 	return;
 }
@@ -6746,6 +7389,8 @@ tny_camel_folder_class_init (TnyCamelFolderClass *class)
 	class->get_url_string= tny_camel_folder_get_url_string_default;
 	class->get_caps= tny_camel_folder_get_caps_default;
 	class->remove_msgs_async= tny_camel_folder_remove_msgs_async_default;
+	class->search= tny_camel_folder_search_default;
+	class->search_async= tny_camel_folder_search_async_default;
 
 	class->get_folders_async= tny_camel_folder_get_folders_async_default;
 	class->get_folders= tny_camel_folder_get_folders_default;
@@ -6816,6 +7461,7 @@ tny_camel_folder_instance_init (GTypeInstance *instance, gpointer g_class)
 	priv->cached_folder_type = TNY_FOLDER_TYPE_UNKNOWN;
 	priv->remove_strat = tny_camel_msg_remove_strategy_new ();
 	priv->receive_strat = tny_camel_full_msg_receive_strategy_new ();
+	priv->prefetch_policy = NULL;
 	priv->reason_lock = g_new0 (GStaticRecMutex, 1);
 	g_static_rec_mutex_init (priv->reason_lock);
 
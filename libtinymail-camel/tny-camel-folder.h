@@ -29,6 +29,7 @@
 
 #include <tny-msg-remove-strategy.h>
 #include <tny-msg-receive-strategy.h>
+#include <tny-camel-prefetch-policy.h>
 
 G_BEGIN_DECLS
 
@@ -89,6 +90,8 @@ struct _TnyCamelFolderClass
 	gchar* (*get_url_string) (TnyFolder *self);
 	TnyFolderCaps (*get_caps) (TnyFolder *self);
 	void (*remove_msgs_async) (TnyFolder *self, TnyList *headers, TnyFolderCallback callback, TnyStatusCallback status_callback, gpointer user_data);
+	void (*search) (TnyFolder *self, TnySearchQuery *query, TnyList *headers, GError **err);
+	void (*search_async) (TnyFolder *self, TnySearchQuery *query, TnyList *headers, TnyGetHeadersCallback callback, TnyStatusCallback status_callback, gpointer user_data);
 
 	void (*get_folders_async) (TnyFolderStore *self, TnyList *list, TnyFolderStoreQuery *query, gboolean refresh, TnyGetFoldersCallback callback, TnyStatusCallback status_callback, gpointer user_data);
 	void (*get_folders) (TnyFolderStore *self, TnyList *list, TnyFolderStoreQuery *query, gboolean refresh, GError **err);
@@ -105,6 +108,11 @@ GType tny_camel_folder_get_type (void);
 
 
 const gchar* tny_camel_folder_get_full_name (TnyCamelFolder *self);
+TnyList* tny_camel_folder_get_headers_view (TnyCamelFolder *self, GError **err);
+TnyList* tny_camel_folder_get_threaded_headers_view (TnyCamelFolder *self, GError **err);
+gint tny_camel_folder_get_thread_depth (TnyCamelFolder *self, TnyList *view, TnyHeader *header);
+void tny_camel_folder_set_prefetch_policy (TnyCamelFolder *self, TnyCamelPrefetchPolicy *policy);
+TnyCamelPrefetchPolicy* tny_camel_folder_get_prefetch_policy (TnyCamelFolder *self);
 
 G_END_DECLS
 
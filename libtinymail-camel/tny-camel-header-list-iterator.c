@@ -0,0 +1,201 @@
+/* libtinymail-camel - The Tiny Mail base library for Camel
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.	 See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with self library; if not, write to the
+ * Free Software Foundation, Inc., 51 Franklin Street, Fifth Floor,
+ * Boston, MA 02110-1301, USA.
+ */
+
+#include <config.h>
+
+#include <glib.h>
+
+#include <tny-list.h>
+#include <tny-iterator.h>
+
+#include "tny-camel-header-list-priv.h"
+
+static GObjectClass *parent_class = NULL;
+
+
+TnyIterator*
+_tny_camel_header_list_iterator_new (TnyCamelHeaderList *list)
+{
+	TnyCamelHeaderListIterator *self = g_object_new (TNY_TYPE_CAMEL_HEADER_LIST_ITERATOR, NULL);
+
+	self->list = g_object_ref (list);
+	self->current = 0;
+
+	return TNY_ITERATOR (self);
+}
+
+static void
+tny_camel_header_list_iterator_instance_init (GTypeInstance *instance, gpointer g_class)
+{
+	TnyCamelHeaderListIterator *self = (TnyCamelHeaderListIterator *) instance;
+
+	self->list = NULL;
+	self->current = 0;
+
+	return;
+}
+
+static void
+tny_camel_header_list_iterator_finalize (GObject *object)
+{
+	TnyCamelHeaderListIterator *self = (TnyCamelHeaderListIterator *) object;
+
+	if (self->list)
+		g_object_unref (self->list);
+
+	(*parent_class->finalize) (object);
+
+	return;
+}
+
+static void
+tny_camel_header_list_iterator_next (TnyIterator *self)
+{
+	TnyCamelHeaderListIterator *me = (TnyCamelHeaderListIterator *) self;
+
+	me->current++;
+
+	return;
+}
+
+static void
+tny_camel_header_list_iterator_prev (TnyIterator *self)
+{
+	TnyCamelHeaderListIterator *me = (TnyCamelHeaderListIterator *) self;
+
+	me->current--;
+
+	return;
+}
+
+static void
+tny_camel_header_list_iterator_first (TnyIterator *self)
+{
+	TnyCamelHeaderListIterator *me = (TnyCamelHeaderListIterator *) self;
+
+	me->current = 0;
+
+	return;
+}
+
+static void
+tny_camel_header_list_iterator_nth (TnyIterator *self, guint nth)
+{
+	TnyCamelHeaderListIterator *me = (TnyCamelHeaderListIterator *) self;
+
+	me->current = nth;
+
+	return;
+}
+
+static gboolean
+tny_camel_header_list_iterator_is_done (TnyIterator *self)
+{
+	TnyCamelHeaderListIterator *me = (TnyCamelHeaderListIterator *) self;
+
+	/* The length is the summary's, so this sees appended messages too. After
+	 * prev on the first item, current wrapped around and this is done too */
+	return me->current >= _tny_camel_header_list_get_length (me->list);
+}
+
+static GObject*
+tny_camel_header_list_iterator_get_current (TnyIterator *self)
+{
+	TnyCamelHeaderListIterator *me = (TnyCamelHeaderListIterator *) self;
+
+	return _tny_camel_header_list_get_nth (me->list, me->current);
+}
+
+static TnyList*
+tny_camel_header_list_iterator_get_list (TnyIterator *self)
+{
+	TnyCamelHeaderListIterator *me = (TnyCamelHeaderListIterator *) self;
+
+	return TNY_LIST (g_object_ref (me->list));
+}
+
+static void
+tny_iterator_init (TnyIteratorIface *klass)
+{
+	klass->next = tny_camel_header_list_iterator_next;
+	klass->prev = tny_camel_header_list_iterator_prev;
+	klass->first = tny_camel_header_list_iterator_first;
+	klass->nth = tny_camel_header_list_iterator_nth;
+	klass->get_current = tny_camel_header_list_iterator_get_current;
+	klass->get_list = tny_camel_header_list_iterator_get_list;
+	klass->is_done = tny_camel_header_list_iterator_is_done;
+
+	return;
+}
+
+static void
+tny_camel_header_list_iterator_class_init (TnyCamelHeaderListIteratorClass *klass)
+{
+	GObjectClass *object_class;
+
+	parent_class = g_type_class_peek_parent (klass);
+	object_class = (GObjectClass *) klass;
+
+	object_class->finalize = tny_camel_header_list_iterator_finalize;
+
+	return;
+}
+
+static gpointer
+tny_camel_header_list_iterator_register_type (gpointer notused)
+{
+	GType type = 0;
+
+	static const GTypeInfo info =
+		{
+			sizeof (TnyCamelHeaderListIteratorClass),
+			NULL,   /* base_init */
+			NULL,   /* base_finalize */
+			(GClassInitFunc) tny_camel_header_list_iterator_class_init,   /* class_init */
+			NULL,   /* class_finalize */
+			NULL,   /* class_data */
+			sizeof (TnyCamelHeaderListIterator),
+			0,      /* n_preallocs */
+			tny_camel_header_list_iterator_instance_init,    /* instance_init */
+			NULL
+		};
+
+	static const GInterfaceInfo tny_iterator_info =
+		{
+			(GInterfaceInitFunc) tny_iterator_init, /* interface_init */
+			NULL,         /* interface_finalize */
+			NULL          /* interface_data */
+		};
+
+	type = g_type_register_static (G_TYPE_OBJECT,
+				       "TnyCamelHeaderListIterator",
+				       &info, 0);
+
+	g_type_add_interface_static (type, TNY_TYPE_ITERATOR,
+				     &tny_iterator_info);
+
+	return GSIZE_TO_POINTER (type);
+}
+
+GType
+_tny_camel_header_list_iterator_get_type (void)
+{
+	static GOnce once = G_ONCE_INIT;
+	g_once (&once, tny_camel_header_list_iterator_register_type, NULL);
+	return GPOINTER_TO_SIZE (once.retval);
+}
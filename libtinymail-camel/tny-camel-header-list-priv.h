@@ -0,0 +1,98 @@
+#ifndef TNY_CAMEL_HEADER_LIST_PRIV_H
+#define TNY_CAMEL_HEADER_LIST_PRIV_H
+
+/* libtinymail-camel - The Tiny Mail base library for Camel
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.	 See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with self library; if not, write to the
+ * Free Software Foundation, Inc., 51 Franklin Street, Fifth Floor,
+ * Boston, MA 02110-1301, USA.
+ */
+
+#include <glib.h>
+#include <glib-object.h>
+
+#include <tny-list.h>
+#include <tny-iterator.h>
+#include <tny-camel-folder.h>
+
+#include <camel/camel-folder.h>
+#include <camel/camel-folder-summary.h>
+#include <camel/camel-folder-thread.h>
+
+G_BEGIN_DECLS
+
+#define TNY_TYPE_CAMEL_HEADER_LIST             (_tny_camel_header_list_get_type ())
+#define TNY_CAMEL_HEADER_LIST(obj)             (G_TYPE_CHECK_INSTANCE_CAST ((obj), TNY_TYPE_CAMEL_HEADER_LIST, TnyCamelHeaderList))
+#define TNY_IS_CAMEL_HEADER_LIST(obj)          (G_TYPE_CHECK_INSTANCE_TYPE ((obj), TNY_TYPE_CAMEL_HEADER_LIST))
+
+#define TNY_TYPE_CAMEL_HEADER_LIST_ITERATOR    (_tny_camel_header_list_iterator_get_type ())
+#define TNY_CAMEL_HEADER_LIST_ITERATOR(obj)    (G_TYPE_CHECK_INSTANCE_CAST ((obj), TNY_TYPE_CAMEL_HEADER_LIST_ITERATOR, TnyCamelHeaderListIterator))
+
+typedef struct _TnyCamelHeaderList TnyCamelHeaderList;
+typedef struct _TnyCamelHeaderListClass TnyCamelHeaderListClass;
+typedef struct _TnyCamelHeaderListIterator TnyCamelHeaderListIterator;
+typedef struct _TnyCamelHeaderListIteratorClass TnyCamelHeaderListIteratorClass;
+
+/* A read-only view on the summary of a folder. Nothing is stored per item,
+ * the nth item is a TnyCamelHeader for the nth message info of the summary,
+ * created when it's asked for.
+ *
+ * A threaded view keeps the messages in a CamelFolderThread instead, which
+ * it updates on the changes of the CamelFolder. Its nth item is the nth
+ * message in depth first order, that order is only walked again when the
+ * threads changed */
+struct _TnyCamelHeaderList
+{
+	GObject parent;
+	TnyCamelFolder *folder;
+	CamelFolderSummary *summary;
+
+	CamelFolder *camel_folder;
+	guint changed_id;
+	GMutex *lock;
+	CamelFolderThread *thread;
+	GPtrArray *order;
+	gboolean dirty;
+};
+
+struct _TnyCamelHeaderListClass
+{
+	GObjectClass parent;
+};
+
+struct _TnyCamelHeaderListIterator
+{
+	GObject parent;
+	TnyCamelHeaderList *list;
+	guint current;
+};
+
+struct _TnyCamelHeaderListIteratorClass
+{
+	GObjectClass parent;
+};
+
+GType _tny_camel_header_list_get_type (void);
+GType _tny_camel_header_list_iterator_get_type (void);
+
+TnyList* _tny_camel_header_list_new (TnyCamelFolder *folder, CamelFolderSummary *summary);
+TnyList* _tny_camel_header_list_new_threaded (TnyCamelFolder *folder, CamelFolder *camel_folder);
+gint _tny_camel_header_list_get_depth (TnyCamelHeaderList *self, const gchar *uid);
+guint _tny_camel_header_list_get_length (TnyCamelHeaderList *self);
+GObject* _tny_camel_header_list_get_nth (TnyCamelHeaderList *self, guint nth);
+TnyIterator* _tny_camel_header_list_iterator_new (TnyCamelHeaderList *list);
+
+G_END_DECLS
+
+#endif
@@ -0,0 +1,419 @@
+/* libtinymail-camel - The Tiny Mail base library for Camel
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.	 See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with self library; if not, write to the
+ * Free Software Foundation, Inc., 51 Franklin Street, Fifth Floor,
+ * Boston, MA 02110-1301, USA.
+ */
+
+#include <config.h>
+
+#include <glib.h>
+
+#include <tny-list.h>
+#include <tny-iterator.h>
+
+#include "tny-camel-folder-priv.h"
+#include "tny-camel-header-priv.h"
+#include "tny-camel-header-list-priv.h"
+
+static GObjectClass *parent_class = NULL;
+
+
+/* Walks the threads depth first. The lists in the tree have the newest
+ * first, so they are walked from their end. Call with the lock held */
+static void
+update_order (TnyCamelHeaderList *self)
+{
+	GPtrArray *stack;
+	CamelFolderThreadNode *node;
+
+	if (!self->dirty)
+		return;
+
+	g_ptr_array_set_size (self->order, 0);
+	stack = g_ptr_array_new ();
+
+	for (node = self->thread->tree; node && node->next; node = node->next);
+	if (node)
+		g_ptr_array_add (stack, node);
+
+	while (stack->len > 0) {
+		node = g_ptr_array_remove_index (stack, stack->len - 1);
+
+		if (node->prev)
+			g_ptr_array_add (stack, node->prev);
+
+		if (node->message)
+			g_ptr_array_add (self->order, (gpointer) node->message);
+
+		if (node->child) {
+			CamelFolderThreadNode *last = node->child;
+			while (last->next)
+				last = last->next;
+			g_ptr_array_add (stack, last);
+		}
+	}
+
+	g_ptr_array_free (stack, TRUE);
+	self->dirty = FALSE;
+}
+
+guint
+_tny_camel_header_list_get_length (TnyCamelHeaderList *self)
+{
+	guint retval;
+
+	if (!self->thread)
+		return camel_folder_summary_count (self->summary);
+
+	g_mutex_lock (self->lock);
+	update_order (self);
+	retval = self->order->len;
+	g_mutex_unlock (self->lock);
+
+	return retval;
+}
+
+/* The depth of a message in its thread, or -1 if it's not in it. Nodes
+ * without a message don't count */
+gint
+_tny_camel_header_list_get_depth (TnyCamelHeaderList *self, const gchar *uid)
+{
+	CamelFolderThreadNode *node;
+	gint retval = -1;
+
+	if (!self->thread)
+		return -1;
+
+	g_mutex_lock (self->lock);
+	node = camel_folder_thread_messages_lookup (self->thread, uid);
+	if (node) {
+		retval = 0;
+		for (node = node->parent; node; node = node->parent)
+			if (node->message)
+				retval++;
+	}
+	g_mutex_unlock (self->lock);
+
+	return retval;
+}
+
+static CamelMessageInfo *
+get_nth_info (TnyCamelHeaderList *self, guint nth)
+{
+	CamelMessageInfo *mi = NULL;
+
+	if (!self->thread)
+		return camel_folder_summary_index (self->summary, nth);
+
+	g_mutex_lock (self->lock);
+	update_order (self);
+	if (nth < self->order->len) {
+		mi = self->order->pdata[nth];
+		camel_message_info_ref (mi);
+	}
+	g_mutex_unlock (self->lock);
+
+	return mi;
+}
+
+/* Returns a new reference, or NULL if the summary has less items by now */
+GObject*
+_tny_camel_header_list_get_nth (TnyCamelHeaderList *self, guint nth)
+{
+	TnyCamelFolderPriv *fpriv = TNY_CAMEL_FOLDER_GET_PRIVATE (self->folder);
+	CamelMessageInfo *mi;
+	TnyHeader *header;
+
+	mi = get_nth_info (self, nth);
+	if (!mi)
+		return NULL;
+
+	header = _tny_camel_header_new ();
+	_tny_camel_header_set_folder ((TnyCamelHeader *) header, self->folder, fpriv);
+	_tny_camel_header_set_camel_message_info ((TnyCamelHeader *) header, mi, FALSE);
+	camel_message_info_free (mi);
+
+	return (GObject *) header;
+}
+
+static guint
+tny_camel_header_list_get_length (TnyList *self)
+{
+	return _tny_camel_header_list_get_length ((TnyCamelHeaderList *) self);
+}
+
+static void
+tny_camel_header_list_prepend (TnyList *self, GObject* item)
+{
+	g_warning ("tny_list_prepend: This is a view on the headers of a folder. You can't modify it.\n");
+	return;
+}
+
+static void
+tny_camel_header_list_append (TnyList *self, GObject* item)
+{
+	g_warning ("tny_list_append: This is a view on the headers of a folder. You can't modify it.\n");
+	return;
+}
+
+static void
+tny_camel_header_list_remove (TnyList *self, GObject* item)
+{
+	g_warning ("tny_list_remove: This is a view on the headers of a folder. You can't modify it.\n");
+	return;
+}
+
+static void
+tny_camel_header_list_remove_matches (TnyList *self, TnyListMatcher matcher, gpointer match_data)
+{
+	g_warning ("tny_list_remove_matches: This is a view on the headers of a folder. You can't modify it.\n");
+	return;
+}
+
+static TnyIterator*
+tny_camel_header_list_create_iterator (TnyList *self)
+{
+	return _tny_camel_header_list_iterator_new ((TnyCamelHeaderList *) self);
+}
+
+static void
+tny_camel_header_list_foreach (TnyList *self, GFunc func, gpointer user_data)
+{
+	TnyCamelHeaderList *me = (TnyCamelHeaderList *) self;
+	guint i, length = _tny_camel_header_list_get_length (me);
+
+	/* Each item only lives for as long as func runs, so it can be reused
+	 * for the next one unless func kept a reference */
+	for (i = 0; i < length; i++) {
+		GObject *item = _tny_camel_header_list_get_nth (me, i);
+		if (!item)
+			break;
+		func (item, user_data);
+		_tny_camel_header_release ((TnyCamelHeader *) item);
+	}
+
+	return;
+}
+
+static TnyList*
+tny_camel_header_list_copy (TnyList *self)
+{
+	TnyCamelHeaderList *me = (TnyCamelHeaderList *) self;
+
+	/* A copy of a view is another view on the same summary */
+	if (me->thread)
+		return _tny_camel_header_list_new_threaded (me->folder, me->camel_folder);
+	return _tny_camel_header_list_new (me->folder, me->summary);
+}
+
+static void
+tny_list_init (TnyListIface *klass)
+{
+	klass->get_length = tny_camel_header_list_get_length;
+	klass->prepend = tny_camel_header_list_prepend;
+	klass->append = tny_camel_header_list_append;
+	klass->remove = tny_camel_header_list_remove;
+	klass->remove_matches = tny_camel_header_list_remove_matches;
+	klass->create_iterator = tny_camel_header_list_create_iterator;
+	klass->copy = tny_camel_header_list_copy;
+	klass->foreach = tny_camel_header_list_foreach;
+
+	return;
+}
+
+static void
+tny_camel_header_list_finalize (GObject *object)
+{
+	TnyCamelHeaderList *self = (TnyCamelHeaderList *) object;
+
+	if (self->camel_folder) {
+		camel_object_remove_event (self->camel_folder, self->changed_id);
+		camel_object_unref (self->camel_folder);
+	}
+
+	if (self->thread) {
+		camel_folder_thread_messages_unref (self->thread);
+		g_ptr_array_free (self->order, TRUE);
+		g_mutex_free (self->lock);
+	}
+
+	if (self->summary)
+		camel_object_unref (self->summary);
+
+	if (self->folder) {
+		_tny_camel_folder_unreason (TNY_CAMEL_FOLDER_GET_PRIVATE (self->folder));
+		g_object_unref (self->folder);
+	}
+
+	_tny_camel_header_pool_trim ();
+
+	(*parent_class->finalize) (object);
+
+	return;
+}
+
+TnyList*
+_tny_camel_header_list_new (TnyCamelFolder *folder, CamelFolderSummary *summary)
+{
+	TnyCamelHeaderList *self = g_object_new (TNY_TYPE_CAMEL_HEADER_LIST, NULL);
+
+	/* As long as the view exists, the folder must not uncache its summary */
+	_tny_camel_folder_reason (TNY_CAMEL_FOLDER_GET_PRIVATE (folder));
+	self->folder = g_object_ref (folder);
+
+	camel_object_ref (summary);
+	self->summary = summary;
+
+	return TNY_LIST (self);
+}
+
+static void
+folder_changed (CamelFolder *camel_folder, CamelFolderChangeInfo *info, gpointer user_data)
+{
+	TnyCamelHeaderList *self = user_data;
+	GPtrArray *added = NULL;
+	guint i;
+
+	if (info->uid_added && info->uid_added->len > 0) {
+		added = g_ptr_array_sized_new (info->uid_added->len);
+		for (i = 0; i < info->uid_added->len; i++) {
+			CamelMessageInfo *mi = camel_folder_summary_uid (self->summary,
+				info->uid_added->pdata[i]);
+			if (mi)
+				g_ptr_array_add (added, mi);
+		}
+	}
+
+	g_mutex_lock (self->lock);
+	if (added && added->len > 0) {
+		camel_folder_thread_messages_add (self->thread, added);
+		self->dirty = TRUE;
+	}
+	if (info->uid_removed && info->uid_removed->len > 0) {
+		camel_folder_thread_messages_remove (self->thread, info->uid_removed);
+		self->dirty = TRUE;
+	}
+	g_mutex_unlock (self->lock);
+
+	if (added) {
+		for (i = 0; i < added->len; i++)
+			camel_message_info_free (added->pdata[i]);
+		g_ptr_array_free (added, TRUE);
+	}
+
+	return;
+}
+
+TnyList*
+_tny_camel_header_list_new_threaded (TnyCamelFolder *folder, CamelFolder *camel_folder)
+{
+	TnyCamelHeaderList *self;
+	GPtrArray *infos;
+
+	self = (TnyCamelHeaderList *) _tny_camel_header_list_new (folder, camel_folder->summary);
+
+	self->lock = g_mutex_new ();
+	self->order = g_ptr_array_new ();
+	self->dirty = TRUE;
+
+	/* Hook first, so that nothing that gets added meanwhile is missed. The
+	 * thread skips what it has already */
+	camel_object_ref (camel_folder);
+	self->camel_folder = camel_folder;
+	g_mutex_lock (self->lock);
+	self->changed_id = camel_object_hook_event (camel_folder, "folder_changed",
+		(CamelObjectEventHookFunc) folder_changed, self);
+
+	infos = camel_folder_summary_array (self->summary);
+	self->thread = camel_folder_thread_messages_new_summary (infos);
+	camel_folder_summary_array_free (self->summary, infos);
+	g_mutex_unlock (self->lock);
+
+	return TNY_LIST (self);
+}
+
+static void
+tny_camel_header_list_class_init (TnyCamelHeaderListClass *klass)
+{
+	GObjectClass *object_class;
+
+	parent_class = g_type_class_peek_parent (klass);
+	object_class = (GObjectClass *) klass;
+
+	object_class->finalize = tny_camel_header_list_finalize;
+
+	return;
+}
+
+static void
+tny_camel_header_list_instance_init (GTypeInstance *instance, gpointer g_class)
+{
+	TnyCamelHeaderList *self = (TnyCamelHeaderList *) instance;
+
+	self->folder = NULL;
+	self->summary = NULL;
+	self->camel_folder = NULL;
+	self->changed_id = 0;
+	self->lock = NULL;
+	self->thread = NULL;
+	self->order = NULL;
+	self->dirty = FALSE;
+
+	return;
+}
+
+static gpointer
+tny_camel_header_list_register_type (gpointer notused)
+{
+	GType type = 0;
+
+	static const GTypeInfo info =
+		{
+			sizeof (TnyCamelHeaderListClass),
+			NULL,   /* base_init */
+			NULL,   /* base_finalize */
+			(GClassInitFunc) tny_camel_header_list_class_init,   /* class_init */
+			NULL,   /* class_finalize */
+			NULL,   /* class_data */
+			sizeof (TnyCamelHeaderList),
+			0,      /* n_preallocs */
+			tny_camel_header_list_instance_init,    /* instance_init */
+			NULL
+		};
+
+	static const GInterfaceInfo tny_list_info =
+		{
+			(GInterfaceInitFunc) tny_list_init, /* interface_init */
+			NULL,         /* interface_finalize */
+			NULL          /* interface_data */
+		};
+
+	type = g_type_register_static (G_TYPE_OBJECT,
+				       "TnyCamelHeaderList",
+				       &info, 0);
+
+	g_type_add_interface_static (type, TNY_TYPE_LIST,
+				     &tny_list_info);
+
+	return GSIZE_TO_POINTER (type);
+}
+
+GType
+_tny_camel_header_list_get_type (void)
+{
+	static GOnce once = G_ONCE_INIT;
+	g_once (&once, tny_camel_header_list_register_type, NULL);
+	return GPOINTER_TO_SIZE (once.retval);
+}
@@ -40,6 +40,16 @@
 
 static GObjectClass *parent_class = NULL;
 
+/* Headers that _tny_camel_header_release got back are kept here and handed
+ * out again by _tny_camel_header_new. Walking a large header view would
+ * otherwise create and destroy one GObject per message. Only a few are ever
+ * idle at the same time, _tny_camel_header_pool_trim gives the rest back */
+#define HEADER_POOL_MAX 64
+#define HEADER_POOL_LOW 8
+
+static GPtrArray *header_pool = NULL;
+G_LOCK_DEFINE_STATIC (header_pool);
+
 
 void 
 _tny_camel_header_set_camel_message_info (TnyCamelHeader *self, CamelMessageInfo *camel_message_info, gboolean knowit)
@@ -128,9 +138,9 @@ tny_camel_header_dup_cc (TnyHeader *self)
 	TnyCamelHeader *me = TNY_CAMEL_HEADER (self);
 	gchar *retval = NULL;
 
-	camel_folder_summary_lock ();
+	camel_message_info_lock (me->info);
 	retval = g_strdup (camel_message_info_cc (me->info));
-	camel_folder_summary_unlock ();
+	camel_message_info_unlock (me->info);
 
 	return retval;
 }
@@ -275,9 +285,9 @@ tny_camel_header_dup_from (TnyHeader *self)
 	TnyCamelHeader *me = TNY_CAMEL_HEADER (self);
 	gchar *retval = NULL;
 
-	camel_folder_summary_lock ();
+	camel_message_info_lock (me->info);
 	retval = g_strdup (camel_message_info_from (me->info));
-	camel_folder_summary_unlock ();
+	camel_message_info_unlock (me->info);
 
 	return retval;
 }
@@ -288,9 +298,9 @@ tny_camel_header_dup_subject (TnyHeader *self)
 	TnyCamelHeader *me = TNY_CAMEL_HEADER (self);
 	gchar *retval = NULL;
 
-	camel_folder_summary_lock ();
+	camel_message_info_lock (me->info);
 	retval = g_strdup (camel_message_info_subject (me->info));
-	camel_folder_summary_unlock ();
+	camel_message_info_unlock (me->info);
 
 	return retval;
 }
@@ -302,9 +312,9 @@ tny_camel_header_dup_to (TnyHeader *self)
 	TnyCamelHeader *me = TNY_CAMEL_HEADER (self);
 	gchar *retval = NULL;
 
-	camel_folder_summary_lock ();
+	camel_message_info_lock (me->info);
 	retval = g_strdup (camel_message_info_to (me->info));
-	camel_folder_summary_unlock ();
+	camel_message_info_unlock (me->info);
 
 	return retval;
 }
@@ -315,10 +325,10 @@ tny_camel_header_dup_message_id (TnyHeader *self)
 	TnyCamelHeader *me = TNY_CAMEL_HEADER (self);
 	gchar *retval = NULL;
 
-	camel_folder_summary_lock ();
+	camel_message_info_lock (me->info);
 	retval = g_strndup ((const gchar *) camel_message_info_message_id (me->info),
 			    sizeof (CamelSummaryMessageID));
-	camel_folder_summary_unlock ();
+	camel_message_info_unlock (me->info);
 
 	return retval;
 }
@@ -371,14 +381,87 @@ tny_camel_header_finalize (GObject *object)
 TnyHeader*
 _tny_camel_header_new (void)
 {
-	TnyCamelHeader *self = g_object_new (TNY_TYPE_CAMEL_HEADER, NULL);
+	TnyCamelHeader *self = NULL;
+
+	G_LOCK (header_pool);
+	if (header_pool && header_pool->len > 0)
+		self = g_ptr_array_remove_index (header_pool, header_pool->len - 1);
+	G_UNLOCK (header_pool);
 
-	self->info = NULL;
-	self->folder = NULL;
+	/* A pooled one comes with the pool's reference, which becomes ours */
+	if (!self)
+		self = g_object_new (TNY_TYPE_CAMEL_HEADER, NULL);
 
 	return (TnyHeader*) self;
 }
 
+/* Drops a reference to a header that libtinymail-camel created itself. When
+ * that was the last one and nothing was attached to it (no weak references,
+ * no data), the instance goes to the pool instead of being finalized. Only
+ * use this for headers that weren't handed out beyond a callback */
+void
+_tny_camel_header_release (TnyCamelHeader *self)
+{
+	GObject *object = (GObject *) self;
+
+	if (G_OBJECT_TYPE (object) != TNY_TYPE_CAMEL_HEADER ||
+	    object->ref_count != 1 || object->qdata != NULL) {
+		g_object_unref (object);
+		return;
+	}
+
+	if (self->info) {
+		camel_message_info_free (self->info);
+		self->info = NULL;
+	}
+
+	if (self->folder) {
+		TnyCamelFolderPriv *fpriv = TNY_CAMEL_FOLDER_GET_PRIVATE (self->folder);
+		_tny_camel_folder_unreason (fpriv);
+		g_object_unref (self->folder);
+		self->folder = NULL;
+	}
+
+	G_LOCK (header_pool);
+	if (header_pool->len < HEADER_POOL_MAX) {
+		g_ptr_array_add (header_pool, object);
+		object = NULL;
+	}
+	G_UNLOCK (header_pool);
+
+	if (object)
+		g_object_unref (object);
+
+	return;
+}
+
+/* Finalizes the pooled headers down to the low-water mark, for when a big
+ * walk over the headers is over */
+void
+_tny_camel_header_pool_trim (void)
+{
+	GPtrArray *trimmed = NULL;
+	guint i;
+
+	G_LOCK (header_pool);
+	if (header_pool && header_pool->len > HEADER_POOL_LOW) {
+		trimmed = g_ptr_array_sized_new (header_pool->len - HEADER_POOL_LOW);
+		while (header_pool->len > HEADER_POOL_LOW)
+			g_ptr_array_add (trimmed, g_ptr_array_remove_index (header_pool,
+				header_pool->len - 1));
+	}
+	G_UNLOCK (header_pool);
+
+	if (!trimmed)
+		return;
+
+	for (i = 0; i < trimmed->len; i++)
+		g_object_unref (trimmed->pdata[i]);
+	g_ptr_array_free (trimmed, TRUE);
+
+	return;
+}
+
 void
 _tny_camel_header_set_folder (TnyCamelHeader *self, TnyCamelFolder *folder, TnyCamelFolderPriv *fpriv)
 {
@@ -448,6 +531,8 @@ tny_camel_header_class_init (TnyCamelHeaderClass *class)
 
 	object_class->finalize = tny_camel_header_finalize;
 
+	header_pool = g_ptr_array_new ();
+
 	return;
 }
 
@@ -0,0 +1,37 @@
+#ifndef TNY_CAMEL_PREFETCH_POLICY_PRIV_H
+#define TNY_CAMEL_PREFETCH_POLICY_PRIV_H
+
+/* libtinymail-camel - The Tiny Mail base library for Camel
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.	 See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with self library; if not, write to the
+ * Free Software Foundation, Inc., 51 Franklin Street, Fifth Floor,
+ * Boston, MA 02110-1301, USA.
+ */
+
+#include <tny-camel-prefetch-policy.h>
+
+#include <camel/camel-folder-summary.h>
+
+G_BEGIN_DECLS
+
+guint _tny_camel_prefetch_policy_navigate (TnyCamelPrefetchPolicy *self, const gchar *uid);
+gboolean _tny_camel_prefetch_policy_is_current (TnyCamelPrefetchPolicy *self, guint generation);
+GPtrArray* _tny_camel_prefetch_policy_get_order (TnyCamelPrefetchPolicy *self, const gchar *uid);
+GPtrArray* _tny_camel_prefetch_policy_select (TnyCamelPrefetchPolicy *self, CamelFolderSummary *summary, GPtrArray *order, const gchar *uid);
+void _tny_camel_prefetch_policy_prefetched (TnyCamelPrefetchPolicy *self, const gchar *uid);
+void _tny_camel_prefetch_policy_cancelled (TnyCamelPrefetchPolicy *self);
+
+G_END_DECLS
+
+#endif
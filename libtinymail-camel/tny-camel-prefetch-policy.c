@@ -0,0 +1,500 @@
+/* libtinymail-camel - The Tiny Mail base library for Camel
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.	 See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with self library; if not, write to the
+ * Free Software Foundation, Inc., 51 Franklin Street, Fifth Floor,
+ * Boston, MA 02110-1301, USA.
+ */
+
+/**
+ * TnyCamelPrefetchPolicy:
+ *
+ * A policy that makes a #TnyCamelFolder fetch the messages that are likely
+ * to be opened next in the background, after a message got retrieved with
+ * tny_folder_get_msg_async(). Set it with tny_camel_folder_set_prefetch_policy().
+ *
+ * free-function: g_object_unref
+ **/
+
+#include <config.h>
+#include <string.h>
+#include <glib.h>
+#include <glib/gi18n-lib.h>
+
+#include <tny-list.h>
+#include <tny-iterator.h>
+#include <tny-header.h>
+
+#include <tny-camel-prefetch-policy.h>
+
+#include "tny-camel-prefetch-policy-priv.h"
+
+/* How far to look for unread messages after the opened one */
+#define TNY_CAMEL_PREFETCH_UNREAD_SCAN 100
+
+/* How many prefetched uids are remembered for counting the hits */
+#define TNY_CAMEL_PREFETCH_REMEMBER 256
+
+static GObjectClass *parent_class = NULL;
+
+typedef struct _TnyCamelPrefetchPolicyPriv TnyCamelPrefetchPolicyPriv;
+
+struct _TnyCamelPrefetchPolicyPriv
+{
+	GMutex *lock;
+	guint neighbours, unread, max_bytes;
+	guint requests, hits, prefetched, cancelled;
+	guint generation;
+	GHashTable *done;
+	TnyList *view;
+};
+
+#define TNY_CAMEL_PREFETCH_POLICY_GET_PRIVATE(o) \
+	(G_TYPE_INSTANCE_GET_PRIVATE ((o), TNY_TYPE_CAMEL_PREFETCH_POLICY, TnyCamelPrefetchPolicyPriv))
+
+
+/**
+ * tny_camel_prefetch_policy_set_neighbours:
+ * @self: a #TnyCamelPrefetchPolicy instance
+ * @neighbours: the amount of messages on each side of the opened one
+ *
+ * Sets how many messages before and after the opened message get prefetched,
+ * in the order of the view of tny_camel_prefetch_policy_set_view() or else of
+ * the summary of the folder. The nearest ones go first. Use 0 to disable this.
+ * Default value is 1.
+ **/
+void
+tny_camel_prefetch_policy_set_neighbours (TnyCamelPrefetchPolicy *self, guint neighbours)
+{
+	TnyCamelPrefetchPolicyPriv *priv = TNY_CAMEL_PREFETCH_POLICY_GET_PRIVATE (self);
+	g_mutex_lock (priv->lock);
+	priv->neighbours = neighbours;
+	g_mutex_unlock (priv->lock);
+}
+
+/**
+ * tny_camel_prefetch_policy_set_unread:
+ * @self: a #TnyCamelPrefetchPolicy instance
+ * @unread: the amount of unread messages
+ *
+ * Sets how many of the unread messages that come after the opened message get
+ * prefetched, on top of the neighbours. Only the next 100 messages are looked
+ * at, in the same order as the neighbours. Default value is 0 or disabled.
+ **/
+void
+tny_camel_prefetch_policy_set_unread (TnyCamelPrefetchPolicy *self, guint unread)
+{
+	TnyCamelPrefetchPolicyPriv *priv = TNY_CAMEL_PREFETCH_POLICY_GET_PRIVATE (self);
+	g_mutex_lock (priv->lock);
+	priv->unread = unread;
+	g_mutex_unlock (priv->lock);
+}
+
+/**
+ * tny_camel_prefetch_policy_set_max_bytes:
+ * @self: a #TnyCamelPrefetchPolicy instance
+ * @max_bytes: the budget in bytes
+ *
+ * Sets how many bytes, by the sizes in the summary, may get prefetched after
+ * one message got opened. Messages that don't fit are skipped. Default value
+ * is 524288 (512 KB).
+ **/
+void
+tny_camel_prefetch_policy_set_max_bytes (TnyCamelPrefetchPolicy *self, guint max_bytes)
+{
+	TnyCamelPrefetchPolicyPriv *priv = TNY_CAMEL_PREFETCH_POLICY_GET_PRIVATE (self);
+	g_mutex_lock (priv->lock);
+	priv->max_bytes = max_bytes;
+	g_mutex_unlock (priv->lock);
+}
+
+static void
+notify_view_del (gpointer user_data, GObject *view)
+{
+	TnyCamelPrefetchPolicyPriv *priv = TNY_CAMEL_PREFETCH_POLICY_GET_PRIVATE (user_data);
+	g_mutex_lock (priv->lock);
+	priv->view = NULL;
+	g_mutex_unlock (priv->lock);
+}
+
+/**
+ * tny_camel_prefetch_policy_set_view:
+ * @self: a #TnyCamelPrefetchPolicy instance
+ * @view: (null-ok): a #TnyList with the headers of the folder or NULL
+ *
+ * Sets the list of headers that the user navigates the folder in, like the
+ * sorted #TnyGtkHeaderListModel of a header view. The neighbours and the
+ * unread messages of an opened message are then taken in the order of @view
+ * rather than in the order of the summary, unless the opened message isn't in
+ * @view. @self doesn't keep a reference to @view. The view is only looked at
+ * after tny_folder_get_msg_async() got a message, from the mainloop. Default
+ * value is NULL.
+ **/
+void
+tny_camel_prefetch_policy_set_view (TnyCamelPrefetchPolicy *self, TnyList *view)
+{
+	TnyCamelPrefetchPolicyPriv *priv = TNY_CAMEL_PREFETCH_POLICY_GET_PRIVATE (self);
+
+	g_mutex_lock (priv->lock);
+	if (priv->view)
+		g_object_weak_unref (G_OBJECT (priv->view), notify_view_del, self);
+	priv->view = view;
+	if (priv->view)
+		g_object_weak_ref (G_OBJECT (priv->view), notify_view_del, self);
+	g_mutex_unlock (priv->lock);
+}
+
+/**
+ * tny_camel_prefetch_policy_get_stats:
+ * @self: a #TnyCamelPrefetchPolicy instance
+ * @requests: (null-ok): byref the amount of opened messages or NULL
+ * @hits: (null-ok): byref the amount of opened messages that got prefetched or NULL
+ * @prefetched: (null-ok): byref the amount of prefetched messages or NULL
+ * @cancelled: (null-ok): byref the amount of cancelled prefetches or NULL
+ *
+ * Gets the counters of @self, to tune the settings with. The hit rate is
+ * @hits divided by @requests, the waste is @prefetched minus @hits.
+ * Prefetches get cancelled when another message gets opened before they ran.
+ **/
+void
+tny_camel_prefetch_policy_get_stats (TnyCamelPrefetchPolicy *self, guint *requests, guint *hits, guint *prefetched, guint *cancelled)
+{
+	TnyCamelPrefetchPolicyPriv *priv = TNY_CAMEL_PREFETCH_POLICY_GET_PRIVATE (self);
+
+	g_mutex_lock (priv->lock);
+	if (requests)
+		*requests = priv->requests;
+	if (hits)
+		*hits = priv->hits;
+	if (prefetched)
+		*prefetched = priv->prefetched;
+	if (cancelled)
+		*cancelled = priv->cancelled;
+	g_mutex_unlock (priv->lock);
+}
+
+/* Counts a message that got opened, and starts a new generation. Prefetches
+ * of older generations are no longer wanted */
+guint
+_tny_camel_prefetch_policy_navigate (TnyCamelPrefetchPolicy *self, const gchar *uid)
+{
+	TnyCamelPrefetchPolicyPriv *priv = TNY_CAMEL_PREFETCH_POLICY_GET_PRIVATE (self);
+	guint retval;
+
+	g_mutex_lock (priv->lock);
+	priv->requests++;
+	if (uid && g_hash_table_remove (priv->done, uid))
+		priv->hits++;
+	retval = ++priv->generation;
+	g_mutex_unlock (priv->lock);
+
+	return retval;
+}
+
+gboolean
+_tny_camel_prefetch_policy_is_current (TnyCamelPrefetchPolicy *self, guint generation)
+{
+	TnyCamelPrefetchPolicyPriv *priv = TNY_CAMEL_PREFETCH_POLICY_GET_PRIVATE (self);
+	gboolean retval;
+
+	g_mutex_lock (priv->lock);
+	retval = (priv->generation == generation);
+	g_mutex_unlock (priv->lock);
+
+	return retval;
+}
+
+void
+_tny_camel_prefetch_policy_prefetched (TnyCamelPrefetchPolicy *self, const gchar *uid)
+{
+	TnyCamelPrefetchPolicyPriv *priv = TNY_CAMEL_PREFETCH_POLICY_GET_PRIVATE (self);
+
+	g_mutex_lock (priv->lock);
+	priv->prefetched++;
+	/* Only remembered for the hit rate, don't let it grow without bound */
+	if (g_hash_table_size (priv->done) >= TNY_CAMEL_PREFETCH_REMEMBER) {
+		g_hash_table_destroy (priv->done);
+		priv->done = g_hash_table_new_full (g_str_hash, g_str_equal, g_free, NULL);
+	}
+	g_hash_table_insert (priv->done, g_strdup (uid), GINT_TO_POINTER (1));
+	g_mutex_unlock (priv->lock);
+}
+
+void
+_tny_camel_prefetch_policy_cancelled (TnyCamelPrefetchPolicy *self)
+{
+	TnyCamelPrefetchPolicyPriv *priv = TNY_CAMEL_PREFETCH_POLICY_GET_PRIVATE (self);
+
+	g_mutex_lock (priv->lock);
+	priv->cancelled++;
+	g_mutex_unlock (priv->lock);
+}
+
+static gchar *
+dup_uid (TnyIterator *iter)
+{
+	TnyHeader *header = TNY_HEADER (tny_iterator_get_current (iter));
+	gchar *retval = NULL;
+
+	if (header) {
+		retval = tny_header_dup_uid (header);
+		g_object_unref (header);
+	}
+
+	return retval;
+}
+
+/* Returns the uids of the view around uid, as far as select looks, or NULL
+ * if there's no view or uid isn't in it. Free the strings and the array.
+ * Only call from the mainloop, like the views that can be set */
+GPtrArray*
+_tny_camel_prefetch_policy_get_order (TnyCamelPrefetchPolicy *self, const gchar *uid)
+{
+	TnyCamelPrefetchPolicyPriv *priv = TNY_CAMEL_PREFETCH_POLICY_GET_PRIVATE (self);
+	GPtrArray *order = NULL;
+	TnyIterator *iter;
+	TnyList *view;
+	gint idx = -1, i, first, last;
+	guint neighbours;
+
+	g_mutex_lock (priv->lock);
+	view = priv->view ? TNY_LIST (g_object_ref (priv->view)) : NULL;
+	neighbours = priv->neighbours;
+	g_mutex_unlock (priv->lock);
+
+	if (!view)
+		return NULL;
+
+	iter = tny_list_create_iterator (view);
+	for (i = 0; uid && idx == -1 && !tny_iterator_is_done (iter); i++) {
+		gchar *cur = dup_uid (iter);
+		if (cur && !strcmp (cur, uid))
+			idx = i;
+		g_free (cur);
+		tny_iterator_next (iter);
+	}
+
+	if (idx != -1) {
+		first = MAX (0, idx - (gint) neighbours);
+		last = idx + MAX ((gint) neighbours, TNY_CAMEL_PREFETCH_UNREAD_SCAN);
+
+		order = g_ptr_array_new ();
+		tny_iterator_nth (iter, first);
+		for (i = first; i <= last && !tny_iterator_is_done (iter); i++) {
+			g_ptr_array_add (order, dup_uid (iter));
+			tny_iterator_next (iter);
+		}
+	}
+
+	g_object_unref (iter);
+	g_object_unref (view);
+
+	return order;
+}
+
+/* Adds the uid of mi if it's worth fetching and fits in what is left of the
+ * budget. Call with the lock held */
+static gboolean
+add_candidate (TnyCamelPrefetchPolicyPriv *priv, GPtrArray *uids, CamelMessageInfo *mi, guint *budget)
+{
+	guint32 size;
+
+	if (!mi)
+		return FALSE;
+
+	if (camel_message_info_flags (mi) & CAMEL_MESSAGE_CACHED)
+		return FALSE;
+
+	if (g_hash_table_lookup (priv->done, camel_message_info_uid (mi)))
+		return FALSE;
+
+	size = camel_message_info_size (mi);
+	if (size > *budget)
+		return FALSE;
+
+	*budget -= size;
+	g_ptr_array_add (uids, g_strdup (camel_message_info_uid (mi)));
+
+	return TRUE;
+}
+
+/* The nth message in the order of the view, or of the summary without one */
+static CamelMessageInfo *
+get_nth_info (CamelFolderSummary *summary, GPtrArray *order, gint nth)
+{
+	if (!order)
+		return camel_folder_summary_index (summary, nth);
+
+	if (!order->pdata[nth])
+		return NULL;
+
+	return camel_folder_summary_uid (summary, order->pdata[nth]);
+}
+
+/* Returns the uids to prefetch after uid got opened, nearest first. The order
+ * is from _tny_camel_prefetch_policy_get_order, or NULL for the order of the
+ * summary. Free the strings and the array */
+GPtrArray*
+_tny_camel_prefetch_policy_select (TnyCamelPrefetchPolicy *self, CamelFolderSummary *summary, GPtrArray *order, const gchar *uid)
+{
+	TnyCamelPrefetchPolicyPriv *priv = TNY_CAMEL_PREFETCH_POLICY_GET_PRIVATE (self);
+	GPtrArray *uids = g_ptr_array_new ();
+	gint idx = -1, count, i, d;
+	guint budget, found;
+
+	if (order) {
+		count = order->len;
+		for (i = 0; idx == -1 && i < count; i++)
+			if (uid && order->pdata[i] && !strcmp (order->pdata[i], uid))
+				idx = i;
+	} else {
+		count = camel_folder_summary_count (summary);
+		idx = camel_folder_summary_get_index_for (summary, uid);
+	}
+
+	if (idx < 0)
+		return uids;
+
+	g_mutex_lock (priv->lock);
+	budget = priv->max_bytes;
+
+	for (d = 1; d <= (gint) priv->neighbours; d++) {
+		CamelMessageInfo *mi;
+
+		if (idx + d < count) {
+			mi = get_nth_info (summary, order, idx + d);
+			add_candidate (priv, uids, mi, &budget);
+			if (mi)
+				camel_message_info_free (mi);
+		}
+		if (idx - d >= 0) {
+			mi = get_nth_info (summary, order, idx - d);
+			add_candidate (priv, uids, mi, &budget);
+			if (mi)
+				camel_message_info_free (mi);
+		}
+	}
+
+	found = 0;
+	for (i = idx + 1 + priv->neighbours;
+	     found < priv->unread && i < count && i <= idx + TNY_CAMEL_PREFETCH_UNREAD_SCAN; i++) {
+		CamelMessageInfo *mi = get_nth_info (summary, order, i);
+
+		if (!mi)
+			continue;
+		if (!(camel_message_info_flags (mi) & CAMEL_MESSAGE_SEEN) &&
+		    add_candidate (priv, uids, mi, &budget))
+			found++;
+		camel_message_info_free (mi);
+	}
+	g_mutex_unlock (priv->lock);
+
+	return uids;
+}
+
+static void
+tny_camel_prefetch_policy_finalize (GObject *object)
+{
+	TnyCamelPrefetchPolicyPriv *priv = TNY_CAMEL_PREFETCH_POLICY_GET_PRIVATE (object);
+
+	if (priv->view)
+		g_object_weak_unref (G_OBJECT (priv->view), notify_view_del, object);
+	g_hash_table_destroy (priv->done);
+	g_mutex_free (priv->lock);
+
+	parent_class->finalize (object);
+}
+
+static void
+tny_camel_prefetch_policy_instance_init (GTypeInstance *instance, gpointer g_class)
+{
+	TnyCamelPrefetchPolicyPriv *priv = TNY_CAMEL_PREFETCH_POLICY_GET_PRIVATE (instance);
+
+	priv->lock = g_mutex_new ();
+	priv->neighbours = 1;
+	priv->unread = 0;
+	priv->max_bytes = 512 * 1024;
+	priv->requests = 0;
+	priv->hits = 0;
+	priv->prefetched = 0;
+	priv->cancelled = 0;
+	priv->generation = 0;
+	priv->done = g_hash_table_new_full (g_str_hash, g_str_equal, g_free, NULL);
+	priv->view = NULL;
+}
+
+static void
+tny_camel_prefetch_policy_class_init (TnyCamelPrefetchPolicyClass *klass)
+{
+	GObjectClass *object_class;
+
+	parent_class = g_type_class_peek_parent (klass);
+	object_class = (GObjectClass*) klass;
+	object_class->finalize = tny_camel_prefetch_policy_finalize;
+
+	g_type_class_add_private (object_class, sizeof (TnyCamelPrefetchPolicyPriv));
+}
+
+/**
+ * tny_camel_prefetch_policy_new:
+ *
+ * A prefetch policy that fetches the neighbours of an opened message, and
+ * optionally the next unread messages, with a budget of bytes.
+ *
+ * Return value: A new #TnyCamelPrefetchPolicy instance
+ **/
+TnyCamelPrefetchPolicy*
+tny_camel_prefetch_policy_new (void)
+{
+	return TNY_CAMEL_PREFETCH_POLICY (g_object_new (TNY_TYPE_CAMEL_PREFETCH_POLICY, NULL));
+}
+
+static gpointer
+tny_camel_prefetch_policy_register_type (gpointer notused)
+{
+	GType type = 0;
+	static const GTypeInfo info =
+		{
+			sizeof (TnyCamelPrefetchPolicyClass),
+			NULL,   /* base_init */
+			NULL,   /* base_finalize */
+			(GClassInitFunc) tny_camel_prefetch_policy_class_init,   /* class_init */
+			NULL,   /* class_finalize */
+			NULL,   /* class_data */
+			sizeof (TnyCamelPrefetchPolicy),
+			0,      /* n_preallocs */
+			tny_camel_prefetch_policy_instance_init,    /* instance_init */
+			NULL
+		};
+
+	type = g_type_register_static (G_TYPE_OBJECT,
+				       "TnyCamelPrefetchPolicy",
+				       &info, 0);
+
+	return GSIZE_TO_POINTER (type);
+}
+
+/**
+ * tny_camel_prefetch_policy_get_type:
+ *
+ * GType system helper function
+ *
+ * returns: a #GType
+ **/
+GType
+tny_camel_prefetch_policy_get_type (void)
+{
+	static GOnce once = G_ONCE_INIT;
+	g_once (&once, tny_camel_prefetch_policy_register_type, NULL);
+	return GPOINTER_TO_SIZE (once.retval);
+}
@@ -0,0 +1,58 @@
+#ifndef TNY_CAMEL_PREFETCH_POLICY_H
+#define TNY_CAMEL_PREFETCH_POLICY_H
+
+/* libtinymail-camel - The Tiny Mail base library for Camel
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.	 See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with self library; if not, write to the
+ * Free Software Foundation, Inc., 51 Franklin Street, Fifth Floor,
+ * Boston, MA 02110-1301, USA.
+ */
+
+#include <glib-object.h>
+#include <tny-list.h>
+
+G_BEGIN_DECLS
+
+#define TNY_TYPE_CAMEL_PREFETCH_POLICY             (tny_camel_prefetch_policy_get_type ())
+#define TNY_CAMEL_PREFETCH_POLICY(obj)             (G_TYPE_CHECK_INSTANCE_CAST ((obj), TNY_TYPE_CAMEL_PREFETCH_POLICY, TnyCamelPrefetchPolicy))
+#define TNY_CAMEL_PREFETCH_POLICY_CLASS(vtable)    (G_TYPE_CHECK_CLASS_CAST ((vtable), TNY_TYPE_CAMEL_PREFETCH_POLICY, TnyCamelPrefetchPolicyClass))
+#define TNY_IS_CAMEL_PREFETCH_POLICY(obj)          (G_TYPE_CHECK_INSTANCE_TYPE ((obj), TNY_TYPE_CAMEL_PREFETCH_POLICY))
+#define TNY_IS_CAMEL_PREFETCH_POLICY_CLASS(vtable) (G_TYPE_CHECK_CLASS_TYPE ((vtable), TNY_TYPE_CAMEL_PREFETCH_POLICY))
+#define TNY_CAMEL_PREFETCH_POLICY_GET_CLASS(inst)  (G_TYPE_INSTANCE_GET_CLASS ((inst), TNY_TYPE_CAMEL_PREFETCH_POLICY, TnyCamelPrefetchPolicyClass))
+
+typedef struct _TnyCamelPrefetchPolicy TnyCamelPrefetchPolicy;
+typedef struct _TnyCamelPrefetchPolicyClass TnyCamelPrefetchPolicyClass;
+
+struct _TnyCamelPrefetchPolicy
+{
+	GObject parent;
+};
+
+struct _TnyCamelPrefetchPolicyClass
+{
+	GObjectClass parent_class;
+};
+
+GType tny_camel_prefetch_policy_get_type (void);
+TnyCamelPrefetchPolicy* tny_camel_prefetch_policy_new (void);
+
+void tny_camel_prefetch_policy_set_neighbours (TnyCamelPrefetchPolicy *self, guint neighbours);
+void tny_camel_prefetch_policy_set_unread (TnyCamelPrefetchPolicy *self, guint unread);
+void tny_camel_prefetch_policy_set_max_bytes (TnyCamelPrefetchPolicy *self, guint max_bytes);
+void tny_camel_prefetch_policy_set_view (TnyCamelPrefetchPolicy *self, TnyList *view);
+void tny_camel_prefetch_policy_get_stats (TnyCamelPrefetchPolicy *self, guint *requests, guint *hits, guint *prefetched, guint *cancelled);
+
+G_END_DECLS
+
+#endif
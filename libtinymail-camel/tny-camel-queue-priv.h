@@ -37,13 +37,53 @@ G_BEGIN_DECLS
 typedef struct _TnyCamelQueue TnyCamelQueue;
 typedef struct _TnyCamelQueueable TnyCamelQueueable;
 typedef struct _TnyCamelQueueClass TnyCamelQueueClass;
+typedef struct _TnyCamelQueueStats TnyCamelQueueStats;
+
+/* The bit of each of the TnyCamelQueueItemFlags. A new flag goes before the
+ * count, that sizes the flag counts of a queue */
+enum {
+	TNY_CAMEL_QUEUE_NORMAL_ITEM_BIT,
+	TNY_CAMEL_QUEUE_RECONNECT_ITEM_BIT,
+	TNY_CAMEL_QUEUE_CANCELLABLE_ITEM_BIT,
+	TNY_CAMEL_QUEUE_PRIORITY_ITEM_BIT,
+	TNY_CAMEL_QUEUE_GET_HEADERS_ITEM_BIT,
+	TNY_CAMEL_QUEUE_SYNC_ITEM_BIT,
+	TNY_CAMEL_QUEUE_REFRESH_ITEM_BIT,
+	TNY_CAMEL_QUEUE_AUTO_CANCELLABLE_ITEM_BIT,
+	TNY_CAMEL_QUEUE_CONNECT_ITEM_BIT,
+	TNY_CAMEL_QUEUE_PREFETCH_ITEM_BIT,
+	TNY_CAMEL_QUEUE_ITEM_FLAG_COUNT
+};
+
+typedef enum {
+	TNY_CAMEL_QUEUE_NORMAL_ITEM = 1<<TNY_CAMEL_QUEUE_NORMAL_ITEM_BIT,
+	TNY_CAMEL_QUEUE_RECONNECT_ITEM = 1<<TNY_CAMEL_QUEUE_RECONNECT_ITEM_BIT,
+	TNY_CAMEL_QUEUE_CANCELLABLE_ITEM = 1<<TNY_CAMEL_QUEUE_CANCELLABLE_ITEM_BIT,
+	TNY_CAMEL_QUEUE_PRIORITY_ITEM = 1<<TNY_CAMEL_QUEUE_PRIORITY_ITEM_BIT,
+	TNY_CAMEL_QUEUE_GET_HEADERS_ITEM = 1<<TNY_CAMEL_QUEUE_GET_HEADERS_ITEM_BIT,
+	TNY_CAMEL_QUEUE_SYNC_ITEM = 1<<TNY_CAMEL_QUEUE_SYNC_ITEM_BIT,
+	TNY_CAMEL_QUEUE_REFRESH_ITEM = 1<<TNY_CAMEL_QUEUE_REFRESH_ITEM_BIT,
+	TNY_CAMEL_QUEUE_AUTO_CANCELLABLE_ITEM = 1<<TNY_CAMEL_QUEUE_AUTO_CANCELLABLE_ITEM_BIT,
+	TNY_CAMEL_QUEUE_CONNECT_ITEM = 1<<TNY_CAMEL_QUEUE_CONNECT_ITEM_BIT,
+	TNY_CAMEL_QUEUE_PREFETCH_ITEM = 1<<TNY_CAMEL_QUEUE_PREFETCH_ITEM_BIT,
+} TnyCamelQueueItemFlags;
+
+struct _TnyCamelQueueStats
+{
+	guint depth, max_depth;
+	guint launched, performed, cancelled;
+	/* in seconds, between the launch of an item and its start */
+	gdouble total_wait, max_wait;
+};
 
 struct _TnyCamelQueue
 {
 	GObject parent;
 
 	TnyCamelAccount *account;
-	GList *list;
+	GQueue *priority, *normal;
+	guint flag_counts[TNY_CAMEL_QUEUE_ITEM_FLAG_COUNT];
+	TnyCamelQueueStats stats;
 	GThread *thread;
 	GCond *condition;
 	GMutex *mutex;
@@ -65,18 +105,6 @@ struct _TnyCamelQueueable
 	GMutex *mutex;
 };
 
-typedef enum {
-	TNY_CAMEL_QUEUE_NORMAL_ITEM = 1<<0,
-	TNY_CAMEL_QUEUE_RECONNECT_ITEM = 1<<1,
-	TNY_CAMEL_QUEUE_CANCELLABLE_ITEM = 1<<2,
-	TNY_CAMEL_QUEUE_PRIORITY_ITEM = 1<<3,
-	TNY_CAMEL_QUEUE_GET_HEADERS_ITEM = 1<<4,
-	TNY_CAMEL_QUEUE_SYNC_ITEM = 1<<5, 
-	TNY_CAMEL_QUEUE_REFRESH_ITEM = 1<<6,
-	TNY_CAMEL_QUEUE_AUTO_CANCELLABLE_ITEM = 1<<7,
-	TNY_CAMEL_QUEUE_CONNECT_ITEM = 1<<8,
-} TnyCamelQueueItemFlags;
-
 GType tny_camel_queue_get_type (void);
 
 TnyCamelQueue* _tny_camel_queue_new (TnyCamelAccount *account);
@@ -85,6 +113,7 @@ void _tny_camel_queue_launch (TnyCamelQueue *queue, GThreadFunc func, GSourceFun
 void _tny_camel_queue_remove_items (TnyCamelQueue *queue, TnyCamelQueueItemFlags flags);
 void _tny_camel_queue_cancel_remove_items (TnyCamelQueue *queue, TnyCamelQueueItemFlags flags);
 gboolean _tny_camel_queue_has_items (TnyCamelQueue *queue, TnyCamelQueueItemFlags flags);
+void _tny_camel_queue_get_stats (TnyCamelQueue *queue, TnyCamelQueueStats *stats);
 
 G_END_DECLS
 
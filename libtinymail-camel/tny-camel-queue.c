@@ -54,8 +54,10 @@ tny_camel_queue_finalize (GObject *object)
 	g_mutex_unlock (self->mutex);
 
 	g_static_rec_mutex_lock (self->lock);
-	g_list_free (self->list);
-	self->list = NULL;
+	g_queue_free (self->priority);
+	g_queue_free (self->normal);
+	self->priority = NULL;
+	self->normal = NULL;
 	g_static_rec_mutex_unlock (self->lock);
 
 	g_cond_free (self->condition);
@@ -114,8 +116,89 @@ typedef struct
 	const gchar *name;
 	gboolean *cancel_field;
 	gboolean deleted;
+	GTimeVal launched;
 } QueueItem;
 
+/* Items are kept in two FIFOs: the prioritized ones go before all others
+ * but keep their order among themselves. The item that is being performed
+ * stays at the head of its FIFO until it's done, like it always did in
+ * the list. The flag counts make _tny_camel_queue_has_items O(1) */
+
+static guint
+queue_length (TnyCamelQueue *queue)
+{
+	return g_queue_get_length (queue->priority) + g_queue_get_length (queue->normal);
+}
+
+static void
+queue_count_flags (TnyCamelQueue *queue, TnyCamelQueueItemFlags flags, gint delta)
+{
+	gint i;
+
+	for (i = 0; i < TNY_CAMEL_QUEUE_ITEM_FLAG_COUNT; i++)
+		if (flags & (1 << i))
+			queue->flag_counts[i] += delta;
+}
+
+static void
+queue_push (TnyCamelQueue *queue, QueueItem *item)
+{
+	guint depth;
+
+	if (item->flags & TNY_CAMEL_QUEUE_PRIORITY_ITEM)
+		g_queue_push_tail (queue->priority, item);
+	else
+		g_queue_push_tail (queue->normal, item);
+
+	queue_count_flags (queue, item->flags, 1);
+
+	queue->stats.launched++;
+	depth = queue_length (queue);
+	if (depth > queue->stats.max_depth)
+		queue->stats.max_depth = depth;
+}
+
+static GQueue *
+queue_head (TnyCamelQueue *queue)
+{
+	if (!g_queue_is_empty (queue->priority))
+		return queue->priority;
+	if (!g_queue_is_empty (queue->normal))
+		return queue->normal;
+	return NULL;
+}
+
+static void
+queue_remove_head (TnyCamelQueue *queue, GQueue *fifo)
+{
+	QueueItem *item = g_queue_pop_head (fifo);
+
+	queue_count_flags (queue, item->flags, -1);
+
+	if (item->deleted)
+		queue->stats.cancelled++;
+	else
+		queue->stats.performed++;
+}
+
+static void
+queue_account_wait (TnyCamelQueue *queue, QueueItem *item)
+{
+	GTimeVal now;
+	gdouble wait;
+
+	g_get_current_time (&now);
+	wait = (now.tv_sec - item->launched.tv_sec) +
+		(now.tv_usec - item->launched.tv_usec) / (gdouble) G_USEC_PER_SEC;
+
+	queue->stats.total_wait += wait;
+	if (wait > queue->stats.max_wait)
+		queue->stats.max_wait = wait;
+
+	tny_debug ("TnyCamelQueue: %s waited %.3fs, %d more queued\n",
+		item->name, wait, queue_length (queue) - 1);
+}
+
 static gboolean
 perform_callback (gpointer user_data)
 {
@@ -187,7 +270,7 @@ tny_camel_queue_thread_main_func (gpointer user_data)
 
 	while (!queue->stopped)
 	{
-		GList *first = NULL;
+		GQueue *first = NULL;
 		QueueItem *item = NULL;
 		gboolean deleted = FALSE, wait = FALSE;
 
@@ -207,18 +290,19 @@ tny_camel_queue_thread_main_func (gpointer user_data)
 			queue->next_uncancel = FALSE;
 		}
 
-		first = g_list_first (queue->list);
+		first = queue_head (queue);
 		if (first) {
-			item = first->data;
-			if (item)
-				deleted = item->deleted;
+			item = g_queue_peek_head (first);
+			deleted = item->deleted;
 			queue->current = item;
+			if (!deleted)
+				queue_account_wait (queue, item);
 		} else
 			wait = TRUE;
 		/* If no next item is scheduled then we can go idle after finishing operation */
 		apriv = TNY_CAMEL_ACCOUNT_GET_PRIVATE (queue->account);
 		if (apriv->service)
-			camel_service_can_idle (apriv->service, !first || !first->next);
+			camel_service_can_idle (apriv->service, queue_length (queue) <= 1);
 		g_static_rec_mutex_unlock (queue->lock);
 
 		if (item) {
@@ -265,10 +349,10 @@ tny_camel_queue_thread_main_func (gpointer user_data)
 
 		g_static_rec_mutex_lock (queue->lock);
 		if (first)
-			queue->list = g_list_delete_link (queue->list, first);
+			queue_remove_head (queue, first);
 		queue->current = NULL;
 
-		if (g_list_length (queue->list) == 0)
+		if (queue_length (queue) == 0)
 			wait = TRUE;
 		g_static_rec_mutex_unlock (queue->lock);
 
@@ -307,27 +391,34 @@ tny_camel_queue_thread_main_func (gpointer user_data)
 void 
 _tny_camel_queue_remove_items (TnyCamelQueue *queue, TnyCamelQueueItemFlags flags)
 {
-	GList *copy = NULL;
+	GQueue *fifos[2];
+	gint i;
 
 	g_static_rec_mutex_lock (queue->lock);
-	copy = queue->list;
-	while (copy) 
+	fifos[0] = queue->priority;
+	fifos[1] = queue->normal;
+	for (i = 0; i < 2; i++)
 	{
-		QueueItem *item = copy->data;
+		GList *copy = fifos[i]->head;
 
-		if (queue->current != item)
+		while (copy) 
 		{
-			if (item && (item->flags & flags)) 
+			QueueItem *item = copy->data;
+
+			if (queue->current != item)
 			{
-				tny_debug ("TnyCamelQueue: %s 's performance is removed\n", item->name);
+				if (item && (item->flags & flags)) 
+				{
+					tny_debug ("TnyCamelQueue: %s 's performance is removed\n", item->name);
 
-				if (item->cancel_field)
-					*item->cancel_field = TRUE;
+					if (item->cancel_field)
+						*item->cancel_field = TRUE;
 
-				item->deleted = TRUE;
+					item->deleted = TRUE;
+				}
 			}
+			copy = g_list_next (copy);
 		}
-		copy = g_list_next (copy);
 	}
 	g_static_rec_mutex_unlock (queue->lock);
 }
@@ -418,35 +509,20 @@ _tny_camel_queue_launch_wflags (TnyCamelQueue *queue, GThreadFunc func, GSourceF
 	item->name = name;
 	item->cancel_field = cancel_field;
 	item->deleted = FALSE;
+	g_get_current_time (&item->launched);
 
 	g_static_rec_mutex_lock (queue->lock);
 
 	if (queue->account == NULL)
 		g_assert ("We should never be running tny_camel_queue_launch_wflags if account was unreferenced");
 
-	if (flags & TNY_CAMEL_QUEUE_PRIORITY_ITEM) 
-	{
-		/* Preserve the order for prioritized items */
-		gboolean stop = FALSE; gint cnt = 0;
-		GList *first = g_list_first (queue->list);
-		while (first && !stop) {
-			QueueItem *item = first->data;
-			if (item)
-				if (!(item->flags & TNY_CAMEL_QUEUE_PRIORITY_ITEM)) {
-					stop = TRUE;
-					cnt--;
-				}
-			cnt++;
-			first = g_list_next (first);
-		}
-		queue->list = g_list_insert (queue->list, item, cnt);
-	} else /* Normal items simply get appended */
-		queue->list = g_list_append (queue->list, item);
+	/* Prioritized items go before the normal ones, in their own order */
+	queue_push (queue, item);
 
 	/* If no next item is scheduled then we can go idle after finishing operation */
 	apriv = TNY_CAMEL_ACCOUNT_GET_PRIVATE (queue->account);
 	if (apriv->service)
-		camel_service_can_idle (apriv->service, !queue->list || !queue->list->next);
+		camel_service_can_idle (apriv->service, queue_length (queue) <= 1);
 
 	if (queue->stopped) 
 	{
@@ -499,32 +575,52 @@ _tny_camel_queue_launch (TnyCamelQueue *queue, GThreadFunc func, GSourceFunc cal
 	return;
 }
 
+/**
+ * _tny_camel_queue_has_items
+ * @queue: the queue
+ * @flags: flags
+ *
+ * Internal, non-public API documentation of Tinymail
+ *
+ * Whether there's an item in the queue, including the one that is being
+ * performed and the removed ones that didn't get their callback yet, that
+ * has one of @flags.
+ **/
 gboolean 
 _tny_camel_queue_has_items (TnyCamelQueue *queue, TnyCamelQueueItemFlags flags)
 {
-	GList *copy = NULL;
 	gboolean retval = FALSE;
+	gint i;
 
 	g_static_rec_mutex_lock (queue->lock);
-	copy = queue->list;
-	while (copy)
-	{
-		QueueItem *item = copy->data;
-
-		if (item && (item->flags & flags)) 
-		{
-			tny_debug ("TnyCamelQueue: %s found\n", item->name);
+	for (i = 0; i < TNY_CAMEL_QUEUE_ITEM_FLAG_COUNT && !retval; i++)
+		if ((flags & (1 << i)) && queue->flag_counts[i] > 0)
 			retval = TRUE;
-			break;
-		}
-		
-		copy = g_list_next (copy);
-	}
 	g_static_rec_mutex_unlock (queue->lock);
 
 	return retval;
 }
 
+/**
+ * _tny_camel_queue_get_stats
+ * @queue: the queue
+ * @stats: a #TnyCamelQueueStats to fill in
+ *
+ * Internal, non-public API documentation of Tinymail
+ *
+ * Get how many items are in @queue now and at most were, how many were
+ * launched, performed and cancelled, and how long the performed ones had
+ * to wait before they got their turn.
+ **/
+void
+_tny_camel_queue_get_stats (TnyCamelQueue *queue, TnyCamelQueueStats *stats)
+{
+	g_static_rec_mutex_lock (queue->lock);
+	*stats = queue->stats;
+	stats->depth = queue_length (queue);
+	g_static_rec_mutex_unlock (queue->lock);
+}
+
 static void 
 tny_camel_queue_class_init (TnyCamelQueueClass *class)
 {
@@ -549,7 +645,10 @@ tny_camel_queue_instance_init (GTypeInstance *instance, gpointer g_class)
 	self->condition = g_cond_new ();
 	self->account = NULL;
 	self->stopped = TRUE;
-	self->list = NULL;
+	self->priority = g_queue_new ();
+	self->normal = g_queue_new ();
+	memset (self->flag_counts, 0, sizeof (self->flag_counts));
+	memset (&self->stats, 0, sizeof (TnyCamelQueueStats));
 
 	/* We don't use a GThreadPool because we need control over the queued
 	 * items: we must remove them sometimes for example. */
@@ -35,6 +35,7 @@
 #include <camel/camel-store.h>
 #include <camel/camel.h>
 #include <camel/camel-session.h>
+#include <camel/camel-net-utils.h>
 
 #include <tny-session-camel.h>
 #include <tny-account.h>
@@ -901,6 +902,10 @@ tny_session_camel_connection_changed (TnyDevice *device, gboolean online, gpoint
 
 	camel_session_set_online ((CamelSession *) self, online); 
 
+	/* A new connection can have other name servers, or other answers */
+
+	camel_getaddrinfo_flush ();
+
 
 	/* As said, we can issue this signal. We can't issue when connecting 
 	 * actually finished: that's because all accounts register getting 
@@ -0,0 +1,238 @@
+/* tinymail - Tiny Mail unit test
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.	 See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with self library; if not, write to the
+ * Free Software Foundation, Inc., 51 Franklin Street, Fifth Floor,
+ * Boston, MA 02110-1301, USA.
+ */
+
+#include "check_libtinymail.h"
+
+#include <stdlib.h>
+#include <glib/gstdio.h>
+
+#include <camel/camel.h>
+#include <camel/camel-folder-summary.h>
+#include <camel/camel-mime-utils.h>
+
+/* Saves on many summaries while other threads read the subjects of their
+ * message infos. Every save remaps the summary file and points the infos
+ * into it, the readers must never see a string that isn't there anymore */
+
+#define NUM_SUMMARIES 8
+#define NUM_INITIAL 200
+#define NUM_ROUNDS 20
+#define NUM_PER_ROUND 10
+
+static CamelFolderSummary *summaries[NUM_SUMMARIES];
+static gchar *tmpdir = NULL;
+static volatile gint writers_running = 0;
+static volatile gint bad_reads = 0;
+static gchar *str;
+
+static void
+add_message (CamelFolderSummary *summary, gint nth)
+{
+	struct _camel_header_raw *headers = NULL;
+	gchar *subject, *uid;
+
+	subject = g_strdup_printf ("Subject %d", nth);
+	uid = g_strdup_printf ("%d", nth);
+
+	camel_header_raw_append (&headers, "Subject", subject, 0);
+	camel_header_raw_append (&headers, "From", "tinymail@example.org", 0);
+	camel_header_raw_append (&headers, "To", "test@example.org", 0);
+
+	camel_folder_summary_add_from_header (summary, headers, uid);
+
+	camel_header_raw_clear (&headers);
+	g_free (subject);
+	g_free (uid);
+}
+
+static void
+camel_folder_summary_test_setup (void)
+{
+	gint i, n;
+
+	tmpdir = g_strdup ("/tmp/tinymail-summary-test.XXXXXX");
+	if (mkdtemp (tmpdir) == NULL)
+		perror ("Creating temporary directory");
+
+	for (i = 0; i < NUM_SUMMARIES; i++) {
+		CamelException ex = CAMEL_EXCEPTION_INITIALISER;
+		gchar *path = g_strdup_printf ("%s/summary-%d", tmpdir, i);
+
+		summaries[i] = camel_folder_summary_new (NULL);
+		camel_folder_summary_set_filename (summaries[i], path);
+		g_free (path);
+
+		for (n = 0; n < NUM_INITIAL; n++)
+			add_message (summaries[i], n);
+
+		camel_folder_summary_save (summaries[i], &ex);
+	}
+
+	bad_reads = 0;
+	writers_running = 0;
+}
+
+static void
+camel_folder_summary_test_teardown (void)
+{
+	gint i;
+
+	for (i = 0; i < NUM_SUMMARIES; i++) {
+		gchar *path = g_strdup_printf ("%s/summary-%d", tmpdir, i);
+		gchar *uidx = g_strdup_printf ("%s.uidx", path);
+
+		camel_object_unref (summaries[i]);
+		g_unlink (path);
+		g_unlink (uidx);
+		g_free (path);
+		g_free (uidx);
+	}
+
+	g_rmdir (tmpdir);
+	g_free (tmpdir);
+}
+
+static gpointer
+writer_thread (gpointer data)
+{
+	CamelFolderSummary *summary = data;
+	gint round, n, next = NUM_INITIAL;
+
+	for (round = 0; round < NUM_ROUNDS; round++) {
+		CamelException ex = CAMEL_EXCEPTION_INITIALISER;
+
+		for (n = 0; n < NUM_PER_ROUND; n++)
+			add_message (summary, next++);
+
+		for (n = round; n < camel_folder_summary_count (summary); n += 7) {
+			CamelMessageInfo *info = camel_folder_summary_index (summary, n);
+
+			if (info) {
+				camel_message_info_set_flags (info, CAMEL_MESSAGE_SEEN,
+					(round % 2) ? CAMEL_MESSAGE_SEEN : 0);
+				camel_message_info_free (info);
+			}
+		}
+
+		/* Every few rounds an expunge, so that the file gets rewritten
+		 * instead of appended to */
+		if (round % 5 == 4)
+			camel_folder_summary_remove_index (summary, 0);
+
+		camel_folder_summary_save (summary, &ex);
+	}
+
+	g_atomic_int_add (&writers_running, -1);
+
+	return NULL;
+}
+
+static gpointer
+reader_thread (gpointer data)
+{
+	gint first = GPOINTER_TO_INT (data);
+
+	while (g_atomic_int_get (&writers_running) > 0) {
+		gint i, n;
+
+		/* Each reader walks all the summaries, not just its own */
+		for (i = 0; i < NUM_SUMMARIES; i++) {
+			CamelFolderSummary *summary = summaries[(first + i) % NUM_SUMMARIES];
+
+			for (n = 0; n < camel_folder_summary_count (summary); n++) {
+				CamelMessageInfo *info = camel_folder_summary_index (summary, n);
+				gchar *subject;
+
+				if (info == NULL)
+					continue;
+
+				camel_message_info_lock (info);
+				subject = g_strdup (camel_message_info_subject (info));
+				camel_message_info_unlock (info);
+
+				if (subject == NULL || !g_str_has_prefix (subject, "Subject "))
+					g_atomic_int_inc (&bad_reads);
+
+				g_free (subject);
+				camel_message_info_free (info);
+			}
+		}
+	}
+
+	return NULL;
+}
+
+START_TEST (camel_folder_summary_test_concurrent_save)
+{
+	GThread *writers[NUM_SUMMARIES], *readers[NUM_SUMMARIES];
+	gint i, expected;
+
+	g_atomic_int_set (&writers_running, NUM_SUMMARIES);
+
+	for (i = 0; i < NUM_SUMMARIES; i++)
+		writers[i] = g_thread_create (writer_thread, summaries[i], TRUE, NULL);
+	for (i = 0; i < NUM_SUMMARIES; i++)
+		readers[i] = g_thread_create (reader_thread, GINT_TO_POINTER (i), TRUE, NULL);
+
+	for (i = 0; i < NUM_SUMMARIES; i++)
+		g_thread_join (writers[i]);
+	for (i = 0; i < NUM_SUMMARIES; i++)
+		g_thread_join (readers[i]);
+
+	str = g_strdup_printf ("%d subjects were read while they weren't valid\n", bad_reads);
+	fail_unless (bad_reads == 0, str);
+	g_free (str);
+
+	expected = NUM_INITIAL + NUM_ROUNDS * NUM_PER_ROUND - NUM_ROUNDS / 5;
+
+	for (i = 0; i < NUM_SUMMARIES; i++) {
+		CamelFolderSummary *reloaded = camel_folder_summary_new (NULL);
+		gchar *path = g_strdup_printf ("%s/summary-%d", tmpdir, i);
+
+		str = g_strdup_printf ("Summary %d has %d messages in memory instead of %d\n",
+			i, camel_folder_summary_count (summaries[i]), expected);
+		fail_unless (camel_folder_summary_count (summaries[i]) == expected, str);
+		g_free (str);
+
+		camel_folder_summary_set_filename (reloaded, path);
+		camel_folder_summary_load (reloaded);
+
+		str = g_strdup_printf ("Summary %d has %d messages on disk instead of %d\n",
+			i, camel_folder_summary_count (reloaded), expected);
+		fail_unless (camel_folder_summary_count (reloaded) == expected, str);
+		g_free (str);
+
+		camel_object_unref (reloaded);
+		g_free (path);
+	}
+}
+END_TEST
+
+Suite *
+create_camel_folder_summary_suite (void)
+{
+     Suite *s = suite_create ("Folder summary");
+
+     TCase *tc = tcase_create ("Concurrent save");
+     tcase_set_timeout (tc, 120);
+     tcase_add_checked_fixture (tc, camel_folder_summary_test_setup, camel_folder_summary_test_teardown);
+     tcase_add_test (tc, camel_folder_summary_test_concurrent_save);
+     suite_add_tcase (s, tc);
+
+     return s;
+}
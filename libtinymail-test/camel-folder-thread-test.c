@@ -0,0 +1,286 @@
+/* tinymail - Tiny Mail unit test
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.	 See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with self library; if not, write to the
+ * Free Software Foundation, Inc., 51 Franklin Street, Fifth Floor,
+ * Boston, MA 02110-1301, USA.
+ */
+
+#include "check_libtinymail.h"
+
+#include <camel/camel.h>
+#include <camel/camel-folder-summary.h>
+#include <camel/camel-folder-thread.h>
+
+/* The incremental threading is tested with message infos that don't belong
+ * to a summary, their message id and parent id are small numbers. The tree
+ * is written out as a string like "a(b(c) e) d": the threads in the order
+ * they were started, each followed by its replies between parentheses, a
+ * node without a message (yet) is a "-" */
+
+static CamelFolderThread *thread = NULL;
+static gchar *str;
+
+static void
+add (const gchar *uid, guint64 id, guint64 parent)
+{
+	CamelMessageInfoBase *mi;
+	GPtrArray *infos;
+
+	mi = (CamelMessageInfoBase *) camel_message_info_new (NULL);
+	mi->flags |= CAMEL_MESSAGE_INFO_NEEDS_FREE;
+	mi->uid = g_strdup (uid);
+	mi->message_id.id.id = id;
+	mi->parent_id.id.id = parent;
+
+	infos = g_ptr_array_new ();
+	g_ptr_array_add (infos, mi);
+	camel_folder_thread_messages_add (thread, infos);
+	g_ptr_array_free (infos, TRUE);
+
+	/* the thread has its own reference */
+	camel_message_info_free (mi);
+}
+
+static void
+remove_uid (const gchar *uid)
+{
+	GPtrArray *uids = g_ptr_array_new ();
+
+	g_ptr_array_add (uids, (gpointer) uid);
+	camel_folder_thread_messages_remove (thread, uids);
+	g_ptr_array_free (uids, TRUE);
+}
+
+/* The lists have the newest first, so they are written from their end */
+static void
+append_nodes (GString *out, CamelFolderThreadNode *parent, CamelFolderThreadNode *node)
+{
+	CamelFolderThreadNode *last = node;
+
+	while (last && last->next) {
+		fail_unless (last->next->prev == last,
+			"The prev pointer of a node is wrong\n");
+		last = last->next;
+	}
+
+	for (node = last; node; node = node->prev) {
+		fail_unless (node->parent == parent,
+			"The parent pointer of a node is wrong\n");
+
+		if (node != last)
+			g_string_append_c (out, ' ');
+		g_string_append (out, node->message ?
+			camel_message_info_uid (node->message) : "-");
+
+		if (node->child) {
+			g_string_append_c (out, '(');
+			append_nodes (out, node, node->child);
+			g_string_append_c (out, ')');
+		}
+	}
+}
+
+static void
+check_tree (const gchar *what, const gchar *expected)
+{
+	GString *out = g_string_new ("");
+
+	fail_unless (thread->tree == NULL || thread->tree->prev == NULL,
+		"The first thread has a prev pointer\n");
+	append_nodes (out, NULL, thread->tree);
+
+	str = g_strdup_printf ("%s: the tree is \"%s\" instead of \"%s\"\n",
+		what, out->str, expected);
+	fail_unless (!strcmp (out->str, expected), str);
+	g_free (str);
+
+	g_string_free (out, TRUE);
+}
+
+/* Like in a threaded header view, nodes without a message don't count */
+static gint
+depth (const gchar *uid)
+{
+	CamelFolderThreadNode *node = camel_folder_thread_messages_lookup (thread, uid);
+	gint retval = 0;
+
+	if (!node)
+		return -1;
+
+	for (node = node->parent; node; node = node->parent)
+		if (node->message)
+			retval++;
+
+	return retval;
+}
+
+static void
+check_depth (const gchar *uid, gint expected)
+{
+	gint d = depth (uid);
+
+	str = g_strdup_printf ("%s is at depth %d instead of %d\n", uid, d, expected);
+	fail_unless (d == expected, str);
+	g_free (str);
+}
+
+static void
+camel_folder_thread_test_setup (void)
+{
+	GPtrArray *none = g_ptr_array_new ();
+
+	thread = camel_folder_thread_messages_new_summary (none);
+	g_ptr_array_free (none, TRUE);
+}
+
+static void
+camel_folder_thread_test_teardown (void)
+{
+	camel_folder_thread_messages_unref (thread);
+	thread = NULL;
+}
+
+START_TEST (camel_folder_thread_test_add)
+{
+	add ("a", 1, 0);
+	add ("b", 2, 1);
+	add ("c", 3, 2);
+	add ("d", 4, 0);
+	add ("e", 5, 1);
+	check_tree ("In order", "a(b(c) e) d");
+
+	check_depth ("a", 0);
+	check_depth ("b", 1);
+	check_depth ("c", 2);
+	check_depth ("d", 0);
+	check_depth ("e", 1);
+
+	/* a uid that is in the thread already is skipped */
+	add ("b", 6, 4);
+	check_tree ("Added twice", "a(b(c) e) d");
+}
+END_TEST
+
+/* Replies that arrive before what they reply to wait in an empty node */
+START_TEST (camel_folder_thread_test_add_reversed)
+{
+	add ("c", 3, 2);
+	check_tree ("Reply without parent", "-(c)");
+	check_depth ("c", 0);
+
+	add ("b", 2, 1);
+	check_tree ("Reply to a missing reply", "-(b(c))");
+	check_depth ("c", 1);
+
+	add ("a", 1, 0);
+	check_tree ("Complete", "a(b(c))");
+	check_depth ("a", 0);
+	check_depth ("b", 1);
+	check_depth ("c", 2);
+}
+END_TEST
+
+START_TEST (camel_folder_thread_test_remove)
+{
+	add ("a", 1, 0);
+	add ("b", 2, 1);
+	add ("c", 3, 2);
+	add ("d", 4, 0);
+
+	/* b has an id, so its node stays for c */
+	remove_uid ("b");
+	check_tree ("Removed a message with replies", "a(-(c)) d");
+	fail_unless (camel_folder_thread_messages_lookup (thread, "b") == NULL,
+		"A removed message is still found\n");
+	check_depth ("c", 1);
+
+	/* and goes once c is gone too */
+	remove_uid ("c");
+	check_tree ("Removed the last reply", "a d");
+
+	remove_uid ("d");
+	check_tree ("Removed a thread", "a");
+
+	/* unknown uids are ignored */
+	remove_uid ("x");
+	check_tree ("Removed an unknown uid", "a");
+
+	remove_uid ("a");
+	check_tree ("Removed all", "");
+}
+END_TEST
+
+/* A message that comes back fills its old node, the replies stay */
+START_TEST (camel_folder_thread_test_relink)
+{
+	add ("a", 1, 0);
+	add ("b", 2, 1);
+	remove_uid ("a");
+	check_tree ("Removed the root", "-(b)");
+	check_depth ("b", 0);
+
+	add ("a2", 1, 0);
+	check_tree ("Root came back", "a2(b)");
+	check_depth ("b", 1);
+}
+END_TEST
+
+START_TEST (camel_folder_thread_test_duplicates)
+{
+	add ("a", 1, 0);
+	add ("b", 2, 1);
+
+	/* the second message with the same id can't have replies */
+	add ("a2", 1, 0);
+	check_tree ("Duplicate id", "a(b) a2");
+
+	remove_uid ("a");
+	check_tree ("Removed the first of the duplicates", "-(b) a2");
+	remove_uid ("a2");
+	check_tree ("Removed the second of the duplicates", "-(b)");
+}
+END_TEST
+
+/* Messages that claim to reply to each other must not make a loop */
+START_TEST (camel_folder_thread_test_loop)
+{
+	add ("x", 5, 6);
+	add ("y", 6, 5);
+	check_tree ("Loop", "y(x)");
+	check_depth ("y", 0);
+	check_depth ("x", 1);
+
+	/* a message that replies to itself is a thread on its own */
+	add ("z", 7, 7);
+	check_tree ("Reply to itself", "y(x) z");
+}
+END_TEST
+
+Suite *
+create_camel_folder_thread_suite (void)
+{
+     Suite *s = suite_create ("Folder thread");
+
+     TCase *tc = tcase_create ("Incremental");
+     tcase_add_checked_fixture (tc, camel_folder_thread_test_setup, camel_folder_thread_test_teardown);
+     tcase_add_test (tc, camel_folder_thread_test_add);
+     tcase_add_test (tc, camel_folder_thread_test_add_reversed);
+     tcase_add_test (tc, camel_folder_thread_test_remove);
+     tcase_add_test (tc, camel_folder_thread_test_relink);
+     tcase_add_test (tc, camel_folder_thread_test_duplicates);
+     tcase_add_test (tc, camel_folder_thread_test_loop);
+     suite_add_tcase (s, tc);
+
+     return s;
+}
@@ -0,0 +1,279 @@
+/* tinymail - Tiny Mail unit test
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.	 See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with self library; if not, write to the
+ * Free Software Foundation, Inc., 51 Franklin Street, Fifth Floor,
+ * Boston, MA 02110-1301, USA.
+ */
+
+#include "check_libtinymail.h"
+
+#include <camel/camel.h>
+#include <camel/camel-folder-summary.h>
+
+#include "camel-imap-summary.h"
+#include "camel-imap-utils.h"
+
+/* FETCH responses the way camel_imap_command_response leaves them: the
+ * CRLF of literals turned into LF, the literal inlined. The parser points
+ * into the response, so besides what it finds, it must never read past
+ * the end of a truncated one */
+
+#define MAX_PARTS 4
+
+static gchar *str;
+
+typedef struct {
+	const gchar *response;
+	gboolean ok;
+	guint32 fields;
+	guint32 seq;
+	const gchar *uid;
+	guint32 flags;
+	guint32 size;
+	const gchar *idate;
+	const gchar *body;
+	guint64 modseq;
+	/* spec, data pairs of the BODY[...] parts, in order */
+	const gchar *parts[MAX_PARTS * 2];
+} FetchCase;
+
+static const FetchCase cases[] = {
+	{ "* 1 FETCH (UID 42 FLAGS (\\Seen \\Flagged) RFC822.SIZE 1234)", TRUE,
+	  IMAP_FETCH_SEQUENCE | IMAP_FETCH_UID | IMAP_FETCH_FLAGS | IMAP_FETCH_RFC822_SIZE,
+	  1, "42", CAMEL_MESSAGE_SEEN | CAMEL_MESSAGE_FLAGGED, 1234 },
+	{ "(UID 7 FLAGS ())", TRUE,
+	  IMAP_FETCH_UID | IMAP_FETCH_FLAGS, 0, "7" },
+	{ "* 3 fetch (uid 8 flags (\\Deleted))", TRUE,
+	  IMAP_FETCH_SEQUENCE | IMAP_FETCH_UID | IMAP_FETCH_FLAGS,
+	  3, "8", CAMEL_MESSAGE_DELETED },
+	{ "* 4 FETCH (UID 9 INTERNALDATE \"17-Jul-1996 02:44:25 -0700\")", TRUE,
+	  IMAP_FETCH_SEQUENCE | IMAP_FETCH_UID | IMAP_FETCH_INTERNALDATE,
+	  4, "9", 0, 0, "17-Jul-1996 02:44:25 -0700" },
+	{ "* 5 FETCH (UID 10 MODSEQ (12345678901))", TRUE,
+	  IMAP_FETCH_SEQUENCE | IMAP_FETCH_UID | IMAP_FETCH_MODSEQ,
+	  5, "10", 0, 0, NULL, NULL, G_GUINT64_CONSTANT (12345678901) },
+	{ "* 6 FETCH (UID 11 BODYSTRUCTURE (\"TEXT\" \"PLAIN\" (\"CHARSET\" \"us-ascii\") NIL NIL \"7BIT\" 3 1 NIL NIL NIL))", TRUE,
+	  IMAP_FETCH_SEQUENCE | IMAP_FETCH_UID | IMAP_FETCH_BODY,
+	  6, "11", 0, 0, NULL,
+	  "(\"TEXT\" \"PLAIN\" (\"CHARSET\" \"us-ascii\") NIL NIL \"7BIT\" 3 1 NIL NIL NIL)" },
+
+	/* Literals, quoted strings and NIL as part data */
+	{ "* 7 FETCH (UID 12 BODY[HEADER] {12}\nSubject: x\n\n)", TRUE,
+	  IMAP_FETCH_SEQUENCE | IMAP_FETCH_UID | IMAP_FETCH_BODY_PART,
+	  7, "12", 0, 0, NULL, NULL, 0,
+	  { "HEADER", "Subject: x\n\n" } },
+	{ "* 8 FETCH (BODY[1] {5}\n(a) \" UID 13)", TRUE,
+	  IMAP_FETCH_SEQUENCE | IMAP_FETCH_UID | IMAP_FETCH_BODY_PART,
+	  8, "13", 0, 0, NULL, NULL, 0,
+	  { "1", "(a) \"" } },
+	{ "* 9 FETCH (UID 14 BODY[1] \"a \\\"quoted\\\" part\")", TRUE,
+	  IMAP_FETCH_SEQUENCE | IMAP_FETCH_UID | IMAP_FETCH_BODY_PART,
+	  9, "14", 0, 0, NULL, NULL, 0,
+	  { "1", "a \"quoted\" part" } },
+	{ "* 10 FETCH (UID 15 BODY[2] NIL)", TRUE,
+	  IMAP_FETCH_SEQUENCE | IMAP_FETCH_UID | IMAP_FETCH_BODY_PART,
+	  10, "15", 0, 0, NULL, NULL, 0,
+	  { "2", "" } },
+	{ "* 11 FETCH (UID 16 RFC822 {3}\nabc)", TRUE,
+	  IMAP_FETCH_SEQUENCE | IMAP_FETCH_UID | IMAP_FETCH_BODY_PART,
+	  11, "16", 0, 0, NULL, NULL, 0,
+	  { "", "abc" } },
+
+	/* More than one part in one response */
+	{ "* 12 FETCH (UID 17 BODYSTRUCTURE (\"TEXT\" \"PLAIN\" NIL NIL NIL \"7BIT\" 3 1) "
+	  "BODY[1.HEADER] {3}\nabc BODY[2.HEADER] \"de\" "
+	  "BODY[HEADER.FIELDS (Subject)] {4}\nf)]i)", TRUE,
+	  IMAP_FETCH_SEQUENCE | IMAP_FETCH_UID | IMAP_FETCH_BODY | IMAP_FETCH_BODY_PART,
+	  12, "17", 0, 0, NULL,
+	  "(\"TEXT\" \"PLAIN\" NIL NIL NIL \"7BIT\" 3 1)", 0,
+	  { "1.HEADER", "abc", "2.HEADER", "de", "HEADER.FIELDS (Subject)", "f)]i" } },
+
+	/* Not a FETCH response */
+	{ "", FALSE },
+	{ "garbage", FALSE },
+	{ "* 1 EXISTS", FALSE },
+	{ "* 0 FETCH (UID 1)", FALSE },
+	{ "* 1 FETCH UID 1", FALSE },
+	{ "* 1 FETCH (X-UNKNOWN 1)", FALSE },
+
+	/* Truncated or broken */
+	{ "* 1 FETCH (", FALSE },
+	{ "* 1 FETCH (UID 42", FALSE },
+	{ "* 1 FETCH (UID 42 ", FALSE },
+	{ "* 1 FETCH (FLAGS (\\Seen)", FALSE },
+	{ "* 1 FETCH (FLAGS (\\Seen", FALSE },
+	{ "* 1 FETCH (RFC822.SIZE 12", FALSE },
+	{ "* 1 FETCH (INTERNALDATE \"17-Jul-1996", FALSE },
+	{ "* 1 FETCH (MODSEQ (123", FALSE },
+	{ "* 1 FETCH (BODYSTRUCTURE (\"TEXT\" \"PLAIN\"", FALSE },
+	{ "* 1 FETCH (BODYSTRUCTURE (\"TEXT", FALSE },
+	{ "* 1 FETCH (BODY[1 {3}\nabc)", FALSE },
+	{ "* 1 FETCH (BODY[1]{3}\nabc)", FALSE },
+	{ "* 1 FETCH (BODY[1] {100}\nshort)", FALSE },
+	{ "* 1 FETCH (BODY[1] {3}abc)", FALSE },
+	{ "* 1 FETCH (BODY[1] {3}\nabc", FALSE },
+	{ "* 1 FETCH (BODY[1] {x}\nabc)", FALSE },
+	{ "* 1 FETCH (BODY[1] \"abc)", FALSE },
+	{ "* 1 FETCH (BODY[1] \"abc\\", FALSE },
+	{ "* 1 FETCH (BODY[1] \"ab\nc\")", FALSE },
+	{ "* 1 FETCH (BODY[1] NIL", FALSE },
+	{ "* 1 FETCH (BODY[1] garbage)", FALSE },
+};
+
+typedef struct {
+	gint count;
+	gchar *specs[MAX_PARTS];
+	gchar *data[MAX_PARTS];
+} PartsSeen;
+
+static void
+collect_part (CamelImapFetchRecord *record, gpointer user_data)
+{
+	PartsSeen *seen = user_data;
+	const char *part;
+	char *to_free;
+	size_t len;
+
+	if (seen->count < MAX_PARTS) {
+		part = imap_fetch_record_part (record, &len, &to_free);
+		seen->specs[seen->count] = g_strndup (record->part_spec, record->part_spec_len);
+		seen->data[seen->count] = g_strndup (part, len);
+		g_free (to_free);
+	}
+
+	seen->count++;
+}
+
+static void
+check_string (gint i, const gchar *what, const gchar *expected, const char *found, size_t len)
+{
+	str = g_strdup_printf ("Case %d: %s is '%.*s' instead of '%s'\n", i, what,
+		found ? (int) len : 4, found ? found : "NULL", expected);
+	fail_unless (found != NULL && len == strlen (expected) &&
+		strncmp (found, expected, len) == 0, str);
+	g_free (str);
+}
+
+START_TEST (camel_imap_utils_test_parse_fetch_record)
+{
+	gint i, n;
+
+	for (i = 0; i < G_N_ELEMENTS (cases); i++) {
+		const FetchCase *c = &cases[i];
+		CamelImapFetchRecord record;
+		PartsSeen seen;
+		gboolean ok;
+		gchar *response;
+
+		/* A copy of exactly the right size, so that reading past the
+		 * end shows up with valgrind */
+		response = g_strdup (c->response);
+		memset (&seen, 0, sizeof (seen));
+
+		ok = imap_parse_fetch_record_parts (response, &record, collect_part, &seen);
+
+		str = g_strdup_printf ("Case %d: '%s' was %s\n", i, c->response,
+			ok ? "accepted" : "rejected");
+		fail_unless (ok == c->ok, str);
+		g_free (str);
+
+		/* The plain variant must agree */
+		fail_unless (imap_parse_fetch_record (response, &record) == ok,
+			"imap_parse_fetch_record and imap_parse_fetch_record_parts disagree\n");
+
+		if (ok) {
+			str = g_strdup_printf ("Case %d: fields are 0x%x instead of 0x%x\n",
+				i, record.fields, c->fields);
+			fail_unless (record.fields == c->fields, str);
+			g_free (str);
+
+			if (c->fields & IMAP_FETCH_SEQUENCE)
+				fail_unless (record.seq == c->seq, "Wrong sequence number\n");
+			if (c->uid) {
+				check_string (i, "the uid", c->uid, record.uid, record.uid_len);
+				fail_unless (imap_fetch_record_uid_equal (&record, c->uid),
+					"imap_fetch_record_uid_equal doesn't match the uid\n");
+			}
+			if (c->fields & IMAP_FETCH_FLAGS)
+				fail_unless (record.flags == c->flags, "Wrong flags\n");
+			if (c->fields & IMAP_FETCH_RFC822_SIZE)
+				fail_unless (record.size == c->size, "Wrong size\n");
+			if (c->idate)
+				check_string (i, "the date", c->idate, record.idate, record.idate_len);
+			if (c->body)
+				check_string (i, "the structure", c->body, record.body, record.body_len);
+			if (c->fields & IMAP_FETCH_MODSEQ)
+				fail_unless (record.modseq == c->modseq, "Wrong modseq\n");
+
+			for (n = 0; n < MAX_PARTS && c->parts[n * 2]; n++) {
+				fail_unless (n < seen.count, "A part was not passed to the callback\n");
+				check_string (i, "the part spec", c->parts[n * 2],
+					seen.specs[n], strlen (seen.specs[n]));
+				check_string (i, "the part", c->parts[n * 2 + 1],
+					seen.data[n], strlen (seen.data[n]));
+			}
+
+			str = g_strdup_printf ("Case %d: the callback saw %d parts instead of %d\n",
+				i, seen.count, n);
+			fail_unless (seen.count == n, str);
+			g_free (str);
+		}
+
+		for (n = 0; n < MIN (seen.count, MAX_PARTS); n++) {
+			g_free (seen.specs[n]);
+			g_free (seen.data[n]);
+		}
+		g_free (response);
+	}
+}
+END_TEST
+
+/* Whether the BODY[...] is (all of) the header decides whether it's cached
+ * as the message's header */
+START_TEST (camel_imap_utils_test_fetch_record_header)
+{
+	CamelImapFetchRecord record;
+
+	fail_unless (imap_parse_fetch_record ("* 1 FETCH (BODY[HEADER] {1}\na)", &record),
+		"BODY[HEADER] was rejected\n");
+	fail_unless (record.header && record.cache_header,
+		"BODY[HEADER] is not the complete header\n");
+
+	fail_unless (imap_parse_fetch_record ("* 1 FETCH (BODY[HEADER.FIELDS (Subject)] {1}\na)", &record),
+		"BODY[HEADER.FIELDS] was rejected\n");
+	fail_unless (record.header && !record.cache_header,
+		"BODY[HEADER.FIELDS] is taken for the complete header\n");
+
+	fail_unless (imap_parse_fetch_record ("* 1 FETCH (BODY[0] {1}\na)", &record),
+		"BODY[0] was rejected\n");
+	fail_unless (record.header, "BODY[0] is not a header\n");
+
+	fail_unless (imap_parse_fetch_record ("* 1 FETCH (BODY[1] {1}\na)", &record),
+		"BODY[1] was rejected\n");
+	fail_unless (!record.header, "BODY[1] is taken for a header\n");
+}
+END_TEST
+
+Suite *
+create_camel_imap_utils_suite (void)
+{
+     Suite *s = suite_create ("IMAP utils");
+
+     TCase *tc = tcase_create ("Parse FETCH responses");
+     tcase_add_test (tc, camel_imap_utils_test_parse_fetch_record);
+     tcase_add_test (tc, camel_imap_utils_test_fetch_record_header);
+     suite_add_tcase (s, tc);
+
+     return s;
+}
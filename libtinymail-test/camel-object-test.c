@@ -0,0 +1,201 @@
+/* tinymail - Tiny Mail unit test
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.	 See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with self library; if not, write to the
+ * Free Software Foundation, Inc., 51 Franklin Street, Fifth Floor,
+ * Boston, MA 02110-1301, USA.
+ */
+
+#include "check_libtinymail.h"
+
+#include <stdio.h>
+
+#include <camel/camel.h>
+#include <camel/camel-object.h>
+#include <camel/camel-folder-summary.h>
+#include <camel/camel-mime-utils.h>
+
+/* Many threads take and drop references on the same objects. The counts
+ * must end up where they started, and the throughput for each number of
+ * threads is printed so that lock contention shows up as a drop */
+
+#define MAX_THREADS 8
+#define NUM_REFS 200000
+#define NUM_BAG_ROUNDS 20000
+
+static CamelObject *object = NULL;
+static CamelFolderSummary *summary = NULL;
+static CamelMessageInfo *info = NULL;
+static CamelObjectBag *bag = NULL;
+static volatile gint bad_lookups = 0;
+static gchar *str;
+
+static void
+camel_object_test_setup (void)
+{
+	struct _camel_header_raw *headers = NULL;
+
+	object = camel_object_new (camel_object_get_type ());
+
+	summary = camel_folder_summary_new (NULL);
+	camel_header_raw_append (&headers, "Subject", "Refcount", 0);
+	camel_folder_summary_add_from_header (summary, headers, "1");
+	camel_header_raw_clear (&headers);
+	info = camel_folder_summary_index (summary, 0);
+
+	bag = camel_object_bag_new (g_str_hash, g_str_equal,
+		(CamelCopyFunc) g_strdup, g_free);
+	bad_lookups = 0;
+}
+
+static void
+camel_object_test_teardown (void)
+{
+	camel_object_bag_destroy (bag);
+	camel_message_info_free (info);
+	camel_object_unref (summary);
+	camel_object_unref (object);
+}
+
+static gpointer
+object_ref_thread (gpointer data)
+{
+	gint i;
+
+	for (i = 0; i < NUM_REFS; i++) {
+		camel_object_ref (object);
+		camel_object_unref (object);
+	}
+
+	return NULL;
+}
+
+static gpointer
+info_ref_thread (gpointer data)
+{
+	gint i;
+
+	for (i = 0; i < NUM_REFS; i++) {
+		camel_message_info_ref (info);
+		camel_message_info_free (info);
+	}
+
+	return NULL;
+}
+
+/* Keeps creating the one object of the bag and dropping it again, so that
+ * lookups race with the last unref of whoever had it before */
+static gpointer
+bag_thread (gpointer data)
+{
+	gint i;
+
+	for (i = 0; i < NUM_BAG_ROUNDS; i++) {
+		CamelObject *o = camel_object_bag_reserve (bag, "key");
+
+		if (o == NULL) {
+			o = camel_object_new (camel_object_get_type ());
+			camel_object_bag_add (bag, "key", o);
+		} else if (o->ref_count < 1 || (o->flags & CAMEL_OBJECT_DESTROY))
+			g_atomic_int_inc (&bad_lookups);
+
+		camel_object_unref (o);
+	}
+
+	return NULL;
+}
+
+static gdouble
+run_threads (GThreadFunc func, gint count)
+{
+	GThread *threads[MAX_THREADS];
+	GTimer *timer = g_timer_new ();
+	gdouble elapsed;
+	gint i;
+
+	for (i = 0; i < count; i++)
+		threads[i] = g_thread_create (func, NULL, TRUE, NULL);
+	for (i = 0; i < count; i++)
+		g_thread_join (threads[i]);
+
+	elapsed = g_timer_elapsed (timer, NULL);
+	g_timer_destroy (timer);
+
+	return elapsed;
+}
+
+static void
+benchmark (const gchar *what, GThreadFunc func)
+{
+	gint count;
+
+	for (count = 1; count <= MAX_THREADS; count *= 2) {
+		gdouble elapsed = run_threads (func, count);
+
+		printf ("%s: %d threads, %.0f ref/unref pairs per second\n", what,
+			count, elapsed > 0 ? (count * NUM_REFS) / elapsed : 0);
+	}
+}
+
+START_TEST (camel_object_test_concurrent_ref)
+{
+	benchmark ("CamelObject", object_ref_thread);
+
+	str = g_strdup_printf ("The object ended with %d references instead of 1\n",
+		object->ref_count);
+	fail_unless (object->ref_count == 1, str);
+	g_free (str);
+}
+END_TEST
+
+START_TEST (camel_object_test_concurrent_info_ref)
+{
+	benchmark ("CamelMessageInfo", info_ref_thread);
+
+	/* one for the summary, one for the test */
+	str = g_strdup_printf ("The info ended with %d references instead of 2\n",
+		info->refcount);
+	fail_unless (info->refcount == 2, str);
+	g_free (str);
+}
+END_TEST
+
+START_TEST (camel_object_test_bag_last_unref)
+{
+	run_threads (bag_thread, MAX_THREADS);
+
+	str = g_strdup_printf ("%d bag lookups returned an object that was being finalized\n",
+		bad_lookups);
+	fail_unless (bad_lookups == 0, str);
+	g_free (str);
+
+	fail_unless (camel_object_bag_peek (bag, "key") == NULL,
+		"The bag still has an object after the last unref\n");
+}
+END_TEST
+
+Suite *
+create_camel_object_suite (void)
+{
+     Suite *s = suite_create ("Object");
+
+     TCase *tc = tcase_create ("Concurrent reference counting");
+     tcase_set_timeout (tc, 120);
+     tcase_add_checked_fixture (tc, camel_object_test_setup, camel_object_test_teardown);
+     tcase_add_test (tc, camel_object_test_concurrent_ref);
+     tcase_add_test (tc, camel_object_test_concurrent_info_ref);
+     tcase_add_test (tc, camel_object_test_bag_last_unref);
+     suite_add_tcase (s, tc);
+
+     return s;
+}
@@ -0,0 +1,281 @@
+/* tinymail - Tiny Mail unit test
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.	 See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with self library; if not, write to the
+ * Free Software Foundation, Inc., 51 Franklin Street, Fifth Floor,
+ * Boston, MA 02110-1301, USA.
+ */
+
+#include "check_libtinymail.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <glib/gstdio.h>
+
+#include <camel/camel.h>
+#include <camel/camel-folder-summary.h>
+#include <camel/camel-uid-table.h>
+
+/* The table is tested against a bare array of message infos, the way a
+ * summary uses it: every change to the array is announced to the table
+ * first, lookups must always agree with a linear search */
+
+#define NUM_MESSAGES 500
+
+static GPtrArray *messages = NULL;
+static CamelUIDTable *table = NULL;
+static gchar *str;
+
+static CamelMessageInfo *
+info_new (const gchar *uid)
+{
+	CamelMessageInfo *info = g_new0 (CamelMessageInfo, 1);
+
+	info->uid = g_strdup (uid);
+
+	return info;
+}
+
+static void
+info_free (CamelMessageInfo *info)
+{
+	g_free (info->uid);
+	g_free (info);
+}
+
+static void
+append (const gchar *uid)
+{
+	g_ptr_array_add (messages, info_new (uid));
+	camel_uid_table_append (table, messages, messages->len - 1);
+}
+
+static void
+remove_index (guint index)
+{
+	CamelMessageInfo *info = messages->pdata[index];
+
+	camel_uid_table_remove (table, messages, index);
+	g_ptr_array_remove_index (messages, index);
+	info_free (info);
+}
+
+static void
+fill (const gchar *format)
+{
+	gint i;
+
+	for (i = 0; i < NUM_MESSAGES; i++) {
+		gchar *uid = g_strdup_printf (format, i + 1);
+		g_ptr_array_add (messages, info_new (uid));
+		g_free (uid);
+	}
+}
+
+/* Every uid in the array must be found at its own index */
+static void
+check_all (const gchar *what)
+{
+	guint i;
+
+	for (i = 0; i < messages->len; i++) {
+		const gchar *uid = ((CamelMessageInfo *) messages->pdata[i])->uid;
+		gint idx = camel_uid_table_lookup (table, messages, uid);
+
+		str = g_strdup_printf ("%s: %s was found at %d instead of %d\n",
+			what, uid, idx, i);
+		fail_unless (idx == (gint) i, str);
+		g_free (str);
+	}
+}
+
+static void
+camel_uid_table_test_setup (void)
+{
+	messages = g_ptr_array_new ();
+	table = camel_uid_table_new ();
+}
+
+static void
+camel_uid_table_test_teardown (void)
+{
+	guint i;
+
+	for (i = 0; i < messages->len; i++)
+		info_free (messages->pdata[i]);
+	g_ptr_array_free (messages, TRUE);
+	camel_uid_table_free (table);
+}
+
+START_TEST (camel_uid_table_test_numeric)
+{
+	fill ("%d");
+
+	fail_unless (camel_uid_table_build (table, messages),
+		"Building the table failed\n");
+	check_all ("Numeric after build");
+
+	append ("1000");
+	append ("1001");
+	check_all ("Numeric after append");
+
+	fail_unless (camel_uid_table_lookup (table, messages, "0") == -1,
+		"A uid that was never added was found\n");
+	fail_unless (camel_uid_table_lookup (table, messages, "007") == -1,
+		"A uid that isn't canonical was found\n");
+}
+END_TEST
+
+START_TEST (camel_uid_table_test_hashed)
+{
+	fill ("uidl-%d");
+
+	fail_unless (camel_uid_table_build (table, messages),
+		"Building the table failed\n");
+	check_all ("Hashed after build");
+
+	/* Enough to make the table grow */
+	append ("uidl-new-1");
+	append ("uidl-new-2");
+	check_all ("Hashed after append");
+
+	fail_unless (camel_uid_table_lookup (table, messages, "uidl-0") == -1,
+		"A uid that was never added was found\n");
+}
+END_TEST
+
+START_TEST (camel_uid_table_test_remove)
+{
+	const gchar *formats[] = { "%d", "uidl-%d" };
+	gint f;
+
+	for (f = 0; f < G_N_ELEMENTS (formats); f++) {
+		gchar *first, *middle, *last;
+
+		fill (formats[f]);
+		camel_uid_table_build (table, messages);
+
+		first = g_strdup (((CamelMessageInfo *) messages->pdata[0])->uid);
+		middle = g_strdup (((CamelMessageInfo *) messages->pdata[NUM_MESSAGES / 2])->uid);
+		last = g_strdup (((CamelMessageInfo *) messages->pdata[NUM_MESSAGES - 1])->uid);
+
+		remove_index (NUM_MESSAGES - 1);
+		remove_index (NUM_MESSAGES / 2);
+		remove_index (0);
+		check_all (formats[f]);
+
+		fail_unless (camel_uid_table_lookup (table, messages, first) == -1,
+			"The first uid is still found after its removal\n");
+		fail_unless (camel_uid_table_lookup (table, messages, middle) == -1,
+			"A uid in the middle is still found after its removal\n");
+		fail_unless (camel_uid_table_lookup (table, messages, last) == -1,
+			"The last uid is still found after its removal\n");
+
+		g_free (first);
+		g_free (middle);
+		g_free (last);
+
+		while (messages->len > 0)
+			remove_index (0);
+	}
+}
+END_TEST
+
+/* Changes that the table wasn't told about must end in a rebuild, never in
+ * a uid that is there but isn't found */
+START_TEST (camel_uid_table_test_stale)
+{
+	const gchar *formats[] = { "%d", "uidl-%d" };
+	gint f;
+
+	for (f = 0; f < G_N_ELEMENTS (formats); f++) {
+		gpointer tmp;
+
+		fill (formats[f]);
+		camel_uid_table_build (table, messages);
+
+		tmp = messages->pdata[10];
+		messages->pdata[10] = messages->pdata[20];
+		messages->pdata[20] = tmp;
+		check_all (formats[f]);
+
+		while (messages->len > 0) {
+			info_free (messages->pdata[0]);
+			g_ptr_array_remove_index (messages, 0);
+		}
+		camel_uid_table_invalidate (table);
+	}
+}
+END_TEST
+
+START_TEST (camel_uid_table_test_persist)
+{
+	gchar *tmpdir, *path, *uidx;
+	FILE *f;
+
+	tmpdir = g_strdup ("/tmp/tinymail-uid-table-test.XXXXXX");
+	if (mkdtemp (tmpdir) == NULL)
+		perror ("Creating temporary directory");
+	path = g_strdup_printf ("%s/summary", tmpdir);
+	uidx = g_strdup_printf ("%s.uidx", path);
+
+	/* The table only cares about the size and mtime of the summary */
+	f = g_fopen (path, "w");
+	fputs ("summary", f);
+	fclose (f);
+
+	fill ("uidl-%d");
+	fail_unless (camel_uid_table_save (table, messages, path) == 0,
+		"Saving the table failed\n");
+
+	camel_uid_table_free (table);
+	table = camel_uid_table_new ();
+	fail_unless (camel_uid_table_load (table, messages, path),
+		"The saved table didn't load\n");
+	check_all ("Hashed after load");
+
+	remove_index (5);
+	check_all ("Hashed after a removal from a loaded table");
+
+	/* The summary changed, the table must not be used anymore */
+	f = g_fopen (path, "a");
+	fputs ("changed", f);
+	fclose (f);
+	fail_unless (!camel_uid_table_load (table, messages, path),
+		"A table of an older summary was loaded\n");
+
+	g_unlink (uidx);
+	g_unlink (path);
+	g_rmdir (tmpdir);
+	g_free (uidx);
+	g_free (path);
+	g_free (tmpdir);
+}
+END_TEST
+
+Suite *
+create_camel_uid_table_suite (void)
+{
+     Suite *s = suite_create ("UID table");
+
+     TCase *tc = tcase_create ("Lookups");
+     tcase_add_checked_fixture (tc, camel_uid_table_test_setup, camel_uid_table_test_teardown);
+     tcase_add_test (tc, camel_uid_table_test_numeric);
+     tcase_add_test (tc, camel_uid_table_test_hashed);
+     tcase_add_test (tc, camel_uid_table_test_remove);
+     tcase_add_test (tc, camel_uid_table_test_stale);
+     tcase_add_test (tc, camel_uid_table_test_persist);
+     suite_add_tcase (s, tc);
+
+     return s;
+}
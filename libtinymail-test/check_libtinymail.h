@@ -5,8 +5,16 @@
 #include <glib.h>
 #include <check.h>
 
+Suite *create_camel_folder_summary_suite (void);
+Suite *create_camel_folder_thread_suite (void);
+Suite *create_camel_imap_utils_suite (void);
+Suite *create_camel_object_suite (void);
+Suite *create_camel_uid_table_suite (void);
 Suite *create_tny_account_store_suite (void);
 Suite *create_tny_account_suite (void);
+Suite *create_tny_camel_header_list_suite (void);
+Suite *create_tny_camel_prefetch_policy_suite (void);
+Suite *create_tny_camel_queue_suite (void);
 Suite *create_tny_device_suite (void);
 Suite *create_tny_folder_store_query_suite (void);
 Suite *create_tny_folder_store_suite (void);
@@ -17,6 +17,9 @@ main (void)
      sr = srunner_create (NULL);
      srunner_add_suite (sr, (Suite *) create_tny_account_store_suite ());
      srunner_add_suite (sr, (Suite *) create_tny_account_suite ());
+     srunner_add_suite (sr, (Suite *) create_tny_camel_header_list_suite ());
+     srunner_add_suite (sr, (Suite *) create_tny_camel_prefetch_policy_suite ());
+     srunner_add_suite (sr, (Suite *) create_tny_camel_queue_suite ());
      srunner_add_suite (sr, (Suite *) create_tny_device_suite ());
      srunner_add_suite (sr, (Suite *) create_tny_folder_store_query_suite ());
      srunner_add_suite (sr, (Suite *) create_tny_folder_store_suite ());
@@ -26,6 +29,11 @@ main (void)
      srunner_add_suite (sr, (Suite *) create_tny_mime_part_suite ());
      srunner_add_suite (sr, (Suite *) create_tny_msg_suite ());
      srunner_add_suite (sr, (Suite *) create_tny_stream_suite ());
+     srunner_add_suite (sr, (Suite *) create_camel_folder_summary_suite ());
+     srunner_add_suite (sr, (Suite *) create_camel_folder_thread_suite ());
+     srunner_add_suite (sr, (Suite *) create_camel_object_suite ());
+     srunner_add_suite (sr, (Suite *) create_camel_uid_table_suite ());
+     srunner_add_suite (sr, (Suite *) create_camel_imap_utils_suite ());
 
      srunner_run_all (sr, CK_VERBOSE);
      n = srunner_ntests_failed (sr);
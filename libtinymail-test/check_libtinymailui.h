@@ -5,6 +5,7 @@
 #include <glib.h>
 #include <check.h>
 
+Suite *create_tny_gtk_header_list_model_suite (void);
 Suite *create_tny_platform_factory_suite (void);
 
 #endif /* CHECK_LIBTINYMAILUI_H */
@@ -17,6 +17,7 @@ main (void)
      g_thread_init (NULL);
 
      sr = srunner_create ((Suite *) create_tny_platform_factory_suite ());
+     srunner_add_suite (sr, (Suite *) create_tny_gtk_header_list_model_suite ());
 
      srunner_run_all (sr, CK_VERBOSE);
      n = srunner_ntests_failed (sr);
@@ -0,0 +1,332 @@
+/* tinymail - Tiny Mail unit test
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.	 See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with self library; if not, write to the
+ * Free Software Foundation, Inc., 51 Franklin Street, Fifth Floor,
+ * Boston, MA 02110-1301, USA.
+ */
+
+#include "check_libtinymail.h"
+
+#include <tny-list.h>
+#include <tny-iterator.h>
+#include <tny-simple-list.h>
+#include <tny-folder.h>
+#include <tny-header.h>
+#include <tny-store-account.h>
+#include <tny-camel-folder.h>
+
+#include <account-store.h>
+#include <maildir.h>
+
+/* The header views are tested on a local maildir, which a test changes
+ * behind the back of the folder and then refreshes it. The uid of each
+ * message is also its subject */
+
+static gchar *dir = NULL;
+static TnyAccountStore *account_store = NULL;
+static TnyStoreAccount *account = NULL;
+static TnyFolder *iface = NULL;
+static gchar *str;
+
+static TnyHeader *
+get_header (TnyList *list, const gchar *subject, gint *index)
+{
+	TnyIterator *iter = tny_list_create_iterator (list);
+	TnyHeader *retval = NULL;
+	gint i = 0;
+
+	while (!retval && !tny_iterator_is_done (iter)) {
+		TnyHeader *header = TNY_HEADER (tny_iterator_get_current (iter));
+		gchar *s = tny_header_dup_subject (header);
+
+		if (s && !strcmp (s, subject))
+			retval = header;
+		else {
+			g_object_unref (header);
+			i++;
+		}
+		g_free (s);
+		tny_iterator_next (iter);
+	}
+	g_object_unref (iter);
+
+	if (index)
+		*index = retval ? i : -1;
+
+	return retval;
+}
+
+static gint
+index_of (TnyList *list, const gchar *subject)
+{
+	TnyHeader *header;
+	gint index;
+
+	header = get_header (list, subject, &index);
+	if (header)
+		g_object_unref (header);
+
+	return index;
+}
+
+static void
+check_depth (TnyList *view, const gchar *subject, gint expected)
+{
+	TnyHeader *header = get_header (view, subject, NULL);
+	gint depth = -1;
+
+	if (header) {
+		depth = tny_camel_folder_get_thread_depth (TNY_CAMEL_FOLDER (iface), view, header);
+		g_object_unref (header);
+	}
+
+	str = g_strdup_printf ("%s is at depth %d instead of %d\n", subject, depth, expected);
+	fail_unless (depth == expected, str);
+	g_free (str);
+}
+
+static void
+check_follows (TnyList *view, const gchar *first, const gchar *second)
+{
+	gint a = index_of (view, first), b = index_of (view, second);
+
+	str = g_strdup_printf ("%s is at %d instead of right after %s at %d\n",
+		second, b, first, a);
+	fail_unless (a != -1 && b == a + 1, str);
+	g_free (str);
+}
+
+static void
+check_length (TnyList *view, guint expected)
+{
+	guint length = tny_list_get_length (view);
+
+	str = g_strdup_printf ("The view has %d items instead of %d\n", length, expected);
+	fail_unless (length == expected, str);
+	g_free (str);
+}
+
+static void
+tny_camel_header_list_test_setup (void)
+{
+	dir = tny_test_maildir_new ();
+	tny_test_maildir_add_msg (dir, "a", "a@example.org", NULL, TRUE);
+	tny_test_maildir_add_msg (dir, "b", "b@example.org", "a@example.org", TRUE);
+	tny_test_maildir_add_msg (dir, "c", "c@example.org", "b@example.org", TRUE);
+	tny_test_maildir_add_msg (dir, "d", "d@example.org", NULL, TRUE);
+
+	account_store = tny_test_account_store_new (FALSE, dir);
+	account = tny_test_maildir_account_new (account_store, dir);
+	iface = tny_test_maildir_get_folder (account, NULL);
+}
+
+static void
+tny_camel_header_list_test_teardown (void)
+{
+	if (iface)
+		g_object_unref (iface);
+	g_object_unref (account);
+	g_object_unref (account_store);
+
+	tny_test_maildir_remove (dir);
+	g_free (dir);
+}
+
+static gint counter;
+
+static void
+count_item (gpointer item, gpointer user_data)
+{
+	counter++;
+}
+
+static gchar *
+dup_uid (TnyIterator *iter)
+{
+	TnyHeader *header = TNY_HEADER (tny_iterator_get_current (iter));
+	gchar *retval = NULL;
+
+	if (header) {
+		retval = tny_header_dup_uid (header);
+		g_object_unref (header);
+	}
+
+	return retval;
+}
+
+/* The plain view has the messages in the order of the summary, a new one
+ * goes at the end */
+START_TEST (tny_camel_header_list_test_plain)
+{
+	TnyList *view, *headers;
+	TnyIterator *iter, *nth, *early;
+	TnyHeader *header;
+	GError *err = NULL;
+	gchar *s;
+	gint i;
+
+	fail_unless (iface != NULL, "The maildir wasn't found\n");
+
+	view = tny_camel_folder_get_headers_view (TNY_CAMEL_FOLDER (iface), &err);
+	fail_unless (view != NULL, "No headers view of the maildir\n");
+
+	check_length (view, 4);
+	str = g_strdup_printf ("The folder has %d messages instead of 4\n",
+		tny_folder_get_all_count (iface));
+	fail_unless (tny_folder_get_all_count (iface) == 4, str);
+	g_free (str);
+
+	counter = 0;
+	tny_list_foreach (view, count_item, NULL);
+	str = g_strdup_printf ("Counter after foreach should be 4 but is %d\n", counter);
+	fail_unless (counter == 4, str);
+	g_free (str);
+
+	/* the same messages as tny_folder_get_headers, in whatever order */
+	headers = tny_simple_list_new ();
+	tny_folder_get_headers (iface, headers, FALSE, &err);
+	fail_unless (err == NULL, "Getting the headers failed\n");
+	check_length (headers, 4);
+
+	/* jumping to an item gets the same one as walking up to it */
+	iter = tny_list_create_iterator (view);
+	nth = tny_list_create_iterator (view);
+	for (i = 0; !tny_iterator_is_done (iter); i++) {
+		gchar *uid = dup_uid (iter), *uid_nth;
+
+		tny_iterator_nth (nth, i);
+		uid_nth = dup_uid (nth);
+
+		str = g_strdup_printf ("Item %d is %s, but %s when asked for it\n",
+			i, uid, uid_nth);
+		fail_unless (uid && uid_nth && !strcmp (uid, uid_nth), str);
+		g_free (str);
+
+		str = g_strdup_printf ("Item %d of the view isn't in the folder\n", i);
+		fail_unless (uid && index_of (headers, uid) != -1, str);
+		g_free (str);
+
+		g_free (uid_nth);
+		g_free (uid);
+		tny_iterator_next (iter);
+	}
+	g_object_unref (iter);
+	g_object_unref (headers);
+
+	tny_iterator_nth (nth, 4);
+	fail_unless (tny_iterator_is_done (nth), "An iterator past the last item isn't done\n");
+	g_object_unref (nth);
+
+	/* an iterator from before the message arrived gets to see it too */
+	early = tny_list_create_iterator (view);
+	tny_iterator_nth (early, 3);
+
+	tny_test_maildir_add_msg (dir, "e", "e@example.org", NULL, FALSE);
+	tny_folder_refresh (iface, &err);
+	fail_unless (err == NULL, "Refreshing the maildir failed\n");
+
+	check_length (view, 5);
+	str = g_strdup_printf ("The folder has %d messages instead of 5\n",
+		tny_folder_get_all_count (iface));
+	fail_unless (tny_folder_get_all_count (iface) == 5, str);
+	g_free (str);
+
+	iter = tny_list_create_iterator (view);
+	tny_iterator_nth (iter, 4);
+	header = TNY_HEADER (tny_iterator_get_current (iter));
+	fail_unless (header != NULL, "The last item of the view is missing\n");
+	s = tny_header_dup_subject (header);
+	str = g_strdup_printf ("The last item is %s instead of e\n", s);
+	fail_unless (s && !strcmp (s, "e"), str);
+	g_free (str);
+	g_free (s);
+	g_object_unref (header);
+	g_object_unref (iter);
+
+	tny_iterator_next (early);
+	fail_unless (!tny_iterator_is_done (early), "An older iterator doesn't see the new message\n");
+	s = dup_uid (early);
+	str = g_strdup_printf ("The older iterator is at %s instead of e\n", s);
+	fail_unless (s && !strcmp (s, "e"), str);
+	g_free (str);
+	g_free (s);
+	tny_iterator_next (early);
+	fail_unless (tny_iterator_is_done (early), "An older iterator isn't done after the new message\n");
+	g_object_unref (early);
+
+	g_object_unref (view);
+}
+END_TEST
+
+START_TEST (tny_camel_header_list_test_threaded)
+{
+	TnyList *view;
+	GError *err = NULL;
+
+	fail_unless (iface != NULL, "The maildir wasn't found\n");
+
+	view = tny_camel_folder_get_threaded_headers_view (TNY_CAMEL_FOLDER (iface), &err);
+	fail_unless (view != NULL, "No threaded view of the maildir\n");
+
+	check_length (view, 4);
+	check_depth (view, "a", 0);
+	check_depth (view, "b", 1);
+	check_depth (view, "c", 2);
+	check_depth (view, "d", 0);
+
+	/* depth first */
+	check_follows (view, "a", "b");
+	check_follows (view, "b", "c");
+
+	/* the second reply to a comes after the first one's replies */
+	tny_test_maildir_add_msg (dir, "e", "e@example.org", "a@example.org", TRUE);
+	tny_folder_refresh (iface, &err);
+	fail_unless (err == NULL, "Refreshing the maildir failed\n");
+
+	check_length (view, 5);
+	check_depth (view, "e", 1);
+	check_follows (view, "c", "e");
+
+	/* c stays in the thread of a, without b above it */
+	tny_test_maildir_remove_msg (dir, "b");
+	tny_folder_refresh (iface, &err);
+	fail_unless (err == NULL, "Refreshing the maildir failed\n");
+
+	check_length (view, 4);
+	fail_unless (index_of (view, "b") == -1, "A removed message is still in the view\n");
+	check_depth (view, "c", 1);
+	check_follows (view, "a", "c");
+	check_follows (view, "c", "e");
+
+	g_object_unref (view);
+}
+END_TEST
+
+Suite *
+create_tny_camel_header_list_suite (void)
+{
+     Suite *s = suite_create ("Camel header views");
+
+     TCase *tc = tcase_create ("Threaded");
+     tcase_add_checked_fixture (tc, tny_camel_header_list_test_setup, tny_camel_header_list_test_teardown);
+     tcase_add_test (tc, tny_camel_header_list_test_threaded);
+     suite_add_tcase (s, tc);
+
+     tc = tcase_create ("Plain");
+     tcase_add_checked_fixture (tc, tny_camel_header_list_test_setup, tny_camel_header_list_test_teardown);
+     tcase_add_test (tc, tny_camel_header_list_test_plain);
+     suite_add_tcase (s, tc);
+
+     return s;
+}
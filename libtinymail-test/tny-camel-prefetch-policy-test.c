@@ -0,0 +1,283 @@
+/* tinymail - Tiny Mail unit test
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.	 See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with self library; if not, write to the
+ * Free Software Foundation, Inc., 51 Franklin Street, Fifth Floor,
+ * Boston, MA 02110-1301, USA.
+ */
+
+#include "check_libtinymail.h"
+
+#include <tny-simple-list.h>
+#include <tny-camel-prefetch-policy.h>
+#include <tny-camel-prefetch-policy-priv.h>
+#include <tny-test-header.h>
+
+#include <camel/camel.h>
+#include <camel/camel-folder-summary.h>
+#include <camel/camel-mime-utils.h>
+
+/* The selection is tested on a summary that is only in memory, with the
+ * messages "0" to "9" in that order. They are all read, not cached and
+ * 1000 bytes big unless a test changes that. The selected uids are written
+ * out as a string like "6 4 7" */
+
+#define NUM_MESSAGES 10
+
+static CamelFolderSummary *summary = NULL;
+static TnyCamelPrefetchPolicy *iface = NULL;
+static gchar *str;
+
+static CamelMessageInfoBase *
+get_info (const gchar *uid)
+{
+	CamelMessageInfo *mi = camel_folder_summary_uid (summary, uid);
+
+	/* the summary keeps its own reference */
+	camel_message_info_free (mi);
+
+	return (CamelMessageInfoBase *) mi;
+}
+
+static void
+set_unread (const gchar *uid)
+{
+	get_info (uid)->flags &= ~CAMEL_MESSAGE_SEEN;
+}
+
+static void
+check_uids (const gchar *what, GPtrArray *uids, const gchar *expected)
+{
+	GString *out = g_string_new ("");
+	guint i;
+
+	for (i = 0; i < uids->len; i++) {
+		if (i > 0)
+			g_string_append_c (out, ' ');
+		g_string_append (out, uids->pdata[i]);
+	}
+
+	str = g_strdup_printf ("%s: selected \"%s\" instead of \"%s\"\n",
+		what, out->str, expected);
+	fail_unless (!strcmp (out->str, expected), str);
+	g_free (str);
+
+	g_string_free (out, TRUE);
+}
+
+static void
+free_uids (GPtrArray *uids)
+{
+	g_ptr_array_foreach (uids, (GFunc) g_free, NULL);
+	g_ptr_array_free (uids, TRUE);
+}
+
+static void
+check_select (const gchar *what, GPtrArray *order, const gchar *uid, const gchar *expected)
+{
+	GPtrArray *uids = _tny_camel_prefetch_policy_select (iface, summary, order, uid);
+
+	check_uids (what, uids, expected);
+	free_uids (uids);
+}
+
+static void
+check_stats (guint requests, guint hits, guint prefetched, guint cancelled)
+{
+	guint r, h, p, c;
+
+	tny_camel_prefetch_policy_get_stats (iface, &r, &h, &p, &c);
+	str = g_strdup_printf ("The stats are %d requests, %d hits, %d prefetched and %d cancelled "
+		"instead of %d, %d, %d and %d\n", r, h, p, c, requests, hits, prefetched, cancelled);
+	fail_unless (r == requests && h == hits && p == prefetched && c == cancelled, str);
+	g_free (str);
+}
+
+static void
+tny_camel_prefetch_policy_test_setup (void)
+{
+	gint i;
+
+	summary = camel_folder_summary_new (NULL);
+
+	for (i = 0; i < NUM_MESSAGES; i++) {
+		struct _camel_header_raw *headers = NULL;
+		CamelMessageInfoBase *mi;
+		gchar *uid = g_strdup_printf ("%d", i);
+
+		camel_header_raw_append (&headers, "Subject", uid, 0);
+		camel_header_raw_append (&headers, "From", "tinymail@example.org", 0);
+
+		mi = (CamelMessageInfoBase *) camel_folder_summary_add_from_header (summary, headers, uid);
+		mi->flags = (mi->flags & ~CAMEL_MESSAGE_CACHED) | CAMEL_MESSAGE_SEEN;
+		mi->size = 1000;
+
+		camel_header_raw_clear (&headers);
+		g_free (uid);
+	}
+
+	iface = tny_camel_prefetch_policy_new ();
+}
+
+static void
+tny_camel_prefetch_policy_test_teardown (void)
+{
+	g_object_unref (iface);
+	camel_object_unref (summary);
+}
+
+START_TEST (tny_camel_prefetch_policy_test_neighbours)
+{
+	check_select ("Default", NULL, "5", "6 4");
+
+	tny_camel_prefetch_policy_set_neighbours (iface, 2);
+	check_select ("Two neighbours", NULL, "5", "6 4 7 3");
+	check_select ("First message", NULL, "0", "1 2");
+	check_select ("Last message", NULL, "9", "8 7");
+	check_select ("Unknown message", NULL, "x", "");
+
+	/* what is cached already doesn't have to be fetched */
+	get_info ("6")->flags |= CAMEL_MESSAGE_CACHED;
+	check_select ("Cached neighbour", NULL, "5", "4 7 3");
+
+	tny_camel_prefetch_policy_set_neighbours (iface, 0);
+	check_select ("Disabled", NULL, "5", "");
+}
+END_TEST
+
+START_TEST (tny_camel_prefetch_policy_test_unread)
+{
+	set_unread ("3");
+	set_unread ("7");
+	set_unread ("8");
+	set_unread ("9");
+
+	tny_camel_prefetch_policy_set_unread (iface, 2);
+
+	/* 3 is a neighbour already, the unread ones come after those */
+	check_select ("Next unread", NULL, "2", "3 1 7 8");
+	check_select ("Not enough unread", NULL, "7", "8 6 9");
+
+	tny_camel_prefetch_policy_set_neighbours (iface, 0);
+	check_select ("Only unread", NULL, "2", "3 7");
+}
+END_TEST
+
+START_TEST (tny_camel_prefetch_policy_test_budget)
+{
+	tny_camel_prefetch_policy_set_neighbours (iface, 3);
+	tny_camel_prefetch_policy_set_max_bytes (iface, 2500);
+	check_select ("Capped", NULL, "5", "6 4");
+
+	/* what doesn't fit is skipped, smaller ones after it still go */
+	get_info ("6")->size = 5000;
+	get_info ("3")->size = 100;
+	check_select ("Too big", NULL, "5", "4 7 3");
+
+	tny_camel_prefetch_policy_set_max_bytes (iface, 0);
+	check_select ("No budget", NULL, "5", "");
+}
+END_TEST
+
+START_TEST (tny_camel_prefetch_policy_test_stats)
+{
+	guint first, second;
+
+	check_stats (0, 0, 0, 0);
+
+	first = _tny_camel_prefetch_policy_navigate (iface, "5");
+	check_stats (1, 0, 0, 0);
+	fail_unless (_tny_camel_prefetch_policy_is_current (iface, first),
+		"The last generation isn't current\n");
+
+	_tny_camel_prefetch_policy_prefetched (iface, "6");
+	_tny_camel_prefetch_policy_prefetched (iface, "4");
+	check_stats (1, 0, 2, 0);
+
+	/* prefetched already, so it isn't selected again */
+	check_select ("After prefetching", NULL, "5", "");
+
+	second = _tny_camel_prefetch_policy_navigate (iface, "6");
+	check_stats (2, 1, 2, 0);
+	fail_unless (!_tny_camel_prefetch_policy_is_current (iface, first),
+		"An older generation is still current\n");
+	fail_unless (_tny_camel_prefetch_policy_is_current (iface, second),
+		"The last generation isn't current\n");
+
+	/* a hit counts once */
+	_tny_camel_prefetch_policy_navigate (iface, "6");
+	check_stats (3, 1, 2, 0);
+
+	_tny_camel_prefetch_policy_navigate (iface, "9");
+	_tny_camel_prefetch_policy_cancelled (iface);
+	check_stats (4, 1, 2, 1);
+}
+END_TEST
+
+/* The user sees the messages in another order than the summary has them */
+START_TEST (tny_camel_prefetch_policy_test_view)
+{
+	const gchar *uids[] = { "9", "2", "5", "0", "7", "1" };
+	TnyList *view = tny_simple_list_new ();
+	GPtrArray *order;
+	gint i;
+
+	for (i = 0; i < G_N_ELEMENTS (uids); i++) {
+		TnyHeader *header = tny_test_header_new (uids[i], uids[i], 0);
+		tny_list_append (view, (GObject *) header);
+		g_object_unref (header);
+	}
+
+	fail_unless (_tny_camel_prefetch_policy_get_order (iface, "5") == NULL,
+		"There's an order without a view\n");
+
+	tny_camel_prefetch_policy_set_view (iface, view);
+
+	order = _tny_camel_prefetch_policy_get_order (iface, "5");
+	fail_unless (order != NULL, "There's no order with a view\n");
+	check_uids ("Order", order, "2 5 0 7 1");
+	check_select ("Neighbours in the view", order, "5", "0 2");
+
+	tny_camel_prefetch_policy_set_neighbours (iface, 0);
+	tny_camel_prefetch_policy_set_unread (iface, 1);
+	set_unread ("6");
+	set_unread ("1");
+	check_select ("Unread in the view", order, "5", "1");
+	free_uids (order);
+
+	fail_unless (_tny_camel_prefetch_policy_get_order (iface, "8") == NULL,
+		"There's an order for a message that isn't in the view\n");
+
+	/* the policy doesn't keep the view alive */
+	g_object_unref (view);
+	fail_unless (_tny_camel_prefetch_policy_get_order (iface, "5") == NULL,
+		"There's an order after the view got finalized\n");
+}
+END_TEST
+
+Suite *
+create_tny_camel_prefetch_policy_suite (void)
+{
+     Suite *s = suite_create ("Prefetch policy");
+
+     TCase *tc = tcase_create ("Selection");
+     tcase_add_checked_fixture (tc, tny_camel_prefetch_policy_test_setup, tny_camel_prefetch_policy_test_teardown);
+     tcase_add_test (tc, tny_camel_prefetch_policy_test_neighbours);
+     tcase_add_test (tc, tny_camel_prefetch_policy_test_unread);
+     tcase_add_test (tc, tny_camel_prefetch_policy_test_budget);
+     tcase_add_test (tc, tny_camel_prefetch_policy_test_stats);
+     tcase_add_test (tc, tny_camel_prefetch_policy_test_view);
+     suite_add_tcase (s, tc);
+
+     return s;
+}
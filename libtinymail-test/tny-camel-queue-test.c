@@ -0,0 +1,210 @@
+/* tinymail - Tiny Mail unit test
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.	 See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with self library; if not, write to the
+ * Free Software Foundation, Inc., 51 Franklin Street, Fifth Floor,
+ * Boston, MA 02110-1301, USA.
+ */
+
+#include "check_libtinymail.h"
+
+#include <tny-camel-store-account.h>
+#include <tny-camel-queue-priv.h>
+
+/* The first item blocks the queue until the others are launched and some
+ * of them removed, so that the depth, the waits and the cancellations are
+ * all known up front */
+
+#define NUM_NORMAL 5
+#define NUM_REMOVED 3
+#define NUM_ITEMS (1 + NUM_NORMAL + NUM_REMOVED)
+#define GATE_MSEC 50
+
+typedef struct {
+	TnyCamelQueueable parent;	/* the queue uses the start of the data */
+	gint nth;
+} TestItem;
+
+static TnyCamelStoreAccount *account = NULL;
+static TnyCamelQueue *queue = NULL;
+static GMutex *gate_lock = NULL;
+static GCond *gate_cond = NULL;
+static gboolean gate_open = FALSE, gate_reached = FALSE;
+static gint callbacks = 0, cancel_callbacks = 0;
+static gchar *str;
+
+static gpointer
+blocking_func (gpointer data)
+{
+	g_mutex_lock (gate_lock);
+	gate_reached = TRUE;
+	g_cond_broadcast (gate_cond);
+	while (!gate_open)
+		g_cond_wait (gate_cond, gate_lock);
+	g_mutex_unlock (gate_lock);
+
+	return NULL;
+}
+
+static gpointer
+item_func (gpointer data)
+{
+	return NULL;
+}
+
+static gboolean
+item_callback (gpointer data)
+{
+	callbacks++;
+	return FALSE;
+}
+
+static gboolean
+item_cancel_callback (gpointer data)
+{
+	cancel_callbacks++;
+	return FALSE;
+}
+
+static void
+launch (GThreadFunc func, TnyCamelQueueItemFlags flags, gint nth)
+{
+	TestItem *item = g_slice_new0 (TestItem);
+
+	item->nth = nth;
+	_tny_camel_queue_launch_wflags (queue, func, item_callback, NULL,
+		item_cancel_callback, NULL, NULL, item, sizeof (TestItem),
+		flags, __FUNCTION__);
+}
+
+static gboolean
+all_done (gpointer data)
+{
+	GMainLoop *loop = data;
+	TnyCamelQueueStats stats;
+
+	_tny_camel_queue_get_stats (queue, &stats);
+
+	/* The stats are updated after the callback, in the queue's thread */
+	if (callbacks + cancel_callbacks == NUM_ITEMS &&
+	    stats.performed + stats.cancelled == NUM_ITEMS) {
+		g_main_loop_quit (loop);
+		return FALSE;
+	}
+
+	return TRUE;
+}
+
+static void
+tny_camel_queue_test_setup (void)
+{
+	account = TNY_CAMEL_STORE_ACCOUNT (tny_camel_store_account_new ());
+	queue = _tny_camel_queue_new (TNY_CAMEL_ACCOUNT (account));
+	gate_lock = g_mutex_new ();
+	gate_cond = g_cond_new ();
+	gate_open = FALSE;
+	gate_reached = FALSE;
+	callbacks = 0;
+	cancel_callbacks = 0;
+}
+
+static void
+tny_camel_queue_test_teardown (void)
+{
+	g_object_unref (queue);
+	g_object_unref (account);
+	g_cond_free (gate_cond);
+	g_mutex_free (gate_lock);
+}
+
+START_TEST (tny_camel_queue_test_stats)
+{
+	TnyCamelQueueStats stats;
+	GMainLoop *loop;
+	gint i;
+
+	launch (blocking_func, TNY_CAMEL_QUEUE_NORMAL_ITEM, 0);
+
+	g_mutex_lock (gate_lock);
+	while (!gate_reached)
+		g_cond_wait (gate_cond, gate_lock);
+	g_mutex_unlock (gate_lock);
+
+	for (i = 0; i < NUM_NORMAL; i++)
+		launch (item_func, TNY_CAMEL_QUEUE_NORMAL_ITEM, 1 + i);
+	for (i = 0; i < NUM_REMOVED; i++)
+		launch (item_func, TNY_CAMEL_QUEUE_PREFETCH_ITEM, 1 + NUM_NORMAL + i);
+	_tny_camel_queue_remove_items (queue, TNY_CAMEL_QUEUE_PREFETCH_ITEM);
+
+	_tny_camel_queue_get_stats (queue, &stats);
+
+	str = g_strdup_printf ("The depth is %d instead of %d while the first item blocks\n",
+		stats.depth, NUM_ITEMS);
+	fail_unless (stats.depth == NUM_ITEMS, str);
+	g_free (str);
+
+	fail_unless (stats.launched == NUM_ITEMS, "Not all launched items were counted\n");
+	fail_unless (stats.performed == 0 && stats.cancelled == 0,
+		"Items were counted as done while the first item blocks\n");
+
+	/* Makes the waits of the other items measurable */
+	g_usleep (GATE_MSEC * 1000);
+
+	g_mutex_lock (gate_lock);
+	gate_open = TRUE;
+	g_cond_broadcast (gate_cond);
+	g_mutex_unlock (gate_lock);
+
+	loop = g_main_loop_new (NULL, FALSE);
+	g_timeout_add (10, all_done, loop);
+	g_main_loop_run (loop);
+	g_main_loop_unref (loop);
+
+	_tny_camel_queue_get_stats (queue, &stats);
+
+	fail_unless (callbacks == 1 + NUM_NORMAL, "Not all performed items had their callback\n");
+	fail_unless (cancel_callbacks == NUM_REMOVED, "Not all removed items had their cancel callback\n");
+
+	fail_unless (stats.depth == 0, "The queue is not empty in the end\n");
+	str = g_strdup_printf ("The maximum depth is %d instead of %d\n",
+		stats.max_depth, NUM_ITEMS);
+	fail_unless (stats.max_depth == NUM_ITEMS, str);
+	g_free (str);
+
+	fail_unless (stats.launched == NUM_ITEMS, "Not all launched items were counted\n");
+	str = g_strdup_printf ("%d items were counted as performed and %d as cancelled\n",
+		stats.performed, stats.cancelled);
+	fail_unless (stats.performed == 1 + NUM_NORMAL && stats.cancelled == NUM_REMOVED, str);
+	g_free (str);
+
+	str = g_strdup_printf ("The longest wait was %.3fs, the first item blocked for %.3fs\n",
+		stats.max_wait, GATE_MSEC / 1000.0);
+	fail_unless (stats.max_wait >= GATE_MSEC / 1000.0, str);
+	g_free (str);
+	fail_unless (stats.total_wait >= stats.max_wait, "The total wait is less than the longest\n");
+}
+END_TEST
+
+Suite *
+create_tny_camel_queue_suite (void)
+{
+     Suite *s = suite_create ("Camel queue");
+
+     TCase *tc = tcase_create ("Statistics");
+     tcase_set_timeout (tc, 30);
+     tcase_add_checked_fixture (tc, tny_camel_queue_test_setup, tny_camel_queue_test_teardown);
+     tcase_add_test (tc, tny_camel_queue_test_stats);
+     suite_add_tcase (s, tc);
+
+     return s;
+}
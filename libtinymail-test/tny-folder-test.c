@@ -31,6 +31,7 @@
 #include <tny-store-account.h>
 #include <tny-folder.h>
 #include <tny-camel-header.h>
+#include <tny-search-query.h>
 
 #include <account-store.h>
 
@@ -164,6 +165,79 @@ START_TEST (tny_folder_test_get_headers_sync)
 }
 END_TEST
 
+START_TEST (tny_folder_test_search)
+{
+	TnySearchQuery *query;
+	TnyList *headers, *found;
+	TnyIterator *iter;
+	TnyHeader *header;
+	gchar *subject;
+	gint all_count, length;
+	gboolean has_it = FALSE;
+
+	if (iface == NULL)
+	{
+		g_warning ("Test cannot continue (are you online?)");
+		return;
+	}
+
+	headers = tny_simple_list_new ();
+	tny_folder_get_headers (iface, headers, TRUE, NULL);
+	all_count = tny_list_get_length (headers);
+
+	/* A query without items matches everything */
+	query = tny_search_query_new ();
+	found = tny_simple_list_new ();
+	tny_folder_search (iface, query, found, NULL);
+	length = tny_list_get_length (found);
+	str = g_strdup_printf ("An empty query found %d headers, the folder has %d\n", length, all_count);
+	fail_unless (length == all_count, str);
+	g_free (str);
+	g_object_unref (found);
+	g_object_unref (query);
+
+	if (all_count == 0) {
+		g_object_unref (headers);
+		return;
+	}
+
+	iter = tny_list_create_iterator (headers);
+	header = TNY_HEADER (tny_iterator_get_current (iter));
+	subject = g_strdup (tny_header_get_subject (header));
+	g_object_unref (iter);
+
+	/* Searching for the subject of a header must find at least that one,
+	 * and nothing that doesn't have it in its subject */
+	query = tny_search_query_new ();
+	tny_search_query_add_item (query, TNY_SEARCH_QUERY_FIELD_SUBJECT, subject ? subject : "");
+	found = tny_simple_list_new ();
+	tny_folder_search (iface, query, found, NULL);
+
+	iter = tny_list_create_iterator (found);
+	while (!tny_iterator_is_done (iter))
+	{
+		TnyHeader *match = TNY_HEADER (tny_iterator_get_current (iter));
+		const gchar *uid = tny_header_get_uid (match);
+
+		if (uid && !strcmp (uid, tny_header_get_uid (header)))
+			has_it = TRUE;
+		g_object_unref (match);
+		tny_iterator_next (iter);
+	}
+	g_object_unref (iter);
+
+	fail_unless (has_it, "Searching for the subject of a message didn't find it\n");
+	fail_unless (tny_list_get_length (found) <= all_count,
+		"The search found more headers than the folder has\n");
+
+	g_free (subject);
+	g_object_unref (header);
+	g_object_unref (found);
+	g_object_unref (query);
+	g_object_unref (headers);
+}
+END_TEST
+
 #if 0
 static void
 message_received (TnyFolder *folder, gboolean cancelled, TnyMsg *msg, GError **err, gpointer user_data)
@@ -375,6 +449,12 @@ create_tny_folder_suite (void)
 	tcase_add_test (tc, tny_folder_test_get_headers_sync);
 	suite_add_tcase (s, tc);
 
+	tc = tcase_create ("Search");
+	tcase_set_timeout (tc, 10);
+	tcase_add_checked_fixture (tc, tny_folder_test_setup, tny_folder_test_teardown);
+	tcase_add_test (tc, tny_folder_test_search);
+	suite_add_tcase (s, tc);
+
 	tc = tcase_create ("Get/Get Async/Remove/Add Message");
 	tcase_set_timeout (tc, 5);
 	tcase_add_checked_fixture (tc, tny_folder_test_setup, tny_folder_test_teardown);
@@ -0,0 +1,505 @@
+/* tinymail - Tiny Mail unit test
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.	 See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with self library; if not, write to the
+ * Free Software Foundation, Inc., 51 Franklin Street, Fifth Floor,
+ * Boston, MA 02110-1301, USA.
+ */
+
+#include "check_libtinymailui.h"
+
+#include <gtk/gtk.h>
+
+#include <tny-list.h>
+#include <tny-header.h>
+#include <tny-gtk-header-list-model.h>
+
+#include "tny-test-header.h"
+
+/* The model is filled with headers that aren't in a folder. Rows only get
+ * added, sorted and removed from the mainloop, so the tests run it until
+ * the model has the rows they expect, and no items waiting to become rows
+ * or to be removed. The rows are written out as a string
+ * of UIDs, like "1 3 2".
+ *
+ * Like a GtkTreeView, the test keeps its own copy of the rows, which only
+ * follows the signals of the model. It must always be the same as what the
+ * model has */
+
+static GtkTreeModel *model = NULL;
+static GPtrArray *shadow = NULL;
+static gint reorders = 0, deletes = 0;
+static gchar *str;
+
+static gboolean
+wait_timeout (gpointer data)
+{
+	*(gboolean *) data = TRUE;
+	return FALSE;
+}
+
+static void
+wait_for_rows (gint n)
+{
+	gboolean timed_out = FALSE;
+	guint src = g_timeout_add (3000, wait_timeout, &timed_out);
+
+	while (!timed_out && (gtk_tree_model_iter_n_children (model, NULL) != n ||
+			tny_list_get_length (TNY_LIST (model)) != n))
+		g_main_context_iteration (NULL, TRUE);
+	while (g_main_context_pending (NULL))
+		g_main_context_iteration (NULL, FALSE);
+
+	if (!timed_out)
+		g_source_remove (src);
+
+	str = g_strdup_printf ("The model has %d rows instead of %d\n",
+		gtk_tree_model_iter_n_children (model, NULL), n);
+	fail_unless (!timed_out, str);
+	g_free (str);
+}
+
+static void
+add (const gchar *uid, const gchar *subject, time_t date_received)
+{
+	TnyHeader *header = tny_test_header_new (uid, subject, date_received);
+
+	tny_list_prepend (TNY_LIST (model), (GObject *) header);
+	g_object_unref (header);
+}
+
+static gchar *
+dup_row_uid (GtkTreeIter *iter)
+{
+	TnyHeader *header = NULL;
+	gchar *uid;
+
+	gtk_tree_model_get (model, iter,
+		TNY_GTK_HEADER_LIST_MODEL_INSTANCE_COLUMN, &header, -1);
+	uid = header ? tny_header_dup_uid (header) : g_strdup ("?");
+	if (header)
+		g_object_unref (header);
+
+	return uid;
+}
+
+static gchar **
+get_rows (void)
+{
+	gint i, n = gtk_tree_model_iter_n_children (model, NULL);
+	gchar **rows = g_new0 (gchar *, n + 1);
+
+	for (i = 0; i < n; i++) {
+		GtkTreeIter iter;
+
+		if (gtk_tree_model_iter_nth_child (model, &iter, NULL, i))
+			rows[i] = dup_row_uid (&iter);
+		else
+			rows[i] = g_strdup ("?");
+	}
+
+	return rows;
+}
+
+static void
+check_rows (const gchar *what, const gchar *expected)
+{
+	gchar **rows = get_rows ();
+	gchar *got = g_strjoinv (" ", rows), *followed;
+
+	str = g_strdup_printf ("%s: the rows are \"%s\" instead of \"%s\"\n",
+		what, got, expected);
+	fail_unless (!strcmp (got, expected), str);
+	g_free (str);
+
+	g_ptr_array_add (shadow, NULL);
+	followed = g_strjoinv (" ", (gchar **) shadow->pdata);
+	g_ptr_array_remove_index (shadow, shadow->len - 1);
+
+	str = g_strdup_printf ("%s: the signals say \"%s\" but the rows are \"%s\"\n",
+		what, followed, got);
+	fail_unless (!strcmp (followed, got), str);
+	g_free (str);
+
+	g_free (followed);
+	g_free (got);
+	g_strfreev (rows);
+}
+
+static void
+on_row_inserted (GtkTreeModel *m, GtkTreePath *path, GtkTreeIter *iter, gpointer user_data)
+{
+	gint row = gtk_tree_path_get_indices (path)[0];
+
+	fail_unless (row >= 0 && row <= shadow->len,
+		"A row was inserted past the end\n");
+
+	g_ptr_array_add (shadow, NULL);
+	memmove (shadow->pdata + row + 1, shadow->pdata + row,
+		(shadow->len - row - 1) * sizeof (gpointer));
+	shadow->pdata[row] = dup_row_uid (iter);
+}
+
+static void
+on_row_deleted (GtkTreeModel *m, GtkTreePath *path, gpointer user_data)
+{
+	gint row = gtk_tree_path_get_indices (path)[0];
+
+	fail_unless (row >= 0 && row < shadow->len,
+		"A row that doesn't exist was deleted\n");
+
+	g_free (g_ptr_array_remove_index (shadow, row));
+	deletes++;
+}
+
+/* new_order[i] is the old position of what is at row i now */
+static void
+on_rows_reordered (GtkTreeModel *m, GtkTreePath *path, GtkTreeIter *iter, gint *new_order, gpointer user_data)
+{
+	gpointer *old = g_memdup (shadow->pdata, shadow->len * sizeof (gpointer));
+	guint i;
+
+	fail_unless (gtk_tree_path_get_depth (path) == 0,
+		"The reordered rows aren't the toplevel ones\n");
+
+	for (i = 0; i < shadow->len; i++) {
+		fail_unless (new_order[i] >= 0 && new_order[i] < shadow->len,
+			"new_order has a row that doesn't exist\n");
+		shadow->pdata[i] = old[new_order[i]];
+	}
+	g_free (old);
+
+	reorders++;
+}
+
+static void
+check_reordered (gint expected)
+{
+	str = g_strdup_printf ("The rows were reordered %d times instead of %d\n",
+		reorders, expected);
+	fail_unless (reorders == expected, str);
+	g_free (str);
+
+	reorders = 0;
+}
+
+static void
+check_deleted (gint expected)
+{
+	str = g_strdup_printf ("%d rows were deleted instead of %d\n",
+		deletes, expected);
+	fail_unless (deletes == expected, str);
+	g_free (str);
+
+	deletes = 0;
+}
+
+static void
+remove_uid (const gchar *uid)
+{
+	TnyHeader *header;
+
+	header = tny_gtk_header_list_model_find_uid (TNY_GTK_HEADER_LIST_MODEL (model), uid);
+	str = g_strdup_printf ("%s isn't found for removing it\n", uid);
+	fail_unless (header != NULL, str);
+	g_free (str);
+
+	tny_list_remove (TNY_LIST (model), (GObject *) header);
+	g_object_unref (header);
+}
+
+/* subject is NULL if uid must not be found */
+static void
+check_found (const gchar *uid, const gchar *subject)
+{
+	TnyHeader *header;
+	gchar *found = NULL;
+
+	header = tny_gtk_header_list_model_find_uid (TNY_GTK_HEADER_LIST_MODEL (model), uid);
+	if (header) {
+		found = tny_header_dup_subject (header);
+		g_object_unref (header);
+	}
+
+	str = g_strdup_printf ("Found %s for %s instead of %s\n",
+		found ? found : "nothing", uid, subject ? subject : "nothing");
+	fail_unless ((!found && !subject) || (found && subject && !strcmp (found, subject)), str);
+	g_free (str);
+
+	g_free (found);
+}
+
+static void
+tny_gtk_header_list_model_test_setup (void)
+{
+	model = tny_gtk_header_list_model_new ();
+	shadow = g_ptr_array_new ();
+	reorders = deletes = 0;
+
+	g_signal_connect (model, "row-inserted", G_CALLBACK (on_row_inserted), NULL);
+	g_signal_connect (model, "row-deleted", G_CALLBACK (on_row_deleted), NULL);
+	g_signal_connect (model, "rows-reordered", G_CALLBACK (on_rows_reordered), NULL);
+}
+
+static void
+tny_gtk_header_list_model_test_teardown (void)
+{
+	guint i;
+
+	g_object_unref (model);
+	model = NULL;
+
+	for (i = 0; i < shadow->len; i++)
+		g_free (shadow->pdata[i]);
+	g_ptr_array_free (shadow, TRUE);
+	shadow = NULL;
+}
+
+START_TEST (tny_gtk_header_list_model_test_sort_order)
+{
+	GtkTreeSortable *sortable = GTK_TREE_SORTABLE (model);
+
+	add ("1", "d", 0);
+	add ("2", "b", 0);
+	add ("3", "e", 0);
+	add ("4", "a", 0);
+	add ("5", "c", 0);
+	wait_for_rows (5);
+	check_rows ("Unsorted", "1 2 3 4 5");
+
+	gtk_tree_sortable_set_sort_column_id (sortable,
+		TNY_GTK_HEADER_LIST_MODEL_SUBJECT_COLUMN, GTK_SORT_ASCENDING);
+	check_rows ("Ascending", "4 2 5 1 3");
+	check_reordered (1);
+
+	gtk_tree_sortable_set_sort_column_id (sortable,
+		TNY_GTK_HEADER_LIST_MODEL_SUBJECT_COLUMN, GTK_SORT_DESCENDING);
+	check_rows ("Descending", "3 1 5 2 4");
+	check_reordered (1);
+
+	/* Sorting what is sorted already doesn't reorder */
+	gtk_tree_sortable_set_sort_column_id (sortable,
+		TNY_GTK_HEADER_LIST_MODEL_SUBJECT_COLUMN, GTK_SORT_DESCENDING);
+	check_reordered (0);
+}
+END_TEST
+
+/* Rows with the same key keep the order they had */
+START_TEST (tny_gtk_header_list_model_test_sort_stable)
+{
+	GtkTreeSortable *sortable = GTK_TREE_SORTABLE (model);
+
+	add ("1", "x", 30);
+	add ("2", "y", 10);
+	add ("3", "x", 20);
+	add ("4", "y", 30);
+	add ("5", "x", 10);
+	wait_for_rows (5);
+
+	gtk_tree_sortable_set_sort_column_id (sortable,
+		TNY_GTK_HEADER_LIST_MODEL_SUBJECT_COLUMN, GTK_SORT_ASCENDING);
+	check_rows ("Ascending subject", "1 3 5 2 4");
+	check_reordered (1);
+
+	gtk_tree_sortable_set_sort_column_id (sortable,
+		TNY_GTK_HEADER_LIST_MODEL_SUBJECT_COLUMN, GTK_SORT_DESCENDING);
+	check_rows ("Descending subject", "2 4 1 3 5");
+	check_reordered (1);
+
+	/* Starts from the order of the subject sort */
+	gtk_tree_sortable_set_sort_column_id (sortable,
+		TNY_GTK_HEADER_LIST_MODEL_DATE_RECEIVED_TIME_T_COLUMN, GTK_SORT_ASCENDING);
+	check_rows ("Ascending date", "2 5 3 4 1");
+	check_reordered (1);
+}
+END_TEST
+
+/* Rows added to a sorted model are sorted on their own and merged in */
+START_TEST (tny_gtk_header_list_model_test_sort_merge)
+{
+	GtkTreeSortable *sortable = GTK_TREE_SORTABLE (model);
+
+	gtk_tree_sortable_set_sort_column_id (sortable,
+		TNY_GTK_HEADER_LIST_MODEL_SUBJECT_COLUMN, GTK_SORT_ASCENDING);
+
+	add ("1", "c", 0);
+	add ("2", "a", 0);
+	add ("3", "e", 0);
+	wait_for_rows (3);
+	check_rows ("First rows", "2 1 3");
+	check_reordered (1);
+
+	add ("4", "d", 0);
+	add ("5", "b", 0);
+	add ("6", "c", 0);
+	wait_for_rows (6);
+	check_rows ("Merged", "2 5 1 6 4 3");
+	check_reordered (1);
+}
+END_TEST
+
+/* A sort func of the column is used instead of the model's own keys */
+START_TEST (tny_gtk_header_list_model_test_sort_func)
+{
+	GtkTreeSortable *sortable = GTK_TREE_SORTABLE (model);
+
+	gtk_tree_sortable_set_sort_func (sortable,
+		TNY_GTK_HEADER_LIST_MODEL_DATE_RECEIVED_COLUMN,
+		tny_gtk_header_list_model_received_date_sort_func, NULL, NULL);
+
+	add ("1", "a", 300);
+	add ("2", "b", 100);
+	add ("3", "c", 200);
+	add ("4", "d", 100);
+	wait_for_rows (4);
+
+	gtk_tree_sortable_set_sort_column_id (sortable,
+		TNY_GTK_HEADER_LIST_MODEL_DATE_RECEIVED_COLUMN, GTK_SORT_ASCENDING);
+	check_rows ("Sort func", "2 4 3 1");
+	check_reordered (1);
+}
+END_TEST
+
+/* A header with the UID of one that is there already replaces it */
+START_TEST (tny_gtk_header_list_model_test_no_duplicates)
+{
+	tny_gtk_header_list_model_set_no_duplicates (TNY_GTK_HEADER_LIST_MODEL (model), TRUE);
+
+	add ("1", "a", 0);
+	add ("2", "b", 0);
+	wait_for_rows (2);
+	check_found ("1", "a");
+
+	add ("1", "a2", 0);
+	add ("2", "b2", 0);
+	add ("2", "b3", 0);
+	wait_for_rows (2);
+	check_rows ("Replaced", "1 2");
+	/* b2 was replaced before it became a row */
+	check_deleted (2);
+	check_found ("1", "a2");
+	check_found ("2", "b3");
+}
+END_TEST
+
+/* Removals get done together, in one pass */
+START_TEST (tny_gtk_header_list_model_test_remove_batch)
+{
+	TnyGtkHeaderListModel *me = TNY_GTK_HEADER_LIST_MODEL (model);
+	gint i;
+
+	tny_gtk_header_list_model_set_no_duplicates (me, TRUE);
+
+	for (i = 1; i <= 10; i++) {
+		gchar *uid = g_strdup_printf ("%d", i);
+		add (uid, uid, 0);
+		g_free (uid);
+	}
+	wait_for_rows (10);
+
+	remove_uid ("1");
+	remove_uid ("4");
+	remove_uid ("5");
+	remove_uid ("10");
+	/* twice, before the first one got done */
+	remove_uid ("4");
+	wait_for_rows (6);
+	check_rows ("Removed", "2 3 6 7 8 9");
+	check_deleted (4);
+
+	check_found ("1", NULL);
+	check_found ("4", NULL);
+	check_found ("10", NULL);
+	check_found ("3", "3");
+	check_found ("9", "9");
+
+	/* The same without the UID table, and with one built again */
+	tny_gtk_header_list_model_set_no_duplicates (me, FALSE);
+	check_found ("4", NULL);
+	check_found ("3", "3");
+	tny_gtk_header_list_model_set_no_duplicates (me, TRUE);
+	check_found ("4", NULL);
+	check_found ("3", "3");
+}
+END_TEST
+
+/* A header that replaces one that is being removed stays */
+START_TEST (tny_gtk_header_list_model_test_remove_replace)
+{
+	tny_gtk_header_list_model_set_no_duplicates (TNY_GTK_HEADER_LIST_MODEL (model), TRUE);
+
+	add ("1", "a", 0);
+	add ("2", "b", 0);
+	wait_for_rows (2);
+
+	remove_uid ("1");
+	add ("1", "a2", 0);
+	wait_for_rows (2);
+	check_rows ("Replaced while removing", "2 1");
+	check_deleted (1);
+	check_found ("1", "a2");
+}
+END_TEST
+
+/* Removing rows keeps a sorted model sorted, also for what gets added next */
+START_TEST (tny_gtk_header_list_model_test_remove_sorted)
+{
+	gtk_tree_sortable_set_sort_column_id (GTK_TREE_SORTABLE (model),
+		TNY_GTK_HEADER_LIST_MODEL_SUBJECT_COLUMN, GTK_SORT_ASCENDING);
+
+	add ("1", "d", 0);
+	add ("2", "b", 0);
+	add ("3", "e", 0);
+	add ("4", "a", 0);
+	add ("5", "c", 0);
+	wait_for_rows (5);
+	check_rows ("Sorted", "4 2 5 1 3");
+
+	remove_uid ("2");
+	remove_uid ("1");
+	wait_for_rows (3);
+	check_rows ("Sorted after removing", "4 5 3");
+	check_deleted (2);
+	reorders = 0;
+
+	add ("6", "bb", 0);
+	wait_for_rows (4);
+	check_rows ("Sorted after adding", "4 6 5 3");
+	check_reordered (1);
+}
+END_TEST
+
+Suite *
+create_tny_gtk_header_list_model_suite (void)
+{
+     Suite *s = suite_create ("Header list model");
+     TCase *tc = NULL;
+
+     tc = tcase_create ("Sorting");
+     tcase_add_checked_fixture (tc, tny_gtk_header_list_model_test_setup, tny_gtk_header_list_model_test_teardown);
+     tcase_add_test (tc, tny_gtk_header_list_model_test_sort_order);
+     tcase_add_test (tc, tny_gtk_header_list_model_test_sort_stable);
+     tcase_add_test (tc, tny_gtk_header_list_model_test_sort_merge);
+     tcase_add_test (tc, tny_gtk_header_list_model_test_sort_func);
+     suite_add_tcase (s, tc);
+
+     tc = tcase_create ("Duplicates and removals");
+     tcase_add_checked_fixture (tc, tny_gtk_header_list_model_test_setup, tny_gtk_header_list_model_test_teardown);
+     tcase_add_test (tc, tny_gtk_header_list_model_test_no_duplicates);
+     tcase_add_test (tc, tny_gtk_header_list_model_test_remove_batch);
+     tcase_add_test (tc, tny_gtk_header_list_model_test_remove_replace);
+     tcase_add_test (tc, tny_gtk_header_list_model_test_remove_sorted);
+     suite_add_tcase (s, tc);
+
+     return s;
+}
@@ -0,0 +1,314 @@
+/* libtinymail-test - The Tiny Mail test library
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.	 See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with self library; if not, write to the
+ * Free Software Foundation, Inc., 51 Franklin Street, Fifth Floor,
+ * Boston, MA 02110-1301, USA.
+ */
+
+#include <string.h>
+
+#include <tny-header.h>
+#include <tny-test-header.h>
+
+static GObjectClass *parent_class = NULL;
+
+static gchar*
+tny_test_header_dup_uid (TnyHeader *self)
+{
+	return g_strdup (TNY_TEST_HEADER (self)->uid);
+}
+
+static gchar*
+tny_test_header_dup_bcc (TnyHeader *self)
+{
+	return g_strdup (TNY_TEST_HEADER (self)->bcc);
+}
+
+static gchar*
+tny_test_header_dup_cc (TnyHeader *self)
+{
+	return g_strdup (TNY_TEST_HEADER (self)->cc);
+}
+
+static gchar*
+tny_test_header_dup_subject (TnyHeader *self)
+{
+	return g_strdup (TNY_TEST_HEADER (self)->subject);
+}
+
+static gchar*
+tny_test_header_dup_to (TnyHeader *self)
+{
+	return g_strdup (TNY_TEST_HEADER (self)->to);
+}
+
+static gchar*
+tny_test_header_dup_from (TnyHeader *self)
+{
+	return g_strdup (TNY_TEST_HEADER (self)->from);
+}
+
+static gchar*
+tny_test_header_dup_replyto (TnyHeader *self)
+{
+	return g_strdup (TNY_TEST_HEADER (self)->replyto);
+}
+
+static gchar*
+tny_test_header_dup_message_id (TnyHeader *self)
+{
+	return NULL;
+}
+
+static guint
+tny_test_header_get_message_size (TnyHeader *self)
+{
+	return TNY_TEST_HEADER (self)->size;
+}
+
+static time_t
+tny_test_header_get_date_received (TnyHeader *self)
+{
+	return TNY_TEST_HEADER (self)->date_received;
+}
+
+static time_t
+tny_test_header_get_date_sent (TnyHeader *self)
+{
+	return TNY_TEST_HEADER (self)->date_sent;
+}
+
+static void
+replace (gchar **field, const gchar *value)
+{
+	g_free (*field);
+	*field = g_strdup (value);
+}
+
+static void
+tny_test_header_set_bcc (TnyHeader *self, const gchar *bcc)
+{
+	replace (&TNY_TEST_HEADER (self)->bcc, bcc);
+}
+
+static void
+tny_test_header_set_cc (TnyHeader *self, const gchar *cc)
+{
+	replace (&TNY_TEST_HEADER (self)->cc, cc);
+}
+
+static void
+tny_test_header_set_from (TnyHeader *self, const gchar *from)
+{
+	replace (&TNY_TEST_HEADER (self)->from, from);
+}
+
+static void
+tny_test_header_set_subject (TnyHeader *self, const gchar *subject)
+{
+	replace (&TNY_TEST_HEADER (self)->subject, subject);
+}
+
+static void
+tny_test_header_set_to (TnyHeader *self, const gchar *to)
+{
+	replace (&TNY_TEST_HEADER (self)->to, to);
+}
+
+static void
+tny_test_header_set_replyto (TnyHeader *self, const gchar *replyto)
+{
+	replace (&TNY_TEST_HEADER (self)->replyto, replyto);
+}
+
+static TnyFolder*
+tny_test_header_get_folder (TnyHeader *self)
+{
+	return NULL;
+}
+
+static TnyHeaderFlags
+tny_test_header_get_flags (TnyHeader *self)
+{
+	return TNY_TEST_HEADER (self)->flags;
+}
+
+static void
+tny_test_header_set_flag (TnyHeader *self, TnyHeaderFlags mask)
+{
+	TNY_TEST_HEADER (self)->flags |= mask;
+}
+
+static void
+tny_test_header_unset_flag (TnyHeader *self, TnyHeaderFlags mask)
+{
+	TNY_TEST_HEADER (self)->flags &= ~mask;
+}
+
+static gboolean
+tny_test_header_get_user_flag (TnyHeader *self, const gchar *id)
+{
+	return FALSE;
+}
+
+static void
+tny_test_header_set_user_flag (TnyHeader *self, const gchar *id)
+{
+	return;
+}
+
+static void
+tny_test_header_unset_user_flag (TnyHeader *self, const gchar *id)
+{
+	return;
+}
+
+static TnyHeaderSupportFlags
+tny_test_header_support_user_flags (TnyHeader *self)
+{
+	return TNY_HEADER_SUPPORT_FLAGS_NONE;
+}
+
+
+/**
+ * tny_test_header_new:
+ * @uid: the UID
+ * @subject: the subject
+ * @date_received: the received date
+ *
+ * Create a header that isn't in a folder
+ *
+ * Return value: a new #TnyHeader instance
+ **/
+TnyHeader*
+tny_test_header_new (const gchar *uid, const gchar *subject, time_t date_received)
+{
+	TnyTestHeader *self = g_object_new (TNY_TYPE_TEST_HEADER, NULL);
+
+	self->uid = g_strdup (uid);
+	self->subject = g_strdup (subject);
+	self->date_received = date_received;
+	self->date_sent = date_received;
+
+	return TNY_HEADER (self);
+}
+
+static void
+tny_test_header_instance_init (GTypeInstance *instance, gpointer g_class)
+{
+	return;
+}
+
+static void
+tny_test_header_finalize (GObject *object)
+{
+	TnyTestHeader *self = TNY_TEST_HEADER (object);
+
+	g_free (self->uid);
+	g_free (self->subject);
+	g_free (self->from);
+	g_free (self->to);
+	g_free (self->cc);
+	g_free (self->bcc);
+	g_free (self->replyto);
+
+	(*parent_class->finalize) (object);
+
+	return;
+}
+
+static void
+tny_header_init (gpointer g, gpointer iface_data)
+{
+	TnyHeaderIface *klass = (TnyHeaderIface *)g;
+
+	klass->dup_uid= tny_test_header_dup_uid;
+	klass->dup_bcc= tny_test_header_dup_bcc;
+	klass->dup_cc= tny_test_header_dup_cc;
+	klass->dup_subject= tny_test_header_dup_subject;
+	klass->dup_to= tny_test_header_dup_to;
+	klass->dup_from= tny_test_header_dup_from;
+	klass->dup_replyto= tny_test_header_dup_replyto;
+	klass->dup_message_id= tny_test_header_dup_message_id;
+	klass->get_message_size= tny_test_header_get_message_size;
+	klass->get_date_received= tny_test_header_get_date_received;
+	klass->get_date_sent= tny_test_header_get_date_sent;
+	klass->set_bcc= tny_test_header_set_bcc;
+	klass->set_cc= tny_test_header_set_cc;
+	klass->set_from= tny_test_header_set_from;
+	klass->set_subject= tny_test_header_set_subject;
+	klass->set_to= tny_test_header_set_to;
+	klass->set_replyto= tny_test_header_set_replyto;
+	klass->get_folder= tny_test_header_get_folder;
+	klass->get_flags= tny_test_header_get_flags;
+	klass->set_flag= tny_test_header_set_flag;
+	klass->unset_flag= tny_test_header_unset_flag;
+	klass->get_user_flag= tny_test_header_get_user_flag;
+	klass->set_user_flag= tny_test_header_set_user_flag;
+	klass->unset_user_flag= tny_test_header_unset_user_flag;
+	klass->support_user_flags= tny_test_header_support_user_flags;
+
+	return;
+}
+
+static void 
+tny_test_header_class_init (TnyTestHeaderClass *class)
+{
+	GObjectClass *object_class;
+
+	parent_class = g_type_class_peek_parent (class);
+	object_class = (GObjectClass*) class;
+
+	object_class->finalize = tny_test_header_finalize;
+
+	return;
+}
+
+GType 
+tny_test_header_get_type (void)
+{
+	static GType type = 0;
+
+	if (type == 0) 
+	{
+		static const GTypeInfo info = 
+		{
+		  sizeof (TnyTestHeaderClass),
+		  NULL,   /* base_init */
+		  NULL,   /* base_finalize */
+		  (GClassInitFunc) tny_test_header_class_init,   /* class_init */
+		  NULL,   /* class_finalize */
+		  NULL,   /* class_data */
+		  sizeof (TnyTestHeader),
+		  0,      /* n_preallocs */
+		  tny_test_header_instance_init    /* instance_init */
+		};
+
+		static const GInterfaceInfo tny_header_info = 
+		{
+		  (GInterfaceInitFunc) tny_header_init, /* interface_init */
+		  NULL,         /* interface_finalize */
+		  NULL          /* interface_data */
+		};
+
+		type = g_type_register_static (G_TYPE_OBJECT,
+			"TnyTestHeader",
+			&info, 0);
+
+		g_type_add_interface_static (type, TNY_TYPE_HEADER, 
+			&tny_header_info);
+	}
+
+	return type;
+}
@@ -0,0 +1,64 @@
+#ifndef TNY_TEST_HEADER_H
+#define TNY_TEST_HEADER_H
+
+/* libtinymail-test - The Tiny Mail test library
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.	 See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with self library; if not, write to the
+ * Free Software Foundation, Inc., 51 Franklin Street, Fifth Floor,
+ * Boston, MA 02110-1301, USA.
+ */
+
+#include <glib.h>
+#include <glib-object.h>
+#include <time.h>
+
+#include <tny-header.h>
+
+
+G_BEGIN_DECLS
+
+#define TNY_TYPE_TEST_HEADER             (tny_test_header_get_type ())
+#define TNY_TEST_HEADER(obj)             (G_TYPE_CHECK_INSTANCE_CAST ((obj), TNY_TYPE_TEST_HEADER, TnyTestHeader))
+#define TNY_TEST_HEADER_CLASS(vtable)    (G_TYPE_CHECK_CLASS_CAST ((vtable), TNY_TYPE_TEST_HEADER, TnyTestHeaderClass))
+#define TNY_IS_TEST_HEADER(obj)          (G_TYPE_CHECK_INSTANCE_TYPE ((obj), TNY_TYPE_TEST_HEADER))
+#define TNY_IS_TEST_HEADER_CLASS(vtable) (G_TYPE_CHECK_CLASS_TYPE ((vtable), TNY_TYPE_TEST_HEADER))
+#define TNY_TEST_HEADER_GET_CLASS(inst)  (G_TYPE_INSTANCE_GET_CLASS ((inst), TNY_TYPE_TEST_HEADER, TnyTestHeaderClass))
+
+typedef struct _TnyTestHeader TnyTestHeader;
+typedef struct _TnyTestHeaderClass TnyTestHeaderClass;
+
+/* A header that isn't in any folder, for testing the things that show or
+ * sort headers */
+struct _TnyTestHeader
+{
+	GObject parent;
+
+	gchar *uid, *subject, *from, *to, *cc, *bcc, *replyto;
+	time_t date_received, date_sent;
+	guint size;
+	TnyHeaderFlags flags;
+};
+
+struct _TnyTestHeaderClass 
+{
+	GObjectClass parent;
+};
+
+GType                   tny_test_header_get_type        (void);
+TnyHeader*              tny_test_header_new             (const gchar *uid, const gchar *subject, time_t date_received);
+
+G_END_DECLS
+
+#endif
+
@@ -23,6 +23,7 @@ typedef enum
 	TNY_FOLDER_STATUS_CODE_COPY_FOLDER = 5,
 	TNY_GET_SUPPORTED_SECURE_AUTH_STATUS_GET_SECURE_AUTH = 6,
 	TNY_FOLDER_STATUS_CODE_SYNC = 7,
+	TNY_FOLDER_STATUS_CODE_SEARCH = 8,
 } TnyStatusCode;
 
 typedef enum 
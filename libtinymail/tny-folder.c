@@ -824,6 +824,91 @@ tny_folder_remove_msgs_async (TnyFolder *self, TnyList *headers, TnyFolderCallba
 	return;
 }
 
+/**
+ * tny_folder_search:
+ * @self: a #TnyFolder
+ * @query: a #TnySearchQuery
+ * @headers: a #TnyList where the headers of the matching messages will be prepended to
+ * @err: (null-ok): a #GError or NULL
+ *
+ * Search @self for the messages that match @query, and prepend their headers
+ * to @headers. Only the matching messages get a #TnyHeader instance, which
+ * makes this a lot cheaper than getting all the headers of a large folder
+ * and filtering them.
+ *
+ * The header fields of @query are matched against the summary of @self. For
+ * the body, @self asks the service to search if it can (for example IMAP
+ * when online), else the bodies that are available locally are searched.
+ *
+ * Example:
+ * <informalexample><programlisting>
+ * TnySearchQuery *query = tny_search_query_new ();
+ * TnyList *headers = tny_simple_list_new ();
+ * TnyFolder *folder = ...;
+ * TnyIterator *iter;
+ * tny_search_query_add_item (query, TNY_SEARCH_QUERY_FIELD_BODY, "tinymail");
+ * tny_folder_search (folder, query, headers, NULL);
+ * iter = tny_list_create_iterator (headers);
+ * while (!tny_iterator_is_done (iter))
+ * {
+ *     TnyHeader *header = TNY_HEADER (tny_iterator_get_current (iter));
+ *     g_print ("%s\n", tny_header_get_subject (header));
+ *     g_object_unref (header);
+ *     tny_iterator_next (iter);
+ * }
+ * g_object_unref (iter);
+ * g_object_unref (headers);
+ * g_object_unref (query);
+ * </programlisting></informalexample>
+ *
+ * since: 1.0
+ * audience: application-developer
+ **/
+void
+tny_folder_search (TnyFolder *self, TnySearchQuery *query, TnyList *headers, GError **err)
+{
+#ifdef DBC /* require */
+	g_assert (TNY_IS_FOLDER (self));
+	g_assert (TNY_IS_SEARCH_QUERY (query));
+	g_assert (headers);
+	g_assert (TNY_IS_LIST (headers));
+	g_assert (TNY_FOLDER_GET_IFACE (self)->search!= NULL);
+#endif
+
+	TNY_FOLDER_GET_IFACE (self)->search(self, query, headers, err);
+	return;
+}
+
+/**
+ * tny_folder_search_async:
+ * @self: a #TnyFolder
+ * @query: a #TnySearchQuery
+ * @headers: a #TnyList where the headers of the matching messages will be prepended to
+ * @callback: (null-ok): a #TnyGetHeadersCallback or NULL
+ * @status_callback: (null-ok): a #TnyStatusCallback or NULL
+ * @user_data: (null-ok): user data that will be passed to the callbacks
+ *
+ * The asynchronous version of tny_folder_search(). The @callback gets
+ * @headers once the search is finished.
+ *
+ * since: 1.0
+ * audience: application-developer
+ **/
+void
+tny_folder_search_async (TnyFolder *self, TnySearchQuery *query, TnyList *headers, TnyGetHeadersCallback callback, TnyStatusCallback status_callback, gpointer user_data)
+{
+#ifdef DBC /* require */
+	g_assert (TNY_IS_FOLDER (self));
+	g_assert (TNY_IS_SEARCH_QUERY (query));
+	g_assert (headers);
+	g_assert (TNY_IS_LIST (headers));
+	g_assert (TNY_FOLDER_GET_IFACE (self)->search_async!= NULL);
+#endif
+
+	TNY_FOLDER_GET_IFACE (self)->search_async(self, query, headers, callback, status_callback, user_data);
+	return;
+}
+
 /**
  * tny_folder_refresh_async:
  * @self: a #TnyFolder
@@ -28,6 +28,7 @@
 #include <tny-account.h>
 #include <tny-msg-remove-strategy.h>
 #include <tny-list.h>
+#include <tny-search-query.h>
 
 G_BEGIN_DECLS
 
@@ -128,6 +129,8 @@ struct _TnyFolderIface
 	gchar* (*get_url_string) (TnyFolder *self);
 	TnyFolderCaps (*get_caps) (TnyFolder *self);
 	void (*remove_msgs_async) (TnyFolder *self, TnyList *headers, TnyFolderCallback callback, TnyStatusCallback status_callback, gpointer user_data);
+	void (*search) (TnyFolder *self, TnySearchQuery *query, TnyList *headers, GError **err);
+	void (*search_async) (TnyFolder *self, TnySearchQuery *query, TnyList *headers, TnyGetHeadersCallback callback, TnyStatusCallback status_callback, gpointer user_data);
 
 };
 
@@ -164,6 +167,8 @@ TnyFolderStats* tny_folder_get_stats (TnyFolder *self);
 TnyFolderCaps tny_folder_get_caps (TnyFolder *self);
 gchar* tny_folder_get_url_string (TnyFolder *self);
 void tny_folder_remove_msgs_async (TnyFolder *self, TnyList *headers, TnyFolderCallback callback, TnyStatusCallback status_callback, gpointer user_data);
+void tny_folder_search (TnyFolder *self, TnySearchQuery *query, TnyList *headers, GError **err);
+void tny_folder_search_async (TnyFolder *self, TnySearchQuery *query, TnyList *headers, TnyGetHeadersCallback callback, TnyStatusCallback status_callback, gpointer user_data);
 
 #ifndef TNY_DISABLE_DEPRECATED
 TnyFolder* tny_folder_copy (TnyFolder *self, TnyFolderStore *into, const gchar *new_name, gboolean del, GError **err);
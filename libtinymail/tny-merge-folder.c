@@ -37,6 +37,8 @@
 #include <tny-folder-observer.h>
 #include <tny-noop-lockable.h>
 
+#include "tny-common-priv.h"
+
 static GObjectClass *parent_class = NULL;
 
 typedef struct _TnyMergeFolderPriv TnyMergeFolderPriv;
@@ -746,17 +748,170 @@ tny_merge_folder_find_msg_async (TnyFolder *self, const gchar *url_string, TnyGe
 }
 
 
+/* get_headers, search and refresh run on all mothers at the same time, each in
+ * its own thread. That way the merge folder takes as long as its slowest mother, not
+ * as long as all of them together */
+
+typedef void (*MothersProgressFunc) (TnyFolder *self, guint done, guint total, gpointer user_data);
+
+typedef struct
+{
+	TnyFolder *folder;
+	TnyList *headers;
+	TnySearchQuery *query;
+	gboolean refresh;
+	GError *err;
+	GAsyncQueue *done;
+} MotherJob;
+
+static gpointer
+mother_job_thread (gpointer data)
+{
+	MotherJob *job = data;
+
+	if (job->query)
+		tny_folder_search (job->folder, job->query, job->headers, &job->err);
+	else if (job->headers)
+		tny_folder_get_headers (job->folder, job->headers, job->refresh, &job->err);
+	else
+		tny_folder_refresh (job->folder, &job->err);
+
+	g_async_queue_push (job->done, job);
+
+	return NULL;
+}
+
+static void
+add_to_array (gpointer item, gpointer user_data)
+{
+	g_ptr_array_add (user_data, g_object_ref (item));
+}
+
+/* Each list has its oldest header first, like tny_folder_get_headers makes
+ * them. Picks the newest of the last headers of all lists and prepends that
+ * to @headers, until all lists are empty, so that @headers gets them oldest
+ * first too */
+static void
+merge_headers (MotherJob *jobs, guint count, TnyList *headers)
+{
+	GPtrArray **arrays = g_new (GPtrArray *, count);
+	time_t *dates = g_new (time_t, count);
+	guint i;
+
+	for (i = 0; i < count; i++) {
+		arrays[i] = g_ptr_array_new ();
+		tny_list_foreach (jobs[i].headers, add_to_array, arrays[i]);
+		if (arrays[i]->len > 0)
+			dates[i] = tny_header_get_date_received (
+				arrays[i]->pdata[arrays[i]->len - 1]);
+	}
+
+	while (TRUE) {
+		gint newest = -1;
+		TnyHeader *header;
+
+		for (i = 0; i < count; i++)
+			if (arrays[i]->len > 0 && (newest == -1 || dates[i] > dates[newest]))
+				newest = i;
+
+		if (newest == -1)
+			break;
+
+		header = g_ptr_array_remove_index (arrays[newest], arrays[newest]->len - 1);
+		tny_list_prepend (headers, (GObject *) header);
+		g_object_unref (header);
+
+		if (arrays[newest]->len > 0)
+			dates[newest] = tny_header_get_date_received (
+				arrays[newest]->pdata[arrays[newest]->len - 1]);
+	}
+
+	for (i = 0; i < count; i++)
+		g_ptr_array_free (arrays[i], TRUE);
+	g_free (arrays);
+	g_free (dates);
+}
+
+/* Gets the headers of all mothers into @headers, or only the ones that match
+ * @query if it's set, or refreshes them all if @headers is NULL. Returns the
+ * error of the first mother that failed */
+static GError *
+run_on_mothers (TnyFolder *self, TnyList *headers, TnySearchQuery *query, gboolean refresh, MothersProgressFunc progress, gpointer user_data)
+{
+	TnyMergeFolderPriv *priv = TNY_MERGE_FOLDER_GET_PRIVATE (self);
+	GAsyncQueue *done = g_async_queue_new ();
+	GError *err = NULL;
+	MotherJob *jobs;
+	TnyIterator *iter;
+	TnyList *copy;
+	guint count, i;
+
+	g_static_rec_mutex_lock (priv->lock);
+	copy = tny_list_copy (priv->mothers);
+	g_static_rec_mutex_unlock (priv->lock);
+
+	count = tny_list_get_length (copy);
+	jobs = g_new0 (MotherJob, count);
+
+	iter = tny_list_create_iterator (copy);
+	for (i = 0; i < count && !tny_iterator_is_done (iter); i++) {
+		jobs[i].folder = TNY_FOLDER (tny_iterator_get_current (iter));
+		jobs[i].headers = headers ? tny_simple_list_new () : NULL;
+		jobs[i].query = query;
+		jobs[i].refresh = refresh;
+		jobs[i].done = done;
+		tny_iterator_next (iter);
+	}
+	count = i;
+	g_object_unref (iter);
+	g_object_unref (copy);
+
+	for (i = 0; i < count; i++) {
+		if (!g_thread_create (mother_job_thread, &jobs[i], FALSE, NULL))
+			mother_job_thread (&jobs[i]);
+	}
+
+	for (i = 0; i < count; i++) {
+		g_async_queue_pop (done);
+		if (progress)
+			progress (self, i + 1, count, user_data);
+	}
+
+	if (headers)
+		merge_headers (jobs, count, headers);
+
+	for (i = 0; i < count; i++) {
+		if (jobs[i].err) {
+			if (!err)
+				err = jobs[i].err;
+			else
+				g_error_free (jobs[i].err);
+		}
+		if (jobs[i].headers)
+			g_object_unref (jobs[i].headers);
+		g_object_unref (jobs[i].folder);
+	}
+
+	g_free (jobs);
+	g_async_queue_unref (done);
+
+	return err;
+}
+
+
 
 typedef struct 
 {
 	TnyFolder *self;
 	TnyList *headers;
+	TnySearchQuery *query;
 	TnyGetHeadersCallback callback;
 	TnyStatusCallback status_callback;
 	gpointer user_data;
 	gboolean cancelled, refresh;
 	guint depth;
 	GError *err;
+	TnyIdleStopper *stopper;
 } GetHeadersFolderInfo;
 
 
@@ -768,10 +923,15 @@ get_headers_async_destroyer (gpointer thr_user_data)
 	/* thread reference */
 	g_object_unref (info->self);
 	g_object_unref (info->headers);
+	if (info->query)
+		g_object_unref (info->query);
 
 	if (info->err)
 		g_error_free (info->err);
 
+	tny_idle_stopper_destroy (info->stopper);
+	info->stopper = NULL;
+
 	g_slice_free (GetHeadersFolderInfo, thr_user_data);
 
 	return;
@@ -789,48 +949,46 @@ get_headers_async_callback (gpointer thr_user_data)
 		tny_lockable_unlock (priv->ui_locker);
 	}
 
+	tny_idle_stopper_stop (info->stopper);
+
 	return FALSE;
 }
 
-
-static gpointer 
-get_headers_async_thread (gpointer thr_user_data)
+static void
+get_headers_async_status (TnyFolder *self, guint done, guint total, gpointer user_data)
 {
-	GetHeadersFolderInfo *info = thr_user_data;
-	TnyFolder *self = info->self;
+	GetHeadersFolderInfo *oinfo = user_data;
 	TnyMergeFolderPriv *priv = TNY_MERGE_FOLDER_GET_PRIVATE (self);
-	TnyIterator *iter;
-	GError *err = NULL;
-	TnyList *copy;
+	TnyProgressInfo *info;
 
-	g_static_rec_mutex_lock (priv->lock);
-	copy = tny_list_copy (priv->mothers);
-	g_static_rec_mutex_unlock (priv->lock);
-
-	info->cancelled = FALSE;
-
-	iter = tny_list_create_iterator (copy);
-	while (!tny_iterator_is_done (iter))
-	{
-		TnyFolder *cur = TNY_FOLDER (tny_iterator_get_current (iter));
-
-		tny_folder_get_headers (cur, info->headers, info->refresh, &err);
+	if (!oinfo->status_callback)
+		return;
 
-		/* TODO: Handler err */
+	if (oinfo->query)
+		info = tny_progress_info_new (G_OBJECT (self), oinfo->status_callback,
+			TNY_FOLDER_STATUS, TNY_FOLDER_STATUS_CODE_SEARCH,
+			_("Searching the merged folders"), done, total,
+			oinfo->stopper, priv->ui_locker, oinfo->user_data);
+	else
+		info = tny_progress_info_new (G_OBJECT (self), oinfo->status_callback,
+			TNY_FOLDER_STATUS, TNY_FOLDER_STATUS_CODE_REFRESH,
+			_("Getting the headers of the merged folders"), done, total,
+			oinfo->stopper, priv->ui_locker, oinfo->user_data);
 
-		/* TODO: Handle progress status callbacks ( info->status_callback )
-		 * you might have to start using refresh_async for that (in a 
-		 * serialized way, else you'd launch a buch of concurrent threads
-		 * and ain't going to be nice, perhaps). */
+	g_idle_add_full (TNY_PRIORITY_LOWER_THAN_GTK_REDRAWS,
+		tny_progress_info_idle_func, info,
+		tny_progress_info_destroy);
+}
 
-		g_object_unref (cur);
-		tny_iterator_next (iter);
-	}
 
-	g_object_unref (iter);
-	g_object_unref (copy);
+static gpointer 
+get_headers_async_thread (gpointer thr_user_data)
+{
+	GetHeadersFolderInfo *info = thr_user_data;
 
-	info->err = NULL;
+	info->cancelled = FALSE;
+	info->err = run_on_mothers (info->self, info->headers, info->query,
+		info->refresh, get_headers_async_status, info);
 
 	if (info->callback)
 	{
@@ -868,6 +1026,7 @@ tny_merge_folder_get_headers_async (TnyFolder *self, TnyList *headers, gboolean
 	info->status_callback = status_callback;
 	info->user_data = user_data;
 	info->depth = g_main_depth ();
+	info->stopper = tny_idle_stopper_new ();
 
 	/* thread reference */
 	g_object_ref (self);
@@ -881,35 +1040,51 @@ tny_merge_folder_get_headers_async (TnyFolder *self, TnyList *headers, gboolean
 static void
 tny_merge_folder_get_headers (TnyFolder *self, TnyList *headers, gboolean refresh, GError **err)
 {
-	TnyMergeFolderPriv *priv = TNY_MERGE_FOLDER_GET_PRIVATE (self);
-	TnyIterator *iter;
-	TnyList *copy;
+	GError *new_err = run_on_mothers (self, headers, NULL, refresh, NULL, NULL);
 
-	g_static_rec_mutex_lock (priv->lock);
-	copy = tny_list_copy (priv->mothers);
-	g_static_rec_mutex_unlock (priv->lock);
+	if (new_err != NULL)
+		g_propagate_error (err, new_err);
 
-	iter = tny_list_create_iterator (copy);
+	return;
+}
 
-	while (!tny_iterator_is_done (iter))
-	{
-		GError *new_err = NULL;
-		TnyFolder *cur = TNY_FOLDER (tny_iterator_get_current (iter));
-		tny_folder_get_headers (cur, headers, refresh, &new_err);
-		g_object_unref (cur);
+static void
+tny_merge_folder_search_async (TnyFolder *self, TnySearchQuery *query, TnyList *headers, TnyGetHeadersCallback callback, TnyStatusCallback status_callback, gpointer user_data)
+{
+	GetHeadersFolderInfo *info;
+	GThread *thread;
 
-		if (new_err != NULL)
-		{
-			g_propagate_error (err, new_err);
-			break;
-		}
+	info = g_slice_new0 (GetHeadersFolderInfo);
+	info->err = NULL;
+	info->self = self;
+	info->headers = headers;
+	info->query = query;
+	info->refresh = FALSE;
+	info->callback = callback;
+	info->status_callback = status_callback;
+	info->user_data = user_data;
+	info->depth = g_main_depth ();
+	info->stopper = tny_idle_stopper_new ();
 
-		tny_iterator_next (iter);
-	}
+	/* thread reference */
+	g_object_ref (self);
+	g_object_ref (headers);
+	g_object_ref (query);
 
-	g_object_unref (iter);
-	g_object_unref (copy);
+	thread = g_thread_create (get_headers_async_thread, info, FALSE, NULL);
+
+	return;
+}
 
+static void
+tny_merge_folder_search (TnyFolder *self, TnySearchQuery *query, TnyList *headers, GError **err)
+{
+	GError *new_err = run_on_mothers (self, headers, query, FALSE, NULL, NULL);
+
+	if (new_err != NULL)
+		g_propagate_error (err, new_err);
+
+	return;
 }
 
 static const gchar*
@@ -1106,33 +1281,10 @@ tny_merge_folder_is_subscribed (TnyFolder *self)
 static void
 tny_merge_folder_refresh (TnyFolder *self, GError **err)
 {
-	TnyMergeFolderPriv *priv = TNY_MERGE_FOLDER_GET_PRIVATE (self);
-	TnyIterator *iter;
-	TnyList *copy;
-
-	g_static_rec_mutex_lock (priv->lock);
-	copy = tny_list_copy (priv->mothers);
-	g_static_rec_mutex_unlock (priv->lock);
+	GError *new_err = run_on_mothers (self, NULL, NULL, FALSE, NULL, NULL);
 
-	iter = tny_list_create_iterator (copy);
-	while (!tny_iterator_is_done (iter))
-	{
-		GError *new_err = NULL;
-		TnyFolder *cur = TNY_FOLDER (tny_iterator_get_current (iter));
-		tny_folder_refresh (cur, &new_err);
-		g_object_unref (cur);
-
-		if (new_err != NULL)
-		{
-			g_propagate_error (err, new_err);
-			break;
-		}
-
-		tny_iterator_next (iter);
-	}
-
-	g_object_unref (iter);
-	g_object_unref (copy);
+	if (new_err != NULL)
+		g_propagate_error (err, new_err);
 
 	return;
 }
@@ -1147,6 +1299,7 @@ typedef struct
 	gboolean cancelled;
 	guint depth;
 	GError *err;
+	TnyIdleStopper *stopper;
 } RefreshFolderInfo;
 
 
@@ -1161,6 +1314,9 @@ refresh_async_destroyer (gpointer thr_user_data)
 	if (info->err)
 		g_error_free (info->err);
 
+	tny_idle_stopper_destroy (info->stopper);
+	info->stopper = NULL;
+
 	g_slice_free (RefreshFolderInfo, thr_user_data);
 
 	return;
@@ -1178,6 +1334,8 @@ refresh_async_callback (gpointer thr_user_data)
 		tny_lockable_unlock (priv->ui_locker);
 	}
 
+	tny_idle_stopper_stop (info->stopper);
+
 	/* TNY TODO: trigger this change notification
 
 	if (info->oldlen != priv->cached_length || info->oldurlen != priv->unread_length)
@@ -1195,45 +1353,34 @@ refresh_async_callback (gpointer thr_user_data)
 }
 
 
-static gpointer 
-refresh_async_thread (gpointer thr_user_data)
+static void
+refresh_async_status (TnyFolder *self, guint done, guint total, gpointer user_data)
 {
-	RefreshFolderInfo *info = thr_user_data;
-	TnyFolder *self = info->self;
+	RefreshFolderInfo *oinfo = user_data;
 	TnyMergeFolderPriv *priv = TNY_MERGE_FOLDER_GET_PRIVATE (self);
-	TnyIterator *iter;
-	GError *err = NULL;
-	TnyList *copy;
-
-	g_static_rec_mutex_lock (priv->lock);
-	copy = tny_list_copy (priv->mothers);
-	g_static_rec_mutex_unlock (priv->lock);
+	TnyProgressInfo *info;
 
-	info->cancelled = FALSE;
-
-	iter = tny_list_create_iterator (copy);
-	while (!tny_iterator_is_done (iter))
-	{
-		TnyFolder *cur = TNY_FOLDER (tny_iterator_get_current (iter));
-
-		tny_folder_refresh (cur, &err);
-
-		/* TODO: Handler err */
-
-		/* TODO: Handle progress status callbacks ( info->status_callback )
-		 * you might have to start using refresh_async for that (in a 
-		 * serialized way, else you'd launch a buch of concurrent threads
-		 * and ain't going to be nice, perhaps). */
+	if (!oinfo->status_callback)
+		return;
 
-		g_object_unref (cur);
-		tny_iterator_next (iter);
-	}
+	info = tny_progress_info_new (G_OBJECT (self), oinfo->status_callback,
+		TNY_FOLDER_STATUS, TNY_FOLDER_STATUS_CODE_REFRESH,
+		_("Refreshing the merged folders"), done, total,
+		oinfo->stopper, priv->ui_locker, oinfo->user_data);
 
-	g_object_unref (iter);
-	g_object_unref (copy);
+	g_idle_add_full (TNY_PRIORITY_LOWER_THAN_GTK_REDRAWS,
+		tny_progress_info_idle_func, info,
+		tny_progress_info_destroy);
+}
 
-	info->err = NULL;
+static gpointer 
+refresh_async_thread (gpointer thr_user_data)
+{
+	RefreshFolderInfo *info = thr_user_data;
 
+	info->cancelled = FALSE;
+	info->err = run_on_mothers (info->self, NULL, NULL, FALSE,
+		refresh_async_status, info);
 
 	if (info->callback)
 	{
@@ -1269,6 +1416,7 @@ tny_merge_folder_refresh_async (TnyFolder *self, TnyFolderCallback callback, Tny
 	info->status_callback = status_callback;
 	info->user_data = user_data;
 	info->depth = g_main_depth ();
+	info->stopper = tny_idle_stopper_new ();
 
 	/* thread reference */
 	g_object_ref (self);
@@ -1986,6 +2134,8 @@ tny_folder_init (TnyFolderIface *klass)
 	klass->get_caps= tny_merge_folder_get_caps;
 	klass->remove_msgs= tny_merge_folder_remove_msgs;
 	klass->remove_msgs_async= tny_merge_folder_remove_msgs_async;
+	klass->search= tny_merge_folder_search;
+	klass->search_async= tny_merge_folder_search_async;
 }
 
 static void
@@ -0,0 +1,318 @@
+/* libtinymail - The Tiny Mail base library
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.	 See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with self library; if not, write to the
+ * Free Software Foundation, Inc., 51 Franklin Street, Fifth Floor,
+ * Boston, MA 02110-1301, USA.
+ */
+
+/**
+ * TnySearchQuery:
+ *
+ * A query for searching the messages of a folder with tny_folder_search()
+ *
+ * free-function: g_object_unref
+ **/
+
+#include <config.h>
+
+#include <glib.h>
+#include <glib/gi18n-lib.h>
+
+#include <tny-search-query.h>
+#include <tny-simple-list.h>
+
+static GObjectClass *parent_class;
+static GObjectClass *item_parent_class;
+
+/**
+ * tny_search_query_new:
+ *
+ * Create a new #TnySearchQuery instance. A query without items matches all
+ * the messages.
+ *
+ * returns: (caller-owns): a new #TnySearchQuery instance
+ * since: 1.0
+ * audience: application-developer
+ **/
+TnySearchQuery*
+tny_search_query_new (void)
+{
+	TnySearchQuery *self = g_object_new (TNY_TYPE_SEARCH_QUERY, NULL);
+	return self;
+}
+
+static void
+tny_search_query_item_finalize (GObject *object)
+{
+	TnySearchQueryItem *self = (TnySearchQueryItem*) object;
+
+	if (self->pattern)
+		g_free (self->pattern);
+
+	item_parent_class->finalize (object);
+}
+
+static void
+tny_search_query_finalize (GObject *object)
+{
+	TnySearchQuery *self = (TnySearchQuery*) object;
+	g_object_unref (self->items);
+	parent_class->finalize (object);
+	return;
+}
+
+static void
+tny_search_query_item_class_init (TnySearchQueryItemClass *klass)
+{
+	GObjectClass *object_class;
+	object_class = (GObjectClass *)klass;
+	item_parent_class = g_type_class_peek_parent (klass);
+	object_class->finalize = tny_search_query_item_finalize;
+	return;
+}
+
+static void
+tny_search_query_class_init (TnySearchQueryClass *klass)
+{
+	GObjectClass *object_class;
+	object_class = (GObjectClass *)klass;
+	parent_class = g_type_class_peek_parent (klass);
+	object_class->finalize = tny_search_query_finalize;
+	return;
+}
+
+static void
+tny_search_query_item_init (TnySearchQueryItem *self)
+{
+	self->field = TNY_SEARCH_QUERY_FIELD_SUBJECT;
+	self->pattern = NULL;
+
+	return;
+}
+
+static void
+tny_search_query_init (TnySearchQuery *self)
+{
+	self->items = tny_simple_list_new ();
+	return;
+}
+
+
+static gpointer
+tny_search_query_register_type (gpointer notused)
+{
+	GType object_type = 0;
+
+	static const GTypeInfo object_info =
+		{
+			sizeof (TnySearchQueryClass),
+			NULL,		/* base_init */
+			NULL,		/* base_finalize */
+			(GClassInitFunc) tny_search_query_class_init,
+			NULL,		/* class_finalize */
+			NULL,		/* class_data */
+			sizeof (TnySearchQuery),
+			0,              /* n_preallocs */
+			(GInstanceInitFunc) tny_search_query_init,
+			NULL
+		};
+	object_type = g_type_register_static (G_TYPE_OBJECT,
+					      "TnySearchQuery", &object_info, 0);
+
+	return GSIZE_TO_POINTER (object_type);
+}
+
+/**
+ * tny_search_query_get_type:
+ *
+ * GType system helper function
+ *
+ * returns: a #GType
+ **/
+GType
+tny_search_query_get_type (void)
+{
+	static GOnce once = G_ONCE_INIT;
+	g_once (&once, tny_search_query_register_type, NULL);
+	return GPOINTER_TO_SIZE (once.retval);
+}
+
+static gpointer
+tny_search_query_item_register_type (gpointer notused)
+{
+	GType object_type = 0;
+
+	static const GTypeInfo object_info =
+		{
+			sizeof (TnySearchQueryItemClass),
+			NULL,		/* base_init */
+			NULL,		/* base_finalize */
+			(GClassInitFunc) tny_search_query_item_class_init,
+			NULL,		/* class_finalize */
+			NULL,		/* class_data */
+			sizeof (TnySearchQueryItem),
+			0,              /* n_preallocs */
+			(GInstanceInitFunc) tny_search_query_item_init,
+			NULL
+		};
+	object_type = g_type_register_static (G_TYPE_OBJECT,
+					      "TnySearchQueryItem", &object_info, 0);
+
+	return GSIZE_TO_POINTER (object_type);
+}
+
+/**
+ * tny_search_query_item_get_type:
+ *
+ * GType system helper function
+ *
+ * returns: a #GType
+ **/
+GType
+tny_search_query_item_get_type (void)
+{
+	static GOnce once = G_ONCE_INIT;
+	g_once (&once, tny_search_query_item_register_type, NULL);
+	return GPOINTER_TO_SIZE (once.retval);
+}
+
+
+/**
+ * tny_search_query_add_item:
+ * @query: a #TnySearchQuery
+ * @field: a #TnySearchQueryField
+ * @pattern: the text to look for
+ *
+ * Add a query-item to @query. A message matches the item if @field of the
+ * message contains @pattern, ignoring case. A message matches @query if it
+ * matches all of its items.
+ *
+ * The header fields are matched against the summary of the folder, for the
+ * body the service is asked if it can search itself (like IMAP can, when
+ * online). Else the bodies that are available locally are searched.
+ *
+ * Example:
+ * <informalexample><programlisting>
+ * TnySearchQuery *query = tny_search_query_new ();
+ * TnyList *headers = tny_simple_list_new ();
+ * TnyFolder *folder = ...;
+ * tny_search_query_add_item (query, TNY_SEARCH_QUERY_FIELD_FROM, "gnome.org");
+ * tny_search_query_add_item (query, TNY_SEARCH_QUERY_FIELD_SUBJECT, "tinymail");
+ * tny_folder_search (folder, query, headers, NULL);
+ * g_print ("%d messages found\n", tny_list_get_length (headers));
+ * g_object_unref (headers);
+ * g_object_unref (query);
+ * </programlisting></informalexample>
+ *
+ * since: 1.0
+ * audience: application-developer
+ **/
+void
+tny_search_query_add_item (TnySearchQuery *query, TnySearchQueryField field, const gchar *pattern)
+{
+	TnySearchQueryItem *add;
+
+	g_return_if_fail (pattern != NULL);
+
+	add = g_object_new (TNY_TYPE_SEARCH_QUERY_ITEM, NULL);
+	add->field = field;
+	add->pattern = g_strdup (pattern);
+
+	tny_list_append (query->items, (GObject *) add);
+	g_object_unref (add);
+
+	return;
+}
+
+/**
+ * tny_search_query_get_items:
+ * @query: a #TnySearchQuery
+ *
+ * Get a list of query items in @query, in the order in which they were added.
+ * The return value must be unreferenced after use.
+ *
+ * returns: (caller-owns): a list of query items
+ * since: 1.0
+ * audience: tinymail-developer
+ **/
+TnyList*
+tny_search_query_get_items (TnySearchQuery *query)
+{
+	return TNY_LIST (g_object_ref (query->items));
+}
+
+
+/**
+ * tny_search_query_item_get_field:
+ * @item: a #TnySearchQueryItem
+ *
+ * Get the field of the messages that @item matches on.
+ *
+ * returns: the field of a query item
+ * since: 1.0
+ * audience: tinymail-developer
+ **/
+TnySearchQueryField
+tny_search_query_item_get_field (TnySearchQueryItem *item)
+{
+	return item->field;
+}
+
+
+/**
+ * tny_search_query_item_get_pattern:
+ * @item: a #TnySearchQueryItem
+ *
+ * Get the text that @item looks for. You must not free the returned value.
+ *
+ * returns: the pattern of a query item
+ * since: 1.0
+ * audience: tinymail-developer
+ **/
+const gchar*
+tny_search_query_item_get_pattern (TnySearchQueryItem *item)
+{
+	return (const gchar*) item->pattern;
+}
+
+static gpointer
+tny_search_query_field_register_type (gpointer notused)
+{
+	GType etype = 0;
+	static const GEnumValue values[] = {
+		{ TNY_SEARCH_QUERY_FIELD_SUBJECT, "TNY_SEARCH_QUERY_FIELD_SUBJECT", "subject" },
+		{ TNY_SEARCH_QUERY_FIELD_FROM, "TNY_SEARCH_QUERY_FIELD_FROM", "from" },
+		{ TNY_SEARCH_QUERY_FIELD_TO, "TNY_SEARCH_QUERY_FIELD_TO", "to" },
+		{ TNY_SEARCH_QUERY_FIELD_CC, "TNY_SEARCH_QUERY_FIELD_CC", "cc" },
+		{ TNY_SEARCH_QUERY_FIELD_BODY, "TNY_SEARCH_QUERY_FIELD_BODY", "body" },
+		{ 0, NULL, NULL }
+	};
+	etype = g_enum_register_static ("TnySearchQueryField", values);
+	return GSIZE_TO_POINTER (etype);
+}
+
+/**
+ * tny_search_query_field_get_type:
+ *
+ * GType system helper function
+ *
+ * returns: a #GType
+ **/
+GType
+tny_search_query_field_get_type (void)
+{
+	static GOnce once = G_ONCE_INIT;
+	g_once (&once, tny_search_query_field_register_type, NULL);
+	return GPOINTER_TO_SIZE (once.retval);
+}
@@ -0,0 +1,95 @@
+#ifndef TNY_SEARCH_QUERY_H
+#define TNY_SEARCH_QUERY_H
+
+/* libtinymail - The Tiny Mail base library
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.	 See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with self library; if not, write to the
+ * Free Software Foundation, Inc., 51 Franklin Street, Fifth Floor,
+ * Boston, MA 02110-1301, USA.
+ */
+
+#include <tny-shared.h>
+#include <tny-list.h>
+#include <tny-iterator.h>
+
+G_BEGIN_DECLS
+
+#define TNY_TYPE_SEARCH_QUERY             (tny_search_query_get_type ())
+#define TNY_SEARCH_QUERY(obj)             (G_TYPE_CHECK_INSTANCE_CAST ((obj), TNY_TYPE_SEARCH_QUERY, TnySearchQuery))
+#define TNY_SEARCH_QUERY_CLASS(vtable)    (G_TYPE_CHECK_CLASS_CAST ((vtable), TNY_TYPE_SEARCH_QUERY, TnySearchQueryClass))
+#define TNY_IS_SEARCH_QUERY(obj)          (G_TYPE_CHECK_INSTANCE_TYPE ((obj), TNY_TYPE_SEARCH_QUERY))
+#define TNY_IS_SEARCH_QUERY_CLASS(vtable) (G_TYPE_CHECK_CLASS_TYPE ((vtable), TNY_TYPE_SEARCH_QUERY))
+#define TNY_SEARCH_QUERY_GET_CLASS(inst)  (G_TYPE_INSTANCE_GET_CLASS ((inst), TNY_TYPE_SEARCH_QUERY, TnySearchQueryClass))
+
+#define TNY_TYPE_SEARCH_QUERY_ITEM             (tny_search_query_item_get_type ())
+#define TNY_SEARCH_QUERY_ITEM(obj)             (G_TYPE_CHECK_INSTANCE_CAST ((obj), TNY_TYPE_SEARCH_QUERY_ITEM, TnySearchQueryItem))
+#define TNY_SEARCH_QUERY_ITEM_CLASS(vtable)    (G_TYPE_CHECK_CLASS_CAST ((vtable), TNY_TYPE_SEARCH_QUERY_ITEM, TnySearchQueryItemClass))
+#define TNY_IS_SEARCH_QUERY_ITEM(obj)          (G_TYPE_CHECK_INSTANCE_TYPE ((obj), TNY_TYPE_SEARCH_QUERY_ITEM))
+#define TNY_IS_SEARCH_QUERY_ITEM_CLASS(vtable) (G_TYPE_CHECK_CLASS_TYPE ((vtable), TNY_TYPE_SEARCH_QUERY_ITEM))
+#define TNY_SEARCH_QUERY_ITEM_GET_CLASS(inst)  (G_TYPE_INSTANCE_GET_CLASS ((inst), TNY_TYPE_SEARCH_QUERY_ITEM, TnySearchQueryItemClass))
+
+#define TNY_TYPE_SEARCH_QUERY_FIELD (tny_search_query_field_get_type())
+
+typedef enum
+{
+	TNY_SEARCH_QUERY_FIELD_SUBJECT,
+	TNY_SEARCH_QUERY_FIELD_FROM,
+	TNY_SEARCH_QUERY_FIELD_TO,
+	TNY_SEARCH_QUERY_FIELD_CC,
+	TNY_SEARCH_QUERY_FIELD_BODY
+} TnySearchQueryField;
+
+#ifndef TNY_SHARED_H
+typedef struct _TnySearchQuery TnySearchQuery;
+typedef struct _TnySearchQueryClass TnySearchQueryClass;
+typedef struct _TnySearchQueryItem TnySearchQueryItem;
+typedef struct _TnySearchQueryItemClass TnySearchQueryItemClass;
+#endif
+
+struct _TnySearchQueryItem
+{
+	GObject parent;
+	TnySearchQueryField field;
+	gchar *pattern;
+};
+
+struct _TnySearchQueryItemClass
+{
+	GObjectClass parent;
+};
+
+struct _TnySearchQuery
+{
+	GObject parent;
+	TnyList *items;
+};
+
+struct _TnySearchQueryClass
+{
+	GObjectClass parent;
+};
+
+GType tny_search_query_get_type (void);
+GType tny_search_query_item_get_type (void);
+GType tny_search_query_field_get_type (void);
+
+TnySearchQuery* tny_search_query_new (void);
+void tny_search_query_add_item (TnySearchQuery *query, TnySearchQueryField field, const gchar *pattern);
+TnyList* tny_search_query_get_items (TnySearchQuery *query);
+TnySearchQueryField tny_search_query_item_get_field (TnySearchQueryItem *item);
+const gchar* tny_search_query_item_get_pattern (TnySearchQueryItem *item);
+
+G_END_DECLS
+
+#endif
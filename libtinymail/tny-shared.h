@@ -72,6 +72,10 @@ typedef struct _TnyFolderStoreQuery TnyFolderStoreQuery;
 typedef struct _TnyFolderStoreQueryClass TnyFolderStoreQueryClass;
 typedef struct _TnyFolderStoreQueryItem TnyFolderStoreQueryItem;
 typedef struct _TnyFolderStoreQueryItemClass TnyFolderStoreQueryItemClass;
+typedef struct _TnySearchQuery TnySearchQuery;
+typedef struct _TnySearchQueryClass TnySearchQueryClass;
+typedef struct _TnySearchQueryItem TnySearchQueryItem;
+typedef struct _TnySearchQueryItemClass TnySearchQueryItemClass;
 typedef struct _TnyMsgRemoveStrategy TnyMsgRemoveStrategy;
 typedef struct _TnyMsgRemoveStrategyIface TnyMsgRemoveStrategyIface;
 typedef struct _TnySendQueue TnySendQueue;
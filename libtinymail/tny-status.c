@@ -331,6 +331,7 @@ tny_status_code_register_type (gpointer notused)
     { TNY_FOLDER_STATUS_CODE_COPY_FOLDER, "TNY_FOLDER_STATUS_CODE_COPY_FOLDER", "copy-folder" },
     { TNY_GET_SUPPORTED_SECURE_AUTH_STATUS_GET_SECURE_AUTH, "TNY_GET_SUPPORTED_SECURE_AUTH_STATUS_GET_SECURE_AUTH", "get-secure-auth" },
     { TNY_FOLDER_STATUS_CODE_SYNC, "TNY_FOLDER_STATUS_CODE_SYNC", "code-sync" },
+    { TNY_FOLDER_STATUS_CODE_SEARCH, "TNY_FOLDER_STATUS_CODE_SEARCH", "code-search" },
     { 0, NULL, NULL }
   };
   etype = g_enum_register_static ("TnyStatusCode", values);
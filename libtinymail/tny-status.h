@@ -49,7 +49,8 @@ typedef enum
 	TNY_FOLDER_STATUS_CODE_XFER_MSGS = 4,
 	TNY_FOLDER_STATUS_CODE_COPY_FOLDER = 5,
 	TNY_GET_SUPPORTED_SECURE_AUTH_STATUS_GET_SECURE_AUTH = 6,
-	TNY_FOLDER_STATUS_CODE_SYNC = 7
+	TNY_FOLDER_STATUS_CODE_SYNC = 7,
+	TNY_FOLDER_STATUS_CODE_SEARCH = 8
 } TnyStatusCode;
 
 struct _TnyStatus 
@@ -27,6 +27,7 @@
 #include <tny-msg-remove-strategy.h>
 #include <tny-noop-lockable.h>
 #include <tny-pair.h>
+#include <tny-search-query.h>
 #include <tny-password-getter.h>
 #include <tny-send-queue.h>
 #include <tny-signals-marshal.h>
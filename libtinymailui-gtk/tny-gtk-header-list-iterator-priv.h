@@ -26,6 +26,9 @@
 #include <tny-shared.h>
 #include <tny-list.h>
 #include <tny-iterator.h>
+#include <gtk/gtk.h>
+
+#include <tny-gtk-header-list-model.h>
 
 G_BEGIN_DECLS
 
@@ -66,6 +69,13 @@ void _tny_gtk_header_list_iterator_next_nl (TnyGtkHeaderListIterator *me);
 
 typedef struct _TnyGtkHeaderListModelPriv TnyGtkHeaderListModelPriv;
 
+typedef struct
+{
+	GtkTreeIterCompareFunc func;
+	gpointer user_data;
+	GDestroyNotify destroy;
+} TnyGtkHeaderListModelSortFunc;
+
 struct _TnyGtkHeaderListModelPriv
 {
 	GStaticRecMutex *iterator_lock;
@@ -78,15 +88,30 @@ struct _TnyGtkHeaderListModelPriv
 
 	guint timeout_span;
 	GPtrArray *items;
-	GArray *del_timeouts;
+	GHashTable *pending_deletes;
+	guint delete_timeout;
 	TnyIterator *iterator;
 	gboolean no_duplicates;
+	GHashTable *uids;
 	gint show_latest;
 	GPtrArray *not_latest_items;
 	time_t oldest_received;
 	guint headers_per_batch;
+	TnyList *view;
+	TnyIterator *view_iter;
+	guint resync_timeout;
+	gint sort_column;
+	GtkSortType sort_order;
+	guint sorted;
+	GHashTable *sort_keys;
+	TnyGtkHeaderListModelSortFunc sort_funcs[TNY_GTK_HEADER_LIST_MODEL_N_COLUMNS];
+	TnyGtkHeaderListModelSortFunc default_sort;
+	time_t rdate_minute;
+	gchar rdate[64];
 };
 
+gpointer _tny_gtk_header_list_model_get_item_nl (TnyGtkHeaderListModelPriv *priv, guint i);
+
 G_END_DECLS
 
 #endif
@@ -229,7 +229,7 @@ gpointer
 _tny_gtk_header_list_iterator_get_current_nl (TnyGtkHeaderListIterator *me)
 {
 	TnyGtkHeaderListModelPriv *mpriv = TNY_GTK_HEADER_LIST_MODEL_GET_PRIVATE (me->model);
-	return mpriv->items->pdata[me->current];
+	return _tny_gtk_header_list_model_get_item_nl (mpriv, me->current);
 }
 
 static GObject* 
@@ -247,7 +247,7 @@ tny_gtk_header_list_iterator_get_current (TnyIterator *self)
 	mpriv = TNY_GTK_HEADER_LIST_MODEL_GET_PRIVATE (me->model);
 
 	g_static_rec_mutex_lock (mpriv->iterator_lock);
-	retval = mpriv->items->pdata[me->current];
+	retval = _tny_gtk_header_list_model_get_item_nl (mpriv, me->current);
 	if (retval)
 		g_object_ref (retval);
 	g_static_rec_mutex_unlock (mpriv->iterator_lock);
@@ -32,11 +32,16 @@
  * you get out of the instance column of this type using the #GtkTreeModel API
  * gtk_tree_model_get().
  *
+ * A #TnyGtkHeaderListModel is a #GtkTreeSortable too. Sorting it by one of its
+ * columns is a lot faster than sorting a #GtkTreeModelSort on top of it, as it
+ * compares precomputed keys rather than the values of its cells.
+ *
  * free-function: g_object_unref
  **/
 
 #include <config.h>
 
+#include <string.h>
 #include <glib.h>
 #include <glib/gi18n-lib.h>
 #include <gdk/gdk.h>
@@ -64,50 +69,133 @@ static GObjectClass *parent_class;
 
 static void update_oldest_received (TnyGtkHeaderListModel *self, TnyHeader *header);
 
-static gint 
-add_del_timeout (TnyGtkHeaderListModel *me, guint num)
+/* With a view set, the rows only get their header once it's needed */
+gpointer
+_tny_gtk_header_list_model_get_item_nl (TnyGtkHeaderListModelPriv *priv, guint i)
 {
-	TnyGtkHeaderListModelPriv *priv = TNY_GTK_HEADER_LIST_MODEL_GET_PRIVATE (me);
+	if (i >= priv->items->len)
+		return NULL;
+
+	if (!priv->items->pdata[i] && priv->view) {
+		tny_iterator_nth (priv->view_iter, i);
+		priv->items->pdata[i] = tny_iterator_get_current (priv->view_iter);
+	}
+
+	return priv->items->pdata[i];
+}
+
+static void
+unref_item (gpointer item, gpointer user_data)
+{
+	if (item)
+		g_object_unref (item);
+}
+
+/* With no_duplicates set, priv->uids maps the UID of each item of priv->items
+ * and priv->not_latest_items to that item. Call with the iterator_lock held */
+static void
+uids_add (TnyGtkHeaderListModelPriv *priv, GObject *item)
+{
+	gchar *uid;
+
+	if (!priv->uids)
+		return;
+
+	uid = tny_header_dup_uid ((TnyHeader *) item);
+	if (uid)
+		g_hash_table_insert (priv->uids, uid, item);
+}
+
+static void
+uids_remove (TnyGtkHeaderListModelPriv *priv, GObject *item)
+{
+	gchar *uid;
+
+	if (!priv->uids)
+		return;
+
+	uid = tny_header_dup_uid ((TnyHeader *) item);
+	if (uid) {
+		/* A newer duplicate might have replaced it already */
+		if (g_hash_table_lookup (priv->uids, uid) == item)
+			g_hash_table_remove (priv->uids, uid);
+		g_free (uid);
+	}
+}
+
+static void
+uids_add_all (TnyGtkHeaderListModelPriv *priv)
+{
+	guint i;
+
+	for (i = 0; i < priv->items->len; i++)
+		if (priv->items->pdata[i])
+			uids_add (priv, priv->items->pdata[i]);
+	for (i = 0; i < priv->not_latest_items->len; i++)
+		uids_add (priv, priv->not_latest_items->pdata[i]);
+}
+
+static gboolean notify_views_delete (gpointer data);
+
+static void
+notify_views_delete_destroy (gpointer data)
+{
+	TnyGtkHeaderListModelPriv *priv = TNY_GTK_HEADER_LIST_MODEL_GET_PRIVATE (data);
 
-	gint retval = 0;
 	g_mutex_lock (priv->to_lock);
-	if (!priv->del_timeouts)
-		priv->del_timeouts = g_array_new (FALSE, FALSE, sizeof (guint));
-	g_array_append_val (priv->del_timeouts, num);
-	retval = priv->del_timeouts->len-1;
+	priv->delete_timeout = 0;
 	g_mutex_unlock (priv->to_lock);
+	g_object_unref (data);
 
-	return retval;
+	return;
 }
 
+/* Removals get collected and are all done by one notify_views_delete in the
+ * mainloop, in one pass over the items */
 static void
-remove_del_timeouts (TnyGtkHeaderListModel *me)
+schedule_delete (TnyGtkHeaderListModel *me, GObject *item)
 {
 	TnyGtkHeaderListModelPriv *priv = TNY_GTK_HEADER_LIST_MODEL_GET_PRIVATE (me);
 
-	gint i;
-	guint src;
-
 	g_mutex_lock (priv->to_lock);
 
-	if (!priv->del_timeouts)
-	{
-		g_mutex_unlock (priv->to_lock);
-		return;
-	}
+	if (!priv->pending_deletes)
+		priv->pending_deletes = g_hash_table_new_full (g_direct_hash,
+			g_direct_equal, NULL, g_object_unref);
 
-	for (i = 0; i < priv->del_timeouts->len; i++)
-	{
-		src = g_array_index (priv->del_timeouts, guint, i);
-		if (src > 0)
-			g_source_remove (src);
-		g_array_index (priv->del_timeouts, guint, i) = 0;
+	if (!g_hash_table_lookup (priv->pending_deletes, item))
+		g_hash_table_insert (priv->pending_deletes, item, g_object_ref (item));
+
+	if (priv->delete_timeout == 0) {
+		g_object_ref (me);
+		priv->delete_timeout = g_timeout_add_full (G_PRIORITY_HIGH_IDLE, 0,
+			notify_views_delete, me, notify_views_delete_destroy);
 	}
-	g_array_free (priv->del_timeouts, TRUE);
-	priv->del_timeouts = NULL;
+
 	g_mutex_unlock (priv->to_lock);
 }
 
+static void
+remove_pending_deletes (TnyGtkHeaderListModel *me)
+{
+	TnyGtkHeaderListModelPriv *priv = TNY_GTK_HEADER_LIST_MODEL_GET_PRIVATE (me);
+	GHashTable *pending;
+	guint src;
+
+	g_mutex_lock (priv->to_lock);
+	pending = priv->pending_deletes;
+	priv->pending_deletes = NULL;
+	src = priv->delete_timeout;
+	g_mutex_unlock (priv->to_lock);
+
+	/* The destroy notify resets delete_timeout */
+	if (src > 0)
+		g_source_remove (src);
+
+	if (pending)
+		g_hash_table_destroy (pending);
+}
+
 static guint
 tny_gtk_header_list_model_get_flags (GtkTreeModel *self)
 {
@@ -219,19 +307,26 @@ tny_gtk_header_list_model_get_path (GtkTreeModel *self, GtkTreeIter *iter)
 }
 
 
+/* The format has no seconds, so a sorted column keeps asking for the same
+ * string. Call with the iterator_lock held */
 static gchar *
-_get_readable_date (time_t file_time_raw)
+_get_readable_date (TnyGtkHeaderListModelPriv *priv, time_t file_time_raw)
 {
 	struct tm file_time;
-	static gchar readable_date[64];
 	gsize readable_date_size;
 
+	if (file_time_raw / 60 == priv->rdate_minute)
+		return priv->rdate[0] ? priv->rdate : NULL;
+
 	gmtime_r (&file_time_raw, &file_time);
 
-	readable_date_size = strftime (readable_date, 63, _("%Y-%m-%d, %-I:%M %p"), &file_time);
+	readable_date_size = strftime (priv->rdate, 63, _("%Y-%m-%d, %-I:%M %p"), &file_time);
+	if (readable_date_size == 0)
+		priv->rdate[0] = '\0';
+	priv->rdate_minute = file_time_raw / 60;
 
 	if (readable_date_size > 0)
-		return readable_date;
+		return priv->rdate;
 
 	return NULL;
 }
@@ -263,11 +358,11 @@ tny_gtk_header_list_model_received_date_sort_func (GtkTreeModel *model, GtkTreeI
 
 	g_static_rec_mutex_lock (priv->iterator_lock);
 
-	hdr_a = priv->items->pdata[(gint)a->user_data];
-	hdr_b = priv->items->pdata[(gint)b->user_data];
+	hdr_a = _tny_gtk_header_list_model_get_item_nl (priv, (gint)a->user_data);
+	hdr_b = _tny_gtk_header_list_model_get_item_nl (priv, (gint)b->user_data);
 
-	recv_a = tny_header_get_date_received (hdr_a);
-	recv_b = tny_header_get_date_received (hdr_b);
+	recv_a = hdr_a ? tny_header_get_date_received (hdr_a) : 0;
+	recv_b = hdr_b ? tny_header_get_date_received (hdr_b) : 0;
 	g_static_rec_mutex_unlock (priv->iterator_lock);
 
 	return (recv_a - recv_b);
@@ -300,11 +395,11 @@ tny_gtk_header_list_model_sent_date_sort_func (GtkTreeModel *model, GtkTreeIter
 
 	g_static_rec_mutex_lock (priv->iterator_lock);
 
-	hdr_a = priv->items->pdata[(gint)a->user_data];
-	hdr_b = priv->items->pdata[(gint)b->user_data];
+	hdr_a = _tny_gtk_header_list_model_get_item_nl (priv, (gint)a->user_data);
+	hdr_b = _tny_gtk_header_list_model_get_item_nl (priv, (gint)b->user_data);
 
-	recv_a = tny_header_get_date_sent (hdr_a);
-	recv_b = tny_header_get_date_sent (hdr_b);
+	recv_a = hdr_a ? tny_header_get_date_sent (hdr_a) : 0;
+	recv_b = hdr_b ? tny_header_get_date_sent (hdr_b) : 0;
 
 	g_static_rec_mutex_unlock (priv->iterator_lock);
 
@@ -355,6 +450,7 @@ tny_gtk_header_list_model_get_value (GtkTreeModel *self, GtkTreeIter *iter, gint
 
 	gchar *str;
 	gchar *rdate = NULL;
+	TnyHeader *header;
 	gint i;
 
 	if (iter->stamp != priv->stamp) {
@@ -382,14 +478,18 @@ tny_gtk_header_list_model_get_value (GtkTreeModel *self, GtkTreeIter *iter, gint
 		return;
 	}
 
-	if (priv->items->pdata[i] == NULL) {
-		g_warning ("GtkTreeModel in invalid state\n");
+	header = _tny_gtk_header_list_model_get_item_nl (priv, i);
+
+	if (header == NULL) {
+		/* A view can get shorter before the rows are removed */
+		if (!priv->view)
+			g_warning ("GtkTreeModel in invalid state\n");
 		set_dummy (column, value);
 		g_static_rec_mutex_unlock (priv->iterator_lock);
 		return;
 	}
 
-	if (!TNY_IS_HEADER (priv->items->pdata[i])) {
+	if (!TNY_IS_HEADER (header)) {
 		g_warning ("GtkTreeModel in invalid state\n");
 		set_dummy (column, value);
 		g_static_rec_mutex_unlock (priv->iterator_lock);
@@ -400,13 +500,13 @@ tny_gtk_header_list_model_get_value (GtkTreeModel *self, GtkTreeIter *iter, gint
 	{
 		case TNY_GTK_HEADER_LIST_MODEL_CC_COLUMN:
 			g_value_init (value, G_TYPE_STRING);
-			str = tny_header_dup_cc ((TnyHeader*) priv->items->pdata[i]);
+			str = tny_header_dup_cc (header);
 			if (str)
 				g_value_take_string (value, str);
 			break;
 		case TNY_GTK_HEADER_LIST_MODEL_DATE_SENT_COLUMN:
 			g_value_init (value, G_TYPE_STRING);
-			rdate = _get_readable_date (tny_header_get_date_sent ((TnyHeader*) priv->items->pdata[i]));
+			rdate = _get_readable_date (priv, tny_header_get_date_sent (header));
 			if (rdate)
 				g_value_set_string (value, rdate);
 			else
@@ -414,7 +514,7 @@ tny_gtk_header_list_model_get_value (GtkTreeModel *self, GtkTreeIter *iter, gint
 			break;
 		case TNY_GTK_HEADER_LIST_MODEL_DATE_RECEIVED_COLUMN:
 			g_value_init (value, G_TYPE_STRING);
-			rdate = _get_readable_date (tny_header_get_date_received ((TnyHeader*) priv->items->pdata[i]));
+			rdate = _get_readable_date (priv, tny_header_get_date_received (header));
 			if (rdate)
 				g_value_set_string (value, rdate);
 			else
@@ -423,43 +523,43 @@ tny_gtk_header_list_model_get_value (GtkTreeModel *self, GtkTreeIter *iter, gint
 		case TNY_GTK_HEADER_LIST_MODEL_DATE_SENT_TIME_T_COLUMN:
 			g_value_init (value, G_TYPE_INT);
 			g_value_set_int (value, 
-					    tny_header_get_date_sent ((TnyHeader*) priv->items->pdata[i]));
+					    tny_header_get_date_sent (header));
 			break;
 		case TNY_GTK_HEADER_LIST_MODEL_DATE_RECEIVED_TIME_T_COLUMN:
 			g_value_init (value, G_TYPE_INT);
 			g_value_set_int (value, 
-					 tny_header_get_date_received ((TnyHeader*) priv->items->pdata[i]));
+					 tny_header_get_date_received (header));
 			break;
 
 		case TNY_GTK_HEADER_LIST_MODEL_MESSAGE_SIZE_COLUMN:
 			g_value_init (value, G_TYPE_INT);
-			g_value_set_int (value, tny_header_get_message_size((TnyHeader*) priv->items->pdata[i]));
+			g_value_set_int (value, tny_header_get_message_size(header));
 			break;			
 		case TNY_GTK_HEADER_LIST_MODEL_INSTANCE_COLUMN:
 			g_value_init (value, G_TYPE_OBJECT);
-			g_value_set_object (value, (TnyHeader*) priv->items->pdata[i]);
+			g_value_set_object (value, header);
 			break;
 		case TNY_GTK_HEADER_LIST_MODEL_TO_COLUMN:
 			g_value_init (value, G_TYPE_STRING);
-			str = tny_header_dup_to ((TnyHeader*) priv->items->pdata[i]);
+			str = tny_header_dup_to (header);
 			if (str)
 				g_value_take_string (value, str);
 			break;
 		case TNY_GTK_HEADER_LIST_MODEL_SUBJECT_COLUMN:
 			g_value_init (value, G_TYPE_STRING);
-			str = tny_header_dup_subject ((TnyHeader*) priv->items->pdata[i]);
+			str = tny_header_dup_subject (header);
 			if (str)
 				g_value_take_string (value, str);
 			break;
 		case TNY_GTK_HEADER_LIST_MODEL_FROM_COLUMN:
 			g_value_init (value, G_TYPE_STRING);
-			str = tny_header_dup_from ((TnyHeader*) priv->items->pdata[i]);
+			str = tny_header_dup_from (header);
 			if (str)
 				g_value_take_string (value, str);
 			break;
 		case TNY_GTK_HEADER_LIST_MODEL_FLAGS_COLUMN:
 			g_value_init (value, G_TYPE_INT);
-			g_value_set_int (value, tny_header_get_flags ((TnyHeader*) priv->items->pdata[i]));
+			g_value_set_int (value, tny_header_get_flags (header));
 			break;
 		default:
 			break;
@@ -657,6 +757,376 @@ gtk_tree_path_free_internal (GtkTreePath *path_in)
 
 #endif
 
+/* Sorting. Rather than letting a GtkTreeModelSort call get_value, which dups
+ * strings and formats dates, twice for every comparison, the model sorts its
+ * own rows: it builds an array with one compact key per row (a collation key
+ * or an integer), merge sorts that and then permutes priv->items. The
+ * collation keys are cached per item for as long as the column stays the
+ * same, and rows that get added later are sorted on their own and merged in */
+
+#define PARALLEL_SORT_THRESHOLD 16384
+#define PARALLEL_SORT_DEPTH 2
+
+typedef struct
+{
+	const gchar *str;
+	gint num;
+	guint pos;
+} SortKey;
+
+typedef struct
+{
+	GtkTreeModel *model;
+	GtkTreeIterCompareFunc func;
+	gpointer user_data;
+	gint stamp;
+	gboolean descending;
+} SortContext;
+
+typedef struct
+{
+	SortContext *ctx;
+	SortKey *keys, *tmp;
+	guint len;
+	gint depth;
+} SortJob;
+
+static inline gint
+sort_key_compare (SortContext *ctx, SortKey *a, SortKey *b)
+{
+	gint r;
+
+	if (ctx->func) {
+		GtkTreeIter ia, ib;
+		ia.stamp = ib.stamp = ctx->stamp;
+		ia.user_data = (gpointer) a->pos;
+		ib.user_data = (gpointer) b->pos;
+		r = ctx->func (ctx->model, &ia, &ib, ctx->user_data);
+	} else if (a->str || b->str)
+		r = strcmp (a->str ? a->str : "", b->str ? b->str : "");
+	else
+		r = (a->num > b->num) - (a->num < b->num);
+
+	return ctx->descending ? -r : r;
+}
+
+/* Merges the sorted runs keys[0, mid) and keys[mid, len). Taking from the
+ * left run on ties keeps the sort stable */
+static void
+sort_keys_merge (SortContext *ctx, SortKey *keys, SortKey *tmp, guint mid, guint len)
+{
+	guint i = 0, j = mid, k = 0;
+
+	if (mid == 0 || mid == len || sort_key_compare (ctx, &keys[mid - 1], &keys[mid]) <= 0)
+		return;
+
+	while (i < mid && j < len) {
+		if (sort_key_compare (ctx, &keys[j], &keys[i]) < 0)
+			tmp[k++] = keys[j++];
+		else
+			tmp[k++] = keys[i++];
+	}
+	while (i < mid)
+		tmp[k++] = keys[i++];
+
+	memcpy (keys, tmp, k * sizeof (SortKey));
+}
+
+static gpointer sort_keys_job (gpointer data);
+
+static void
+sort_keys (SortContext *ctx, SortKey *keys, SortKey *tmp, guint len, gint depth)
+{
+	guint mid;
+
+	if (len < 2)
+		return;
+
+	mid = len / 2;
+
+	/* The keys don't touch the headers, so the halves of a large array can
+	 * be sorted at the same time. A sort func might not be thread safe */
+	if (!ctx->func && depth > 0 && len >= PARALLEL_SORT_THRESHOLD) {
+		SortJob job = { ctx, keys, tmp, mid, depth - 1 };
+		GThread *thread = g_thread_create (sort_keys_job, &job, TRUE, NULL);
+
+		if (thread) {
+			sort_keys (ctx, keys + mid, tmp + mid, len - mid, depth - 1);
+			g_thread_join (thread);
+		} else {
+			sort_keys (ctx, keys, tmp, mid, 0);
+			sort_keys (ctx, keys + mid, tmp + mid, len - mid, 0);
+		}
+	} else {
+		sort_keys (ctx, keys, tmp, mid, 0);
+		sort_keys (ctx, keys + mid, tmp + mid, len - mid, 0);
+	}
+
+	sort_keys_merge (ctx, keys, tmp, mid, len);
+}
+
+static gpointer
+sort_keys_job (gpointer data)
+{
+	SortJob *job = data;
+	sort_keys (job->ctx, job->keys, job->tmp, job->len, job->depth);
+	return NULL;
+}
+
+static const gchar *
+get_collate_key (TnyGtkHeaderListModelPriv *priv, TnyHeader *header)
+{
+	gchar *key = g_hash_table_lookup (priv->sort_keys, header);
+
+	if (!key) {
+		gchar *str = NULL;
+
+		switch (priv->sort_column) {
+			case TNY_GTK_HEADER_LIST_MODEL_FROM_COLUMN:
+				str = tny_header_dup_from (header);
+				break;
+			case TNY_GTK_HEADER_LIST_MODEL_TO_COLUMN:
+				str = tny_header_dup_to (header);
+				break;
+			case TNY_GTK_HEADER_LIST_MODEL_CC_COLUMN:
+				str = tny_header_dup_cc (header);
+				break;
+			default:
+				str = tny_header_dup_subject (header);
+				break;
+		}
+
+		key = g_utf8_collate_key (str ? str : "", -1);
+		g_free (str);
+		g_hash_table_insert (priv->sort_keys, header, key);
+	}
+
+	return key;
+}
+
+static void
+get_sort_key (TnyGtkHeaderListModelPriv *priv, TnyHeader *header, SortKey *key)
+{
+	key->str = NULL;
+	key->num = 0;
+
+	if (!header)
+		return;
+
+	switch (priv->sort_column) {
+		case TNY_GTK_HEADER_LIST_MODEL_FROM_COLUMN:
+		case TNY_GTK_HEADER_LIST_MODEL_TO_COLUMN:
+		case TNY_GTK_HEADER_LIST_MODEL_SUBJECT_COLUMN:
+		case TNY_GTK_HEADER_LIST_MODEL_CC_COLUMN:
+			key->str = get_collate_key (priv, header);
+			break;
+		case TNY_GTK_HEADER_LIST_MODEL_DATE_SENT_COLUMN:
+		case TNY_GTK_HEADER_LIST_MODEL_DATE_SENT_TIME_T_COLUMN:
+			key->num = tny_header_get_date_sent (header);
+			break;
+		case TNY_GTK_HEADER_LIST_MODEL_DATE_RECEIVED_COLUMN:
+		case TNY_GTK_HEADER_LIST_MODEL_DATE_RECEIVED_TIME_T_COLUMN:
+			key->num = tny_header_get_date_received (header);
+			break;
+		case TNY_GTK_HEADER_LIST_MODEL_MESSAGE_SIZE_COLUMN:
+			key->num = tny_header_get_message_size (header);
+			break;
+		case TNY_GTK_HEADER_LIST_MODEL_FLAGS_COLUMN:
+			key->num = tny_header_get_flags (header);
+			break;
+		default:
+			break;
+	}
+}
+
+static GtkTreeIterCompareFunc
+get_sort_func (TnyGtkHeaderListModelPriv *priv, gpointer *user_data)
+{
+	if (priv->sort_column == GTK_TREE_SORTABLE_DEFAULT_SORT_COLUMN_ID) {
+		*user_data = priv->default_sort.user_data;
+		return priv->default_sort.func;
+	}
+
+	*user_data = priv->sort_funcs[priv->sort_column].user_data;
+	return priv->sort_funcs[priv->sort_column].func;
+}
+
+static gboolean
+is_sorted (TnyGtkHeaderListModelPriv *priv)
+{
+	if (priv->sort_column == GTK_TREE_SORTABLE_DEFAULT_SORT_COLUMN_ID)
+		return priv->default_sort.func != NULL;
+
+	return priv->sort_column >= 0 && priv->sort_column < TNY_GTK_HEADER_LIST_MODEL_N_COLUMNS;
+}
+
+/* Sorts the rows that the views know about. The first priv->sorted rows
+ * already are in order, only the ones after that get sorted and then merged
+ * in. Call with the iterator_lock held, from the mainloop */
+static void
+sort_rows (TnyGtkHeaderListModel *self)
+{
+	TnyGtkHeaderListModelPriv *priv = TNY_GTK_HEADER_LIST_MODEL_GET_PRIVATE (self);
+	SortContext ctx;
+	SortKey *keys, *tmp;
+	gint *new_order;
+	gpointer *old_items;
+	gboolean changed = FALSE;
+	GtkTreePath *path;
+	guint i, len;
+
+	len = priv->cur_len;
+
+	if (!is_sorted (priv) || priv->sorted >= len)
+		return;
+
+	ctx.model = (GtkTreeModel *) self;
+	ctx.func = get_sort_func (priv, &ctx.user_data);
+	ctx.stamp = priv->stamp;
+	ctx.descending = (priv->sort_order == GTK_SORT_DESCENDING);
+
+	keys = g_new (SortKey, len);
+	tmp = g_new (SortKey, len);
+
+	for (i = 0; i < len; i++) {
+		if (!ctx.func)
+			get_sort_key (priv, _tny_gtk_header_list_model_get_item_nl (priv, i), &keys[i]);
+		keys[i].pos = i;
+	}
+
+	sort_keys (&ctx, keys + priv->sorted, tmp, len - priv->sorted, PARALLEL_SORT_DEPTH);
+	sort_keys_merge (&ctx, keys, tmp, priv->sorted, len);
+
+	g_free (tmp);
+
+	new_order = g_new (gint, len);
+	old_items = g_memdup (priv->items->pdata, len * sizeof (gpointer));
+	for (i = 0; i < len; i++) {
+		new_order[i] = keys[i].pos;
+		priv->items->pdata[i] = old_items[keys[i].pos];
+		if (keys[i].pos != i)
+			changed = TRUE;
+	}
+	g_free (old_items);
+	g_free (keys);
+
+	priv->sorted = len;
+
+	if (changed) {
+		priv->stamp++;
+		path = gtk_tree_path_new ();
+		gtk_tree_model_rows_reordered ((GtkTreeModel *) self, path, NULL, new_order);
+		gtk_tree_path_free (path);
+	}
+
+	g_free (new_order);
+}
+
+static gboolean
+tny_gtk_header_list_model_get_sort_column_id (GtkTreeSortable *self, gint *sort_column_id, GtkSortType *order)
+{
+	TnyGtkHeaderListModelPriv *priv = TNY_GTK_HEADER_LIST_MODEL_GET_PRIVATE (self);
+
+	if (sort_column_id)
+		*sort_column_id = priv->sort_column;
+	if (order)
+		*order = priv->sort_order;
+
+	return (priv->sort_column != GTK_TREE_SORTABLE_DEFAULT_SORT_COLUMN_ID &&
+		priv->sort_column != GTK_TREE_SORTABLE_UNSORTED_SORT_COLUMN_ID);
+}
+
+static void
+tny_gtk_header_list_model_set_sort_column_id (GtkTreeSortable *self, gint sort_column_id, GtkSortType order)
+{
+	TnyGtkHeaderListModelPriv *priv = TNY_GTK_HEADER_LIST_MODEL_GET_PRIVATE (self);
+
+	g_return_if_fail (sort_column_id == GTK_TREE_SORTABLE_DEFAULT_SORT_COLUMN_ID ||
+		sort_column_id == GTK_TREE_SORTABLE_UNSORTED_SORT_COLUMN_ID ||
+		(sort_column_id >= 0 && sort_column_id < TNY_GTK_HEADER_LIST_MODEL_N_COLUMNS));
+
+	g_static_rec_mutex_lock (priv->iterator_lock);
+
+	if (priv->sort_column == sort_column_id && priv->sort_order == order) {
+		g_static_rec_mutex_unlock (priv->iterator_lock);
+		return;
+	}
+
+	if (priv->sort_column != sort_column_id)
+		g_hash_table_remove_all (priv->sort_keys);
+
+	priv->sort_column = sort_column_id;
+	priv->sort_order = order;
+	priv->sorted = 0;
+
+	sort_rows ((TnyGtkHeaderListModel *) self);
+
+	g_static_rec_mutex_unlock (priv->iterator_lock);
+
+	gtk_tree_sortable_sort_column_changed (self);
+}
+
+static void
+set_sort_func (TnyGtkHeaderListModelSortFunc *sort, GtkTreeIterCompareFunc func, gpointer data, GDestroyNotify destroy)
+{
+	if (sort->destroy)
+		sort->destroy (sort->user_data);
+
+	sort->func = func;
+	sort->user_data = data;
+	sort->destroy = destroy;
+}
+
+static void
+tny_gtk_header_list_model_set_sort_func (GtkTreeSortable *self, gint sort_column_id, GtkTreeIterCompareFunc func, gpointer data, GDestroyNotify destroy)
+{
+	TnyGtkHeaderListModelPriv *priv = TNY_GTK_HEADER_LIST_MODEL_GET_PRIVATE (self);
+
+	g_return_if_fail (sort_column_id >= 0 && sort_column_id < TNY_GTK_HEADER_LIST_MODEL_N_COLUMNS);
+
+	g_static_rec_mutex_lock (priv->iterator_lock);
+	set_sort_func (&priv->sort_funcs[sort_column_id], func, data, destroy);
+	if (priv->sort_column == sort_column_id) {
+		priv->sorted = 0;
+		sort_rows ((TnyGtkHeaderListModel *) self);
+	}
+	g_static_rec_mutex_unlock (priv->iterator_lock);
+}
+
+static void
+tny_gtk_header_list_model_set_default_sort_func (GtkTreeSortable *self, GtkTreeIterCompareFunc func, gpointer data, GDestroyNotify destroy)
+{
+	TnyGtkHeaderListModelPriv *priv = TNY_GTK_HEADER_LIST_MODEL_GET_PRIVATE (self);
+
+	g_static_rec_mutex_lock (priv->iterator_lock);
+	set_sort_func (&priv->default_sort, func, data, destroy);
+	if (priv->sort_column == GTK_TREE_SORTABLE_DEFAULT_SORT_COLUMN_ID) {
+		priv->sorted = 0;
+		sort_rows ((TnyGtkHeaderListModel *) self);
+	}
+	g_static_rec_mutex_unlock (priv->iterator_lock);
+}
+
+static gboolean
+tny_gtk_header_list_model_has_default_sort_func (GtkTreeSortable *self)
+{
+	TnyGtkHeaderListModelPriv *priv = TNY_GTK_HEADER_LIST_MODEL_GET_PRIVATE (self);
+
+	return priv->default_sort.func != NULL;
+}
+
+static void
+tny_gtk_header_list_model_tree_sortable_init (GtkTreeSortableIface *iface)
+{
+	iface->get_sort_column_id = tny_gtk_header_list_model_get_sort_column_id;
+	iface->set_sort_column_id = tny_gtk_header_list_model_set_sort_column_id;
+	iface->set_sort_func = tny_gtk_header_list_model_set_sort_func;
+	iface->set_default_sort_func = tny_gtk_header_list_model_set_default_sort_func;
+	iface->has_default_sort_func = tny_gtk_header_list_model_has_default_sort_func;
+
+	return;
+}
+
 static gboolean
 notify_views_add (gpointer data)
 {
@@ -710,26 +1180,151 @@ notify_views_add (gpointer data)
 		gtk_tree_model_row_inserted ((GtkTreeModel *) data, path, &iter);
 		gtk_tree_path_free_internal (path);
 	}
+
+	g_static_rec_mutex_lock (priv->iterator_lock);
+	sort_rows ((TnyGtkHeaderListModel *) data);
+	g_static_rec_mutex_unlock (priv->iterator_lock);
+
 	gdk_threads_leave();
 
 	return needmore;
 }
 
 
-static gboolean 
-uid_matcher (TnyList *list, GObject *item, gpointer match_data)
+/* The notificating of the view is quite slow and gdk wants us to do it from
+ * the mainloop. Call with the ra_lock held */
+static void
+schedule_notify_views_add (TnyGtkHeaderListModel *self)
+{
+	TnyGtkHeaderListModelPriv *priv = TNY_GTK_HEADER_LIST_MODEL_GET_PRIVATE (self);
+
+	if (priv->updating_views == -1)
+	{
+		priv->updating_views = 0;
+		g_object_ref (self);
+
+		if (priv->add_timeout == 0) {
+			priv->add_timeout = g_timeout_add_full (G_PRIORITY_DEFAULT_IDLE, 
+								priv->timeout_span, notify_views_add, self, 
+								notify_views_add_destroy);
+		}
+	}
+}
+
+static gboolean
+same_uid (TnyHeader *a, TnyHeader *b)
+{
+	gchar *ua = tny_header_dup_uid (a), *ub = tny_header_dup_uid (b);
+	gboolean retval = (ua && ub && !strcmp (ua, ub));
+
+	g_free (ua);
+	g_free (ub);
+
+	return retval;
+}
+
+/* With a view set, what gets prepended is already in the view. The rows only
+ * have to grow to its length */
+static void
+view_grow (TnyGtkHeaderListModel *self)
+{
+	TnyGtkHeaderListModelPriv *priv = TNY_GTK_HEADER_LIST_MODEL_GET_PRIVATE (self);
+	guint length = tny_list_get_length (priv->view);
+
+	g_mutex_lock (priv->ra_lock);
+	if (length > priv->items->len) {
+		g_ptr_array_set_size (priv->items, length);
+		schedule_notify_views_add (self);
+	}
+	g_mutex_unlock (priv->ra_lock);
+}
+
+static void
+notify_views_resync_destroy (gpointer data)
+{
+	TnyGtkHeaderListModelPriv *priv = TNY_GTK_HEADER_LIST_MODEL_GET_PRIVATE (data);
+
+	g_mutex_lock (priv->ra_lock);
+	priv->resync_timeout = 0;
+	g_mutex_unlock (priv->ra_lock);
+	g_object_unref (data);
+
+	return;
+}
+
+/* Removing from a view means that messages got expunged from its folder.
+ * Which rows they were isn't known without creating all of the headers, so
+ * the headers that were created are dropped and all rows get reloaded */
+static gboolean
+notify_views_resync (gpointer data)
 {
-	gboolean result = FALSE;
-	char *uid = tny_header_dup_uid ((TnyHeader *) item);
+	TnyGtkHeaderListModelPriv *priv = TNY_GTK_HEADER_LIST_MODEL_GET_PRIVATE (data);
+	GtkTreePath *path;
+	GtkTreeIter iter;
+	gint i, length;
+
+	g_static_rec_mutex_lock (priv->iterator_lock);
 
-	if (uid && !strcmp (uid, (const char*) match_data))
- 		result = TRUE;
+	if (!priv->view) {
+		g_static_rec_mutex_unlock (priv->iterator_lock);
+		return FALSE;
+	}
+
+	length = tny_list_get_length (priv->view);
+
+	for (i = 0; i < priv->items->len; i++) {
+		unref_item (priv->items->pdata[i], NULL);
+		priv->items->pdata[i] = NULL;
+	}
+
+	while (priv->registered > length) {
+		path = gtk_tree_path_new_internal (priv->registered - 1);
+		gtk_tree_model_row_deleted ((GtkTreeModel *) data, path);
+		gtk_tree_path_free_internal (path);
+		g_mutex_lock (priv->ra_lock);
+		priv->registered--;
+		priv->cur_len = priv->registered;
+		g_mutex_unlock (priv->ra_lock);
+	}
+
+	if (length < priv->items->len)
+		g_ptr_array_set_size (priv->items, length);
+
+	priv->stamp++;
+	priv->sorted = 0;
+	g_hash_table_remove_all (priv->sort_keys);
+
+	for (i = 0; i < priv->registered; i++) {
+		iter.stamp = priv->stamp;
+		iter.user_data = (gpointer) i;
+		path = gtk_tree_path_new_internal (i);
+		gtk_tree_model_row_changed ((GtkTreeModel *) data, path, &iter);
+		gtk_tree_path_free_internal (path);
+	}
+
+	sort_rows ((TnyGtkHeaderListModel *) data);
+
+	g_static_rec_mutex_unlock (priv->iterator_lock);
 
-	g_free (uid);
+	/* And if meanwhile messages got added too */
+	view_grow ((TnyGtkHeaderListModel *) data);
 
-	return result;
+	return FALSE;
 }
 
+static void
+schedule_notify_views_resync (TnyGtkHeaderListModel *self)
+{
+	TnyGtkHeaderListModelPriv *priv = TNY_GTK_HEADER_LIST_MODEL_GET_PRIVATE (self);
+
+	g_mutex_lock (priv->ra_lock);
+	if (priv->resync_timeout == 0) {
+		g_object_ref (self);
+		priv->resync_timeout = g_timeout_add_full (G_PRIORITY_HIGH_IDLE, 0,
+			notify_views_resync, self, notify_views_resync_destroy);
+	}
+	g_mutex_unlock (priv->ra_lock);
+}
 
 /* This will be called often while you are in tny_folder_refresh(_async). It can
  * and will be called from a thread, so we must cope with that in case we want 
@@ -742,11 +1337,39 @@ tny_gtk_header_list_model_prepend (TnyList *self, GObject* item)
 
 	g_static_rec_mutex_lock (priv->iterator_lock);
 
-	if (priv->no_duplicates) {
+	if (priv->view) {
+		guint len = priv->items->len;
+		GObject *last = NULL;
+
+		/* A view that isn't sorted by arrival, like a threaded one,
+		 * gets new items in the middle. Then the rows must be reloaded */
+		if (len < tny_list_get_length (priv->view)) {
+			TnyIterator *iter = tny_list_create_iterator (priv->view);
+			tny_iterator_nth (iter, len);
+			if (!tny_iterator_is_done (iter))
+				last = tny_iterator_get_current (iter);
+			g_object_unref (iter);
+		}
+
+		if (last && !same_uid ((TnyHeader *) last, (TnyHeader *) item))
+			schedule_notify_views_resync ((TnyGtkHeaderListModel *) self);
+		else
+			view_grow ((TnyGtkHeaderListModel *) self);
+
+		if (last)
+			g_object_unref (last);
+		g_static_rec_mutex_unlock (priv->iterator_lock);
+		return;
+	}
+
+	if (priv->uids) {
 		gchar *uid = tny_header_dup_uid ((TnyHeader *) item);
 		if (uid) {
-			tny_list_remove_matches (self, uid_matcher, (gpointer) uid); 
-			g_free (uid);
+			GObject *dup = g_hash_table_lookup (priv->uids, uid);
+			if (dup && dup != item)
+				schedule_delete ((TnyGtkHeaderListModel *) self, dup);
+			/* The table takes uid */
+			g_hash_table_insert (priv->uids, uid, item);
 		}
 	}
 
@@ -777,17 +1400,7 @@ tny_gtk_header_list_model_prepend (TnyList *self, GObject* item)
 		/* This prepend will happen very often, the notificating of the view is, 
 		 * however, quite slow and gdk wants us to do this from the mainloop */
 
-		if (priv->updating_views == -1)
-		{
-			priv->updating_views = 0;
-			g_object_ref (self);
-
-			if (priv->add_timeout == 0) {
-				priv->add_timeout = g_timeout_add_full (G_PRIORITY_DEFAULT_IDLE, 
-									priv->timeout_span, notify_views_add, self, 
-									notify_views_add_destroy);
-			}
-		}
+		schedule_notify_views_add (TNY_GTK_HEADER_LIST_MODEL (self));
 	}
 
 	g_mutex_unlock (priv->ra_lock);
@@ -805,86 +1418,84 @@ tny_gtk_header_list_model_append (TnyList *self, GObject* item)
 }
 
 
-typedef struct
-{
-	TnyGtkHeaderListModel *self;
-	GObject *item;
-	/* GMainLoop *loop; */
-	gint src;
-} notify_views_data_t;
-
-typedef struct
+/* Removes all items of priv->pending_deletes in one pass over each array,
+ * then tells the views about the rows that went away, from the last to the
+ * first so that the indices of the rows still to come stay right */
+static gboolean
+notify_views_delete (gpointer data)
 {
-	TnyGtkHeaderListModel *self;
-	GList *items;
-	/* GMainLoop *loop; */
-	gint src;
-} notify_views_data_list_t;
-
+	TnyGtkHeaderListModelPriv *priv = TNY_GTK_HEADER_LIST_MODEL_GET_PRIVATE (data);
+	GHashTable *pending;
+	GArray *deleted;
+	guint i, j, sorted;
 
-static void 
-notify_views_delete_destroy (gpointer data)
-{
-	notify_views_data_t *stuff = data;
-	TnyGtkHeaderListModelPriv *priv = TNY_GTK_HEADER_LIST_MODEL_GET_PRIVATE (stuff->self);
+	g_static_rec_mutex_lock (priv->iterator_lock);
 
 	g_mutex_lock (priv->to_lock);
-	if (stuff->src != -1 && stuff->src < priv->del_timeouts->len)
-		g_array_index (priv->del_timeouts, guint, (guint) stuff->src) = 0;
+	pending = priv->pending_deletes;
+	priv->pending_deletes = NULL;
 	g_mutex_unlock (priv->to_lock);
 
-	g_object_unref (stuff->item);
-	g_object_unref (stuff->self);
-	/* g_main_loop_unref (stuff->loop); */
-
-	g_slice_free (notify_views_data_t, data);
-	return;
-}
-
+	if (!pending) {
+		g_static_rec_mutex_unlock (priv->iterator_lock);
+		return FALSE;
+	}
 
-static gboolean
-notify_views_delete (gpointer data)
-{
-	notify_views_data_t *stuff = data;
-	TnyGtkHeaderListModelPriv *priv = TNY_GTK_HEADER_LIST_MODEL_GET_PRIVATE (stuff->self);
+	for (i = 0, j = 0; i < priv->not_latest_items->len; i++) {
+		GObject *item = priv->not_latest_items->pdata[i];
+		if (g_hash_table_lookup (pending, item)) {
+			uids_remove (priv, item);
+			g_hash_table_remove (priv->sort_keys, item);
+			g_object_unref (item);
+		} else
+			priv->not_latest_items->pdata[j++] = item;
+	}
+	g_ptr_array_set_size (priv->not_latest_items, j);
+
+	/* Removing rows doesn't change the order of the others */
+	sorted = priv->sorted;
+	deleted = g_array_new (FALSE, FALSE, sizeof (guint));
+	for (i = 0, j = 0; i < priv->items->len; i++) {
+		GObject *item = priv->items->pdata[i];
+		if (item && g_hash_table_lookup (pending, item)) {
+			g_array_append_val (deleted, i);
+			uids_remove (priv, item);
+			g_hash_table_remove (priv->sort_keys, item);
+			if (i < priv->sorted)
+				sorted--;
+			g_object_unref (item);
+		} else
+			priv->items->pdata[j++] = item;
+	}
+	g_ptr_array_set_size (priv->items, j);
+	priv->sorted = sorted;
 
-	GtkTreePath *path;
-	GtkTreeIter iter;
-	gint i; gboolean found = FALSE;
-	GObject *mitem, *item = stuff->item;
+	if (deleted->len > 0)
+		priv->stamp++;
 
-	g_static_rec_mutex_lock (priv->iterator_lock);
+	for (i = deleted->len; i > 0; i--) {
+		guint row = g_array_index (deleted, guint, i - 1);
+		GtkTreePath *path;
 
-	for (i=0; i < priv->items->len; i++)
-		if (priv->items->pdata[i] == item)
-		{
-			found = TRUE;
-			break;
-		}
+		/* Rows that weren't added to the views yet needn't be removed */
+		if (row >= priv->registered)
+			continue;
 
-	if (found)
-	{
-		iter.stamp = priv->stamp;
-		iter.user_data = (gpointer) i;
-		path = gtk_tree_path_new ();
-		gtk_tree_path_append_index (path, i);
-		gtk_tree_model_row_deleted ((GtkTreeModel *) stuff->self, path);
-		priv->stamp++;
 		g_mutex_lock (priv->ra_lock);
 		priv->cur_len--;
 		priv->registered--;
 		g_mutex_unlock (priv->ra_lock);
-		gtk_tree_path_free (path);
 
-		mitem = g_ptr_array_remove_index (priv->items, i);
-		if (mitem)
-			g_object_unref (mitem);
+		path = gtk_tree_path_new_internal (row);
+		gtk_tree_model_row_deleted ((GtkTreeModel *) data, path);
+		gtk_tree_path_free_internal (path);
 	}
 
+	g_array_free (deleted, TRUE);
+
 	g_static_rec_mutex_unlock (priv->iterator_lock);
 
-	/* if (g_main_loop_is_running (stuff->loop))
-		g_main_loop_quit (stuff->loop); */
+	g_hash_table_destroy (pending);
 
 	return FALSE;
 }
@@ -893,134 +1504,42 @@ notify_views_delete (gpointer data)
 static void
 tny_gtk_header_list_model_remove (TnyList *self, GObject* item)
 {
-	notify_views_data_t *stuff;
-	guint src;
-
-	stuff = g_slice_new (notify_views_data_t);
-	stuff->src = -1;
-	stuff->self = g_object_ref (self);
-	stuff->item = g_object_ref (item);
-
-	/* stuff->loop = g_main_loop_new (NULL, FALSE); */
-
-	src = g_timeout_add_full (G_PRIORITY_HIGH_IDLE, 0,
-		notify_views_delete, stuff, notify_views_delete_destroy);
-	stuff->src = (gint) add_del_timeout ((TnyGtkHeaderListModel *) self, src);
-
-	/* This truly sucks :-( 
-	g_main_loop_run (stuff->loop); */
-
-	return;
-}
-
-
-static void 
-notify_views_delete_destroy_list (gpointer data)
-{
-	notify_views_data_list_t *stuff = data;
-	TnyGtkHeaderListModelPriv *priv = TNY_GTK_HEADER_LIST_MODEL_GET_PRIVATE (stuff->self);
-
-	g_mutex_lock (priv->to_lock);
-	if (stuff->src != -1 && stuff->src < priv->del_timeouts->len)
-		g_array_index (priv->del_timeouts, guint, (guint) stuff->src) = 0;
-	g_mutex_unlock (priv->to_lock);
+	TnyGtkHeaderListModelPriv *priv = TNY_GTK_HEADER_LIST_MODEL_GET_PRIVATE (self);
 
-	while (stuff->items) {
-		g_object_unref (stuff->items->data);
-		stuff->items = g_list_next (stuff->items);
+	if (priv->view) {
+		schedule_notify_views_resync ((TnyGtkHeaderListModel *) self);
+		return;
 	}
 
-	if (stuff->items)
-		g_list_free (stuff->items);
-
-	g_object_unref (stuff->self);
-	/* g_main_loop_unref (stuff->loop); */
+	schedule_delete ((TnyGtkHeaderListModel *) self, item);
 
-	g_slice_free (notify_views_data_list_t, data);
 	return;
 }
 
 
-static gboolean
-notify_views_delete_list (gpointer data)
-{
-	notify_views_data_list_t *stuff = data;
-	TnyGtkHeaderListModelPriv *priv = TNY_GTK_HEADER_LIST_MODEL_GET_PRIVATE (stuff->self);
-	GList *copy = stuff->items;
-
-	g_static_rec_mutex_lock (priv->iterator_lock);
-
-	while (copy) 
-	{
-		gint i; gboolean found = FALSE;
-		GtkTreePath *path;
-		GtkTreeIter iter;
-		GObject *mitem, *item = copy->data;
-
-		for (i=0; i < priv->items->len; i++)
-			if (priv->items->pdata[i] == item)
-			{
-				found = TRUE;
-				break;
-			}
-
-		if (found)
-		{
-			iter.stamp = priv->stamp;
-			iter.user_data = (gpointer) i;
-			path = gtk_tree_path_new ();
-			gtk_tree_path_append_index (path, i);
-			gtk_tree_model_row_deleted ((GtkTreeModel *) stuff->self, path);
-			priv->stamp++;
-			g_mutex_lock (priv->ra_lock);
-			priv->cur_len--;
-			priv->registered--;
-			g_mutex_unlock (priv->ra_lock);
-			gtk_tree_path_free (path);
-
-			mitem = g_ptr_array_remove_index (priv->items, i);
-			if (mitem)
-				g_object_unref (mitem);
-		}
-
-		copy = g_list_next (copy);
-	}
-
-	g_static_rec_mutex_unlock (priv->iterator_lock);
-
-
-	return FALSE;
-}
-
-
 static void
 tny_gtk_header_list_model_remove_matches (TnyList *self, TnyListMatcher matcher, gpointer match_data)
 {
 	TnyGtkHeaderListModelPriv *priv = TNY_GTK_HEADER_LIST_MODEL_GET_PRIVATE (self);
-	int i; GList *items = NULL;
+	int i;
+
+	if (priv->view) {
+		schedule_notify_views_resync ((TnyGtkHeaderListModel *) self);
+		return;
+	}
 
 	g_static_rec_mutex_lock (priv->iterator_lock);
 
 	for (i=0; i < priv->items->len; i++) {
 		if (matcher (self, priv->items->pdata[i], match_data))
-			items = g_list_append (items, g_object_ref (priv->items->pdata[i]));
+			schedule_delete ((TnyGtkHeaderListModel *) self, priv->items->pdata[i]);
 	}
-	g_static_rec_mutex_unlock (priv->iterator_lock);
-
-
-	if (items) 
-	{
-		notify_views_data_list_t *stuff;
-		guint src;
-
-		stuff = g_slice_new (notify_views_data_list_t);
-		stuff->src = -1;
-		stuff->self = g_object_ref (self);
-		stuff->items = items;
-		src = g_timeout_add_full (G_PRIORITY_HIGH_IDLE, 0,
-			notify_views_delete_list, stuff, notify_views_delete_destroy_list);
-		stuff->src = (gint) add_del_timeout ((TnyGtkHeaderListModel *) self, src);
+	for (i=0; i < priv->not_latest_items->len; i++) {
+		if (matcher (self, priv->not_latest_items->pdata[i], match_data))
+			schedule_delete ((TnyGtkHeaderListModel *) self, priv->not_latest_items->pdata[i]);
 	}
+
+	g_static_rec_mutex_unlock (priv->iterator_lock);
 }
 
 
@@ -1069,7 +1588,15 @@ tny_gtk_header_list_model_copy_the_list (TnyList *self)
 
 	g_static_rec_mutex_lock (priv->iterator_lock);
 	items_copy = g_ptr_array_sized_new (priv->items->len);
-	g_ptr_array_foreach (priv->items, copy_it, items_copy);
+	if (priv->view) {
+		guint i;
+		for (i = 0; i < priv->items->len; i++) {
+			gpointer item = _tny_gtk_header_list_model_get_item_nl (priv, i);
+			if (item)
+				copy_it (item, items_copy);
+		}
+	} else
+		g_ptr_array_foreach (priv->items, copy_it, items_copy);
 	cpriv->items = items_copy;
 	items_copy = g_ptr_array_sized_new (priv->not_latest_items->len);
 	g_ptr_array_foreach (priv->not_latest_items, copy_it, items_copy);
@@ -1086,7 +1613,15 @@ tny_gtk_header_list_model_foreach_in_the_list (TnyList *self, GFunc func, gpoint
 	TnyGtkHeaderListModelPriv *priv = TNY_GTK_HEADER_LIST_MODEL_GET_PRIVATE (self);
 
 	g_static_rec_mutex_lock (priv->iterator_lock);
-	g_ptr_array_foreach (priv->items, func, user_data);
+	if (priv->view) {
+		guint i;
+		for (i = 0; i < priv->items->len; i++) {
+			gpointer item = _tny_gtk_header_list_model_get_item_nl (priv, i);
+			if (item)
+				func (item, user_data);
+		}
+	} else
+		g_ptr_array_foreach (priv->items, func, user_data);
 	g_static_rec_mutex_unlock (priv->iterator_lock);
 
 	return;
@@ -1125,7 +1660,7 @@ free_items (gpointer user_data)
 #ifdef DEBUG_EXTRA
 	g_ptr_array_foreach (copy, (GFunc) forea, NULL);
 #else
-	g_ptr_array_foreach (copy, (GFunc) g_object_unref, NULL);
+	g_ptr_array_foreach (copy, unref_item, NULL);
 #endif
 	g_ptr_array_free (copy, TRUE);
 
@@ -1141,6 +1676,7 @@ tny_gtk_header_list_model_finalize (GObject *object)
 	TnyGtkHeaderListModel *self = (TnyGtkHeaderListModel *) object;
 	TnyGtkHeaderListModelPriv *priv = TNY_GTK_HEADER_LIST_MODEL_GET_PRIVATE (self);
 	GPtrArray *copy = g_ptr_array_new ();
+	gint i;
 
 	g_static_rec_mutex_lock (priv->iterator_lock);
 
@@ -1153,7 +1689,7 @@ tny_gtk_header_list_model_finalize (GObject *object)
 		priv->add_timeout = 0;
 	}
 
-	remove_del_timeouts (self);
+	remove_pending_deletes (self);
 
 	g_ptr_array_foreach (priv->items, (GFunc) copy_them, copy);
 	free_items (copy);
@@ -1167,6 +1703,16 @@ tny_gtk_header_list_model_finalize (GObject *object)
 
 	if (priv->folder)
 		g_object_unref (priv->folder);
+	if (priv->view_iter)
+		g_object_unref (priv->view_iter);
+	if (priv->view)
+		g_object_unref (priv->view);
+	if (priv->uids)
+		g_hash_table_destroy (priv->uids);
+	g_hash_table_destroy (priv->sort_keys);
+	for (i = 0; i < TNY_GTK_HEADER_LIST_MODEL_N_COLUMNS; i++)
+		set_sort_func (&priv->sort_funcs[i], NULL, NULL, NULL);
+	set_sort_func (&priv->default_sort, NULL, NULL, NULL);
 	g_ptr_array_free (priv->items, TRUE);
 	g_ptr_array_free (priv->not_latest_items, TRUE);
 	priv->items = NULL;
@@ -1222,7 +1768,16 @@ tny_gtk_header_list_model_init (TnyGtkHeaderListModel *self)
 	priv->cur_len = 0;
 
 	priv->timeout_span = 1;
-	priv->del_timeouts = NULL;
+	priv->pending_deletes = NULL;
+	priv->delete_timeout = 0;
+	priv->uids = NULL;
+	priv->sort_column = GTK_TREE_SORTABLE_UNSORTED_SORT_COLUMN_ID;
+	priv->sort_order = GTK_SORT_ASCENDING;
+	priv->sorted = 0;
+	priv->sort_keys = g_hash_table_new_full (g_direct_hash, g_direct_equal, NULL, g_free);
+	memset (priv->sort_funcs, 0, sizeof (priv->sort_funcs));
+	memset (&priv->default_sort, 0, sizeof (priv->default_sort));
+	priv->rdate_minute = -1;
 	priv->add_timeout = 0;
 	priv->items = g_ptr_array_sized_new (1000);
 	priv->not_latest_items = g_ptr_array_sized_new (1000);
@@ -1231,6 +1786,9 @@ tny_gtk_header_list_model_init (TnyGtkHeaderListModel *self)
 	priv->to_lock = g_mutex_new ();
 	priv->registered = 0;
 	priv->headers_per_batch = 3000;
+	priv->view = NULL;
+	priv->view_iter = NULL;
+	priv->resync_timeout = 0;
 
 	return;
 }
@@ -1262,10 +1820,12 @@ tny_gtk_header_list_model_get_no_duplicates (TnyGtkHeaderListModel *self)
  *
  * Sets whether or not @self allows duplicates of #TnyHeader instances to be
  * added. The duplicates will be tested by tny_header_dup_uid uniqueness.
- * Setting this property to TRUE will negatively impact performance of @self.
- * It'll also influence behaviour of tny_list_prepend and tny_list_append.
+ * It'll also influence behaviour of tny_list_prepend and tny_list_append: a
+ * prepended #TnyHeader replaces the one with the same UID, if any.
  *
- * Default value, therefore, is FALSE.
+ * @self keeps a table of the UIDs of its items while this is set, so finding
+ * a duplicate doesn't depend on the number of items. It does cost a
+ * tny_header_dup_uid for every item. Default value is FALSE.
  * 
  * since: 1.0
  * audience: application-developer
@@ -1274,10 +1834,74 @@ void
 tny_gtk_header_list_model_set_no_duplicates (TnyGtkHeaderListModel *self, gboolean setting)
 {
 	TnyGtkHeaderListModelPriv *priv = TNY_GTK_HEADER_LIST_MODEL_GET_PRIVATE (self);
+
+	g_static_rec_mutex_lock (priv->iterator_lock);
 	priv->no_duplicates = setting;
+	if (setting && !priv->uids) {
+		priv->uids = g_hash_table_new_full (g_str_hash, g_str_equal, g_free, NULL);
+		uids_add_all (priv);
+	} else if (!setting && priv->uids) {
+		g_hash_table_destroy (priv->uids);
+		priv->uids = NULL;
+	}
+	g_static_rec_mutex_unlock (priv->iterator_lock);
+
 	return;
 }
 
+/**
+ * tny_gtk_header_list_model_find_uid:
+ * @self: a #TnyGtkHeaderListModel
+ * @uid: the UID of a #TnyHeader
+ *
+ * Finds the #TnyHeader in @self whose tny_header_dup_uid is @uid. This is
+ * fast when tny_gtk_header_list_model_set_no_duplicates is set, otherwise
+ * all items are compared. Rows that weren't fetched yet from a view set with
+ * tny_gtk_header_list_model_set_view aren't searched.
+ *
+ * If not NULL, the returned value must be unreferenced after use.
+ *
+ * returns: (null-ok) (caller-owns): the #TnyHeader or NULL
+ * since: 1.0
+ * audience: application-developer
+ **/
+TnyHeader *
+tny_gtk_header_list_model_find_uid (TnyGtkHeaderListModel *self, const gchar *uid)
+{
+	TnyGtkHeaderListModelPriv *priv = TNY_GTK_HEADER_LIST_MODEL_GET_PRIVATE (self);
+	GObject *retval = NULL;
+
+	g_static_rec_mutex_lock (priv->iterator_lock);
+
+	if (priv->uids) {
+		retval = g_hash_table_lookup (priv->uids, uid);
+	} else {
+		GPtrArray *arrays[2] = { priv->items, priv->not_latest_items };
+		guint a, i;
+
+		for (a = 0; a < 2 && !retval; a++) {
+			for (i = 0; i < arrays[a]->len && !retval; i++) {
+				GObject *item = arrays[a]->pdata[i];
+				gchar *item_uid;
+
+				if (!item)
+					continue;
+				item_uid = tny_header_dup_uid ((TnyHeader *) item);
+				if (item_uid && !strcmp (item_uid, uid))
+					retval = item;
+				g_free (item_uid);
+			}
+		}
+	}
+
+	if (retval)
+		g_object_ref (retval);
+
+	g_static_rec_mutex_unlock (priv->iterator_lock);
+
+	return (TnyHeader *) retval;
+}
+
 /**
  * tny_gtk_header_list_model_set_folder:
  * @self: a #TnyGtkHeaderListModel
@@ -1312,7 +1936,7 @@ tny_gtk_header_list_model_set_folder (TnyGtkHeaderListModel *self, TnyFolder *fo
 		priv->add_timeout = 0;
 	}
 
-	remove_del_timeouts (self);
+	remove_pending_deletes (self);
 
 	/* Set it to 1 as initial value, else you cause the length > 0 
 	 * assertion in gtk_tree_model_sort_build_level (I have no idea why the
@@ -1323,9 +1947,19 @@ tny_gtk_header_list_model_set_folder (TnyGtkHeaderListModel *self, TnyFolder *fo
 	priv->registered = 0;
 	priv->items = g_ptr_array_sized_new (priv->show_latest?MIN (tny_folder_get_all_count (folder),priv->show_latest):tny_folder_get_all_count (folder));
 	priv->not_latest_items = g_ptr_array_sized_new (tny_folder_get_all_count (folder));
+	if (priv->uids)
+		g_hash_table_remove_all (priv->uids);
+	g_hash_table_remove_all (priv->sort_keys);
+	priv->sorted = 0;
 	if (priv->folder)
 		g_object_unref (priv->folder);
 	priv->folder = TNY_FOLDER (g_object_ref (folder));
+	if (priv->view) {
+		g_object_unref (priv->view_iter);
+		g_object_unref (priv->view);
+		priv->view_iter = NULL;
+		priv->view = NULL;
+	}
 	g_static_rec_mutex_unlock (priv->iterator_lock);
 
 	/* Get a new list of headers */
@@ -1338,9 +1972,9 @@ tny_gtk_header_list_model_set_folder (TnyGtkHeaderListModel *self, TnyFolder *fo
 
 	g_static_rec_mutex_lock (priv->iterator_lock);
 
-	g_ptr_array_foreach (copy_items, (GFunc) g_object_unref, NULL);
+	g_ptr_array_foreach (copy_items, unref_item, NULL);
 	g_ptr_array_free (copy_items, TRUE);
-	g_ptr_array_foreach (copy_not_latest_items, (GFunc) g_object_unref, NULL);
+	g_ptr_array_foreach (copy_not_latest_items, unref_item, NULL);
 	g_ptr_array_free (copy_not_latest_items, TRUE);
 
 	/* Reference the new folder instance */
@@ -1357,6 +1991,71 @@ tny_gtk_header_list_model_set_folder (TnyGtkHeaderListModel *self, TnyFolder *fo
 	return;
 }
 
+/**
+ * tny_gtk_header_list_model_set_view:
+ * @self: a #TnyGtkHeaderListModel
+ * @view: a #TnyList with #TnyHeader instances
+ *
+ * Make @self show the items of @view, which is typically a live view on the
+ * headers of a folder, like the one tny_camel_folder_get_headers_view()
+ * returns. The items aren't copied: a row only gets its #TnyHeader from @view
+ * once it's displayed or compared, so @self can show a very large folder
+ * without creating a #TnyHeader for every message in it. Note that sorting
+ * needs all of them.
+ *
+ * While a view is set, prepending or appending to @self only makes it add
+ * rows up to the length of @view. Removing from @self makes it reload all its
+ * rows from @view. tny_gtk_header_list_model_set_folder() unsets the view.
+ *
+ * since: 1.0
+ * audience: application-developer
+ **/
+void
+tny_gtk_header_list_model_set_view (TnyGtkHeaderListModel *self, TnyList *view)
+{
+	TnyGtkHeaderListModelPriv *priv = TNY_GTK_HEADER_LIST_MODEL_GET_PRIVATE (self);
+	GPtrArray *copy_items;
+	GPtrArray *copy_not_latest_items;
+
+	g_static_rec_mutex_lock (priv->iterator_lock);
+
+	priv->timeout_span = 1;
+	if (priv->add_timeout > 0) {
+		g_source_remove (priv->add_timeout);
+		priv->add_timeout = 0;
+	}
+
+	remove_pending_deletes (self);
+
+	copy_items = priv->items;
+	copy_not_latest_items = priv->not_latest_items;
+	priv->registered = 0;
+	priv->items = g_ptr_array_new ();
+	priv->not_latest_items = g_ptr_array_new ();
+	if (priv->uids)
+		g_hash_table_remove_all (priv->uids);
+	g_hash_table_remove_all (priv->sort_keys);
+	priv->sorted = 0;
+
+	if (priv->view) {
+		g_object_unref (priv->view_iter);
+		g_object_unref (priv->view);
+	}
+	priv->view = TNY_LIST (g_object_ref (view));
+	priv->view_iter = tny_list_create_iterator (view);
+
+	view_grow (self);
+
+	g_ptr_array_foreach (copy_items, unref_item, NULL);
+	g_ptr_array_free (copy_items, TRUE);
+	g_ptr_array_foreach (copy_not_latest_items, unref_item, NULL);
+	g_ptr_array_free (copy_not_latest_items, TRUE);
+
+	g_static_rec_mutex_unlock (priv->iterator_lock);
+
+	return;
+}
+
 /**
  * tny_gtk_header_list_model_new:
  *
@@ -1400,6 +2099,12 @@ tny_gtk_header_list_model_register_type (gpointer notused)
 	};
 		
 
+	static const GInterfaceInfo tree_sortable_info = {
+		(GInterfaceInitFunc) tny_gtk_header_list_model_tree_sortable_init,
+		NULL,
+		NULL
+	};
+
 	static const GInterfaceInfo tny_list_info = {
 		(GInterfaceInitFunc) tny_list_init,
 		NULL,
@@ -1412,6 +2117,9 @@ tny_gtk_header_list_model_register_type (gpointer notused)
 	g_type_add_interface_static (object_type, GTK_TYPE_TREE_MODEL,
 				     &tree_model_info);
 
+	g_type_add_interface_static (object_type, GTK_TYPE_TREE_SORTABLE,
+				     &tree_sortable_info);
+
 	g_type_add_interface_static (object_type, TNY_TYPE_LIST,
 				     &tny_list_info);
 
@@ -1498,17 +2206,7 @@ tny_gtk_header_list_model_set_show_latest (TnyGtkHeaderListModel *self, gint sho
 			if (priv->show_latest && priv->items->len > priv->show_latest)
 				priv->show_latest = priv->items->len;
 
-			if (priv->updating_views == -1)
-			{
-				priv->updating_views = 0;
-				g_object_ref (self);
-
-				if (priv->add_timeout == 0) {
-					priv->add_timeout = g_timeout_add_full (G_PRIORITY_DEFAULT_IDLE, 
-										priv->timeout_span, notify_views_add, self, 
-										notify_views_add_destroy);
-				}
-			}
+			schedule_notify_views_add (self);
 		}
 		g_ptr_array_remove_range (priv->not_latest_items, 0, recover_latest);
 	}
@@ -34,7 +34,7 @@ G_BEGIN_DECLS
 #define TNY_IS_GTK_HEADER_LIST_MODEL_CLASS(vtable) (G_TYPE_CHECK_CLASS_TYPE ((vtable), TNY_TYPE_GTK_HEADER_LIST_MODEL))
 #define TNY_GTK_HEADER_LIST_MODEL_GET_CLASS(inst)  (G_TYPE_INSTANCE_GET_CLASS ((inst), TNY_TYPE_GTK_HEADER_LIST_MODEL, TnyGtkHeaderListModelClass))
 
-/* Implements GtkTreeModel and TnyList */
+/* Implements GtkTreeModel, GtkTreeSortable and TnyList */
 
 typedef struct _TnyGtkHeaderListModel TnyGtkHeaderListModel;
 typedef struct _TnyGtkHeaderListModelClass TnyGtkHeaderListModelClass;
@@ -73,9 +73,11 @@ GType tny_gtk_header_list_model_column_get_type (void);
 
 GtkTreeModel* tny_gtk_header_list_model_new (void);
 void tny_gtk_header_list_model_set_folder (TnyGtkHeaderListModel *self, TnyFolder *folder, gboolean refresh, TnyGetHeadersCallback callback, TnyStatusCallback status_callback, gpointer user_data);
+void tny_gtk_header_list_model_set_view (TnyGtkHeaderListModel *self, TnyList *view);
 gint tny_gtk_header_list_model_received_date_sort_func (GtkTreeModel *model, GtkTreeIter *a, GtkTreeIter *b, gpointer user_data);
 gint tny_gtk_header_list_model_sent_date_sort_func (GtkTreeModel *model, GtkTreeIter *a, GtkTreeIter *b, gpointer user_data);
 void tny_gtk_header_list_model_set_no_duplicates (TnyGtkHeaderListModel *self, gboolean setting);
+TnyHeader *tny_gtk_header_list_model_find_uid (TnyGtkHeaderListModel *self, const gchar *uid);
 gboolean tny_gtk_header_list_model_get_no_duplicates (TnyGtkHeaderListModel *self);
 void tny_gtk_header_list_model_set_show_latest (TnyGtkHeaderListModel *self, gint show_latest_n);
 gint tny_gtk_header_list_model_get_show_latest (TnyGtkHeaderListModel *self);
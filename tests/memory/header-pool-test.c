@@ -0,0 +1,167 @@
+/* tinymail - Tiny Mail
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.	 See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with self library; if not, write to the
+ * Free Software Foundation, Inc., 51 Franklin Street, Fifth Floor,
+ * Boston, MA 02110-1301, USA.
+ */
+
+/* Creates a maildir with 100000 small messages and times
+ * tny_folder_get_headers on it a few times in a row, the first time includes
+ * building the summary. Then it walks a header view with tny_list_foreach,
+ * which reuses the same few TnyCamelHeader instances from the pool. The
+ * resident size is printed after each step */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <unistd.h>
+#include <glib.h>
+
+#include <tny-list.h>
+#include <tny-iterator.h>
+#include <tny-simple-list.h>
+#include <tny-folder.h>
+#include <tny-camel-folder.h>
+
+#include <account-store.h>
+#include <maildir.h>
+
+static gint count = 100000, rounds = 5;
+
+static const GOptionEntry options[] =
+{
+	{ "count", 'n', 0, G_OPTION_ARG_INT, &count,
+		"Number of messages in the folder", NULL },
+	{ "rounds", 'r', 0, G_OPTION_ARG_INT, &rounds,
+		"Number of times to get the headers", NULL },
+
+	{ NULL }
+};
+
+static glong
+get_rss_kbytes (void)
+{
+	glong size = 0, resident = 0;
+	FILE *f = fopen ("/proc/self/statm", "r");
+
+	if (f) {
+		if (fscanf (f, "%ld %ld", &size, &resident) != 2)
+			resident = 0;
+		fclose (f);
+	}
+
+	return resident * (sysconf (_SC_PAGESIZE) / 1024);
+}
+
+static void
+count_header (gpointer item, gpointer user_data)
+{
+	(*(gint *) user_data)++;
+}
+
+int
+main (int argc, char **argv)
+{
+	GOptionContext *context;
+	TnyAccountStore *account_store;
+	TnyStoreAccount *account;
+	TnyFolder *folder;
+	GError *err = NULL;
+	gchar *tmpdir;
+	gint i;
+
+	g_type_init ();
+
+	context = g_option_context_new ("- The tinymail header pool benchmark");
+	g_option_context_add_main_entries (context, options, "tinymail");
+	g_option_context_parse (context, &argc, &argv, NULL);
+	g_option_context_free (context);
+
+	tmpdir = tny_test_maildir_new ();
+	if (!tmpdir)
+		return 1;
+
+	for (i = 0; i < count; i++) {
+		gchar *uid = g_strdup_printf ("%d.%d.tinymail", i, (gint) getpid ());
+		gchar *message_id = g_strdup_printf ("%d@example.org", i);
+
+		tny_test_maildir_add_msg (tmpdir, uid, message_id, NULL, TRUE);
+		g_free (message_id);
+		g_free (uid);
+	}
+	g_print ("Created a maildir of %d messages in %s\n", count, tmpdir);
+
+	account_store = tny_test_account_store_new (FALSE, tmpdir);
+	account = tny_test_maildir_account_new (account_store, tmpdir);
+
+	folder = tny_test_maildir_get_folder (account, &err);
+	if (!folder) {
+		g_printerr ("No folder found in %s: %s\n", tmpdir,
+			err ? err->message : "no error");
+		g_object_unref (account);
+		g_object_unref (account_store);
+		tny_test_maildir_remove (tmpdir);
+		return 1;
+	}
+
+	g_print ("Opened %s, RSS is %ldK\n", tny_folder_get_id (folder), get_rss_kbytes ());
+
+	for (i = 0; i < rounds; i++) {
+		TnyList *headers = tny_simple_list_new ();
+		GTimer *timer = g_timer_new ();
+
+		tny_folder_get_headers (folder, headers, FALSE, &err);
+		if (err) {
+			g_printerr ("Getting the headers failed: %s\n", err->message);
+			g_clear_error (&err);
+		}
+
+		g_print ("Listing %d: %d headers in %.3f seconds, RSS is %ldK\n", i + 1,
+			tny_list_get_length (headers), g_timer_elapsed (timer, NULL),
+			get_rss_kbytes ());
+
+		g_timer_destroy (timer);
+		g_object_unref (headers);
+	}
+
+	for (i = 0; i < rounds; i++) {
+		TnyList *view = tny_camel_folder_get_headers_view (TNY_CAMEL_FOLDER (folder), &err);
+		GTimer *timer = g_timer_new ();
+		gint n = 0;
+
+		if (!view) {
+			g_printerr ("Getting the header view failed: %s\n",
+				err ? err->message : "no error");
+			g_clear_error (&err);
+			g_timer_destroy (timer);
+			break;
+		}
+
+		tny_list_foreach (view, count_header, &n);
+
+		g_print ("Walk %d: %d headers in %.3f seconds, RSS is %ldK\n", i + 1,
+			n, g_timer_elapsed (timer, NULL), get_rss_kbytes ());
+
+		g_timer_destroy (timer);
+		g_object_unref (view);
+	}
+
+	g_object_unref (folder);
+	g_object_unref (account);
+	g_object_unref (account_store);
+
+	tny_test_maildir_remove (tmpdir);
+	g_free (tmpdir);
+
+	return 0;
+}
@@ -0,0 +1,213 @@
+/* tinymail - Tiny Mail
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.	 See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with self library; if not, write to the
+ * Free Software Foundation, Inc., 51 Franklin Street, Fifth Floor,
+ * Boston, MA 02110-1301, USA.
+ */
+
+#include <config.h>
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <glib.h>
+#include <glib/gstdio.h>
+
+#include <tny-list.h>
+#include <tny-iterator.h>
+#include <tny-simple-list.h>
+#include <tny-folder.h>
+#include <tny-folder-store.h>
+#include <tny-camel-account.h>
+#include <tny-camel-store-account.h>
+
+#include "account-store.h"
+#include "maildir.h"
+
+/**
+ * tny_test_maildir_new:
+ *
+ * Creates a temporary directory with an empty maildir in it.
+ *
+ * Return value: the path of the temporary directory, or NULL
+ **/
+gchar*
+tny_test_maildir_new (void)
+{
+	gchar *dir = g_strdup ("/tmp/tinymail-maildir-test.XXXXXX");
+	const gchar *subdirs[] = { "maildir", "maildir/cur", "maildir/new", "maildir/tmp" };
+	gint i;
+
+	if (mkdtemp (dir) == NULL) {
+		perror ("Creating temporary directory");
+		g_free (dir);
+		return NULL;
+	}
+
+	for (i = 0; i < G_N_ELEMENTS (subdirs); i++) {
+		gchar *sub = g_build_filename (dir, subdirs[i], NULL);
+		g_mkdir (sub, 0700);
+		g_free (sub);
+	}
+
+	return dir;
+}
+
+/**
+ * tny_test_maildir_add_msg:
+ * @dir: a directory from tny_test_maildir_new()
+ * @uid: the uid of the message, also used as its subject
+ * @message_id: (null-ok): the Message-ID, without the angle brackets
+ * @in_reply_to: (null-ok): the In-Reply-To, without the angle brackets
+ * @seen: whether the message has been read
+ *
+ * Puts a small message in the maildir. An account that already opened the
+ * folder only sees it after a refresh.
+ **/
+void
+tny_test_maildir_add_msg (const gchar *dir, const gchar *uid, const gchar *message_id, const gchar *in_reply_to, gboolean seen)
+{
+	gchar *name;
+	FILE *f;
+
+	name = g_strdup_printf ("%s/maildir/cur/%s:2,%s", dir, uid, seen ? "S" : "");
+	f = g_fopen (name, "w");
+	g_free (name);
+
+	if (!f)
+		return;
+
+	fprintf (f, "From: tinymail@example.org\n"
+		"To: tinymail@example.org\n"
+		"Subject: %s\n", uid);
+	if (message_id)
+		fprintf (f, "Message-ID: <%s>\n", message_id);
+	if (in_reply_to)
+		fprintf (f, "In-Reply-To: <%s>\n", in_reply_to);
+	fprintf (f, "\nBody of message %s\n", uid);
+
+	fclose (f);
+}
+
+/**
+ * tny_test_maildir_remove_msg:
+ * @dir: a directory from tny_test_maildir_new()
+ * @uid: the uid of a message from tny_test_maildir_add_msg()
+ *
+ * Removes a message from the maildir, like another client would. An account
+ * that already opened the folder only notices after a refresh.
+ **/
+void
+tny_test_maildir_remove_msg (const gchar *dir, const gchar *uid)
+{
+	gchar *cur = g_build_filename (dir, "maildir", "cur", NULL);
+	gchar *prefix = g_strdup_printf ("%s:", uid);
+	GDir *d = g_dir_open (cur, 0, NULL);
+	const gchar *name;
+
+	while (d && (name = g_dir_read_name (d))) {
+		if (g_str_has_prefix (name, prefix)) {
+			gchar *path = g_build_filename (cur, name, NULL);
+			g_unlink (path);
+			g_free (path);
+		}
+	}
+	if (d)
+		g_dir_close (d);
+
+	g_free (prefix);
+	g_free (cur);
+}
+
+/**
+ * tny_test_maildir_account_new:
+ * @account_store: a #TnyTestAccountStore that has its cache in @dir
+ * @dir: a directory from tny_test_maildir_new()
+ *
+ * Return value: a store account for the maildir in @dir
+ **/
+TnyStoreAccount*
+tny_test_maildir_account_new (TnyAccountStore *account_store, const gchar *dir)
+{
+	TnyStoreAccount *account;
+	gchar *url;
+
+	account = TNY_STORE_ACCOUNT (tny_camel_store_account_new ());
+	tny_camel_account_set_session (TNY_CAMEL_ACCOUNT (account),
+		tny_test_account_store_get_session ((TnyTestAccountStore *) account_store));
+	tny_account_set_proto (TNY_ACCOUNT (account), "maildir");
+	url = g_strdup_printf ("maildir://%s/maildir", dir);
+	tny_account_set_url_string (TNY_ACCOUNT (account), url);
+	g_free (url);
+
+	return account;
+}
+
+/**
+ * tny_test_maildir_get_folder:
+ * @account: an account from tny_test_maildir_account_new()
+ * @err: (null-ok): a #GError or NULL
+ *
+ * Return value: (null-ok) (caller-owns): the maildir as a #TnyFolder, or NULL
+ **/
+TnyFolder*
+tny_test_maildir_get_folder (TnyStoreAccount *account, GError **err)
+{
+	TnyFolder *folder = NULL;
+	TnyList *folders;
+	TnyIterator *iter;
+
+	folders = tny_simple_list_new ();
+	tny_folder_store_get_folders (TNY_FOLDER_STORE (account), folders, NULL, TRUE, err);
+	iter = tny_list_create_iterator (folders);
+	if (!tny_iterator_is_done (iter))
+		folder = TNY_FOLDER (tny_iterator_get_current (iter));
+	g_object_unref (iter);
+	g_object_unref (folders);
+
+	return folder;
+}
+
+static void
+remove_dir (const gchar *path)
+{
+	GDir *dir = g_dir_open (path, 0, NULL);
+	const gchar *name;
+
+	while (dir && (name = g_dir_read_name (dir))) {
+		gchar *child = g_build_filename (path, name, NULL);
+
+		if (g_file_test (child, G_FILE_TEST_IS_DIR) &&
+		    !g_file_test (child, G_FILE_TEST_IS_SYMLINK))
+			remove_dir (child);
+		else
+			g_unlink (child);
+		g_free (child);
+	}
+	if (dir)
+		g_dir_close (dir);
+
+	g_rmdir (path);
+}
+
+/**
+ * tny_test_maildir_remove:
+ * @dir: a directory from tny_test_maildir_new()
+ *
+ * Removes @dir, the maildir and the cache in it included.
+ **/
+void
+tny_test_maildir_remove (const gchar *dir)
+{
+	remove_dir (dir);
+}
@@ -0,0 +1,40 @@
+#ifndef TEST_MAILDIR_H
+#define TEST_MAILDIR_H
+
+/* tinymail - Tiny Mail
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.	 See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with self library; if not, write to the
+ * Free Software Foundation, Inc., 51 Franklin Street, Fifth Floor,
+ * Boston, MA 02110-1301, USA.
+ */
+
+/* A local maildir for the tests that don't need a server. It lives in a
+ * temporary directory, together with the cache of the account that opens
+ * it, and it's the one and only folder of that account */
+
+#include <glib.h>
+#include <tny-shared.h>
+
+G_BEGIN_DECLS
+
+gchar* tny_test_maildir_new (void);
+void tny_test_maildir_add_msg (const gchar *dir, const gchar *uid, const gchar *message_id, const gchar *in_reply_to, gboolean seen);
+void tny_test_maildir_remove_msg (const gchar *dir, const gchar *uid);
+TnyStoreAccount* tny_test_maildir_account_new (TnyAccountStore *account_store, const gchar *dir);
+TnyFolder* tny_test_maildir_get_folder (TnyStoreAccount *account, GError **err);
+void tny_test_maildir_remove (const gchar *dir);
+
+G_END_DECLS
+
+#endif